@@ -61,6 +61,14 @@ class ParsedExpression;
 class LEPTON_EXPORT CompiledExpression {
 public:
     CompiledExpression();
+    /**
+     * Create a CompiledExpression that evaluates several expressions in a single pass.  Subexpressions that
+     * appear in more than one of them (for example, an energy and its derivatives) are only evaluated once.
+     * After calling evaluate(), the value of each expression can be retrieved with getOutput().
+     *
+     * @param expressions    the expressions to evaluate.  evaluate() returns the value of the first one.
+     */
+    explicit CompiledExpression(const std::vector<ParsedExpression>& expressions);
     CompiledExpression(const CompiledExpression& expression);
     ~CompiledExpression();
     CompiledExpression& operator=(const CompiledExpression& expression);
@@ -77,6 +85,16 @@ public:
      * Evaluate the expression.  The values of all variables should have been set before calling this.
      */
     double evaluate() const;
+    /**
+     * Get the number of expressions this CompiledExpression evaluates.
+     */
+    int getNumOutputs() const;
+    /**
+     * Get the value of one of the expressions, as computed by the most recent call to evaluate().
+     *
+     * @param index    the index of the expression, in the order they were passed to the constructor
+     */
+    double getOutput(int index) const;
 private:
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
@@ -84,6 +102,7 @@ private:
     int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     std::vector<std::vector<int> > arguments;
     std::vector<int> target;
+    std::vector<int> outputs;
     std::vector<Operation*> operation;
     std::map<std::string, int> variableIndices;
     std::set<std::string> variableNames;
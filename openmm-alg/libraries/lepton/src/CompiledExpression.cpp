@@ -47,6 +47,30 @@ CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jit
     ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
     vector<pair<ExpressionTreeNode, int> > temps;
     compileExpression(expr.getRootNode(), temps);
+    outputs.push_back((int) workspace.size()-1);
+    int maxArguments = 1;
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i]->getNumArguments() > maxArguments)
+            maxArguments = operation[i]->getNumArguments();
+    argValues.resize(maxArguments);
+#ifdef LEPTON_USE_JIT
+    generateJitCode();
+#endif
+}
+
+CompiledExpression::CompiledExpression(const vector<ParsedExpression>& expressions) : jitCode(NULL) {
+    if (expressions.size() == 0)
+        throw Exception("CompiledExpression: No expressions specified");
+    
+    // Compile all the expressions into a single program.  They share the list of temporaries, so any
+    // subexpression that has already been compiled for one of them is reused by the others.
+    
+    vector<pair<ExpressionTreeNode, int> > temps;
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        ParsedExpression expr = expressions[i].optimize();
+        compileExpression(expr.getRootNode(), temps);
+        outputs.push_back(findTempIndex(expr.getRootNode(), temps));
+    }
     int maxArguments = 1;
     for (int i = 0; i < (int) operation.size(); i++)
         if (operation[i]->getNumArguments() > maxArguments)
@@ -70,6 +94,7 @@ CompiledExpression::CompiledExpression(const CompiledExpression& expression) : j
 CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expression) {
     arguments = expression.arguments;
     target = expression.target;
+    outputs = expression.outputs;
     variableIndices = expression.variableIndices;
     variableNames = expression.variableNames;
     workspace.resize(expression.workspace.size());
@@ -159,10 +184,18 @@ double CompiledExpression::evaluate() const {
             workspace[target[step]] = operation[step]->evaluate(&argValues[0], dummyVariables);
         }
     }
-    return workspace[workspace.size()-1];
+    return workspace[outputs[0]];
 #endif
 }
 
+int CompiledExpression::getNumOutputs() const {
+    return outputs.size();
+}
+
+double CompiledExpression::getOutput(int index) const {
+    return workspace[outputs[index]];
+}
+
 #ifdef LEPTON_USE_JIT
 static double evaluateOperation(Operation* op, double* args) {
     map<string, double>* dummyVariables = NULL;
@@ -362,7 +395,12 @@ void CompiledExpression::generateJitCode() {
                 call->setRet(0, workspaceVar[target[step]]);
         }
     }
-    c.ret(workspaceVar[workspace.size()-1]);
+    
+    // Store the outputs so they can be retrieved with getOutput().
+    
+    for (int i = 0; i < (int) outputs.size(); i++)
+        c.movsd(x86::ptr(workspacePointer, 8*outputs[i], 0), workspaceVar[outputs[i]]);
+    c.ret(workspaceVar[outputs[0]]);
     c.endFunc();
     jitCode = c.make();
 }
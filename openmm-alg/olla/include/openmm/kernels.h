@@ -53,6 +53,7 @@
 #include "openmm/KernelImpl.h"
 #include "openmm/LangevinIntegrator.h"
 #include "openmm/MonteCarloBarostat.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/PeriodicTorsionForce.h"
 #include "openmm/RBTorsionForce.h"
 #include "openmm/NonbondedForce.h"
@@ -571,6 +572,20 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     virtual void copyParametersToContext(ContextImpl& context, const NonbondedForce& force) = 0;
+    /**
+     * Copy changed parameters for a range of particles and a range of exceptions over to a context.  The default
+     * implementation simply copies all parameters.  Platforms may override it to only copy the ones that have changed.
+     *
+     * @param context          the context to copy parameters to
+     * @param force            the NonbondedForce to copy the parameters from
+     * @param firstParticle    the index of the first particle to copy
+     * @param numParticles     the number of consecutive particles to copy
+     * @param firstException   the index of the first exception to copy
+     * @param numExceptions    the number of consecutive exceptions to copy
+     */
+    virtual void copySomeParametersToContext(ContextImpl& context, const NonbondedForce& force, int firstParticle, int numParticles, int firstException, int numExceptions) {
+        copyParametersToContext(context, force);
+    }
 };
 
 /**
@@ -1221,6 +1236,23 @@ public:
      * @param alpha        the Ewald blending parameter
      */
     virtual void initialize(int gridx, int gridy, int gridz, int numParticles, double alpha) = 0;
+    /**
+     * Initialize the kernel, specifying the order of the B-splines used to interpolate charges onto
+     * the grid.  The default implementation only supports fifth order, which is what the other
+     * version of initialize() uses.  Subclasses that support other orders should override it.
+     * 
+     * @param gridx        the x size of the PME grid
+     * @param gridy        the y size of the PME grid
+     * @param gridz        the z size of the PME grid
+     * @param numParticles the number of particles in the system
+     * @param alpha        the Ewald blending parameter
+     * @param order        the B-spline interpolation order
+     */
+    virtual void initialize(int gridx, int gridy, int gridz, int numParticles, double alpha, int order) {
+        if (order != 5)
+            throw OpenMMException("CalcPmeReciprocalForceKernel: Unsupported PME interpolation order");
+        initialize(gridx, gridy, gridz, numParticles, alpha);
+    }
     /**
      * Begin computing the force and energy.
      *
@@ -51,6 +51,7 @@
 #include "openmm/GBVIForce.h"
 #include "openmm/HarmonicAngleForce.h"
 #include "openmm/HarmonicBondForce.h"
+#include "openmm/HydrogenMassRepartitioner.h"
 #include "openmm/Integrator.h"
 #include "openmm/LangevinIntegrator.h"
 #include "openmm/LocalEnergyMinimizer.h"
@@ -65,6 +66,7 @@
 #include "openmm/State.h"
 #include "openmm/System.h"
 #include "openmm/TabulatedFunction.h"
+#include "openmm/TrajectoryWriter.h"
 #include "openmm/Units.h"
 #include "openmm/VariableLangevinIntegrator.h"
 #include "openmm/VariableVerletIntegrator.h"
@@ -137,6 +137,25 @@ public:
      * specific.
      */
     void setState(const State& state);
+    /**
+     * Compute the potential energy of a batch of configurations, each evaluated under a batch of
+     * parameter sets.  This is equivalent to calling setPositions(), setParameter(), and
+     * getState(State::Energy) for every combination, but avoids computing forces and lets the Platform
+     * reuse internal data (such as neighbor lists) between evaluations of the same configuration.
+     * When it returns, the positions and parameters of the Context are restored to their original values.
+     *
+     * @param positions   the configurations to evaluate.  Each element is a vector whose length equals
+     * the number of particles in the System.  If this is empty, the current positions are used.
+     * @param parameters  the parameter sets to evaluate.  Each element maps parameter names to values.
+     * Any parameter not included in a set keeps its current value.  If this is empty, the current
+     * parameter values are used.
+     * @param groups      a set of bit flags for which force groups to include when computing energies.
+     * Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return a matrix of potential energies (measured in kJ/mol), with one row for each configuration
+     * and one column for each parameter set.
+     */
+    std::vector<std::vector<double> > computeEnergies(const std::vector<std::vector<Vec3> >& positions,
+            const std::vector<std::map<std::string, double> >& parameters, int groups=0xFFFFFFFF);
     /**
      * Set the current time of the simulation (in picoseconds).
      */
@@ -260,6 +279,7 @@ public:
 private:
     friend class Force;
     friend class Platform;
+    friend class TrajectoryWriter;
     ContextImpl& getImpl();
     ContextImpl* impl;
     std::map<std::string, std::string> properties;
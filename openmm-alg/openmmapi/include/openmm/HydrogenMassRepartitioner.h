@@ -0,0 +1,69 @@
+#ifndef OPENMM_HYDROGENMASSREPARTITIONER_H_
+#define OPENMM_HYDROGENMASSREPARTITIONER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "System.h"
+
+namespace OpenMM {
+
+/**
+ * This class modifies the masses of particles in a System to allow larger time steps to be used.
+ * Mass is transferred from each heavy atom to the hydrogens bonded to it, so that every hydrogen
+ * ends up with a specified mass while the total mass of each molecule is unchanged.  This slows down
+ * the fastest motions in the System (usually the vibrations of bonds and angles involving hydrogen),
+ * making it possible to integrate with time steps of 4 fs or more when combined with constraints on
+ * bonds to hydrogen.
+ *
+ * A System does not record the elements of its particles, so hydrogens are identified by their mass:
+ * any particle whose mass is greater than 0 and less than 1.5 amu is assumed to be a hydrogen.  Bonds
+ * are identified from the System's constraints and from the bonds in any HarmonicBondForce it contains.
+ * Mass is never transferred between two hydrogens, or to or from massless particles or virtual sites.
+ */
+
+class OPENMM_EXPORT HydrogenMassRepartitioner {
+public:
+    /**
+     * Repartition the masses of particles in a System.
+     *
+     * @param system         the System whose particle masses should be modified
+     * @param hydrogenMass   the mass (in amu) every hydrogen bonded to a heavy atom should have after
+     *                       repartitioning.  The difference between this and its original mass is subtracted
+     *                       from the heavy atom it is bonded to.
+     */
+    static void repartition(System& system, double hydrogenMass);
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_HYDROGENMASSREPARTITIONER_H_*/
@@ -36,6 +36,7 @@
 #include "Force.h"
 #include <map>
 #include <set>
+#include <string>
 #include <utility>
 #include <vector>
 #include "internal/windowsExport.h"
@@ -76,6 +77,20 @@ namespace OpenMM {
  * the effect of all Lennard-Jones interactions beyond the cutoff in a periodic system.  When running a simulation
  * at constant pressure, this can improve the quality of the result.  Call setUseDispersionCorrection() to set whether
  * this should be used.
+ *
+ * NonbondedForce can also be used for alchemical free energy calculations, in which a set of particles (for example
+ * a ligand) is gradually decoupled from the rest of the System.  Call setAlchemicalParticles() to specify which
+ * particles are alchemical.  Interactions between an alchemical particle and a non-alchemical particle are then
+ * modulated by two global parameters, whose names are given by LambdaElectrostatics() and LambdaSterics().  Both
+ * default to 1, which gives the normal interaction, and can be changed by calling setParameter() on the Context.
+ * The Coulomb interaction (including its reciprocal space part when using Ewald or PME) is multiplied by
+ * lambdaElectrostatics.  The Lennard-Jones interaction is replaced by the soft-core form
+ *
+ * E = lambdaSterics*4*epsilon*(1/x^2 - 1/x), x = alpha*(1-lambdaSterics) + (r/sigma)^6
+ *
+ * where alpha is set with setSoftcoreAlpha().  This goes smoothly to zero as lambdaSterics goes to zero without
+ * producing singularities when particles overlap.  Interactions among alchemical particles, interactions among
+ * non-alchemical particles, exceptions, and the dispersion correction are not affected.
  */
 
 class OPENMM_EXPORT NonbondedForce : public Force {
@@ -339,6 +354,45 @@ public:
      *                 that is specified for direct space.
      */
     void setReciprocalSpaceForceGroup(int group);
+    /**
+     * This is the name of the global parameter that scales the Coulomb interaction between alchemical and
+     * non-alchemical particles.
+     */
+    static const std::string& LambdaElectrostatics() {
+        static const std::string key = "lambdaElectrostatics";
+        return key;
+    }
+    /**
+     * This is the name of the global parameter that scales the soft-core Lennard-Jones interaction between
+     * alchemical and non-alchemical particles.
+     */
+    static const std::string& LambdaSterics() {
+        static const std::string key = "lambdaSterics";
+        return key;
+    }
+    /**
+     * Get the set of particles that are treated alchemically.
+     *
+     * @param[out] particles    the indices of the alchemical particles
+     */
+    void getAlchemicalParticles(std::set<int>& particles) const;
+    /**
+     * Set the set of particles that are treated alchemically.  If this is empty (the default), the
+     * LambdaElectrostatics() and LambdaSterics() parameters are not defined and have no effect.
+     *
+     * @param particles    the indices of the alchemical particles
+     */
+    void setAlchemicalParticles(const std::set<int>& particles);
+    /**
+     * Get the alpha parameter of the soft-core Lennard-Jones interaction between alchemical and non-alchemical
+     * particles.
+     */
+    double getSoftcoreAlpha() const;
+    /**
+     * Set the alpha parameter of the soft-core Lennard-Jones interaction between alchemical and non-alchemical
+     * particles.  The default value is 0.5.
+     */
+    void setSoftcoreAlpha(double alpha);
     /**
      * Update the particle and exception parameters in a Context to match those stored in this Force object.  This method
      * provides an efficient method to update certain parameters in an existing Context without needing to reinitialize it.
@@ -352,6 +406,20 @@ public:
      * to add new particles or exceptions, only to change the parameters of existing ones.
      */
     void updateParametersInContext(Context& context);
+    /**
+     * Update the parameters of a range of particles and a range of exceptions in a Context to match those stored in this
+     * Force object.  This is equivalent to updateParametersInContext(), except that only the specified particles and
+     * exceptions are copied.  When only a small number of parameters have changed, this can be much faster than updating
+     * all of them.  It is subject to the same limitations as updateParametersInContext().  In addition, an exception that
+     * was excluded (that is, whose chargeProd and epsilon were both 0) cannot be made non-excluded, or vice versa.
+     *
+     * @param context          the Context in which to update the parameters
+     * @param firstParticle    the index of the first particle whose parameters should be updated
+     * @param numParticles     the number of consecutive particles whose parameters should be updated
+     * @param firstException   the index of the first exception whose parameters should be updated
+     * @param numExceptions    the number of consecutive exceptions whose parameters should be updated
+     */
+    void updateParametersInContext(Context& context, int firstParticle, int numParticles, int firstException, int numExceptions);
     /**
      * Returns whether or not this force makes use of periodic boundary
      * conditions.
@@ -369,13 +437,14 @@ private:
     class ParticleInfo;
     class ExceptionInfo;
     NonbondedMethod nonbondedMethod;
-    double cutoffDistance, switchingDistance, rfDielectric, ewaldErrorTol, alpha;
+    double cutoffDistance, switchingDistance, rfDielectric, ewaldErrorTol, alpha, softcoreAlpha;
     bool useSwitchingFunction, useDispersionCorrection;
     int recipForceGroup, nx, ny, nz;
     void addExclusionsToSet(const std::vector<std::set<int> >& bonded12, std::set<int>& exclusions, int baseParticle, int fromParticle, int currentLevel) const;
     std::vector<ParticleInfo> particles;
     std::vector<ExceptionInfo> exceptions;
     std::map<std::pair<int, int>, int> exceptionMap;
+    std::set<int> alchemicalParticles;
 };
 
 /**
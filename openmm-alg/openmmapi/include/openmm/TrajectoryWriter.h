@@ -0,0 +1,163 @@
+#ifndef OPENMM_TRAJECTORYWRITER_H_
+#define OPENMM_TRAJECTORYWRITER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "Vec3.h"
+#include "internal/windowsExport.h"
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+class Context;
+class TrajectoryWriterImpl;
+/**
+ * This class writes a simulation trajectory to a file.  Two formats are supported: DCD, which stores
+ * coordinates as uncompressed single precision values, and XTC, which compresses them to a fixed precision
+ * and typically produces files several times smaller.  Both can be read by most trajectory analysis programs.
+ *
+ * To use it, create a TrajectoryWriter, then call writeFrame() each time you want to record a frame.  Passing
+ * a Context to writeFrame() copies the positions directly from the Platform, without creating a State.
+ * Frames are collected in memory and written to disk in groups whose size is set by setBufferSize().  If
+ * background writing is enabled with setUseBackgroundThread(), encoding and writing are done on a separate
+ * thread, so writeFrame() only needs to copy the positions and the simulation can continue while the
+ * previous frames are being written.
+ *
+ * The file is finished when close() is called or the TrajectoryWriter is deleted.  Call flush() to make
+ * sure all frames recorded so far are on disk without closing the file.
+ */
+
+class OPENMM_EXPORT TrajectoryWriter {
+public:
+    /**
+     * This is an enumeration of the file formats that can be written.
+     */
+    enum Format {
+        /**
+         * The CHARMM variant of the DCD format, with little-endian byte ordering.
+         */
+        DCD = 0,
+        /**
+         * The compressed XTC format used by GROMACS.
+         */
+        XTC = 1
+    };
+    /**
+     * Create a TrajectoryWriter.  The file is created immediately, but nothing is written to it until
+     * the first frame is recorded.
+     *
+     * @param filename    the path of the file to create.  If it already exists, it is overwritten.
+     * @param format      the format of the file
+     * @param stepSize    the integration step size (in picoseconds).  This is stored in the header of DCD files.
+     * @param firstStep   the index of the step at which the first frame is recorded
+     * @param interval    the number of steps between successive frames
+     */
+    TrajectoryWriter(const std::string& filename, Format format, double stepSize, int firstStep=0, int interval=1);
+    ~TrajectoryWriter();
+    /**
+     * Get the format of the file being written.
+     */
+    Format getFormat() const;
+    /**
+     * Get the number of frames that have been recorded so far.  This includes frames that are still
+     * buffered and have not yet been written to disk.
+     */
+    int getNumFrames() const;
+    /**
+     * Get the precision with which coordinates are stored in XTC files.  Coordinates are rounded to the
+     * nearest multiple of 1/precision nm.  The default value is 1000.
+     */
+    double getXtcPrecision() const;
+    /**
+     * Set the precision with which coordinates are stored in XTC files.  Coordinates are rounded to the
+     * nearest multiple of 1/precision nm.  This cannot be changed after the first frame has been recorded.
+     */
+    void setXtcPrecision(double precision);
+    /**
+     * Get the number of frames that are collected in memory before they are written to disk.
+     */
+    int getBufferSize() const;
+    /**
+     * Set the number of frames that are collected in memory before they are written to disk.  The
+     * default value is 10.
+     */
+    void setBufferSize(int frames);
+    /**
+     * Get whether frames are encoded and written on a background thread.
+     */
+    bool getUseBackgroundThread() const;
+    /**
+     * Set whether frames are encoded and written on a background thread.  This is false by default.
+     * It cannot be changed after the first frame has been recorded.
+     */
+    void setUseBackgroundThread(bool use);
+    /**
+     * Record a frame containing the current positions in a Context.  Periodic box vectors are recorded if
+     * any Force in the System uses periodic boundary conditions.
+     *
+     * @param context     the Context whose positions should be recorded
+     */
+    void writeFrame(Context& context);
+    /**
+     * Record a frame for a non-periodic system.
+     *
+     * @param positions   the position of every particle (measured in nm)
+     * @param time        the simulation time of the frame (measured in ps)
+     */
+    void writeFrame(const std::vector<Vec3>& positions, double time);
+    /**
+     * Record a frame for a periodic system.
+     *
+     * @param positions   the position of every particle (measured in nm)
+     * @param a           the vector defining the first edge of the periodic box (measured in nm)
+     * @param b           the vector defining the second edge of the periodic box (measured in nm)
+     * @param c           the vector defining the third edge of the periodic box (measured in nm)
+     * @param time        the simulation time of the frame (measured in ps)
+     */
+    void writeFrame(const std::vector<Vec3>& positions, const Vec3& a, const Vec3& b, const Vec3& c, double time);
+    /**
+     * Write all frames recorded so far to disk, blocking until they have been written.
+     */
+    void flush();
+    /**
+     * Write all remaining frames and close the file.  After this is called, no more frames may be recorded.
+     */
+    void close();
+private:
+    TrajectoryWriterImpl* impl;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_TRAJECTORYWRITER_H_*/
@@ -48,6 +48,13 @@ namespace OpenMM {
  * next syncThreads(), and the final call waits until they exit from the Task's execute() method.
  * After calling waitForThreads() to block at a synchronization point, the parent thread should
  * call resumeThreads() to instruct the worker threads to resume.
+ *
+ * A ThreadPool with only one thread does not create a worker thread.  Instead, execute() runs the
+ * Task directly on the calling thread, and waitForThreads() returns immediately.  This avoids the
+ * cost of handing off to another thread every time a task is executed.  Tasks that are executed
+ * on such a pool must not call syncThreads(), since there is no other thread to resume them.
+ * Calculations that need to synchronize part way through should instead be divided into separate
+ * Tasks that are executed one after another.
  */
 class OPENMM_EXPORT ThreadPool {
 public:
@@ -66,7 +73,8 @@ public:
      */
     int getNumThreads() const;
     /**
-     * Execute a Task in parallel on the worker threads.
+     * Execute a Task in parallel on the worker threads.  If the pool has only one thread, the Task
+     * is executed on the calling thread before this method returns.
      */
     void execute(Task& task);
     /**
@@ -83,11 +91,27 @@ public:
      * Instruct the threads to resume running after blocking at a synchronization point.
      */
     void resumeThreads();
+    /**
+     * Set whether to record how long each worker thread spends blocked in syncThreads() waiting for
+     * the other threads to reach the same point.  This is disabled by default, in which case it adds
+     * no overhead.
+     */
+    void setRecordWaitTimes(bool record);
+    /**
+     * Get the total time (in seconds) each worker thread has spent waiting for the other threads since
+     * wait times were last reset.  The vector has one element for each thread.
+     */
+    const std::vector<double>& getThreadWaitTimes() const;
+    /**
+     * Reset the accumulated wait times to zero.
+     */
+    void resetThreadWaitTimes();
 private:
-    bool isDeleted;
+    bool isDeleted, recordWaitTimes;
     int numThreads, waitCount;
     std::vector<pthread_t> thread;
     std::vector<ThreadData*> threadData;
+    std::vector<double> arrivalTime, waitTime;
     pthread_cond_t startCondition, endCondition;
     pthread_mutex_t lock;
 };
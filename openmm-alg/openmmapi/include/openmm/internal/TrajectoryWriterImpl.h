@@ -0,0 +1,151 @@
+#ifndef OPENMM_TRAJECTORYWRITERIMPL_H_
+#define OPENMM_TRAJECTORYWRITERIMPL_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/TrajectoryWriter.h"
+#include "windowsExport.h"
+#include <fstream>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+class ContextImpl;
+
+/**
+ * This is the internal implementation of a TrajectoryWriter.
+ */
+
+class OPENMM_EXPORT TrajectoryWriterImpl {
+public:
+    /**
+     * A single frame of a trajectory.
+     */
+    class Frame {
+    public:
+        std::vector<Vec3> positions;
+        Vec3 boxVectors[3];
+        double time;
+        int step;
+    };
+    TrajectoryWriterImpl(const std::string& filename, TrajectoryWriter::Format format, double stepSize, int firstStep, int interval);
+    ~TrajectoryWriterImpl();
+    TrajectoryWriter::Format getFormat() const {
+        return format;
+    }
+    int getNumFrames() const {
+        return numFrames;
+    }
+    double getXtcPrecision() const {
+        return xtcPrecision;
+    }
+    void setXtcPrecision(double precision);
+    int getBufferSize() const {
+        return bufferSize;
+    }
+    void setBufferSize(int frames);
+    bool getUseBackgroundThread() const {
+        return useBackgroundThread;
+    }
+    void setUseBackgroundThread(bool use);
+    /**
+     * Record a frame containing the current positions in a Context.
+     */
+    void writeFrame(ContextImpl& context);
+    /**
+     * Record a frame.  If boxVectors is NULL, the system is not periodic.
+     */
+    void writeFrame(const std::vector<Vec3>& positions, const Vec3* boxVectors, double time);
+    void flush();
+    void close();
+    /**
+     * Encode the header of a DCD file and append it to a buffer.
+     */
+    static void encodeDCDHeader(int numParticles, bool periodic, double stepSize, int firstStep, int interval, std::vector<char>& buffer);
+    /**
+     * Encode a frame of a DCD file and append it to a buffer.
+     */
+    static void encodeDCDFrame(const Frame& frame, bool periodic, std::vector<char>& buffer);
+    /**
+     * Encode a frame of an XTC file and append it to a buffer.  Coordinates are compressed with the
+     * algorithm used by GROMACS.
+     */
+    static void encodeXTCFrame(const Frame& frame, float precision, std::vector<char>& buffer, std::vector<int>& intCoords);
+    /**
+     * This is the entry point for the background thread.  It should not be called directly.
+     */
+    void runThread();
+private:
+    /**
+     * Get a Frame to record new data in, reusing one that has already been written if possible.
+     */
+    Frame* createFrame(int numParticles, bool periodic);
+    /**
+     * Add a Frame to the list of pending frames, and start writing them if the buffer is full.
+     */
+    void addFrame(Frame* frame);
+    /**
+     * Start writing all pending frames.
+     */
+    void submitPendingFrames();
+    /**
+     * Encode a group of frames and write them to the file.  This does not throw exceptions, since it may
+     * be called on the background thread.  Errors are instead recorded in errorMessage.
+     */
+    void writeFrames(const std::vector<Frame*>& frames);
+    /**
+     * Throw an exception if an error occurred on the background thread.
+     */
+    void checkForError();
+    std::string filename;
+    TrajectoryWriter::Format format;
+    double stepSize, xtcPrecision;
+    int firstStep, interval, bufferSize, numParticles, numFrames, numFramesWritten;
+    bool periodic, periodicInitialized, useBackgroundThread, threadStarted, isClosed, isDeleted;
+    std::fstream file;
+    std::vector<char> outputBuffer;
+    std::vector<int> intCoords;
+    std::vector<Frame*> pendingFrames, unusedFrames;
+    std::vector<std::vector<Frame*> > queuedGroups;
+    int activeGroups;
+    std::string errorMessage;
+    pthread_t thread;
+    pthread_cond_t queueCondition, doneCondition;
+    pthread_mutex_t lock;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_TRAJECTORYWRITERIMPL_H_*/
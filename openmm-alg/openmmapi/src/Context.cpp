@@ -35,6 +35,7 @@
 #include "openmm/internal/ForceImpl.h"
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
+#include <algorithm>
 #include <cmath>
 
 using namespace OpenMM;
@@ -156,6 +157,68 @@ void Context::setState(const State& state) {
             setParameter(iter->first, iter->second);
 }
 
+/**
+ * Restore the positions and parameters that were in effect before computeEnergies() was called.
+ */
+static void restoreEnergyState(ContextImpl& impl, const vector<Vec3>& originalPositions, const map<string, double>& originalParameters) {
+    if (originalPositions.size() > 0)
+        impl.setPositions(originalPositions);
+    for (map<string, double>::const_iterator iter = originalParameters.begin(); iter != originalParameters.end(); ++iter)
+        if (impl.getParameter(iter->first) != iter->second)
+            impl.setParameter(iter->first, iter->second);
+}
+
+vector<vector<double> > Context::computeEnergies(const vector<vector<Vec3> >& positions, const vector<map<string, double> >& parameters, int groups) {
+    int numParticles = impl->getSystem().getNumParticles();
+    for (int i = 0; i < (int) positions.size(); i++)
+        if ((int) positions[i].size() != numParticles)
+            throw OpenMMException("Called computeEnergies() with the wrong number of positions");
+    for (int i = 0; i < (int) parameters.size(); i++)
+        for (map<string, double>::const_iterator iter = parameters[i].begin(); iter != parameters[i].end(); ++iter)
+            if (impl->parameters.find(iter->first) == impl->parameters.end())
+                throw OpenMMException("Called computeEnergies() with invalid parameter name: "+iter->first);
+
+    // Build the complete set of values for every parameter set, filling in any that are not specified.
+
+    map<string, double> originalParameters = impl->parameters;
+    vector<map<string, double> > parameterSets;
+    for (int i = 0; i < (int) parameters.size(); i++) {
+        parameterSets.push_back(originalParameters);
+        for (map<string, double>::const_iterator iter = parameters[i].begin(); iter != parameters[i].end(); ++iter)
+            parameterSets[i][iter->first] = iter->second;
+    }
+    vector<Vec3> originalPositions;
+    if (positions.size() > 0)
+        impl->getPositions(originalPositions);
+
+    // Loop over configurations, then parameter sets, so the Platform can reuse anything that depends only
+    // on positions.  Only parameters that actually change are updated.  If an evaluation fails, the original
+    // state is still restored before the exception is passed on.
+
+    int numConfigurations = max((int) positions.size(), 1);
+    int numParameterSets = max((int) parameters.size(), 1);
+    vector<vector<double> > energies(numConfigurations, vector<double>(numParameterSets));
+    try {
+        for (int i = 0; i < numConfigurations; i++) {
+            if (positions.size() > 0)
+                impl->setPositions(positions[i]);
+            for (int j = 0; j < numParameterSets; j++) {
+                if (parameterSets.size() > 0)
+                    for (map<string, double>::const_iterator iter = parameterSets[j].begin(); iter != parameterSets[j].end(); ++iter)
+                        if (impl->parameters[iter->first] != iter->second)
+                            impl->setParameter(iter->first, iter->second);
+                energies[i][j] = impl->calcForcesAndEnergy(false, true, groups);
+            }
+        }
+    }
+    catch (...) {
+        restoreEnergyState(*impl, originalPositions, originalParameters);
+        throw;
+    }
+    restoreEnergyState(*impl, originalPositions, originalParameters);
+    return energies;
+}
+
 void Context::setTime(double time) {
     impl->setTime(time);
 }
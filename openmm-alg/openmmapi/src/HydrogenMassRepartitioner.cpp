@@ -0,0 +1,110 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/HydrogenMassRepartitioner.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/OpenMMException.h"
+#include <set>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+static bool isHydrogen(const System& system, int particle) {
+    double mass = system.getParticleMass(particle);
+    return (mass > 0.0 && mass < 1.5 && !system.isVirtualSite(particle));
+}
+
+static bool isHeavyAtom(const System& system, int particle) {
+    return (system.getParticleMass(particle) >= 1.5 && !system.isVirtualSite(particle));
+}
+
+static void addBond(const System& system, int p1, int p2, set<pair<int, int> >& hydrogenBonds) {
+    if (isHydrogen(system, p2))
+        swap(p1, p2);
+    if (isHydrogen(system, p1) && isHeavyAtom(system, p2))
+        hydrogenBonds.insert(make_pair(p1, p2));
+}
+
+void HydrogenMassRepartitioner::repartition(System& system, double hydrogenMass) {
+    if (hydrogenMass <= 0.0)
+        throw OpenMMException("HydrogenMassRepartitioner: hydrogenMass must be positive");
+    
+    // Find all bonds between a hydrogen and a heavy atom.  A bond may appear both as a constraint and
+    // in a HarmonicBondForce, so store them in a set to make sure each one is only counted once.
+    
+    set<pair<int, int> > hydrogenBonds;
+    for (int i = 0; i < system.getNumConstraints(); i++) {
+        int p1, p2;
+        double distance;
+        system.getConstraintParameters(i, p1, p2, distance);
+        addBond(system, p1, p2, hydrogenBonds);
+    }
+    for (int i = 0; i < system.getNumForces(); i++) {
+        const HarmonicBondForce* bonds = dynamic_cast<const HarmonicBondForce*>(&system.getForce(i));
+        if (bonds == NULL)
+            continue;
+        for (int j = 0; j < bonds->getNumBonds(); j++) {
+            int p1, p2;
+            double length, k;
+            bonds->getBondParameters(j, p1, p2, length, k);
+            addBond(system, p1, p2, hydrogenBonds);
+        }
+    }
+    
+    // Compute the new masses, and make sure no heavy atom is left with zero or negative mass.
+    
+    int numParticles = system.getNumParticles();
+    vector<double> masses(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        masses[i] = system.getParticleMass(i);
+    vector<double> newMasses = masses;
+    for (set<pair<int, int> >::const_iterator iter = hydrogenBonds.begin(); iter != hydrogenBonds.end(); ++iter) {
+        int hydrogen = iter->first, heavyAtom = iter->second;
+        double transfer = hydrogenMass-masses[hydrogen];
+        newMasses[hydrogen] = hydrogenMass;
+        newMasses[heavyAtom] -= transfer;
+    }
+    for (int i = 0; i < numParticles; i++)
+        if (newMasses[i] != masses[i] && newMasses[i] <= 0.0) {
+            stringstream msg;
+            msg << "HydrogenMassRepartitioner: repartitioning would leave particle ";
+            msg << i;
+            msg << " with a mass that is not positive";
+            throw OpenMMException(msg.str());
+        }
+    for (int i = 0; i < numParticles; i++)
+        if (newMasses[i] != masses[i])
+            system.setParticleMass(i, newMasses[i]);
+}
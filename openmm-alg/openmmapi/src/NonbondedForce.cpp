@@ -48,7 +48,7 @@ using std::stringstream;
 using std::vector;
 
 NonbondedForce::NonbondedForce() : nonbondedMethod(NoCutoff), cutoffDistance(1.0), switchingDistance(-1.0), rfDielectric(78.3),
-        ewaldErrorTol(5e-4), alpha(0.0), useSwitchingFunction(false), useDispersionCorrection(true), recipForceGroup(-1), nx(0), ny(0), nz(0) {
+        ewaldErrorTol(5e-4), alpha(0.0), softcoreAlpha(0.5), useSwitchingFunction(false), useDispersionCorrection(true), recipForceGroup(-1), nx(0), ny(0), nz(0) {
 }
 
 NonbondedForce::NonbondedMethod NonbondedForce::getNonbondedMethod() const {
@@ -237,6 +237,30 @@ void NonbondedForce::setReciprocalSpaceForceGroup(int group) {
     recipForceGroup = group;
 }
 
+void NonbondedForce::getAlchemicalParticles(set<int>& particles) const {
+    particles = alchemicalParticles;
+}
+
+void NonbondedForce::setAlchemicalParticles(const set<int>& particles) {
+    alchemicalParticles = particles;
+}
+
+double NonbondedForce::getSoftcoreAlpha() const {
+    return softcoreAlpha;
+}
+
+void NonbondedForce::setSoftcoreAlpha(double alpha) {
+    softcoreAlpha = alpha;
+}
+
 void NonbondedForce::updateParametersInContext(Context& context) {
     dynamic_cast<NonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context));
 }
+
+void NonbondedForce::updateParametersInContext(Context& context, int firstParticle, int numParticles, int firstException, int numExceptions) {
+    if (numParticles < 0 || firstParticle < 0 || firstParticle+numParticles > (int) particles.size())
+        throw OpenMMException("updateParametersInContext: Illegal range of particles");
+    if (numExceptions < 0 || firstException < 0 || firstException+numExceptions > (int) exceptions.size())
+        throw OpenMMException("updateParametersInContext: Illegal range of exceptions");
+    dynamic_cast<NonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context), firstParticle, numParticles, firstException, numExceptions);
+}
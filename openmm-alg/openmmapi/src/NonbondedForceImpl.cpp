@@ -38,6 +38,7 @@
 #include "openmm/kernels.h"
 #include <cmath>
 #include <map>
+#include <set>
 #include <sstream>
 #include <algorithm>
 
@@ -62,7 +63,7 @@ void NonbondedForceImpl::initialize(ContextImpl& context) {
         if (owner.getSwitchingDistance() < 0 || owner.getSwitchingDistance() >= owner.getCutoffDistance())
             throw OpenMMException("NonbondedForce: Switching distance must satisfy 0 <= r_switch < r_cutoff");
     }
-    vector<set<int> > exceptions(owner.getNumParticles());
+    vector<pair<int, int> > exceptions(owner.getNumExceptions());
     for (int i = 0; i < owner.getNumExceptions(); i++) {
         int particle1, particle2;
         double chargeProd, sigma, epsilon;
@@ -79,17 +80,33 @@ void NonbondedForceImpl::initialize(ContextImpl& context) {
             msg << particle2;
             throw OpenMMException(msg.str());
         }
-        if (exceptions[particle1].count(particle2) > 0 || exceptions[particle2].count(particle1) > 0) {
+        exceptions[i] = make_pair(min(particle1, particle2), max(particle1, particle2));
+    }
+    
+    // Sorting the pairs puts any duplicates next to each other.  This is much faster than building
+    // a set of exceptions for every particle.
+    
+    sort(exceptions.begin(), exceptions.end());
+    for (int i = 1; i < (int) exceptions.size(); i++)
+        if (exceptions[i] == exceptions[i-1]) {
             stringstream msg;
             msg << "NonbondedForce: Multiple exceptions are specified for particles ";
-            msg << particle1;
+            msg << exceptions[i].first;
             msg << " and ";
-            msg << particle2;
+            msg << exceptions[i].second;
             throw OpenMMException(msg.str());
         }
-        exceptions[particle1].insert(particle2);
-        exceptions[particle2].insert(particle1);
-    }
+    set<int> alchemicalParticles;
+    owner.getAlchemicalParticles(alchemicalParticles);
+    for (set<int>::const_iterator iter = alchemicalParticles.begin(); iter != alchemicalParticles.end(); ++iter)
+        if (*iter < 0 || *iter >= owner.getNumParticles()) {
+            stringstream msg;
+            msg << "NonbondedForce: Illegal particle index for an alchemical particle: ";
+            msg << *iter;
+            throw OpenMMException(msg.str());
+        }
+    if (owner.getSoftcoreAlpha() < 0)
+        throw OpenMMException("NonbondedForce: The soft-core alpha cannot be negative");
     if (owner.getNonbondedMethod() == NonbondedForce::CutoffPeriodic ||
             owner.getNonbondedMethod() == NonbondedForce::Ewald ||
             owner.getNonbondedMethod() == NonbondedForce::PME) {
@@ -112,6 +129,17 @@ double NonbondedForceImpl::calcForcesAndEnergy(ContextImpl& context, bool includ
     return kernel.getAs<CalcNonbondedForceKernel>().execute(context, includeForces, includeEnergy, includeDirect, includeReciprocal);
 }
 
+map<string, double> NonbondedForceImpl::getDefaultParameters() {
+    map<string, double> parameters;
+    set<int> alchemicalParticles;
+    owner.getAlchemicalParticles(alchemicalParticles);
+    if (alchemicalParticles.size() > 0) {
+        parameters[NonbondedForce::LambdaElectrostatics()] = 1.0;
+        parameters[NonbondedForce::LambdaSterics()] = 1.0;
+    }
+    return parameters;
+}
+
 std::vector<std::string> NonbondedForceImpl::getKernelNames() {
     std::vector<std::string> names;
     names.push_back(CalcNonbondedForceKernel::Name());
@@ -278,3 +306,7 @@ double NonbondedForceImpl::calcDispersionCorrection(const System& system, const
 void NonbondedForceImpl::updateParametersInContext(ContextImpl& context) {
     kernel.getAs<CalcNonbondedForceKernel>().copyParametersToContext(context, owner);
 }
+
+void NonbondedForceImpl::updateParametersInContext(ContextImpl& context, int firstParticle, int numParticles, int firstException, int numExceptions) {
+    kernel.getAs<CalcNonbondedForceKernel>().copySomeParametersToContext(context, owner, firstParticle, numParticles, firstException, numExceptions);
+}
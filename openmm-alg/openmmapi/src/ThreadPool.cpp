@@ -31,11 +31,35 @@
 
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/hardware.h"
+#include "openmm/OpenMMException.h"
+#ifndef WIN32
+    #include <sys/time.h>
+#endif
 
 using namespace std;
 
 namespace OpenMM {
 
+/**
+ * Get the current time in seconds.  This is only used for recording wait times.
+ */
+#ifdef WIN32
+    static double getTime() {
+        FILETIME ft;
+        GetSystemTimeAsFileTime(&ft); // 100-nanoseconds since 1-1-1601
+        ULARGE_INTEGER result;
+        result.LowPart = ft.dwLowDateTime;
+        result.HighPart = ft.dwHighDateTime;
+        return 1e-7*result.QuadPart;
+    }
+#else
+    static double getTime() {
+        struct timeval tod;
+        gettimeofday(&tod, 0);
+        return tod.tv_sec+1e-6*tod.tv_usec;
+    }
+#endif
+
 class ThreadPool::ThreadData {
 public:
     ThreadData(ThreadPool& owner, int index) : owner(owner), index(index), isDeleted(false) {
@@ -60,16 +84,23 @@ static void* threadBody(void* args) {
     return 0;
 }
 
-ThreadPool::ThreadPool(int numThreads) {
+ThreadPool::ThreadPool(int numThreads) : recordWaitTimes(false) {
     if (numThreads <= 0)
         numThreads = getNumProcessors();
     this->numThreads = numThreads;
+    arrivalTime.resize(numThreads, 0.0);
+    waitTime.resize(numThreads, 0.0);
     pthread_cond_init(&startCondition, NULL);
     pthread_cond_init(&endCondition, NULL);
     pthread_mutex_init(&lock, NULL);
+    waitCount = 0;
+    if (numThreads == 1) {
+        // Tasks will be run inline on the calling thread, so there is no need for a worker thread.
+
+        return;
+    }
     thread.resize(numThreads);
     pthread_mutex_lock(&lock);
-    waitCount = 0;
     for (int i = 0; i < numThreads; i++) {
         ThreadData* data = new ThreadData(*this, i);
         data->isDeleted = false;
@@ -99,13 +130,32 @@ int ThreadPool::getNumThreads() const {
 }
 
 void ThreadPool::execute(Task& task) {
+    if (thread.size() == 0) {
+        task.execute(*this, 0);
+        return;
+    }
     for (int i = 0; i < (int) threadData.size(); i++)
         threadData[i]->currentTask = &task;
     resumeThreads();
 }
 
 void ThreadPool::syncThreads() {
+    if (thread.size() == 0)
+        throw OpenMMException("syncThreads() cannot be called by a Task running on a ThreadPool with only one thread");
     pthread_mutex_lock(&lock);
+    if (recordWaitTimes) {
+        // Record when this thread arrived.  Once the last one arrives, every thread's wait time
+        // is the interval between its own arrival and that of the last thread.
+
+        double time = getTime();
+        pthread_t self = pthread_self();
+        for (int i = 0; i < (int) thread.size(); i++)
+            if (pthread_equal(thread[i], self))
+                arrivalTime[i] = time;
+        if (waitCount == numThreads-1)
+            for (int i = 0; i < numThreads; i++)
+                waitTime[i] += time-arrivalTime[i];
+    }
     waitCount++;
     pthread_cond_signal(&endCondition);
     pthread_cond_wait(&startCondition, &lock);
@@ -113,6 +163,8 @@ void ThreadPool::syncThreads() {
 }
 
 void ThreadPool::waitForThreads() {
+    if (thread.size() == 0)
+        return;
     pthread_mutex_lock(&lock);
     while (waitCount < numThreads)
         pthread_cond_wait(&endCondition, &lock);
@@ -120,10 +172,29 @@ void ThreadPool::waitForThreads() {
 }
 
 void ThreadPool::resumeThreads() {
+    if (thread.size() == 0)
+        return;
     pthread_mutex_lock(&lock);
     waitCount = 0;
     pthread_cond_broadcast(&startCondition);
     pthread_mutex_unlock(&lock);
 }
 
+void ThreadPool::setRecordWaitTimes(bool record) {
+    pthread_mutex_lock(&lock);
+    recordWaitTimes = record;
+    pthread_mutex_unlock(&lock);
+}
+
+const vector<double>& ThreadPool::getThreadWaitTimes() const {
+    return waitTime;
+}
+
+void ThreadPool::resetThreadWaitTimes() {
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < numThreads; i++)
+        waitTime[i] = 0.0;
+    pthread_mutex_unlock(&lock);
+}
+
 } // namespace OpenMM
@@ -0,0 +1,99 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/TrajectoryWriter.h"
+#include "openmm/Context.h"
+#include "openmm/internal/TrajectoryWriterImpl.h"
+
+using namespace OpenMM;
+using namespace std;
+
+TrajectoryWriter::TrajectoryWriter(const string& filename, Format format, double stepSize, int firstStep, int interval) {
+    impl = new TrajectoryWriterImpl(filename, format, stepSize, firstStep, interval);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    delete impl;
+}
+
+TrajectoryWriter::Format TrajectoryWriter::getFormat() const {
+    return impl->getFormat();
+}
+
+int TrajectoryWriter::getNumFrames() const {
+    return impl->getNumFrames();
+}
+
+double TrajectoryWriter::getXtcPrecision() const {
+    return impl->getXtcPrecision();
+}
+
+void TrajectoryWriter::setXtcPrecision(double precision) {
+    impl->setXtcPrecision(precision);
+}
+
+int TrajectoryWriter::getBufferSize() const {
+    return impl->getBufferSize();
+}
+
+void TrajectoryWriter::setBufferSize(int frames) {
+    impl->setBufferSize(frames);
+}
+
+bool TrajectoryWriter::getUseBackgroundThread() const {
+    return impl->getUseBackgroundThread();
+}
+
+void TrajectoryWriter::setUseBackgroundThread(bool use) {
+    impl->setUseBackgroundThread(use);
+}
+
+void TrajectoryWriter::writeFrame(Context& context) {
+    impl->writeFrame(context.getImpl());
+}
+
+void TrajectoryWriter::writeFrame(const vector<Vec3>& positions, double time) {
+    impl->writeFrame(positions, NULL, time);
+}
+
+void TrajectoryWriter::writeFrame(const vector<Vec3>& positions, const Vec3& a, const Vec3& b, const Vec3& c, double time) {
+    Vec3 boxVectors[] = {a, b, c};
+    impl->writeFrame(positions, boxVectors, time);
+}
+
+void TrajectoryWriter::flush() {
+    impl->flush();
+}
+
+void TrajectoryWriter::close() {
+    impl->close();
+}
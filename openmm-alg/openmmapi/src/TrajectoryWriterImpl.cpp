@@ -0,0 +1,737 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/TrajectoryWriterImpl.h"
+#include "openmm/internal/ContextImpl.h"
+#include "openmm/Force.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * The maximum number of groups of frames that may be waiting for the background thread.  Once this
+ * many are queued, writeFrame() blocks until one of them has been written.
+ */
+static const int MAX_QUEUED_GROUPS = 2;
+
+static bool isLittleEndian() {
+    int value = 1;
+    return (*reinterpret_cast<char*>(&value) == 1);
+}
+
+/**
+ * Append a value to a buffer with the specified byte ordering.
+ */
+template <class T>
+static void appendValue(vector<char>& buffer, T value, bool bigEndian) {
+    char bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    if (bigEndian == isLittleEndian())
+        for (int i = 0; i < (int) sizeof(T)/2; i++)
+            swap(bytes[i], bytes[sizeof(T)-1-i]);
+    buffer.insert(buffer.end(), bytes, bytes+sizeof(T));
+}
+
+/**
+ * Overwrite a value that was previously appended to a buffer.
+ */
+template <class T>
+static void setValue(vector<char>& buffer, int offset, T value, bool bigEndian) {
+    vector<char> bytes;
+    appendValue(bytes, value, bigEndian);
+    memcpy(&buffer[offset], &bytes[0], sizeof(T));
+}
+
+static void appendString(vector<char>& buffer, const string& value, int length) {
+    for (int i = 0; i < length; i++)
+        buffer.push_back(i < (int) value.size() ? value[i] : '\0');
+}
+
+static void* threadBody(void* args) {
+    reinterpret_cast<TrajectoryWriterImpl*>(args)->runThread();
+    return 0;
+}
+
+/**
+ * These tables and functions implement the coordinate compression used by XTC files.  They follow
+ * xdr3dfcoord() from the GROMACS xdrf library, which defines the format.  magicints contains the
+ * possible sizes of the small integers used to encode runs of nearby atoms.
+ */
+
+static const int magicints[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0,
+    8, 10, 12, 16, 20, 25, 32, 40, 50, 64,
+    80, 101, 128, 161, 203, 256, 322, 406, 512, 645,
+    812, 1024, 1290, 1625, 2048, 2580, 3250, 4096, 5060, 6501,
+    8192, 10321, 13003, 16384, 20642, 26007, 32768, 41285, 52015, 65536,
+    82570, 104031, 131072, 165140, 208063, 262144, 330280, 416127, 524287, 660561,
+    832255, 1048576, 1321122, 1664510, 2097152, 2642245, 3329021, 4194304, 5284491, 6658042,
+    8388607, 10568983, 13316085, 16777216
+};
+static const int FIRSTIDX = 9;
+static const int LASTIDX = sizeof(magicints)/sizeof(magicints[0]);
+
+/**
+ * Get the number of bits needed to store any integer in the range [0, size).
+ */
+static int sizeOfInt(unsigned int size) {
+    unsigned int num = 1;
+    int bits = 0;
+    while (size >= num && bits < 32) {
+        bits++;
+        num <<= 1;
+    }
+    return bits;
+}
+
+/**
+ * Get the number of bits needed to store three integers packed together, where each one is in the range
+ * [0, sizes[i]).
+ */
+static int sizeOfInts(const unsigned int sizes[3]) {
+    unsigned int bytes[32];
+    int numBytes = 1;
+    bytes[0] = 1;
+    for (int i = 0; i < 3; i++) {
+        unsigned long long tmp = 0;
+        int byteIndex;
+        for (byteIndex = 0; byteIndex < numBytes; byteIndex++) {
+            tmp = bytes[byteIndex]*(unsigned long long) sizes[i]+tmp;
+            bytes[byteIndex] = tmp&0xff;
+            tmp >>= 8;
+        }
+        while (tmp != 0) {
+            bytes[byteIndex++] = tmp&0xff;
+            tmp >>= 8;
+        }
+        numBytes = byteIndex;
+    }
+    int numBits = 0;
+    unsigned int num = 1;
+    numBytes--;
+    while (bytes[numBytes] >= num) {
+        numBits++;
+        num *= 2;
+    }
+    return numBits+8*numBytes;
+}
+
+/**
+ * Packs bits into a buffer, starting from the most significant bit of each byte.
+ */
+class BitWriter {
+public:
+    BitWriter(vector<char>& buffer) : buffer(buffer), lastBits(0), lastByte(0) {
+    }
+    void sendBits(int numBits, unsigned int value) {
+        while (numBits >= 8) {
+            lastByte = (lastByte<<8) | ((value>>(numBits-8))&0xff);
+            buffer.push_back((char) (lastByte>>lastBits));
+            numBits -= 8;
+        }
+        if (numBits > 0) {
+            lastByte = (lastByte<<numBits) | (value&((1u<<numBits)-1));
+            lastBits += numBits;
+            if (lastBits >= 8) {
+                lastBits -= 8;
+                buffer.push_back((char) (lastByte>>lastBits));
+            }
+        }
+    }
+    /**
+     * Pack three integers into a single large integer, and send it using the specified number of bits.
+     */
+    void sendInts(int numBits, const unsigned int sizes[3], const int nums[3]) {
+        unsigned int bytes[32];
+        int numBytes = 0;
+        unsigned long long tmp = (unsigned int) nums[0];
+        do {
+            bytes[numBytes++] = tmp&0xff;
+            tmp >>= 8;
+        } while (tmp != 0);
+        for (int i = 1; i < 3; i++) {
+            tmp = (unsigned int) nums[i];
+            int byteIndex;
+            for (byteIndex = 0; byteIndex < numBytes; byteIndex++) {
+                tmp = bytes[byteIndex]*(unsigned long long) sizes[i]+tmp;
+                bytes[byteIndex] = tmp&0xff;
+                tmp >>= 8;
+            }
+            while (tmp != 0) {
+                bytes[byteIndex++] = tmp&0xff;
+                tmp >>= 8;
+            }
+            numBytes = byteIndex;
+        }
+        if (numBits >= 8*numBytes) {
+            for (int i = 0; i < numBytes; i++)
+                sendBits(8, bytes[i]);
+            sendBits(numBits-8*numBytes, 0);
+        }
+        else {
+            for (int i = 0; i < numBytes-1; i++)
+                sendBits(8, bytes[i]);
+            sendBits(numBits-8*(numBytes-1), bytes[numBytes-1]);
+        }
+    }
+    /**
+     * Write out any partial byte that remains.
+     */
+    void finish() {
+        if (lastBits > 0)
+            buffer.push_back((char) (lastByte<<(8-lastBits)));
+    }
+private:
+    vector<char>& buffer;
+    int lastBits;
+    unsigned int lastByte;
+};
+
+static bool isSmallDifference(const int* coord1, const int* coord2, int limit) {
+    return (abs(coord1[0]-coord2[0]) < limit && abs(coord1[1]-coord2[1]) < limit && abs(coord1[2]-coord2[2]) < limit);
+}
+
+static bool usesPeriodicBoundaryConditions(const System& system) {
+    for (int i = 0; i < system.getNumForces(); i++) {
+        try {
+            if (system.getForce(i).usesPeriodicBoundaryConditions())
+                return true;
+        }
+        catch (OpenMMException& ex) {
+            // This force does not say whether it is periodic, so assume it is not.
+        }
+    }
+    return false;
+}
+
+TrajectoryWriterImpl::TrajectoryWriterImpl(const string& filename, TrajectoryWriter::Format format, double stepSize, int firstStep, int interval) :
+        filename(filename), format(format), stepSize(stepSize), xtcPrecision(1000.0), firstStep(firstStep), interval(interval), bufferSize(10),
+        numParticles(0), numFrames(0), numFramesWritten(0), periodic(false), useBackgroundThread(false), threadStarted(false), isClosed(false),
+        isDeleted(false), activeGroups(0) {
+    if (format != TrajectoryWriter::DCD && format != TrajectoryWriter::XTC)
+        throw OpenMMException("TrajectoryWriter: Unknown file format");
+    if (interval < 1)
+        throw OpenMMException("TrajectoryWriter: interval must be positive");
+    file.open(filename.c_str(), ios::in | ios::out | ios::binary | ios::trunc);
+    if (!file.is_open())
+        throw OpenMMException("TrajectoryWriter: Failed to open file "+filename);
+    pthread_cond_init(&queueCondition, NULL);
+    pthread_cond_init(&doneCondition, NULL);
+    pthread_mutex_init(&lock, NULL);
+}
+
+TrajectoryWriterImpl::~TrajectoryWriterImpl() {
+    try {
+        close();
+    }
+    catch (OpenMMException& ex) {
+        // Errors cannot be reported from a destructor.
+    }
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&queueCondition);
+    pthread_cond_destroy(&doneCondition);
+    for (int i = 0; i < (int) pendingFrames.size(); i++)
+        delete pendingFrames[i];
+    for (int i = 0; i < (int) unusedFrames.size(); i++)
+        delete unusedFrames[i];
+}
+
+void TrajectoryWriterImpl::setXtcPrecision(double precision) {
+    if (numFrames > 0)
+        throw OpenMMException("TrajectoryWriter: The XTC precision cannot be changed after the first frame has been written");
+    if (precision <= 0.0)
+        throw OpenMMException("TrajectoryWriter: The XTC precision must be positive");
+    xtcPrecision = precision;
+}
+
+void TrajectoryWriterImpl::setBufferSize(int frames) {
+    if (frames < 1)
+        throw OpenMMException("TrajectoryWriter: The buffer size must be at least 1");
+    bufferSize = frames;
+}
+
+void TrajectoryWriterImpl::setUseBackgroundThread(bool use) {
+    if (numFrames > 0)
+        throw OpenMMException("TrajectoryWriter: The background thread cannot be enabled or disabled after the first frame has been written");
+    useBackgroundThread = use;
+}
+
+TrajectoryWriterImpl::Frame* TrajectoryWriterImpl::createFrame(int numParticles, bool periodic) {
+    if (isClosed)
+        throw OpenMMException("TrajectoryWriter: Called writeFrame() after the file was closed");
+    checkForError();
+    if (numFrames == 0) {
+        this->numParticles = numParticles;
+        this->periodic = periodic;
+    }
+    else {
+        if (numParticles != this->numParticles)
+            throw OpenMMException("TrajectoryWriter: Every frame must contain the same number of particles");
+        if (periodic != this->periodic)
+            throw OpenMMException("TrajectoryWriter: Periodic and non-periodic frames cannot be mixed in one file");
+    }
+    Frame* frame;
+    pthread_mutex_lock(&lock);
+    if (unusedFrames.size() > 0) {
+        frame = unusedFrames.back();
+        unusedFrames.pop_back();
+    }
+    else
+        frame = new Frame();
+    pthread_mutex_unlock(&lock);
+    frame->step = firstStep+numFrames*interval;
+    return frame;
+}
+
+void TrajectoryWriterImpl::addFrame(Frame* frame) {
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < 3; j++) {
+            // This is true if the value is either NaN or infinite.
+
+            double value = frame->positions[i][j];
+            if (value-value != 0.0) {
+                pthread_mutex_lock(&lock);
+                unusedFrames.push_back(frame);
+                pthread_mutex_unlock(&lock);
+                throw OpenMMException("TrajectoryWriter: Particle position is NaN or infinite");
+            }
+        }
+    pendingFrames.push_back(frame);
+    numFrames++;
+    if ((int) pendingFrames.size() >= bufferSize)
+        submitPendingFrames();
+}
+
+void TrajectoryWriterImpl::writeFrame(ContextImpl& context) {
+    const System& system = context.getSystem();
+    bool isPeriodic = (numFrames == 0 ? usesPeriodicBoundaryConditions(system) : periodic);
+    Frame* frame = createFrame(system.getNumParticles(), isPeriodic);
+    context.getPositions(frame->positions);
+    if (isPeriodic)
+        context.getPeriodicBoxVectors(frame->boxVectors[0], frame->boxVectors[1], frame->boxVectors[2]);
+    frame->time = context.getTime();
+    addFrame(frame);
+}
+
+void TrajectoryWriterImpl::writeFrame(const vector<Vec3>& positions, const Vec3* boxVectors, double time) {
+    Frame* frame = createFrame(positions.size(), boxVectors != NULL);
+    frame->positions = positions;
+    if (boxVectors != NULL)
+        for (int i = 0; i < 3; i++)
+            frame->boxVectors[i] = boxVectors[i];
+    frame->time = time;
+    addFrame(frame);
+}
+
+void TrajectoryWriterImpl::submitPendingFrames() {
+    if (pendingFrames.size() == 0)
+        return;
+    if (!useBackgroundThread) {
+        writeFrames(pendingFrames);
+        unusedFrames.insert(unusedFrames.end(), pendingFrames.begin(), pendingFrames.end());
+        pendingFrames.clear();
+        checkForError();
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    if (!threadStarted) {
+        pthread_create(&thread, NULL, threadBody, this);
+        threadStarted = true;
+    }
+    while (activeGroups >= MAX_QUEUED_GROUPS)
+        pthread_cond_wait(&doneCondition, &lock);
+    queuedGroups.push_back(pendingFrames);
+    activeGroups++;
+    pthread_cond_signal(&queueCondition);
+    pthread_mutex_unlock(&lock);
+    pendingFrames.clear();
+}
+
+void TrajectoryWriterImpl::runThread() {
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (queuedGroups.size() == 0 && !isDeleted)
+            pthread_cond_wait(&queueCondition, &lock);
+        if (queuedGroups.size() == 0)
+            break;
+        vector<Frame*> frames = queuedGroups[0];
+        queuedGroups.erase(queuedGroups.begin());
+        pthread_mutex_unlock(&lock);
+        writeFrames(frames);
+        pthread_mutex_lock(&lock);
+        unusedFrames.insert(unusedFrames.end(), frames.begin(), frames.end());
+        activeGroups--;
+        pthread_cond_signal(&doneCondition);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void TrajectoryWriterImpl::writeFrames(const vector<Frame*>& frames) {
+    // Once an error has occurred, do not try to write anything more.
+
+    pthread_mutex_lock(&lock);
+    bool failed = (errorMessage.size() > 0);
+    pthread_mutex_unlock(&lock);
+    if (failed)
+        return;
+
+    // Encode the frames.  This may be running on the background thread, so an exception cannot be
+    // allowed to escape.  Record the error to be reported by the next call on the main thread.
+
+    outputBuffer.clear();
+    try {
+        if (numFramesWritten == 0 && format == TrajectoryWriter::DCD)
+            encodeDCDHeader(numParticles, periodic, stepSize, firstStep, interval, outputBuffer);
+        for (int i = 0; i < (int) frames.size(); i++) {
+            if (format == TrajectoryWriter::DCD)
+                encodeDCDFrame(*frames[i], periodic, outputBuffer);
+            else
+                encodeXTCFrame(*frames[i], (float) xtcPrecision, outputBuffer, intCoords);
+        }
+    }
+    catch (exception& ex) {
+        pthread_mutex_lock(&lock);
+        errorMessage = ex.what();
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    numFramesWritten += frames.size();
+
+    // Write them to the file.  A DCD header records the number of frames, so it must be updated as well.
+
+    file.seekp(0, ios::end);
+    file.write(&outputBuffer[0], outputBuffer.size());
+    if (format == TrajectoryWriter::DCD) {
+        vector<char> header;
+        appendValue(header, numFramesWritten, false);
+        file.seekp(8, ios::beg);
+        file.write(&header[0], 4);
+        header.clear();
+        appendValue(header, firstStep+numFramesWritten*interval, false);
+        file.seekp(20, ios::beg);
+        file.write(&header[0], 4);
+    }
+    file.flush();
+    if (!file.good()) {
+        pthread_mutex_lock(&lock);
+        errorMessage = "TrajectoryWriter: Error writing to file "+filename;
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void TrajectoryWriterImpl::checkForError() {
+    pthread_mutex_lock(&lock);
+    string message = errorMessage;
+    pthread_mutex_unlock(&lock);
+    if (message.size() > 0)
+        throw OpenMMException(message);
+}
+
+void TrajectoryWriterImpl::flush() {
+    if (isClosed)
+        return;
+    submitPendingFrames();
+    if (threadStarted) {
+        pthread_mutex_lock(&lock);
+        while (activeGroups > 0)
+            pthread_cond_wait(&doneCondition, &lock);
+        pthread_mutex_unlock(&lock);
+    }
+    checkForError();
+}
+
+void TrajectoryWriterImpl::close() {
+    if (isClosed)
+        return;
+    try {
+        flush();
+    }
+    catch (OpenMMException& ex) {
+        // The error is reported below, once the file has been closed.
+    }
+    if (threadStarted) {
+        pthread_mutex_lock(&lock);
+        isDeleted = true;
+        pthread_cond_signal(&queueCondition);
+        pthread_mutex_unlock(&lock);
+        pthread_join(thread, NULL);
+        threadStarted = false;
+    }
+    isClosed = true;
+    file.close();
+    checkForError();
+}
+
+void TrajectoryWriterImpl::encodeDCDHeader(int numParticles, bool periodic, double stepSize, int firstStep, int interval, vector<char>& buffer) {
+    // This matches the CHARMM variant of the format written by DCDFile in the Python application layer.
+    // The time step is stored in AKMA units.
+
+    appendValue(buffer, 84, false);
+    appendString(buffer, "CORD", 4);
+    appendValue(buffer, 0, false);
+    appendValue(buffer, firstStep, false);
+    appendValue(buffer, interval, false);
+    for (int i = 0; i < 6; i++)
+        appendValue(buffer, 0, false);
+    appendValue(buffer, (float) (stepSize/0.04888821), false);
+    appendValue(buffer, periodic ? 1 : 0, false);
+    for (int i = 0; i < 8; i++)
+        appendValue(buffer, 0, false);
+    appendValue(buffer, 24, false);
+    appendValue(buffer, 84, false);
+    appendValue(buffer, 164, false);
+    appendValue(buffer, 2, false);
+    appendString(buffer, "Created by OpenMM", 80);
+    time_t currentTime = time(NULL);
+    string timeString = asctime(localtime(&currentTime));
+    appendString(buffer, "Created "+timeString.substr(0, timeString.size()-1), 80);
+    appendValue(buffer, 164, false);
+    appendValue(buffer, 4, false);
+    appendValue(buffer, numParticles, false);
+    appendValue(buffer, 4, false);
+}
+
+void TrajectoryWriterImpl::encodeDCDFrame(const Frame& frame, bool periodic, vector<char>& buffer) {
+    if (periodic) {
+        // Record the lengths of the box vectors (in Angstroms) and the cosines of the angles between them.
+
+        const Vec3* box = frame.boxVectors;
+        double length[3];
+        for (int i = 0; i < 3; i++)
+            length[i] = sqrt(box[i].dot(box[i]));
+        appendValue(buffer, 48, false);
+        appendValue(buffer, 10*length[0], false);
+        appendValue(buffer, box[0].dot(box[1])/(length[0]*length[1]), false);
+        appendValue(buffer, 10*length[1], false);
+        appendValue(buffer, box[0].dot(box[2])/(length[0]*length[2]), false);
+        appendValue(buffer, box[1].dot(box[2])/(length[1]*length[2]), false);
+        appendValue(buffer, 10*length[2], false);
+        appendValue(buffer, 48, false);
+    }
+    int numParticles = frame.positions.size();
+    for (int axis = 0; axis < 3; axis++) {
+        appendValue(buffer, 4*numParticles, false);
+        for (int i = 0; i < numParticles; i++)
+            appendValue(buffer, (float) (10*frame.positions[i][axis]), false);
+        appendValue(buffer, 4*numParticles, false);
+    }
+}
+
+void TrajectoryWriterImpl::encodeXTCFrame(const Frame& frame, float precision, vector<char>& buffer, vector<int>& intCoords) {
+    // Write the frame header.  All values use XDR encoding, which is big-endian.
+
+    int numParticles = frame.positions.size();
+    appendValue(buffer, 1995, true);
+    appendValue(buffer, numParticles, true);
+    appendValue(buffer, frame.step, true);
+    appendValue(buffer, (float) frame.time, true);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            appendValue(buffer, (float) frame.boxVectors[i][j], true);
+    appendValue(buffer, numParticles, true);
+
+    // Very small systems are stored uncompressed.
+
+    if (numParticles <= 9) {
+        for (int i = 0; i < numParticles; i++)
+            for (int j = 0; j < 3; j++)
+                appendValue(buffer, (float) frame.positions[i][j], true);
+        return;
+    }
+    appendValue(buffer, precision, true);
+
+    // Convert the coordinates to integers and find their range, along with the smallest distance
+    // between successive particles.
+
+    intCoords.resize(3*numParticles);
+    int minInt[3] = {INT_MAX, INT_MAX, INT_MAX};
+    int maxInt[3] = {INT_MIN, INT_MIN, INT_MIN};
+    int minDiff = INT_MAX;
+    for (int i = 0; i < numParticles; i++) {
+        for (int j = 0; j < 3; j++) {
+            float value = (float) frame.positions[i][j]*precision;
+            value = (value >= 0.0f ? value+0.5f : value-0.5f);
+            if (fabs(value) > INT_MAX-2)
+                throw OpenMMException("TrajectoryWriter: Coordinate is too large to store in an XTC file");
+            int intValue = (int) value;
+            intCoords[3*i+j] = intValue;
+            minInt[j] = min(minInt[j], intValue);
+            maxInt[j] = max(maxInt[j], intValue);
+        }
+        if (i > 0) {
+            int* coord = &intCoords[3*i];
+            int diff = abs(coord[0]-coord[-3])+abs(coord[1]-coord[-2])+abs(coord[2]-coord[-1]);
+            minDiff = min(minDiff, diff);
+        }
+    }
+    for (int i = 0; i < 3; i++)
+        appendValue(buffer, minInt[i], true);
+    for (int i = 0; i < 3; i++)
+        appendValue(buffer, maxInt[i], true);
+
+    // Decide how many bits to use for each full coordinate.  If the range is very large, each component
+    // is stored separately.  Otherwise they are packed into a single integer.
+
+    unsigned int sizeInt[3], bitSizeInt[3] = {0, 0, 0};
+    bool large = false;
+    for (int i = 0; i < 3; i++) {
+        sizeInt[i] = maxInt[i]-minInt[i]+1;
+        if (sizeInt[i] > 0xffffff)
+            large = true;
+    }
+    int bitSize = 0;
+    if (large)
+        for (int i = 0; i < 3; i++)
+            bitSizeInt[i] = sizeOfInt(sizeInt[i]);
+    else
+        bitSize = sizeOfInts(sizeInt);
+
+    // Choose the initial size of the small integers used for runs of nearby particles.  The encoder
+    // adapts this as it goes.  The last entry of magicints is excluded so the size can always grow by one.
+
+    int smallIndex = FIRSTIDX;
+    while (smallIndex < LASTIDX-2 && magicints[smallIndex] < minDiff)
+        smallIndex++;
+    appendValue(buffer, smallIndex, true);
+    int maxIndex = min(LASTIDX-1, smallIndex+8);
+    int minIndex = maxIndex-8;
+    int smaller = magicints[max(FIRSTIDX, smallIndex-1)]/2;
+    int smallNum = magicints[smallIndex]/2;
+    int larger = magicints[maxIndex]/2;
+    unsigned int sizeSmall[3];
+    sizeSmall[0] = sizeSmall[1] = sizeSmall[2] = magicints[smallIndex];
+
+    // Reserve space for the number of bytes, then compress the coordinates.
+
+    int countOffset = buffer.size();
+    appendValue(buffer, 0, true);
+    int dataOffset = buffer.size();
+    BitWriter writer(buffer);
+    int prevCoord[3] = {0, 0, 0};
+    int tmpCoord[30];
+    int prevRun = -1;
+    int i = 0;
+    while (i < numParticles) {
+        int* thisCoord = &intCoords[3*i];
+        int isSmaller;
+        if (smallIndex < maxIndex && i >= 1 && isSmallDifference(thisCoord, prevCoord, larger))
+            isSmaller = 1;
+        else if (smallIndex > minIndex)
+            isSmaller = -1;
+        else
+            isSmaller = 0;
+
+        // If the next particle is close to this one, swap them.  This gives better compression for
+        // water, where the oxygen is written first but is in the middle of the molecule.
+
+        bool isSmall = false;
+        if (i+1 < numParticles && isSmallDifference(thisCoord, thisCoord+3, smallNum)) {
+            for (int j = 0; j < 3; j++)
+                swap(thisCoord[j], thisCoord[j+3]);
+            isSmall = true;
+        }
+
+        // Write this particle's full coordinates.
+
+        for (int j = 0; j < 3; j++)
+            tmpCoord[j] = thisCoord[j]-minInt[j];
+        if (large)
+            for (int j = 0; j < 3; j++)
+                writer.sendBits(bitSizeInt[j], tmpCoord[j]);
+        else
+            writer.sendInts(bitSize, sizeInt, tmpCoord);
+        for (int j = 0; j < 3; j++)
+            prevCoord[j] = thisCoord[j];
+        thisCoord += 3;
+        i++;
+
+        // Record a run of up to eight following particles, each as a small offset from the previous one.
+
+        int run = 0;
+        if (!isSmall && isSmaller == -1)
+            isSmaller = 0;
+        while (isSmall && run < 24) {
+            if (isSmaller == -1) {
+                int dx = thisCoord[0]-prevCoord[0];
+                int dy = thisCoord[1]-prevCoord[1];
+                int dz = thisCoord[2]-prevCoord[2];
+                if (dx*dx+dy*dy+dz*dz >= smaller*smaller)
+                    isSmaller = 0;
+            }
+            for (int j = 0; j < 3; j++) {
+                tmpCoord[run++] = thisCoord[j]-prevCoord[j]+smallNum;
+                prevCoord[j] = thisCoord[j];
+            }
+            i++;
+            thisCoord += 3;
+            isSmall = (i < numParticles && isSmallDifference(thisCoord, prevCoord, smallNum));
+        }
+        if (run != prevRun || isSmaller != 0) {
+            prevRun = run;
+            writer.sendBits(1, 1);
+            writer.sendBits(5, run+isSmaller+1);
+        }
+        else
+            writer.sendBits(1, 0);
+        for (int k = 0; k < run; k += 3)
+            writer.sendInts(smallIndex, sizeSmall, &tmpCoord[k]);
+
+        // Adjust the size of the small integers for the next run.
+
+        if (isSmaller != 0) {
+            smallIndex += isSmaller;
+            if (isSmaller < 0) {
+                smallNum = smaller;
+                smaller = magicints[smallIndex-1]/2;
+            }
+            else {
+                smaller = smallNum;
+                smallNum = magicints[smallIndex]/2;
+            }
+            sizeSmall[0] = sizeSmall[1] = sizeSmall[2] = magicints[smallIndex];
+        }
+    }
+    writer.finish();
+
+    // Record the number of bytes, and pad the data to a multiple of four bytes.
+
+    int numBytes = buffer.size()-dataOffset;
+    setValue(buffer, countOffset, numBytes, true);
+    while ((buffer.size()-dataOffset)%4 != 0)
+        buffer.push_back(0);
+}
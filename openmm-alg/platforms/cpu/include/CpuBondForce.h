@@ -36,7 +36,6 @@
 #include "windowsExportCpu.h"
 #include "openmm/internal/ThreadPool.h"
 #include <list>
-#include <set>
 #include <vector>
 
 namespace OpenMM {
@@ -62,9 +61,22 @@ public:
      */
     void threadComputeForce(ThreadPool& threads, int threadIndex, std::vector<OpenMM::RealVec>& atomCoordinates, RealOpenMM** parameters,
             std::vector<OpenMM::RealVec>& forces, RealOpenMM* totalEnergy, ReferenceBondIxn& referenceBondIxn);
+    /**
+     * Get the bonds assigned to a thread.  No two threads have bonds that involve the same atom.
+     */
+    const std::vector<int>& getThreadBonds(int threadIndex) const {
+        return threadBonds[threadIndex];
+    }
+    /**
+     * Get the bonds that could not be assigned to any thread.  They must be computed after the threads have finished.
+     */
+    const std::vector<int>& getExtraBonds() const {
+        return extraBonds;
+    }
 private:
     bool canAssignBond(int bond, int thread, std::vector<int>& atomThread);
-    void assignBond(int bond, int thread, std::vector<int>& atomThread, std::vector<int>& bondThread, std::vector<std::set<int> >& atomBonds, std::list<int>& candidateBonds);
+    void assignBond(int bond, int thread, std::vector<int>& atomThread, std::vector<int>& bondThread, const std::vector<int>& atomBondStart,
+            const std::vector<int>& atomBonds, std::list<int>& candidateBonds);
     int numBonds, numAtomsPerBond;
     int** bondAtoms;
     ThreadPool* threads;
@@ -0,0 +1,141 @@
+#ifndef OPENMM_CPU_CUSTOM_EXTERNAL_FORCE_H_
+#define OPENMM_CPU_CUSTOM_EXTERNAL_FORCE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuTabulatedFunction.h"
+#include "RealVec.h"
+#include "openmm/internal/ThreadPool.h"
+#include "lepton/CompiledExpression.h"
+#include "lepton/ParsedExpression.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class computes a potential that acts independently on each of a set of particles, and
+ * depends only on the particle's position and per-particle parameters.  It is used to implement
+ * CustomExternalForce, and CustomCompoundBondForces whose bonds each contain a single particle.
+ * The particles are divided between the threads of a ThreadPool, and every entry for a given
+ * particle is processed by the same thread, so a particle may appear more than once.
+ *
+ * There are two modes of evaluation.  In the general case, the energy and its gradient are
+ * computed from Lepton expressions.  When the energy is a tabulated grid potential,
+ * optionally scaled by a constant and a parameter, the grid is interpolated directly.
+ */
+class CpuCustomExternalForce {
+public:
+    class ComputeTask;
+    /**
+     * Create a CpuCustomExternalForce that evaluates a general expression.
+     *
+     * @param energyExpression   the expression for the energy of each particle
+     * @param coordinateNames    the names of the variables representing the x, y, and z coordinates
+     * @param parameterNames     the names of the per-particle parameters
+     * @param threads            the thread pool to use
+     */
+    CpuCustomExternalForce(const Lepton::ParsedExpression& energyExpression, const std::vector<std::string>& coordinateNames,
+            const std::vector<std::string>& parameterNames, ThreadPool& threads);
+    /**
+     * Create a CpuCustomExternalForce that evaluates a scaled grid potential.
+     *
+     * @param grid               the function defining the grid potential
+     * @param scale              a constant factor to multiply the grid potential by
+     * @param scaleVariable      the name of a per-particle or global parameter to multiply the grid potential by.
+     *                           If this is empty, only the constant factor is used.
+     * @param parameterNames     the names of the per-particle parameters
+     * @param threads            the thread pool to use
+     */
+    CpuCustomExternalForce(const CpuContinuous3DFunction& grid, double scale, const std::string& scaleVariable,
+            const std::vector<std::string>& parameterNames, ThreadPool& threads);
+    ~CpuCustomExternalForce();
+    /**
+     * Set the particles the force acts on and their parameters.
+     *
+     * @param particles     the index of each particle the force acts on
+     * @param parameters    the per-particle parameters for each one
+     */
+    void setParticles(const std::vector<int>& particles, const std::vector<std::vector<double> >& parameters);
+    /**
+     * Calculate the interaction.
+     *
+     * @param positions         the positions of all particles
+     * @param globalParameters  the values of global parameters
+     * @param forces            forces on particles are added to this
+     * @param includeForces     true if forces should be computed
+     * @param includeEnergy     true if the energy should be computed
+     * @param totalEnergy       the energy is added to this
+     */
+    void calculateIxn(const std::vector<RealVec>& positions, const std::map<std::string, double>& globalParameters,
+            std::vector<RealVec>& forces, bool includeForces, bool includeEnergy, double& totalEnergy);
+    /**
+     * This routine contains the code executed by each thread.
+     */
+    void threadComputeForce(ThreadPool& threads, int threadIndex);
+private:
+    class ThreadData;
+    ThreadPool& threads;
+    std::vector<std::string> parameterNames;
+    std::vector<ThreadData*> threadData;
+    CpuContinuous3DFunction* grid;
+    double gridScale;
+    int gridScaleParameter;
+    std::string gridScaleGlobal;
+    std::vector<int> particles;
+    std::vector<std::vector<double> > particleParams;
+    std::vector<int> order;
+    std::vector<double> threadEnergy;
+    // The following variables are used to make information accessible to the individual threads.
+    const std::vector<RealVec>* positions;
+    const std::map<std::string, double>* globalParameters;
+    std::vector<RealVec>* forces;
+    bool includeForces, includeEnergy;
+    double gridGlobalScale;
+    /**
+     * Get the index in the sorted list of entries where a thread's range starts.
+     */
+    int getThreadBoundary(int threadIndex, int numThreads) const;
+    /**
+     * Compute the interaction for this thread's particles using the Lepton expressions.
+     */
+    void computeExpressions(ThreadData& data, int start, int end, double& energy);
+    /**
+     * Compute the interaction for this thread's particles by interpolating the grid, four particles at a time.
+     */
+    void computeGrid(int start, int end, double& energy);
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPU_CUSTOM_EXTERNAL_FORCE_H_*/
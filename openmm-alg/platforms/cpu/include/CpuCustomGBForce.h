@@ -26,6 +26,7 @@
 #define OPENMM_CPU_CUSTOM_GB_FORCE_H__
 
 #include "CompiledExpressionSet.h"
+#include "CpuExclusions.h"
 #include "CpuNeighborList.h"
 #include "lepton/CompiledExpression.h"
 #include "openmm/CustomGBForce.h"
@@ -47,7 +48,7 @@ private:
     const CpuNeighborList* neighborList;
     float periodicBoxSize[3];
     float cutoffDistance, cutoffDistance2;
-    const std::vector<std::set<int> > exclusions;
+    const CpuExclusions& exclusions;
     std::vector<std::string> valueNames;
     std::vector<CustomGBForce::ComputationType> valueTypes;
     std::vector<std::string> paramNames;
@@ -67,9 +68,13 @@ private:
     void* atomicCounter;
     
     /**
-     * This routine contains the code executed by each thread.
+     * This routine contains the code executed by each thread.  The calculation is divided into phases,
+     * which are executed as separate tasks: the first computed value, the remaining computed values,
+     * one phase for each energy term, summing the energy derivatives, and applying the chain rule.
+     *
+     * @param phase   the phase of the calculation to perform
      */
-    void threadComputeForce(ThreadPool& threads, int threadIndex);
+    void threadComputeForce(ThreadPool& threads, int threadIndex, int phase);
 
     /**
      * Calculate a computed value that is based on particle pairs
@@ -185,7 +190,7 @@ public:
      * Construct a new CpuCustomGBForce.
      */
 
-     CpuCustomGBForce(int numAtoms, const std::vector<std::set<int> >& exclusions,
+     CpuCustomGBForce(int numAtoms, const CpuExclusions& exclusions,
                         const std::vector<Lepton::CompiledExpression>& valueExpressions,
                         const std::vector<std::vector<Lepton::CompiledExpression> >& valueDerivExpressions,
                         const std::vector<std::vector<Lepton::CompiledExpression> >& valueGradientExpressions,
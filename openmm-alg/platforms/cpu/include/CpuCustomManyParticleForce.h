@@ -27,8 +27,9 @@
 
 #include "ReferenceForce.h"
 #include "ReferenceBondIxn.h"
+#include "AlignedArray.h"
 #include "CompiledExpressionSet.h"
-#include "CpuNeighborList.h"
+#include "CpuExclusions.h"
 #include "openmm/CustomManyParticleForce.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
@@ -49,20 +50,28 @@ private:
     class AngleTermInfo;
     class DihedralTermInfo;
     class ComputeForceTask;
+    class BuildNeighborsTask;
     class ThreadData;
     int numParticles, numParticlesPerSet, numPerParticleParameters, numTypes;
     bool useCutoff, usePeriodic, triclinic, centralParticleMode;
-    RealOpenMM cutoffDistance;
+    RealOpenMM cutoffDistance, neighborPadding;
     float recipBoxSize[3];
     RealVec periodicBoxVectors[3];
     AlignedArray<fvec4> periodicBoxVec4;
-    CpuNeighborList* neighborList;
     ThreadPool& threads;
-    std::vector<std::set<int> > exclusions;
+    CpuExclusions exclusions;
     std::vector<int> particleTypes;
     std::vector<int> orderIndex;
     std::vector<std::vector<int> > particleOrder;
     std::vector<std::vector<int> > particleNeighbors;
+    // The following variables describe the cell list used to build the neighbor list.
+    bool neighborListValid;
+    int numCells[3];
+    std::vector<int> particleCell;
+    std::vector<int> cellStart;
+    std::vector<int> cellParticles;
+    std::vector<float> neighborListPositions;
+    RealVec neighborListBoxVectors[3];
     std::vector<ThreadData*> threadData;
     // The following variables are used to make information accessible to the individual threads.
     float* posq;
@@ -77,6 +86,23 @@ private:
      */
     void threadComputeForce(ThreadPool& threads, int threadIndex);
 
+    /**
+     * Determine whether the neighbor list built on a previous step can still be used.  This is true
+     * as long as the periodic box has not changed and no particle has moved more than half the padding
+     * distance since it was built.
+     */
+    bool isNeighborListValid() const;
+
+    /**
+     * Sort the particles into cells whose size is at least the cutoff plus padding.
+     */
+    void buildCells();
+
+    /**
+     * This routine contains the code executed by each thread to build the neighbor list.
+     */
+    void threadBuildNeighbors(ThreadPool& threads, int threadIndex);
+
     /**
      * This is called recursively to loop over all possible combination of a set of particles and evaluate the
      * interaction for each one.
@@ -114,6 +140,12 @@ private:
     void computeDelta(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, const fvec4& boxSize, const fvec4& invBoxSize) const;
     
     static float computeAngle(const fvec4& vi, const fvec4& vj, float v2i, float v2j, float sign);
+
+    /**
+     * Compute the angles for up to four angle terms at once, starting from the term with index
+     * firstTerm.  The results are stored in data.angles.
+     */
+    static void computeAngles(ThreadData& data, int firstTerm);
     
     static float getDihedralAngleBetweenThreeVectors(const fvec4& v1, const fvec4& v2, const fvec4& v3, fvec4& cross1, fvec4& cross2, const fvec4& signVector);
 
@@ -163,43 +195,45 @@ class CpuCustomManyParticleForce::ParticleTermInfo {
 public:
     std::string name;
     int atom, component, variableIndex;
-    Lepton::CompiledExpression forceExpression;
-    ParticleTermInfo(const std::string& name, int atom, int component, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    int outputIndex;
+    ParticleTermInfo(const std::string& name, int atom, int component, int outputIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::DistanceTermInfo {
 public:
     std::string name;
     int p1, p2, variableIndex;
-    Lepton::CompiledExpression forceExpression;
+    int outputIndex;
     int delta;
     float deltaSign;
-    DistanceTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    DistanceTermInfo(const std::string& name, const std::vector<int>& atoms, int outputIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::AngleTermInfo {
 public:
     std::string name;
     int p1, p2, p3, variableIndex;
-    Lepton::CompiledExpression forceExpression;
+    int outputIndex;
     int delta1, delta2;
     float delta1Sign, delta2Sign;
-    AngleTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    AngleTermInfo(const std::string& name, const std::vector<int>& atoms, int outputIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::DihedralTermInfo {
 public:
     std::string name;
     int p1, p2, p3, p4, variableIndex;
-    Lepton::CompiledExpression forceExpression;
+    int outputIndex;
     int delta1, delta2, delta3;
-    DihedralTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    DihedralTermInfo(const std::string& name, const std::vector<int>& atoms, int outputIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::ThreadData {
 public:
     CompiledExpressionSet expressionSet;
     Lepton::CompiledExpression energyExpression;
+    // Output 0 is the energy, and the remaining outputs are the derivatives used by the force terms.
+    Lepton::CompiledExpression energyAndForceExpression;
     std::vector<std::vector<int> > particleParamIndices;
     std::vector<int> permutedParticles;
     std::vector<std::pair<int, int> > deltaPairs;
@@ -210,6 +244,7 @@ public:
     AlignedArray<fvec4> delta, cross1, cross2;
     std::vector<float> normDelta;
     std::vector<float> norm2Delta;
+    std::vector<float> angles;
     AlignedArray<fvec4> f;
     double energy;
     ThreadData(const CustomManyParticleForce& force, Lepton::ParsedExpression& energyExpr,
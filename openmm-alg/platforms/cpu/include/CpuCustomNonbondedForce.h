@@ -26,7 +26,9 @@
 #define OPENMM_CPU_CUSTOM_NONBONDED_FORCE_H__
 
 #include "AlignedArray.h"
+#include "CpuExclusions.h"
 #include "CpuNeighborList.h"
+#include "CpuTabulatedFunction.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
 #include "lepton/CompiledExpression.h"
@@ -44,10 +46,15 @@ class CpuCustomNonbondedForce {
 
          Constructor
 
+         @param energyExpression           the expression for the energy
+         @param energyAndForceExpression   an expression with two outputs: the energy and its derivative with
+                                           respect to r.  It is used when forces are needed, so the energy and
+                                           force share any common subexpressions.
+
          --------------------------------------------------------------------------------------- */
 
-       CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
-                                   const std::vector<std::string>& parameterNames, const std::vector<std::set<int> >& exclusions, ThreadPool& threads);
+       CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& energyAndForceExpression,
+                                   const std::vector<std::string>& parameterNames, const CpuExclusions& exclusions, ThreadPool& threads);
 
       /**---------------------------------------------------------------------------------------
 
@@ -101,6 +108,19 @@ class CpuCustomNonbondedForce {
 
       void setPeriodic(RealVec* periodicBoxVectors);
 
+      /**---------------------------------------------------------------------------------------
+
+         Specify that the energy is a tabulated function of r, optionally multiplied by a constant.
+         Interactions taken from the neighbor list are then computed four at a time, evaluating
+         the spline directly instead of through the compiled expressions.
+
+         @param function            the function giving the energy as a function of r
+         @param scale               a constant factor the function is multiplied by
+
+         --------------------------------------------------------------------------------------- */
+
+      void setTabulatedPotential(const CpuContinuous1DFunction& function, double scale);
+
       /**---------------------------------------------------------------------------------------
 
          Calculate custom pair ixn
@@ -128,13 +148,17 @@ private:
     bool useSwitch;
     bool periodic;
     bool triclinic;
+    bool useTable;
     const CpuNeighborList* neighborList;
     float recipBoxSize[3];
     RealVec periodicBoxVectors[3];
     AlignedArray<fvec4> periodicBoxVec4;
     RealOpenMM cutoffDistance, switchingDistance;
+    float tableMin, tableMax, tableInvDelta;
+    int tableIntervals;
+    AlignedArray<float> tableCoeff;
     ThreadPool& threads;
-    const std::vector<std::set<int> > exclusions;
+    const CpuExclusions& exclusions;
     std::vector<ThreadData*> threadData;
     std::vector<std::string> paramNames;
     std::vector<std::pair<int, int> > groupInteractions;
@@ -167,6 +191,17 @@ private:
      */
     void calculateOneIxn(int atom1, int atom2, ThreadData& data, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
 
+    /**
+     * Calculate the interactions of one block of the neighbor list with a tabulated potential.
+     * 
+     * @param blockIndex       the index of the block
+     * @param forces           force array (forces added)
+     * @param totalEnergy      total energy
+     * @param boxSize          the size of the periodic box
+     * @param boxSize          the inverse size of the periodic box
+     */
+    void calculateBlockTableIxn(int blockIndex, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+
     /**
      * Compute the displacement and squared distance between two points, optionally using
      * periodic boundary conditions.
@@ -176,9 +211,9 @@ private:
 
 class CpuCustomNonbondedForce::ThreadData {
 public:
-    ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression, const std::vector<std::string>& parameterNames);
+    ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& energyAndForceExpression, const std::vector<std::string>& parameterNames);
     Lepton::CompiledExpression energyExpression;
-    Lepton::CompiledExpression forceExpression;
+    Lepton::CompiledExpression energyAndForceExpression;
     std::vector<double*> energyParticleParams;
     std::vector<double*> forceParticleParams;
     double* energyR;
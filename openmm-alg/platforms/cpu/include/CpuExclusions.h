@@ -0,0 +1,127 @@
+#ifndef OPENMM_CPU_EXCLUSIONS_H_
+#define OPENMM_CPU_EXCLUSIONS_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "windowsExportCpu.h"
+#include "openmm/internal/ThreadPool.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class records which pairs of atoms are excluded from interacting with each other.  It
+ * stores them in compressed sparse row format: the atoms excluded from atom i are stored in sorted
+ * order in a single array, starting at the position given by the row offset for atom i.  This uses
+ * much less memory than a set for each atom, and allows the exclusions of an atom to be scanned
+ * sequentially.
+ * 
+ * Once created, a CpuExclusions is immutable.  This allows a single copy to be shared by every kernel
+ * in a Context that uses the same exclusions (see CpuPlatform::PlatformData::shareExclusions()).
+ */
+class OPENMM_EXPORT_CPU CpuExclusions {
+public:
+    /**
+     * Create an object in which no atoms are excluded.
+     * 
+     * @param numAtoms    the number of atoms in the system
+     */
+    CpuExclusions(int numAtoms);
+    /**
+     * Create an object from a list of excluded pairs.  Every pair is excluded symmetrically.
+     * Duplicate pairs and pairs of an atom with itself are ignored.
+     * 
+     * @param numAtoms       the number of atoms in the system
+     * @param excludedPairs  the pairs of atoms to exclude
+     */
+    CpuExclusions(int numAtoms, const std::vector<std::pair<int, int> >& excludedPairs);
+    /**
+     * Create an object from a list of excluded pairs, dividing the work of sorting the exclusions
+     * for each atom between the threads of a ThreadPool.  The result is identical to that of the
+     * single threaded constructor.
+     * 
+     * @param numAtoms       the number of atoms in the system
+     * @param excludedPairs  the pairs of atoms to exclude
+     * @param threads        the thread pool to use
+     */
+    CpuExclusions(int numAtoms, const std::vector<std::pair<int, int> >& excludedPairs, ThreadPool& threads);
+    /**
+     * Get the number of atoms in the system.
+     */
+    int getNumAtoms() const {
+        return rowStart.size()-1;
+    }
+    /**
+     * Get the total number of excluded pairs.  Each pair is counted once.
+     */
+    int getNumExcludedPairs() const {
+        return (excluded.size()-1)/2;
+    }
+    /**
+     * Get a pointer to the first atom excluded from an atom.  The excluded atoms are sorted in increasing order.
+     */
+    const int* begin(int atom) const {
+        return &excluded[0]+rowStart[atom];
+    }
+    /**
+     * Get a pointer just past the last atom excluded from an atom.
+     */
+    const int* end(int atom) const {
+        return &excluded[0]+rowStart[atom+1];
+    }
+    /**
+     * Get whether two atoms are excluded from interacting with each other.
+     */
+    bool isExcluded(int atom1, int atom2) const {
+        const int* first = begin(atom1);
+        const int* last = end(atom1);
+        if (first == last || atom2 < first[0] || atom2 > last[-1])
+            return false;
+        return std::binary_search(first, last, atom2);
+    }
+    bool operator==(const CpuExclusions& other) const;
+private:
+    class SortRowsTask;
+    class CopyRowsTask;
+    /**
+     * Build the rows from a list of excluded pairs.  If threads is NULL, all the work is done on
+     * the calling thread.
+     */
+    void build(const std::vector<std::pair<int, int> >& excludedPairs, ThreadPool* threads);
+    std::vector<int> rowStart, excluded;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPU_EXCLUSIONS_H_*/
@@ -26,6 +26,7 @@
 #define OPENMM_CPU_GBSAOBC_FORCE_H__
 
 #include "AlignedArray.h"
+#include "CpuNeighborList.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
 #include <set>
@@ -43,8 +44,9 @@ public:
      * Set the force to use a cutoff.
      * 
      * @param distance    the cutoff distance
+     * @param neighbors   the neighbor list to use
      */
-    void setUseCutoff(float distance);
+    void setUseCutoff(float distance, const CpuNeighborList& neighbors);
 
     /**
      * 
@@ -93,19 +95,36 @@ public:
     void computeForce(const AlignedArray<float>& posq, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads);
 
     /**
-     * This routine contains the code executed by each thread.
+     * This routine contains the code executed by each thread.  The calculation is divided into phases,
+     * which are executed as separate tasks so that each one can rely on the results of the previous one.
+     *
+     * @param phase   the phase of the calculation to perform
      */
-    void threadComputeForce(ThreadPool& threads, int threadIndex);
+    void threadComputeForce(ThreadPool& threads, int threadIndex, int phase);
 
 private:
+    /**
+     * Compute the force with an O(N^2) loop over all pairs of atoms.
+     */
+    void threadComputeAllPairs(ThreadPool& threads, int threadIndex, int phase);
+
+    /**
+     * Compute the force by looping over the pairs in the neighbor list.  Each pair is visited
+     * once per pass, and its contributions to both atoms are accumulated at the same time.
+     */
+    void threadComputeNeighborPairs(ThreadPool& threads, int threadIndex, int phase);
+
     bool cutoff;
     bool periodic;
     float periodicBoxSize[3];
+    const CpuNeighborList* neighborList;
     float cutoffDistance, soluteDielectric, solventDielectric, surfaceAreaFactor;
     std::vector<std::pair<float, float> > particleParams;        
     AlignedArray<float> bornRadii;
     std::vector<AlignedArray<float> > threadBornForces;
+    std::vector<AlignedArray<float> > threadBornSums;
     AlignedArray<float> obcChain;
+    AlignedArray<float> bornForceTotal;
     std::vector<double> threadEnergy;
     std::vector<float> logTable;
     float logDX, logDXInv;
@@ -125,6 +144,17 @@ private:
      */
     void getDeltaR(const fvec4& posI, const fvec4& x, const fvec4& y, const fvec4& z, fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const;
     
+    /**
+     * Compute the contribution of atom J to the Born radius sum of atom I.
+     */
+    fvec4 computeBornSumTerm(const fvec4& r, const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ);
+
+    /**
+     * Compute the chain rule factor for the derivative of atom I's Born radius with respect to
+     * its distance from atom J.
+     */
+    fvec4 computeBornChainTerm(const fvec4& r, const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ);
+
     /**
      * Evaluate log(x) using a lookup table for speed.
      */
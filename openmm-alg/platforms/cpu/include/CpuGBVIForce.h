@@ -0,0 +1,170 @@
+
+/* Portions copyright (c) 2015 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OPENMM_CPU_GBVI_FORCE_H__
+#define OPENMM_CPU_GBVI_FORCE_H__
+
+#include "AlignedArray.h"
+#include "CpuNeighborList.h"
+#include "openmm/internal/ThreadPool.h"
+#include "openmm/internal/vectorize.h"
+#include <vector>
+
+namespace OpenMM {
+
+class CpuGBVIForce {
+public:
+    class ComputeTask;
+    CpuGBVIForce();
+
+    /**
+     * Set the force to use a cutoff.
+     * 
+     * @param distance    the cutoff distance
+     * @param neighbors   the neighbor list to use
+     */
+    void setUseCutoff(float distance, const CpuNeighborList& neighbors);
+
+    /**
+     * 
+     * Set the force to use periodic boundary conditions.  This requires that a cutoff has
+     * already been set, and the smallest side of the periodic box is at least twice the cutoff
+     * distance.
+     *
+     * @param boxSize             the X, Y, and Z widths of the periodic box
+     */
+    void setPeriodic(float* periodicBoxSize);
+
+    /**
+     * Set the solute dielectric constant.
+     */
+    void setSoluteDielectric(float dielectric);
+
+    /**
+     * Set the solvent dielectric constant.
+     */
+    void setSolventDielectric(float dielectric);
+
+    /**
+     * Set whether to smoothly limit the Born radii with a quintic spline, and the parameters of the spline.
+     *
+     * @param useSpline         whether to use the quintic spline
+     * @param lowerLimitFactor  the spline starts at this fraction of the inverse cubed atomic radius
+     * @param upperLimit        the upper limit of the spline, as returned by GBVIForce::getQuinticUpperBornRadiusLimit()
+     */
+    void setUseQuinticSpline(bool useSpline, float lowerLimitFactor, float upperLimit);
+
+    /**
+     * Get the atomic radius of each particle.
+     */
+    const std::vector<float>& getAtomicRadii() const;
+
+    /**
+     * Set the per-particle parameters.
+     *
+     * @param radii          the atomic radius of each particle
+     * @param scaledRadii    the scaled radius of each particle
+     * @param gammas         the gamma parameter of each particle
+     */
+    void setParticleParameters(const std::vector<float>& radii, const std::vector<float>& scaledRadii, const std::vector<float>& gammas);
+
+    /**
+     * Calculate the GB/VI forces and energy.
+     *
+     * @param posq             atom coordinates and charges
+     * @param threadForce      the force array for each thread (forces added)
+     * @param totalEnergy      total energy
+     * @param threads          the thread pool to use
+     */
+    void computeForce(const AlignedArray<float>& posq, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads);
+
+    /**
+     * This routine contains the code executed by each thread.  The calculation is divided into phases,
+     * which are executed as separate tasks so that each one can rely on the results of the previous one.
+     *
+     * @param phase   the phase of the calculation to perform
+     */
+    void threadComputeForce(ThreadPool& threads, int threadIndex, int phase);
+
+private:
+    /**
+     * Compute the force with an O(N^2) loop over all pairs of atoms.
+     */
+    void threadComputeAllPairs(ThreadPool& threads, int threadIndex, int phase);
+
+    /**
+     * Compute the force by looping over the pairs in the neighbor list.  Each pair is visited
+     * once per pass, and its contributions to both atoms are accumulated at the same time.
+     */
+    void threadComputeNeighborPairs(ThreadPool& threads, int threadIndex, int phase);
+
+    /**
+     * Compute the Born radius of an atom from its volume sum, along with the factor by which the
+     * quintic spline scales the derivative.
+     */
+    void computeBornRadius(int atom, float sum);
+
+    bool cutoff;
+    bool periodic;
+    bool useQuinticSpline;
+    float periodicBoxSize[3];
+    const CpuNeighborList* neighborList;
+    float cutoffDistance, soluteDielectric, solventDielectric, quinticLowerLimitFactor, quinticUpperLimit;
+    std::vector<float> atomicRadii, scaledRadii, gammas;
+    AlignedArray<float> bornRadii;
+    std::vector<AlignedArray<float> > threadBornForces;
+    std::vector<AlignedArray<float> > threadBornSums;
+    AlignedArray<float> switchDerivative;
+    AlignedArray<float> bornForceTotal;
+    std::vector<double> threadEnergy;
+    // The following variables are used to make information accessible to the individual threads.
+    float const* posq;
+    std::vector<AlignedArray<float> >* threadForce;
+    bool includeEnergy;
+    void* atomicCounter;
+
+    /**
+     * Compute the displacement and squared distance between a collection of points, optionally using
+     * periodic boundary conditions.
+     */
+    void getDeltaR(const fvec4& posI, const fvec4& x, const fvec4& y, const fvec4& z, fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const;
+
+    /**
+     * Compute the volume of atom J's scaled sphere that lies outside atom I, which is atom J's
+     * contribution to the Born radius sum of atom I (Eq. 4 of Labute, JCC 29 p. 1693-1698 2008).
+     */
+    fvec4 computeVolume(const fvec4& r, const fvec4& radiusI, const fvec4& scaledRadiusJ) const;
+
+    /**
+     * Compute the derivative of computeVolume() with respect to r.
+     */
+    fvec4 computeVolumeDerivative(const fvec4& r, const fvec4& radiusI, const fvec4& scaledRadiusJ) const;
+};
+
+} // namespace OpenMM
+
+// ---------------------------------------------------------------------------------------
+
+#endif // OPENMM_CPU_GBVI_FORCE_H__
@@ -33,14 +33,19 @@
  * -------------------------------------------------------------------------- */
 
 #include "CpuBondForce.h"
+#include "CpuCustomExternalForce.h"
 #include "CpuCustomGBForce.h"
 #include "CpuCustomManyParticleForce.h"
 #include "CpuCustomNonbondedForce.h"
 #include "CpuGBSAOBCForce.h"
+#include "CpuGBVIForce.h"
+#include "CpuLJCoulomb14.h"
 #include "CpuLangevinDynamics.h"
 #include "CpuNeighborList.h"
 #include "CpuNonbondedForce.h"
 #include "CpuPlatform.h"
+#include "CpuVariableLangevinDynamics.h"
+#include "CpuVariableVerletDynamics.h"
 #include "openmm/kernels.h"
 #include "openmm/System.h"
 
@@ -88,6 +93,7 @@ public:
 private:
     CpuPlatform::PlatformData& data;
     Kernel referenceKernel;
+    double computationStartTime;
 };
 
 /**
@@ -95,6 +101,7 @@ private:
  */
 class CpuCalcPeriodicTorsionForceKernel : public CalcPeriodicTorsionForceKernel {
 public:
+    class CopyParametersTask;
     CpuCalcPeriodicTorsionForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) :
             CalcPeriodicTorsionForceKernel(name, platform), data(data), torsionIndexArray(NULL), torsionParamArray(NULL) {
     }
@@ -135,6 +142,7 @@ private:
  */
 class CpuCalcRBTorsionForceKernel : public CalcRBTorsionForceKernel {
 public:
+    class CopyParametersTask;
     CpuCalcRBTorsionForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) :
             CalcRBTorsionForceKernel(name, platform), data(data), torsionIndexArray(NULL), torsionParamArray(NULL) {
     }
@@ -175,6 +183,7 @@ private:
  */
 class CpuCalcNonbondedForceKernel : public CalcNonbondedForceKernel {
 public:
+    class CopyParametersTask;
     CpuCalcNonbondedForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data);
     ~CpuCalcNonbondedForceKernel();
     /**
@@ -202,18 +211,46 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const NonbondedForce& force);
+    /**
+     * Copy changed parameters for a range of particles and a range of exceptions over to a context.
+     * The work done is proportional to the number of particles and exceptions being updated.
+     *
+     * @param context          the context to copy parameters to
+     * @param force            the NonbondedForce to copy the parameters from
+     * @param firstParticle    the index of the first particle to copy
+     * @param numParticles     the number of consecutive particles to copy
+     * @param firstException   the index of the first exception to copy
+     * @param numExceptions    the number of consecutive exceptions to copy
+     */
+    void copySomeParametersToContext(ContextImpl& context, const NonbondedForce& force, int firstParticle, int numParticles, int firstException, int numExceptions);
 private:
     class PmeIO;
+    /**
+     * Select the PME interpolation order and grid size by timing several combinations that give the
+     * requested accuracy, and create the optimized PME kernel with the fastest one.
+     */
+    void tunePmeParameters(ContextImpl& context);
+    /**
+     * Compute the reciprocal space part of the Ewald or PME sum for a set of charges.  The forces are
+     * multiplied by scale before being added, while the energy is returned unscaled.
+     */
+    double computeReciprocal(ContextImpl& context, float* posq, double scale, bool includeForces, bool includeEnergy);
     CpuPlatform::PlatformData& data;
     int numParticles, num14;
     int **bonded14IndexArray;
     double **bonded14ParamArray;
-    double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldSelfEnergy, dispersionCoefficient;
+    double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldErrorTolerance, ewaldSelfEnergy, dispersionCoefficient, sumSquaredCharges, softcoreAlpha;
     int kmax[3], gridSize[3];
-    bool useSwitchingFunction, useOptimizedPme, hasInitializedPme;
-    std::vector<std::set<int> > exclusions;
+    long long numNeighborPairs;
+    bool useSwitchingFunction, useOptimizedPme, hasInitializedPme, canTunePme, hasAlchemical;
+    const CpuExclusions* exclusions;
     std::vector<std::pair<float, float> > particleParams;
+    std::vector<double> particleCharges;
+    std::vector<float> isAlchemical;
+    AlignedArray<float> alchemicalPosq[2];
+    std::vector<int> exceptionIndex;
     std::vector<RealVec> lastPositions;
+    CpuLJCoulomb14 nonbonded14;
     NonbondedMethod nonbondedMethod;
     CpuNeighborList* neighborList;
     CpuNonbondedForce* nonbonded;
@@ -258,7 +295,7 @@ private:
     bool useSwitchingFunction, hasInitializedLongRangeCorrection;
     CustomNonbondedForce* forceCopy;
     std::map<std::string, double> globalParamValues;
-    std::vector<std::set<int> > exclusions;
+    const CpuExclusions* exclusions;
     std::vector<std::string> parameterNames, globalParameterNames;
     std::vector<std::pair<std::set<int>, std::set<int> > > interactionGroups;
     NonbondedMethod nonbondedMethod;
@@ -272,7 +309,7 @@ private:
 class CpuCalcGBSAOBCForceKernel : public CalcGBSAOBCForceKernel {
 public:
     CpuCalcGBSAOBCForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcGBSAOBCForceKernel(name, platform),
-            data(data) {
+            data(data), neighborList(NULL) {
     }
     ~CpuCalcGBSAOBCForceKernel();
     /**
@@ -301,9 +338,46 @@ public:
 private:
     CpuPlatform::PlatformData& data;
     std::vector<std::pair<float, float> > particleParams;
+    const CpuExclusions* noExclusions;
+    float cutoffDistance;
+    CpuNeighborList* neighborList;
     CpuGBSAOBCForce obc;
 };
 
+/**
+ * This kernel is invoked by GBVIForce to calculate the forces acting on the system.
+ */
+class CpuCalcGBVIForceKernel : public CalcGBVIForceKernel {
+public:
+    CpuCalcGBVIForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcGBVIForceKernel(name, platform),
+            data(data), neighborList(NULL) {
+    }
+    ~CpuCalcGBVIForceKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system       the System this kernel will be applied to
+     * @param force        the GBVIForce this kernel will be used for
+     * @param scaledRadii  the scaled radius of each particle
+     */
+    void initialize(const System& system, const GBVIForce& force, const std::vector<double>& scaledRadii);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+private:
+    CpuPlatform::PlatformData& data;
+    const CpuExclusions* noExclusions;
+    float cutoffDistance;
+    CpuNeighborList* neighborList;
+    CpuGBVIForce gbvi;
+};
+
 /**
  * This kernel is invoked by CustomGBForce to calculate the forces acting on the system.
  */
@@ -343,7 +417,7 @@ private:
     RealOpenMM **particleParamArray;
     RealOpenMM nonbondedCutoff;
     CpuCustomGBForce* ixn;
-    std::vector<std::set<int> > exclusions;
+    const CpuExclusions* exclusions;
     std::vector<std::string> particleParameterNames, globalParameterNames, valueNames;
     std::vector<OpenMM::CustomGBForce::ComputationType> valueTypes;
     std::vector<OpenMM::CustomGBForce::ComputationType> energyTypes;
@@ -393,6 +467,88 @@ private:
     NonbondedMethod nonbondedMethod;
 };
 
+/**
+ * This kernel is invoked by CustomExternalForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcCustomExternalForceKernel : public CalcCustomExternalForceKernel {
+public:
+    CpuCalcCustomExternalForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcCustomExternalForceKernel(name, platform),
+            data(data), ixn(NULL) {
+    }
+    ~CpuCalcCustomExternalForceKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomExternalForce this kernel will be used for
+     */
+    void initialize(const System& system, const CustomExternalForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Copy changed parameters over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the CustomExternalForce to copy the parameters from
+     */
+    void copyParametersToContext(ContextImpl& context, const CustomExternalForce& force);
+private:
+    CpuPlatform::PlatformData& data;
+    std::vector<int> particles;
+    CpuCustomExternalForce* ixn;
+    std::vector<std::string> globalParameterNames;
+};
+
+/**
+ * This kernel is invoked by CustomCompoundBondForce to calculate the forces acting on the system and the energy of the system.
+ * Forces whose bonds each contain a single particle, and whose energy does not involve distances, angles,
+ * or dihedrals, are computed in parallel with a CpuCustomExternalForce.  This includes grid potentials
+ * defined by a Continuous3DFunction of x1, y1, and z1.  All others are computed with the Reference implementation.
+ */
+class CpuCalcCustomCompoundBondForceKernel : public CalcCustomCompoundBondForceKernel {
+public:
+    CpuCalcCustomCompoundBondForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcCustomCompoundBondForceKernel(name, platform),
+            data(data), ixn(NULL) {
+    }
+    ~CpuCalcCustomCompoundBondForceKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomCompoundBondForce this kernel will be used for
+     */
+    void initialize(const System& system, const CustomCompoundBondForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Copy changed parameters over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the CustomCompoundBondForce to copy the parameters from
+     */
+    void copyParametersToContext(ContextImpl& context, const CustomCompoundBondForce& force);
+private:
+    CpuPlatform::PlatformData& data;
+    std::vector<int> particles;
+    CpuCustomExternalForce* ixn;
+    Kernel referenceKernel;
+    std::vector<std::string> globalParameterNames;
+};
+
 /**
  * This kernel is invoked by LangevinIntegrator to take one time step.
  */
@@ -430,6 +586,84 @@ private:
     double prevTemp, prevFriction, prevStepSize;
 };
 
+/**
+ * This kernel is invoked by VariableLangevinIntegrator to take one time step.
+ */
+class CpuIntegrateVariableLangevinStepKernel : public IntegrateVariableLangevinStepKernel {
+public:
+    CpuIntegrateVariableLangevinStepKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : IntegrateVariableLangevinStepKernel(name, platform),
+            data(data), dynamics(NULL) {
+    }
+    ~CpuIntegrateVariableLangevinStepKernel();
+    /**
+     * Initialize the kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param integrator the VariableLangevinIntegrator this kernel will be used for
+     */
+    void initialize(const System& system, const VariableLangevinIntegrator& integrator);
+    /**
+     * Execute the kernel.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableLangevinIntegrator this kernel is being used for
+     * @param maxTime    the maximum time beyond which the simulation should not be advanced
+     * @return the size of the step that was taken
+     */
+    double execute(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime);
+    /**
+     * Compute the kinetic energy.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableLangevinIntegrator this kernel is being used for
+     */
+    double computeKineticEnergy(ContextImpl& context, const VariableLangevinIntegrator& integrator);
+private:
+    CpuPlatform::PlatformData& data;
+    CpuVariableLangevinDynamics* dynamics;
+    std::vector<RealOpenMM> masses;
+    double prevTemp, prevFriction, prevErrorTol;
+};
+
+/**
+ * This kernel is invoked by VariableVerletIntegrator to take one time step.
+ */
+class CpuIntegrateVariableVerletStepKernel : public IntegrateVariableVerletStepKernel {
+public:
+    CpuIntegrateVariableVerletStepKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : IntegrateVariableVerletStepKernel(name, platform),
+            data(data), dynamics(NULL) {
+    }
+    ~CpuIntegrateVariableVerletStepKernel();
+    /**
+     * Initialize the kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param integrator the VariableVerletIntegrator this kernel will be used for
+     */
+    void initialize(const System& system, const VariableVerletIntegrator& integrator);
+    /**
+     * Execute the kernel.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableVerletIntegrator this kernel is being used for
+     * @param maxTime    the maximum time beyond which the simulation should not be advanced
+     * @return the size of the step that was taken
+     */
+    double execute(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime);
+    /**
+     * Compute the kinetic energy.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableVerletIntegrator this kernel is being used for
+     */
+    double computeKineticEnergy(ContextImpl& context, const VariableVerletIntegrator& integrator);
+private:
+    CpuPlatform::PlatformData& data;
+    CpuVariableVerletDynamics* dynamics;
+    std::vector<RealOpenMM> masses;
+    double prevErrorTol;
+};
+
 } // namespace OpenMM
 
 #endif /*OPENMM_CPUKERNELS_H_*/
@@ -0,0 +1,94 @@
+#ifndef OPENMM_CPU_LJ_COULOMB14_H_
+#define OPENMM_CPU_LJ_COULOMB14_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuBondForce.h"
+#include "RealVec.h"
+#include "windowsExportCpu.h"
+#include "openmm/internal/ThreadPool.h"
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class computes the nonbonded exceptions (1-4 interactions) of a NonbondedForce.  CpuBondForce divides
+ * the pairs between threads so that no two threads modify the force on the same atom.  Each thread then evaluates
+ * its pairs four at a time with SIMD instructions.  The interaction is the same as in ReferenceLJCoulomb14: a
+ * Lennard-Jones and a Coulomb term with no cutoff and no periodic boundary conditions.
+ */
+class OPENMM_EXPORT_CPU CpuLJCoulomb14 {
+public:
+    class ComputeForceTask;
+    CpuLJCoulomb14();
+    /**
+     * Decide which pairs to compute with each thread.  This must be called again if the atoms in any pair change.
+     * 
+     * @param numAtoms     the number of atoms in the system
+     * @param numPairs     the number of pairs
+     * @param pairAtoms    the indices of the two atoms in each pair
+     * @param threads      the ThreadPool to use for computing the pairs
+     */
+    void initialize(int numAtoms, int numPairs, int** pairAtoms, ThreadPool& threads);
+    /**
+     * Compute the forces from all pairs.
+     * 
+     * @param atomCoordinates  the atom coordinates
+     * @param parameters       the parameters of each pair: sigma, 4*epsilon, and the charge product
+     * @param forces           the forces are added to this
+     * @param totalEnergy      if this is not NULL, the energy is added to it
+     */
+    void calculateForce(std::vector<OpenMM::RealVec>& atomCoordinates, RealOpenMM** parameters, std::vector<OpenMM::RealVec>& forces,
+            RealOpenMM* totalEnergy);
+    /**
+     * This routine contains the code executed by each thread.
+     */
+    void threadComputeForce(ThreadPool& threads, int threadIndex);
+private:
+    /**
+     * Compute a list of pairs, four at a time.
+     */
+    void computePairs(const std::vector<int>& pairs, double* energy);
+    int** pairAtoms;
+    ThreadPool* threads;
+    CpuBondForce partition;
+    std::vector<double> threadEnergy;
+    // The following variables are used to make information accessible to the individual threads.
+    std::vector<OpenMM::RealVec>* atomCoordinates;
+    RealOpenMM** parameters;
+    std::vector<OpenMM::RealVec>* forces;
+    bool includeEnergy;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPU_LJ_COULOMB14_H_*/
@@ -28,6 +28,7 @@
 
 #include "ReferenceStochasticDynamics.h"
 #include "CpuRandom.h"
+#include "CpuVirtualSites.h"
 #include "openmm/internal/ThreadPool.h"
 #include "sfmt/SFMT.h"
 
@@ -37,6 +38,7 @@ class CpuLangevinDynamics : public ReferenceStochasticDynamics {
 public:
     class Update1Task;
     class Update2Task;
+    class Update3Task;
     /**
      * Constructor.
      *
@@ -46,8 +48,10 @@ public:
      * @param temperature    temperature
      * @param threads        thread pool for parallelizing computation
      * @param random         random number generator
+     * @param virtualSites   used for computing the positions of virtual sites
      */
-    CpuLangevinDynamics(int numberOfAtoms, RealOpenMM deltaT, RealOpenMM tau, RealOpenMM temperature, OpenMM::ThreadPool& threads, OpenMM::CpuRandom& random);
+    CpuLangevinDynamics(int numberOfAtoms, RealOpenMM deltaT, RealOpenMM tau, RealOpenMM temperature, OpenMM::ThreadPool& threads, OpenMM::CpuRandom& random,
+                        OpenMM::CpuVirtualSites& virtualSites);
 
     /**
      * Destructor.
@@ -80,12 +84,27 @@ public:
     void updatePart2(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& velocities,
                      std::vector<OpenMM::RealVec>& forces, std::vector<RealOpenMM>& inverseMasses, std::vector<OpenMM::RealVec>& xPrime);
 
+    /**
+     * Third update step.
+     * 
+     * @param system              the System being integrated
+     * @param atomCoordinates     atom coordinates
+     * @param velocities          velocities
+     * @param inverseMasses       inverse atom masses
+     * @param xPrime              xPrime
+     */
+    void updatePart3(const OpenMM::System& system, std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& velocities,
+                     std::vector<RealOpenMM>& inverseMasses, std::vector<OpenMM::RealVec>& xPrime);
+
 private:
     void threadUpdate1(int threadIndex);
     void threadUpdate2(int threadIndex);
+    void threadUpdate3(int threadIndex);
     OpenMM::ThreadPool& threads;
     OpenMM::CpuRandom& random;
+    OpenMM::CpuVirtualSites& virtualSites;
     std::vector<OpenMM_SFMT::SFMT> threadRandom;
+    std::vector<std::vector<float> > threadNoise;
     // The following variables are used to make information accessible to the individual threads.
     int numberOfAtoms;
     OpenMM::RealVec* atomCoordinates;
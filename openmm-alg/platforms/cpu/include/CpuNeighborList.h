@@ -33,10 +33,10 @@
  * -------------------------------------------------------------------------- */
 
 #include "AlignedArray.h"
+#include "CpuExclusions.h"
 #include "RealVec.h"
 #include "windowsExportCpu.h"
 #include "openmm/internal/ThreadPool.h"
-#include <set>
 #include <utility>
 #include <vector>
 
@@ -47,14 +47,27 @@ public:
     class ThreadTask;
     class Voxels;
     CpuNeighborList(int blockSize);
-    void computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const std::vector<std::set<int> >& exclusions,
+    void computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const CpuExclusions& exclusions,
             const RealVec* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads);
     int getNumBlocks() const;
+    /**
+     * Get the atoms in the order they were sorted into blocks.  Block i consists of the atoms at positions
+     * blockSize*i through blockSize*(i+1)-1.
+     */
     const std::vector<int>& getSortedAtoms() const;
+    /**
+     * Get the neighbors of a block.  These are positions in the array returned by getSortedAtoms(), not atom
+     * indices.  This allows kernels to keep per-atom data in sorted order, so that the data for nearby atoms
+     * is close together in memory.
+     */
     const std::vector<int>& getBlockNeighbors(int blockIndex) const;
     const std::vector<char>& getBlockExclusions(int blockIndex) const;
     /**
-     * This routine contains the code executed by each thread.
+     * This routine is executed by each thread to compute the position of every atom along the Hilbert curve.
+     */
+    void threadComputeAtomBins(ThreadPool& threads, int threadIndex);
+    /**
+     * This routine is executed by each thread to find the neighbors of its subset of blocks.
      */
     void threadComputeNeighborList(ThreadPool& threads, int threadIndex);
     void runThread(int index);
@@ -67,7 +80,7 @@ private:
     float minx, maxx, miny, maxy, minz, maxz;
     std::vector<std::pair<int, int> > atomBins;
     Voxels* voxels;
-    const std::vector<std::set<int> >* exclusions;
+    const CpuExclusions* exclusions;
     const float* atomLocations;
     RealVec periodicBoxVectors[3];
     int numAtoms;
@@ -26,11 +26,11 @@
 #define OPENMM_CPU_NONBONDED_FORCE_H__
 
 #include "AlignedArray.h"
+#include "CpuExclusions.h"
 #include "CpuNeighborList.h"
 #include "ReferencePairIxn.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
-#include <set>
 #include <utility>
 #include <vector>
 // ---------------------------------------------------------------------------------------
@@ -40,6 +40,8 @@ namespace OpenMM {
 class CpuNonbondedForce {
     public:
         class ComputeDirectTask;
+        class ComputeReciprocalTask;
+        class CopyToSortedTask;
 
       /**---------------------------------------------------------------------------------------
       
@@ -67,6 +69,16 @@ class CpuNonbondedForce {
       
       void setUseCutoff(float distance, const CpuNeighborList& neighbors, float solventDielectric);
 
+      /**---------------------------------------------------------------------------------------
+      
+         Inform this object that the neighbor list has been rebuilt or the particle parameters have
+         changed.  The parameters are only copied into the neighbor list's sorted order on the next
+         evaluation after this is called, rather than on every evaluation.
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void invalidateSortedParameters();
+
       /**---------------------------------------------------------------------------------------
       
          Set the force to use a switching function on the Lennard-Jones interaction.
@@ -114,6 +126,22 @@ class CpuNonbondedForce {
       
       void setUsePME(float alpha, int meshSize[3]);
 
+      /**---------------------------------------------------------------------------------------
+      
+         Set the force to scale the interactions between alchemical and non-alchemical atoms.
+         Coulomb interactions between them are multiplied by lambdaElectrostatics, and Lennard-Jones
+         interactions are replaced by a soft-core form.  This affects only the direct space part;
+         the caller is responsible for the reciprocal space part.
+      
+         @param isAlchemical          1 for each alchemical atom and 0 for every other atom
+         @param alpha                 the soft-core alpha parameter
+         @param lambdaElectrostatics  the scale factor for Coulomb interactions
+         @param lambdaSterics         the coupling parameter for soft-core Lennard-Jones interactions
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setUseAlchemical(const std::vector<float>& isAlchemical, float alpha, float lambdaElectrostatics, float lambdaSterics);
+
       /**---------------------------------------------------------------------------------------
       
          Calculate Ewald ixn
@@ -122,16 +150,17 @@ class CpuNonbondedForce {
          @param posq             atom coordinates and charges
          @param atomCoordinates  atom coordinates (in format needed by PME)
          @param atomParameters   atom parameters (sigma/2, 2*sqrt(epsilon))
-         @param exclusions       atom exclusion indices
-                                 exclusions[atomIndex] contains the list of exclusions for that atom
+         @param exclusions       the pairs of atoms that are excluded from interacting
          @param forces           force array (forces added)
          @param totalEnergy      total energy
+         @param threads          the thread pool to use
+         @param includeForces    whether to compute forces.  If false, only the energy is computed.
             
          --------------------------------------------------------------------------------------- */
           
       void calculateReciprocalIxn(int numberOfAtoms, float* posq, const std::vector<RealVec>& atomCoordinates,
-                            const std::vector<std::pair<float, float> >& atomParameters, const std::vector<std::set<int> >& exclusions,
-                            std::vector<RealVec>& forces, double* totalEnergy) const;
+                            const std::vector<std::pair<float, float> >& atomParameters, const CpuExclusions& exclusions,
+                            std::vector<RealVec>& forces, double* totalEnergy, ThreadPool& threads, bool includeForces=true);
       
       /**---------------------------------------------------------------------------------------
       
@@ -141,22 +170,35 @@ class CpuNonbondedForce {
          @param posq             atom coordinates and charges
          @param atomCoordinates  atom coordinates (periodic boundary conditions not applied)
          @param atomParameters   atom parameters (sigma/2, 2*sqrt(epsilon))
-         @param exclusions       atom exclusion indices
-                                 exclusions[atomIndex] contains the list of exclusions for that atom
+         @param exclusions       the pairs of atoms that are excluded from interacting
          @param forces           force array (forces added)
          @param totalEnergy      total energy
+         @param lambdaDerivatives  if not NULL, the derivatives of the energy with respect to lambdaElectrostatics and
+                                 lambdaSterics are added to its two elements.  This requires totalEnergy to be non-NULL.
          @param threads          the thread pool to use
+         @param includeForces    whether to compute forces.  If false, only the energy is computed
+                                 and threadForce is left unchanged.
       
          --------------------------------------------------------------------------------------- */
           
       void calculateDirectIxn(int numberOfAtoms, float* posq, const std::vector<RealVec>& atomCoordinates, const std::vector<std::pair<float, float> >& atomParameters,
-            const std::vector<std::set<int> >& exclusions, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads);
+            const CpuExclusions& exclusions, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, double* lambdaDerivatives, ThreadPool& threads, bool includeForces=true);
 
     /**
      * This routine contains the code executed by each thread.
      */
     void threadComputeDirect(ThreadPool& threads, int threadIndex);
 
+    /**
+     * This routine contains the code executed by each thread when computing the reciprocal space
+     * part of an Ewald sum.  The calculation is divided into three phases, which are executed as
+     * separate tasks: building the tables of exp(i*k*r), computing the structure factors, and
+     * computing the forces.
+     *
+     * @param phase   the phase of the calculation to perform (0, 1, or 2)
+     */
+    void threadComputeReciprocal(ThreadPool& threads, int threadIndex, int phase);
+
 protected:
         bool cutoff;
         bool useSwitch;
@@ -164,7 +206,8 @@ protected:
         bool triclinic;
         bool ewald;
         bool pme;
-        bool tableIsValid;
+        bool alchemical;
+        bool tableIsValid, sortedParametersValid, copySortedParameters;
         const CpuNeighborList* neighborList;
         float recipBoxSize[3];
         RealVec periodicBoxVectors[3];
@@ -172,19 +215,35 @@ protected:
         float cutoffDistance, switchingDistance;
         float krf, crf;
         float alphaEwald;
+        float softcoreAlpha, lambdaElectrostatics, lambdaSterics;
         int numRx, numRy, numRz;
         int meshDim[3];
         std::vector<float> ewaldScaleTable;
         float ewaldDX, ewaldDXInv;
         std::vector<double> threadEnergy;
+        std::vector<double> threadLambdaDerivatives;
         // The following variables are used to make information accessible to the individual threads.
         int numberOfAtoms;
         float* posq;
         RealVec const* atomCoordinates;
         std::pair<float, float> const* atomParameters;        
-        std::set<int> const* exclusions;
+        float const* isAlchemical;
+        const CpuExclusions* exclusions;
         std::vector<AlignedArray<float> >* threadForce;
-        bool includeEnergy;
+        bool includeForces, includeEnergy, includeLambdaDerivatives;
+        // When using a neighbor list, the atom data is copied into the same order as the neighbor list's sorted
+        // atoms.  This keeps the data for nearby atoms close together in memory.
+        AlignedArray<float> sortedPosq;
+        std::vector<std::pair<float, float> > sortedAtomParameters;
+        AlignedArray<float> sortedIsAlchemical;
+        std::vector<AlignedArray<float> > threadSortedForce;
+        // The following variables are used for the reciprocal space part of Ewald summation.  The tables of
+        // exp(i*k*r) are stored as separate real and imaginary parts, padded to a multiple of four atoms.
+        int paddedNumAtoms;
+        std::vector<float> ewaldCharges, eirReal, eirImag;
+        std::vector<float> ewaldCs, ewaldSs, ewaldAk;
+        std::vector<std::vector<float> > threadTabXY;
+        RealVec* reciprocalForces;
         void* atomicCounter;
 
         static const float TWO_OVER_SQRT_PI;
@@ -198,34 +257,59 @@ protected:
          @param atom2            the index of the second atom
          @param forces           force array (forces added)
          @param totalEnergy      total energy
+         @param lambdaDerivatives  derivatives of the energy with respect to lambdaElectrostatics and lambdaSterics (added)
             
          --------------------------------------------------------------------------------------- */
           
-      void calculateOneIxn(int atom1, int atom2, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+      void calculateOneIxn(int atom1, int atom2, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize);
+
+      /**
+       * Compute the soft-core Lennard-Jones interaction between an alchemical and a non-alchemical atom.
+       * 
+       * @param sig6        (sigma/r)^6
+       * @param eps         the combined epsilon, including the factor of 4
+       * @param energy      on exit, the energy
+       * @param dEdR        on exit, -r times the derivative of the energy with respect to r
+       * @param dEdLambda   on exit, the derivative of the energy with respect to lambdaSterics
+       */
+      void calculateSoftcoreIxn(float sig6, float eps, float& energy, float& dEdR, float& dEdLambda) const;
+
+      /**
+       * Copy this thread's share of the positions into sortedPosq, and clear its sorted force buffer.  If
+       * copySortedParameters is set, also copy its share of the parameters into sortedAtomParameters.
+       */
+      void copyToSortedOrder(ThreadPool& threads, int threadIndex);
+
+      /**
+       * Add the forces this thread accumulated in sorted order to its force array.
+       */
+      void addSortedForces(int threadIndex, float* forces);
             
       /**---------------------------------------------------------------------------------------
       
          Calculate all the interactions for one atom block.
       
          @param blockIndex       the index of the atom block
-         @param forces           force array (forces added)
+         @param forces           force array, in the order of the neighbor list's sorted atoms (forces added)
          @param totalEnergy      total energy
+         @param lambdaDerivatives  derivatives of the energy with respect to lambdaElectrostatics and lambdaSterics (added)
             
          --------------------------------------------------------------------------------------- */
           
-      virtual void calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) = 0;
+      virtual void calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) = 0;
             
       /**---------------------------------------------------------------------------------------
       
          Calculate all the interactions for one atom block.
       
          @param blockIndex       the index of the atom block
-         @param forces           force array (forces added)
+         @param forces           force array, in the order of the neighbor list's sorted atoms (forces added)
          @param totalEnergy      total energy
+         @param lambdaDerivatives  derivatives of the energy with respect to lambdaElectrostatics and lambdaSterics (added)
             
          --------------------------------------------------------------------------------------- */
           
-      virtual void calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) = 0;
+      virtual void calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) = 0;
 
       /**
        * Compute the displacement and squared distance between two points, optionally using
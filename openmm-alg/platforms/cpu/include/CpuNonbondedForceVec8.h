@@ -47,16 +47,17 @@ protected:
          @param blockIndex       the index of the atom block
          @param forces           force array (forces added)
          @param totalEnergy      total energy
+         @param lambdaDerivatives  derivatives of the energy with respect to lambdaElectrostatics and lambdaSterics (added)
             
          --------------------------------------------------------------------------------------- */
           
-      void calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+      void calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize);
       
       /**
        * Templatized implementation of calculateBlockIxn.
        */
-      template <bool TRICLINIC>
-      void calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+      template <bool TRICLINIC, bool COMPUTE_FORCES>
+      void calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize);
             
       /**---------------------------------------------------------------------------------------
       
@@ -65,16 +66,17 @@ protected:
          @param blockIndex       the index of the atom block
          @param forces           force array (forces added)
          @param totalEnergy      total energy
+         @param lambdaDerivatives  derivatives of the energy with respect to lambdaElectrostatics and lambdaSterics (added)
             
          --------------------------------------------------------------------------------------- */
           
-      void calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+      void calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize);
 
       /**
        * Templatized implementation of calculateBlockEwaldIxn.
        */
-      template <bool TRICLINIC>
-      void calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+      template <bool TRICLINIC, bool COMPUTE_FORCES>
+      void calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize);
 
       /**
        * Compute the displacement and squared distance between a collection of points, optionally using
@@ -83,6 +85,12 @@ protected:
       template <bool TRICLINIC>
       void getDeltaR(const float* posI, const fvec8& x, const fvec8& y, const fvec8& z, fvec8& dx, fvec8& dy, fvec8& dz, fvec8& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const;
 
+      /**
+       * Compute the soft-core Lennard-Jones interaction between alchemical and non-alchemical atoms.
+       * The arguments have the same meaning as for CpuNonbondedForce::calculateSoftcoreIxn().
+       */
+      void calculateSoftcoreIxn(const fvec8& sig6, const fvec8& eps, fvec8& energy, fvec8& dEdR, fvec8& dEdLambda) const;
+
       /**
        * Compute a fast approximation to erfc(x).
        */
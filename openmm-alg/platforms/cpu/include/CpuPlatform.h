@@ -33,7 +33,10 @@
  * -------------------------------------------------------------------------- */
 
 #include "AlignedArray.h"
+#include "CpuExclusions.h"
 #include "CpuRandom.h"
+#include "CpuStatistics.h"
+#include "CpuVirtualSites.h"
 #include "ReferencePlatform.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/ThreadPool.h"
@@ -67,6 +70,86 @@ public:
         static const std::string key = "CpuThreads";
         return key;
     }
+    /**
+     * This is the name of the parameter for selecting what numeric precision to use.  Allowed values are "mixed"
+     * (the default) and "double".  In mixed mode, forces are computed in single precision, while energies are
+     * accumulated and integration is done in double precision.  In double mode, the forces that the CPU kernels
+     * compute in single precision (NonbondedForce, CustomNonbondedForce, CustomManyParticleForce, GBSAOBCForce,
+     * GBVIForce, CustomGBForce, CustomExternalForce, and CustomCompoundBondForce) are computed by the single threaded
+     * Reference kernels instead.  Features that depend on the CPU kernels, such as getLambdaDerivatives(), are then
+     * unavailable.
+     */
+    static const std::string& CpuPrecision() {
+        static const std::string key = "CpuPrecision";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to collect statistics on where time is spent.
+     * Allowed values are "true" and "false".
+     */
+    static const std::string& CpuCollectStatistics() {
+        static const std::string key = "CpuCollectStatistics";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting how worker threads are placed on processors.  Allowed values
+     * are "none" (let the operating system decide), "compact" (fill the processors of one NUMA node before moving
+     * on to the next), and "spread" (distribute threads evenly across NUMA nodes).  Threads are only placed on the
+     * processors the creating thread is allowed to run on.  Threads are only pinned on Linux; on other operating systems
+     * this is ignored.  It is also ignored when CpuThreads is 1, since a single threaded Context does its work on the
+     * calling thread rather than on a worker thread.  If the threads cannot be pinned, they are left for the operating
+     * system to schedule, and querying this property for the Context returns "none".
+     */
+    static const std::string& CpuThreadPlacement() {
+        static const std::string key = "CpuThreadPlacement";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to tune the PME parameters when the Context is created.
+     * Allowed values are "true" and "false".  When it is "true" and the optimized PME implementation is available,
+     * several combinations of interpolation order and grid size that give the same accuracy are timed the first time
+     * forces are computed, and the fastest one is used.  This is ignored if the PME parameters were set explicitly.
+     */
+    static const std::string& CpuPmeTuning() {
+        static const std::string key = "CpuPmeTuning";
+        return key;
+    }
+    /**
+     * This is the name of a read-only property whose value describes the PME parameters selected by tuning and the
+     * time measured for each combination that was tried.  It is empty if no tuning has been done.
+     */
+    static const std::string& CpuPmeTuningReport() {
+        static const std::string key = "CpuPmeTuningReport";
+        return key;
+    }
+    /**
+     * This is the name of a read-only property whose value is a report of the statistics collected so far.
+     * It is only meaningful if CpuCollectStatistics was set to "true" when the Context was created.
+     */
+    static const std::string& CpuStatisticsReport() {
+        static const std::string key = "CpuStatisticsReport";
+        return key;
+    }
+    /**
+     * Get the statistics that have been collected for a Context.
+     */
+    const CpuStatistics& getStatistics(const Context& context) const;
+    /**
+     * Reset all statistics that have been collected for a Context to zero.
+     */
+    void resetStatistics(Context& context) const;
+    /**
+     * Get the derivatives of the potential energy with respect to the NonbondedForce::LambdaElectrostatics() and
+     * NonbondedForce::LambdaSterics() parameters, as needed for thermodynamic integration.  They are computed along
+     * with the energy, so these are the values from the most recent time the energy of the Context was computed.
+     * This throws an exception if CpuPrecision is "double", since the Reference kernels used in that mode do not
+     * compute the derivatives.
+     *
+     * @param context                        the Context to get the derivatives for
+     * @param[out] dEdLambdaElectrostatics   the derivative with respect to lambdaElectrostatics
+     * @param[out] dEdLambdaSterics          the derivative with respect to lambdaSterics
+     */
+    void getLambdaDerivatives(const Context& context, double& dEdLambdaElectrostatics, double& dEdLambdaSterics) const;
     /**
      * We cannot use the standard mechanism for platform data, because that is already used by the superclass.
      * Instead, we maintain a table of ContextImpls to PlatformDatas.
@@ -79,13 +162,32 @@ private:
 
 class CpuPlatform::PlatformData {
 public:
-    PlatformData(int numParticles, int numThreads);
+    /**
+     * Create the PlatformData.  The worker threads are pinned according to the requested placement
+     * before any per-thread buffers are allocated, so each thread's buffers are first touched by
+     * that thread and end up in memory local to it.
+     */
+    PlatformData(int numParticles, int numThreads, const std::string& threadPlacement="none");
+    ~PlatformData();
+    /**
+     * Get a copy of a set of exclusions that can be shared by all kernels in the Context.  If an
+     * identical set has already been created by another kernel, the new one is deleted and the
+     * existing one is returned.  In either case, the PlatformData takes ownership of the object
+     * and deletes it when the Context is destroyed.
+     */
+    const CpuExclusions& shareExclusions(CpuExclusions* exclusions);
     AlignedArray<float> posq;
     std::vector<AlignedArray<float> > threadForce;
     ThreadPool threads;
-    bool isPeriodic;
+    bool isPeriodic, useDoublePrecision, tunePme;
     CpuRandom random;
+    CpuStatistics statistics;
+    CpuVirtualSites* virtualSites;
     std::map<std::string, std::string> propertyValues;
+    std::vector<CpuExclusions*> exclusions;
+    double lambdaDerivatives[2];
+private:
+    class InitializeThreadsTask;
 };
 
 } // namespace OpenMM
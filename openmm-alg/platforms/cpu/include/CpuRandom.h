@@ -40,6 +40,13 @@ namespace OpenMM {
 
 /**
  * This class provides a multithreaded random number generator.
+ *
+ * There are two ways of using it.  getGaussianRandom() and getUniformRandom() take a thread index,
+ * and each thread has its own generator.  The sequence of values therefore depends on the number
+ * of threads.  Alternatively, fillGaussianRandom() generates blocks of values from a fixed number of
+ * independent streams.  If each stream is always used for the same set of particles (for example,
+ * by calling getStreamRange() to decide which particles it is used for), results are reproducible
+ * for a given seed no matter how many threads are used.
  */
 class OPENMM_EXPORT_CPU CpuRandom {
 public:
@@ -48,10 +55,45 @@ public:
     void initialize(int seed, int numThreads);
     float getGaussianRandom(int threadIndex);
     float getUniformRandom(int threadIndex);
+    /**
+     * Get the number of independent streams that can be used with fillGaussianRandom().
+     */
+    int getNumStreams() const {
+        return NumStreams;
+    }
+    /**
+     * Divide a set of elements (such as particles) between the streams, and get the range of elements
+     * that should be processed with a particular stream.
+     *
+     * @param stream        the index of the stream
+     * @param numElements   the total number of elements
+     * @param start         on exit, the index of the first element for the stream
+     * @param end           on exit, one past the index of the last element for the stream
+     */
+    void getStreamRange(int stream, int numElements, int& start, int& end) const {
+        start = (int) ((stream*(long long) numElements)/NumStreams);
+        end = (int) (((stream+1)*(long long) numElements)/NumStreams);
+    }
+    /**
+     * Fill an array with Gaussian distributed random numbers from a particular stream.  A stream must
+     * only be used by one thread at a time.
+     *
+     * @param stream    the index of the stream to generate values from
+     * @param values    the array to store the values into
+     * @param count     the number of values to generate
+     */
+    void fillGaussianRandom(int stream, float* values, int count);
 private:
+    /**
+     * The number of streams is fixed, rather than derived from the number of threads, so that results do not
+     * depend on the thread count.  It also caps the parallelism of code that divides work by stream: when more
+     * than 64 threads are used, the extra threads are idle while random numbers are being generated.
+     */
+    static const int NumStreams = 64;
     bool hasInitialized;
     int randomSeed;
     std::vector<OpenMM_SFMT::SFMT*> threadRandom;
+    std::vector<OpenMM_SFMT::SFMT*> streamRandom;
     std::vector<float> nextGaussian;
     std::vector<int> nextGaussianIsValid;
 };
@@ -0,0 +1,119 @@
+#ifndef OPENMM_CPU_REPLICA_SET_H_
+#define OPENMM_CPU_REPLICA_SET_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuPlatform.h"
+#include "openmm/Context.h"
+#include "openmm/Integrator.h"
+#include "openmm/System.h"
+#include "openmm/internal/ThreadPool.h"
+#include "windowsExportCpu.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * A CpuReplicaSet holds many independent replicas of the same System, each in its own Context on the
+ * CPU platform, and advances them together using a single ThreadPool.  The worker threads divide the replicas
+ * between them.  Each replica's Context uses a ThreadPool with one thread, which runs its tasks directly on
+ * whichever worker is advancing that replica.  For small systems this is much more efficient than giving every
+ * Context its own multithreaded pool: the workers only synchronize with each other at the start and end of
+ * each call to step() or getPotentialEnergies(), not at every stage of every time step, and all cores stay busy
+ * as long as there are at least as many replicas as threads.
+ * 
+ * Each replica needs its own Integrator.  The Integrators are not owned by the CpuReplicaSet, and must not
+ * be deleted while it exists.  Different replicas are stepped concurrently, so this cannot be used with Forces
+ * or Integrators whose implementations share global state between Contexts, such as the random number generator
+ * used by AndersenThermostat and BrownianIntegrator.
+ * 
+ * The first call to step() or getPotentialEnergies() evaluates every replica once on the calling thread before
+ * using the workers, so kernels that finish their setup on first use (such as PME) are never set up concurrently.
+ * When the optimized PME implementation is used, each replica's reciprocal space calculation runs on its own
+ * single thread, since every Context is created with one thread.
+ */
+class OPENMM_EXPORT_CPU CpuReplicaSet {
+public:
+    /**
+     * Create a CpuReplicaSet.
+     * 
+     * @param system       the System to simulate.  Every replica uses the same System.
+     * @param integrators  the Integrator to use for each replica.  The number of replicas equals the number of
+     *                     Integrators.
+     * @param platform     the Platform to create the Contexts with
+     * @param properties   platform properties to use when creating the Contexts.  Any value given for CpuThreads
+     *                     is ignored, since every Context uses a single thread.
+     * @param numThreads   the number of worker threads to use.  If this is 0 (the default), the number of threads
+     *                     is set equal to the number of logical CPU cores available.
+     */
+    CpuReplicaSet(const System& system, const std::vector<Integrator*>& integrators, CpuPlatform& platform,
+            const std::map<std::string, std::string>& properties=std::map<std::string, std::string>(), int numThreads=0);
+    ~CpuReplicaSet();
+    /**
+     * Get the number of replicas.
+     */
+    int getNumReplicas() const {
+        return contexts.size();
+    }
+    /**
+     * Get the Context for a replica.  Use this to set or query its state.
+     */
+    Context& getContext(int index) {
+        return *contexts[index];
+    }
+    /**
+     * Advance every replica by a specified number of time steps.
+     */
+    void step(int steps);
+    /**
+     * Compute the potential energy of every replica.
+     * 
+     * @param groups  a set of bit flags for which force groups to include.  Group i will be included if
+     *                (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return the potential energy of each replica (measured in kJ/mol)
+     */
+    std::vector<double> getPotentialEnergies(int groups=0xFFFFFFFF);
+private:
+    class ReplicaTask;
+    class StepTask;
+    class EnergyTask;
+    void execute(ReplicaTask& task);
+    std::vector<Context*> contexts;
+    ThreadPool threads;
+    bool hasInitializedKernels;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPU_REPLICA_SET_H_*/
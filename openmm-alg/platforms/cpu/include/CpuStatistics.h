@@ -0,0 +1,160 @@
+#ifndef OPENMM_CPUSTATISTICS_H_
+#define OPENMM_CPUSTATISTICS_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "windowsExportCpu.h"
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class records lightweight counters and timers describing where time is spent inside
+ * the CPU platform's kernels.  Collection is disabled by default.  When it is disabled, every
+ * method returns immediately, so the cost to the kernels is a single branch.
+ */
+class OPENMM_EXPORT_CPU CpuStatistics {
+public:
+    class ScopedTimer;
+    /**
+     * The quantities that can be counted.
+     */
+    enum Counter {
+        ForceEvaluations = 0,
+        NeighborListBuilds = 1,
+        PairsEvaluated = 2,
+        ConstraintIterations = 3,
+        NumCounters = 4
+    };
+    /**
+     * The parts of a time step that can be timed.
+     */
+    enum Timer {
+        ForceComputation = 0,
+        InitForces = 1,
+        SumForces = 2,
+        NeighborList = 3,
+        NonbondedDirect = 4,
+        NonbondedExceptions = 5,
+        NonbondedReciprocal = 6,
+        PmeWait = 7,
+        BondedForces = 8,
+        CustomForces = 9,
+        ImplicitSolvent = 10,
+        Integration = 11,
+        NumTimers = 12
+    };
+    CpuStatistics();
+    /**
+     * Get whether statistics are being collected.
+     */
+    bool isEnabled() const {
+        return enabled;
+    }
+    /**
+     * Set whether statistics should be collected.
+     */
+    void setEnabled(bool enabled);
+    /**
+     * Reset all counters and timers to zero.
+     */
+    void reset();
+    /**
+     * Add a value to a counter.
+     */
+    void increment(Counter counter, long long amount=1) {
+        if (enabled)
+            counts[counter] += amount;
+    }
+    /**
+     * Add an interval (in seconds) to a timer.
+     */
+    void addTime(Timer timer, double time) {
+        if (enabled)
+            times[timer] += time;
+    }
+    /**
+     * Get the current value of a counter.
+     */
+    long long getCount(Counter counter) const;
+    /**
+     * Get the total time (in seconds) recorded by a timer.
+     */
+    double getTime(Timer timer) const;
+    /**
+     * Get the name of a counter, as it appears in reports.
+     */
+    static const std::string& getCounterName(Counter counter);
+    /**
+     * Get the name of a timer, as it appears in reports.
+     */
+    static const std::string& getTimerName(Timer timer);
+    /**
+     * Get the current time in seconds, measured from an arbitrary starting point.
+     */
+    static double getCurrentTime();
+    /**
+     * Create a human readable report of all statistics collected so far.
+     *
+     * @param threadWaitTimes   the time each worker thread has spent waiting at synchronization points
+     */
+    std::string createReport(const std::vector<double>& threadWaitTimes) const;
+private:
+    bool enabled;
+    std::vector<long long> counts;
+    std::vector<double> times;
+};
+
+/**
+ * This records the time between its creation and destruction in a CpuStatistics object.
+ * If statistics are disabled, it does nothing.
+ */
+class CpuStatistics::ScopedTimer {
+public:
+    ScopedTimer(CpuStatistics& statistics, Timer timer) : statistics(statistics), timer(timer) {
+        if (statistics.isEnabled())
+            startTime = getCurrentTime();
+    }
+    ~ScopedTimer() {
+        if (statistics.isEnabled())
+            statistics.addTime(timer, getCurrentTime()-startTime);
+    }
+private:
+    CpuStatistics& statistics;
+    Timer timer;
+    double startTime;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUSTATISTICS_H_*/
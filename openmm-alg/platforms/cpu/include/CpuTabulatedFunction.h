@@ -0,0 +1,139 @@
+#ifndef OPENMM_CPU_TABULATED_FUNCTION_H_
+#define OPENMM_CPU_TABULATED_FUNCTION_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "AlignedArray.h"
+#include "windowsExportCpu.h"
+#include "openmm/TabulatedFunction.h"
+#include "lepton/CustomFunction.h"
+#include "openmm/internal/vectorize.h"
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * Create a Lepton::CustomFunction for evaluating a TabulatedFunction on the CPU platform.
+ * Continuous functions are converted to the classes defined below.  Discrete functions already
+ * have constant time lookups, so the Reference implementations are used for them.
+ */
+OPENMM_EXPORT_CPU Lepton::CustomFunction* createCpuTabulatedFunction(const TabulatedFunction& function);
+
+/**
+ * This class evaluates a Continuous1DFunction.  The natural spline is converted to a polynomial
+ * for each interval, and the coefficients are stored contiguously so that evaluating the function
+ * requires a single table lookup instead of a binary search.
+ */
+class OPENMM_EXPORT_CPU CpuContinuous1DFunction : public Lepton::CustomFunction {
+public:
+    CpuContinuous1DFunction(const Continuous1DFunction& function);
+    CpuContinuous1DFunction(const CpuContinuous1DFunction& function);
+    int getNumArguments() const;
+    double evaluate(const double* arguments) const;
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const;
+    CustomFunction* clone() const;
+    /**
+     * Get the polynomial form of the spline.  The coefficients for interval i are elements 4*i
+     * through 4*i+3 of coefficients, ordered by increasing power of the fractional position
+     * within the interval.
+     *
+     * @param min           on exit, the lower bound of the function's range
+     * @param max           on exit, the upper bound of the function's range
+     * @param coefficients  on exit, the polynomial coefficients for every interval
+     */
+    void getCoefficients(double& min, double& max, std::vector<double>& coefficients) const;
+private:
+    int numIntervals;
+    double min, max, invDelta;
+    AlignedArray<double> coeff;
+};
+
+/**
+ * This class evaluates a Continuous2DFunction.  The bicubic coefficients for each grid cell are
+ * stored contiguously, and the cell containing a point is found with a single table lookup.
+ */
+class OPENMM_EXPORT_CPU CpuContinuous2DFunction : public Lepton::CustomFunction {
+public:
+    CpuContinuous2DFunction(const Continuous2DFunction& function);
+    CpuContinuous2DFunction(const CpuContinuous2DFunction& function);
+    int getNumArguments() const;
+    double evaluate(const double* arguments) const;
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const;
+    CustomFunction* clone() const;
+private:
+    int xsize, ysize;
+    double xmin, xmax, ymin, ymax, invDeltaX, invDeltaY;
+    AlignedArray<double> coeff;
+};
+
+/**
+ * This class evaluates a Continuous3DFunction.  The tricubic coefficients for each grid cell are
+ * stored contiguously, and the cell containing a point is found with a single table lookup.
+ */
+class OPENMM_EXPORT_CPU CpuContinuous3DFunction : public Lepton::CustomFunction {
+public:
+    CpuContinuous3DFunction(const Continuous3DFunction& function);
+    CpuContinuous3DFunction(const CpuContinuous3DFunction& function);
+    int getNumArguments() const;
+    double evaluate(const double* arguments) const;
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const;
+    CustomFunction* clone() const;
+    /**
+     * Evaluate the function and all three components of its gradient with a single cell lookup.
+     * The value and gradient are zero outside the grid.
+     *
+     * @param arguments     the point at which to evaluate the function
+     * @param value         on exit, the value of the function
+     * @param gradient      on exit, the gradient of the function
+     */
+    void evaluateWithGradient(const double* arguments, double& value, double* gradient) const;
+    /**
+     * Evaluate the function and its gradient at four points at once.  This is computed in single
+     * precision.  The value and gradient are zero for points outside the grid.
+     *
+     * @param x             the x coordinates of the points
+     * @param y             the y coordinates of the points
+     * @param z             the z coordinates of the points
+     * @param value         on exit, the value of the function at each point
+     * @param gradient      on exit, the x, y, and z components of the gradient at each point
+     */
+    void evaluateWithGradient(const fvec4& x, const fvec4& y, const fvec4& z, fvec4& value, fvec4* gradient) const;
+private:
+    int xsize, ysize, zsize;
+    double xmin, xmax, ymin, ymax, zmin, zmax, invDeltaX, invDeltaY, invDeltaZ;
+    AlignedArray<double> coeff;
+    AlignedArray<float> floatCoeff;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPU_TABULATED_FUNCTION_H_*/
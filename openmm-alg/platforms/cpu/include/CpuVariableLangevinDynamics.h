@@ -0,0 +1,97 @@
+
+/* Portions copyright (c) 2015 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __CPU_VARIABLE_LANGEVIN_DYNAMICS_H__
+#define __CPU_VARIABLE_LANGEVIN_DYNAMICS_H__
+
+#include "ReferenceVariableStochasticDynamics.h"
+#include "CpuRandom.h"
+#include "CpuVirtualSites.h"
+#include "openmm/internal/ThreadPool.h"
+
+namespace OpenMM {
+
+/**
+ * This is the CPU implementation of VariableLangevinIntegrator.  It selects the step size in
+ * exactly the same way as ReferenceVariableStochasticDynamics, but the error estimate and the
+ * updates to positions and velocities are parallelized over a thread pool.
+ */
+class CpuVariableLangevinDynamics : public ReferenceVariableStochasticDynamics {
+public:
+    class ComputeErrorTask;
+    class Update1Task;
+    class Update2Task;
+    /**
+     * Constructor.
+     *
+     * @param numberOfAtoms  number of atoms
+     * @param tau            viscosity
+     * @param temperature    temperature
+     * @param accuracy       required accuracy
+     * @param threads        thread pool for parallelizing computation
+     * @param random         random number generator
+     * @param virtualSites   used for computing the positions of virtual sites
+     */
+    CpuVariableLangevinDynamics(int numberOfAtoms, RealOpenMM tau, RealOpenMM temperature, RealOpenMM accuracy, OpenMM::ThreadPool& threads,
+                                OpenMM::CpuRandom& random, OpenMM::CpuVirtualSites& virtualSites);
+
+    /**
+     * Destructor.
+     */
+    ~CpuVariableLangevinDynamics();
+
+    /**
+     * Perform one time step.
+     * 
+     * @param system              the System to be integrated
+     * @param atomCoordinates     atom coordinates
+     * @param velocities          velocities
+     * @param forces              forces
+     * @param masses              atom masses
+     * @param maxStepSize         maximum time step
+     * @param tolerance           the constraint tolerance
+     */
+    void update(const OpenMM::System& system, std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& velocities,
+                std::vector<OpenMM::RealVec>& forces, std::vector<RealOpenMM>& masses, RealOpenMM maxStepSize, RealOpenMM tolerance);
+
+private:
+    void threadComputeError(int threadIndex);
+    void threadUpdate1(int threadIndex);
+    void threadUpdate2(int threadIndex);
+    OpenMM::ThreadPool& threads;
+    OpenMM::CpuRandom& random;
+    OpenMM::CpuVirtualSites& virtualSites;
+    std::vector<double> threadError;
+    std::vector<std::vector<float> > threadNoise;
+    // The following variables are used to make information accessible to the individual threads.
+    int numberOfAtoms;
+    OpenMM::RealVec* atomCoordinates;
+    OpenMM::RealVec* velocities;
+    OpenMM::RealVec* forces;
+};
+
+} // namespace OpenMM
+
+#endif // __CPU_VARIABLE_LANGEVIN_DYNAMICS_H__
@@ -0,0 +1,87 @@
+#ifndef OPENMM_CPU_VIRTUAL_SITES_H_
+#define OPENMM_CPU_VIRTUAL_SITES_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "RealVec.h"
+#include "windowsExportCpu.h"
+#include "openmm/System.h"
+#include "openmm/internal/ThreadPool.h"
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class computes the positions of virtual sites and distributes the forces on them in parallel.
+ * Positions are computed independently for each site.  When distributing forces, sites that share
+ * any of the particles they are based on are grouped together and always processed by the same thread,
+ * so no two threads ever modify the force on the same particle.
+ */
+class OPENMM_EXPORT_CPU CpuVirtualSites {
+public:
+    class ComputePositionsTask;
+    class DistributeForcesTask;
+    CpuVirtualSites(const System& system, ThreadPool& threads);
+
+    /**
+     * Get whether the System contains any virtual sites.
+     */
+    bool hasVirtualSites() const {
+        return !sites.empty();
+    }
+
+    /**
+     * Compute the positions of all virtual sites.
+     *
+     * @param system           the System containing the virtual sites
+     * @param atomCoordinates  atom coordinates.  The positions of virtual sites are updated.
+     */
+    void computePositions(const System& system, std::vector<RealVec>& atomCoordinates);
+
+    /**
+     * Distribute forces from virtual sites to the atoms they are based on.
+     *
+     * @param system           the System containing the virtual sites
+     * @param atomCoordinates  atom coordinates
+     * @param forces           forces on all particles
+     */
+    void distributeForces(const System& system, const std::vector<RealVec>& atomCoordinates, std::vector<RealVec>& forces);
+private:
+    ThreadPool& threads;
+    std::vector<int> sites;
+    std::vector<std::vector<int> > siteGroups;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPU_VIRTUAL_SITES_H_*/
@@ -65,19 +65,28 @@ void CpuBondForce::initialize(int numAtoms, int numBonds, int numAtomsPerBond, i
     int numThreads = threads.getNumThreads();
     int targetBondsPerThread = numBonds/numThreads;
     
-    // Record the bonds that include each atom.
+    // Record the bonds that include each atom.  They are stored in compressed form: the bonds for atom i
+    // are atomBonds[atomBondStart[i]] through atomBonds[atomBondStart[i+1]-1].
     
-    vector<set<int> > atomBonds(numAtoms);
-    for (int bond = 0; bond < numBonds; bond++) {
+    vector<int> atomBondStart(numAtoms+1, 0);
+    for (int bond = 0; bond < numBonds; bond++)
         for (int i = 0; i < numAtomsPerBond; i++)
-            atomBonds[bondAtoms[bond][i]].insert(bond);
-    }
+            atomBondStart[bondAtoms[bond][i]+1]++;
+    for (int i = 0; i < numAtoms; i++)
+        atomBondStart[i+1] += atomBondStart[i];
+    vector<int> atomBonds(atomBondStart[numAtoms]);
+    vector<int> atomBondCount(atomBondStart.begin(), atomBondStart.end()-1);
+    for (int bond = 0; bond < numBonds; bond++)
+        for (int i = 0; i < numAtomsPerBond; i++)
+            atomBonds[atomBondCount[bondAtoms[bond][i]]++] = bond;
     
     // Divide bonds into groups.
     
     vector<int> atomThread(numAtoms, -1);
     vector<int> bondThread(numBonds, -1);
+    threadBonds.clear();
     threadBonds.resize(numThreads);
+    extraBonds.clear();
     int numProcessed = 0;
     int thread = 0;
     list<int> candidateBonds;
@@ -98,14 +107,14 @@ void CpuBondForce::initialize(int numAtoms, int numBonds, int numAtomsPerBond, i
         
         // Assign this bond to the thread.
         
-        assignBond(numProcessed++, thread, atomThread, bondThread, atomBonds, candidateBonds);
+        assignBond(numProcessed++, thread, atomThread, bondThread, atomBondStart, atomBonds, candidateBonds);
         
         // Assign additional bonds that have been identified as involving atoms assigned to this thread.
         
         while (!candidateBonds.empty() && threadBonds[thread].size() < targetBondsPerThread) {
             int bond = *candidateBonds.begin();
             if (bondThread[bond] == -1 && canAssignBond(bond, thread, atomThread))
-                assignBond(bond, thread, atomThread, bondThread, atomBonds, candidateBonds);
+                assignBond(bond, thread, atomThread, bondThread, atomBondStart, atomBonds, candidateBonds);
             candidateBonds.pop_front();
         }
         
@@ -142,7 +151,7 @@ void CpuBondForce::initialize(int numAtoms, int numBonds, int numAtomsPerBond, i
                 
                 if (assignment == -1)
                     assignment = numThreads-1;
-                assignBond(bond, assignment, atomThread, bondThread, atomBonds, candidateBonds);
+                assignBond(bond, assignment, atomThread, bondThread, atomBondStart, atomBonds, candidateBonds);
             }
             else {
                 // Add it to the list of "extra" bonds.
@@ -162,7 +171,8 @@ bool CpuBondForce::canAssignBond(int bond, int thread, vector<int>& atomThread)
     return true;
 }
 
-void CpuBondForce::assignBond(int bond, int thread, vector<int>& atomThread, vector<int>& bondThread, vector<set<int> >& atomBonds, list<int>& candidateBonds) {
+void CpuBondForce::assignBond(int bond, int thread, vector<int>& atomThread, vector<int>& bondThread, const vector<int>& atomBondStart,
+        const vector<int>& atomBonds, list<int>& candidateBonds) {
     // Assign the bond to a thread.
     
     bondThread[bond] = thread;
@@ -172,14 +182,14 @@ void CpuBondForce::assignBond(int bond, int thread, vector<int>& atomThread, vec
     // bonds to the list of candidates.
     
     for (int i = 0; i < numAtomsPerBond; i++) {
-        int& atom = atomThread[bondAtoms[bond][i]];
-        if (atom == thread)
+        int atom = bondAtoms[bond][i];
+        if (atomThread[atom] == thread)
             continue;
-        if (atom != -1)
+        if (atomThread[atom] != -1)
             throw OpenMMException("CpuBondForce: Internal error: atoms assigned to threads incorrectly");
-        atom = thread;
-        for (set<int>::const_iterator iter = atomBonds[atom].begin(); iter != atomBonds[atom].end(); ++iter)
-            candidateBonds.push_back(*iter);
+        atomThread[atom] = thread;
+        for (int j = atomBondStart[atom]; j < atomBondStart[atom+1]; j++)
+            candidateBonds.push_back(atomBonds[j]);
     }
 }
 
@@ -0,0 +1,252 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuCustomExternalForce.h"
+#include "ReferenceForce.h"
+#include "openmm/OpenMMException.h"
+#include <algorithm>
+#include <utility>
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuCustomExternalForce::ComputeTask : public ThreadPool::Task {
+public:
+    ComputeTask(CpuCustomExternalForce& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadComputeForce(threads, threadIndex);
+    }
+    CpuCustomExternalForce& owner;
+};
+
+/**
+ * This class holds the copies of the expressions used by one thread.
+ */
+class CpuCustomExternalForce::ThreadData {
+public:
+    ThreadData(const Lepton::ParsedExpression& energyExpression, const vector<string>& coordinateNames, const vector<string>& parameterNames) {
+        expressions.push_back(energyExpression.createCompiledExpression());
+        for (int i = 0; i < 3; i++)
+            expressions.push_back(energyExpression.differentiate(coordinateNames[i]).optimize().createCompiledExpression());
+        coordinates.resize(4);
+        params.resize(4);
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 3; j++)
+                coordinates[i].push_back(ReferenceForce::getVariablePointer(expressions[i], coordinateNames[j]));
+            for (int j = 0; j < (int) parameterNames.size(); j++)
+                params[i].push_back(ReferenceForce::getVariablePointer(expressions[i], parameterNames[j]));
+        }
+    }
+    // Element 0 is the energy, and elements 1-3 are its derivatives with respect to x, y, and z.
+    vector<Lepton::CompiledExpression> expressions;
+    vector<vector<double*> > coordinates, params;
+};
+
+CpuCustomExternalForce::CpuCustomExternalForce(const Lepton::ParsedExpression& energyExpression, const vector<string>& coordinateNames,
+        const vector<string>& parameterNames, ThreadPool& threads) : threads(threads), parameterNames(parameterNames), grid(NULL) {
+    for (int i = 0; i < threads.getNumThreads(); i++)
+        threadData.push_back(new ThreadData(energyExpression, coordinateNames, parameterNames));
+}
+
+CpuCustomExternalForce::CpuCustomExternalForce(const CpuContinuous3DFunction& grid, double scale, const string& scaleVariable,
+        const vector<string>& parameterNames, ThreadPool& threads) : threads(threads), parameterNames(parameterNames), gridScale(scale), gridScaleParameter(-1) {
+    this->grid = new CpuContinuous3DFunction(grid);
+    for (int i = 0; i < (int) parameterNames.size(); i++)
+        if (parameterNames[i] == scaleVariable)
+            gridScaleParameter = i;
+    if (gridScaleParameter == -1)
+        gridScaleGlobal = scaleVariable;
+}
+
+CpuCustomExternalForce::~CpuCustomExternalForce() {
+    for (int i = 0; i < (int) threadData.size(); i++)
+        delete threadData[i];
+    if (grid != NULL)
+        delete grid;
+}
+
+void CpuCustomExternalForce::setParticles(const vector<int>& particles, const vector<vector<double> >& parameters) {
+    this->particles = particles;
+    particleParams = parameters;
+
+    // Each thread writes directly to the forces on its own particles.  Process the entries in
+    // order of particle index, so all entries for a particle can be given to the same thread.
+
+    int numEntries = particles.size();
+    vector<pair<int, int> > sortedEntries(numEntries);
+    for (int i = 0; i < numEntries; i++)
+        sortedEntries[i] = make_pair(particles[i], i);
+    sort(sortedEntries.begin(), sortedEntries.end());
+    order.resize(numEntries);
+    for (int i = 0; i < numEntries; i++)
+        order[i] = sortedEntries[i].second;
+}
+
+void CpuCustomExternalForce::calculateIxn(const vector<RealVec>& positions, const map<string, double>& globalParameters,
+        vector<RealVec>& forces, bool includeForces, bool includeEnergy, double& totalEnergy) {
+    // Record the parameters for the threads.
+
+    this->positions = &positions;
+    this->globalParameters = &globalParameters;
+    this->forces = &forces;
+    this->includeForces = includeForces;
+    this->includeEnergy = includeEnergy;
+    threadEnergy.resize(threads.getNumThreads());
+    gridGlobalScale = 1.0;
+    if (grid != NULL && !gridScaleGlobal.empty()) {
+        map<string, double>::const_iterator scale = globalParameters.find(gridScaleGlobal);
+        if (scale == globalParameters.end())
+            throw OpenMMException("Unknown variable '"+gridScaleGlobal+"' in energy expression");
+        gridGlobalScale = scale->second;
+    }
+
+    // Signal the threads to start running and wait for them to finish.
+
+    ComputeTask task(*this);
+    threads.execute(task);
+    threads.waitForThreads();
+
+    // Combine the energies from all the threads.
+
+    if (includeEnergy)
+        for (int i = 0; i < (int) threadEnergy.size(); i++)
+            totalEnergy += threadEnergy[i];
+}
+
+void CpuCustomExternalForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
+    int numThreads = threads.getNumThreads();
+    int start = getThreadBoundary(threadIndex, numThreads);
+    int end = getThreadBoundary(threadIndex+1, numThreads);
+    double energy = 0.0;
+    if (grid == NULL)
+        computeExpressions(*threadData[threadIndex], start, end, energy);
+    else
+        computeGrid(start, end, energy);
+    threadEnergy[threadIndex] = energy;
+}
+
+int CpuCustomExternalForce::getThreadBoundary(int threadIndex, int numThreads) const {
+    // Divide the entries evenly, then move the boundary forward so it does not split the
+    // entries for a single particle.
+
+    int numEntries = order.size();
+    int boundary = (int) ((threadIndex*(long long) numEntries)/numThreads);
+    while (boundary > 0 && boundary < numEntries && particles[order[boundary]] == particles[order[boundary-1]])
+        boundary++;
+    return boundary;
+}
+
+void CpuCustomExternalForce::computeExpressions(ThreadData& data, int start, int end, double& energy) {
+    int numExpressions = (includeForces ? 4 : 1);
+    for (int i = 0; i < numExpressions; i++)
+        for (map<string, double>::const_iterator iter = globalParameters->begin(); iter != globalParameters->end(); ++iter)
+            ReferenceForce::setVariable(ReferenceForce::getVariablePointer(data.expressions[i], iter->first), iter->second);
+    for (int entry = start; entry < end; entry++) {
+        int index = order[entry];
+        int particle = particles[index];
+        const RealVec& pos = (*positions)[particle];
+        for (int i = 0; i < numExpressions; i++) {
+            for (int j = 0; j < 3; j++)
+                ReferenceForce::setVariable(data.coordinates[i][j], pos[j]);
+            for (int j = 0; j < (int) parameterNames.size(); j++)
+                ReferenceForce::setVariable(data.params[i][j], particleParams[index][j]);
+        }
+        if (includeForces) {
+            RealVec& f = (*forces)[particle];
+            f[0] -= data.expressions[1].evaluate();
+            f[1] -= data.expressions[2].evaluate();
+            f[2] -= data.expressions[3].evaluate();
+        }
+        if (includeEnergy)
+            energy += data.expressions[0].evaluate();
+    }
+}
+
+void CpuCustomExternalForce::computeGrid(int start, int end, double& energy) {
+    double scale = gridScale*gridGlobalScale;
+    int entry = start;
+
+    // Interpolate the grid for blocks of four entries at once.  Consecutive entries may refer to the
+    // same particle, so the forces are applied to the particles one at a time.
+
+    for (; entry+3 < end; entry += 4) {
+        float x[4], y[4], z[4], particleScale[4];
+        for (int j = 0; j < 4; j++) {
+            int index = order[entry+j];
+            const RealVec& pos = (*positions)[particles[index]];
+            x[j] = (float) pos[0];
+            y[j] = (float) pos[1];
+            z[j] = (float) pos[2];
+            particleScale[j] = (float) (gridScaleParameter == -1 ? scale : scale*particleParams[index][gridScaleParameter]);
+        }
+        fvec4 value, gradient[3];
+        grid->evaluateWithGradient(fvec4(x), fvec4(y), fvec4(z), value, gradient);
+        fvec4 s(particleScale);
+        if (includeForces) {
+            float fx[4], fy[4], fz[4];
+            (gradient[0]*s).store(fx);
+            (gradient[1]*s).store(fy);
+            (gradient[2]*s).store(fz);
+            for (int j = 0; j < 4; j++) {
+                RealVec& f = (*forces)[particles[order[entry+j]]];
+                f[0] -= fx[j];
+                f[1] -= fy[j];
+                f[2] -= fz[j];
+            }
+        }
+        if (includeEnergy) {
+            float e[4];
+            (value*s).store(e);
+            energy += e[0]+e[1]+e[2]+e[3];
+        }
+    }
+
+    // Process any remaining entries one at a time.
+
+    for (; entry < end; entry++) {
+        int index = order[entry];
+        int particle = particles[index];
+        const RealVec& pos = (*positions)[particle];
+        double point[3] = {pos[0], pos[1], pos[2]};
+        double value, gradient[3];
+        grid->evaluateWithGradient(point, value, gradient);
+        double particleScale = (gridScaleParameter == -1 ? scale : scale*particleParams[index][gridScaleParameter]);
+        if (includeForces) {
+            RealVec& f = (*forces)[particle];
+            f[0] -= particleScale*gradient[0];
+            f[1] -= particleScale*gradient[1];
+            f[2] -= particleScale*gradient[2];
+        }
+        if (includeEnergy)
+            energy += particleScale*value;
+    }
+}
@@ -35,12 +35,13 @@ using namespace std;
 
 class CpuCustomGBForce::ComputeForceTask : public ThreadPool::Task {
 public:
-    ComputeForceTask(CpuCustomGBForce& owner) : owner(owner) {
+    ComputeForceTask(CpuCustomGBForce& owner, int phase) : owner(owner), phase(phase) {
     }
     void execute(ThreadPool& threads, int threadIndex) {
-        owner.threadComputeForce(threads, threadIndex);
+        owner.threadComputeForce(threads, threadIndex, phase);
     }
     CpuCustomGBForce& owner;
+    int phase;
 };
 
 CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threadIndex,
@@ -103,7 +104,7 @@ CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threa
     dVdR2.resize(valueDerivExpressions.size());
 }
 
-CpuCustomGBForce::CpuCustomGBForce(int numAtoms, const std::vector<std::set<int> >& exclusions,
+CpuCustomGBForce::CpuCustomGBForce(int numAtoms, const CpuExclusions& exclusions,
                      const vector<Lepton::CompiledExpression>& valueExpressions,
                      const vector<vector<Lepton::CompiledExpression> >& valueDerivExpressions,
                      const vector<vector<Lepton::CompiledExpression> >& valueGradientExpressions,
@@ -167,37 +168,18 @@ void CpuCustomGBForce::calculateIxn(int numberOfAtoms, float* posq, RealOpenMM**
     gmx_atomic_t counter;
     this->atomicCounter = &counter;
 
-    // Calculate the first computed value.
+    // Signal the threads to start running and wait for them to finish.  There are two phases for the
+    // computed values, one for each energy term, one to sum the energy derivatives, and one to apply
+    // the chain rule.
 
-    ComputeForceTask task(*this);
-    gmx_atomic_set(&counter, 0);
-    threads.execute(task);
-    threads.waitForThreads();
-    
-    // Calculate the remaining computed values.
-    
-    threads.resumeThreads();
-    threads.waitForThreads();
-
-    // Calculate the energy terms.
-
-    for (int i = 0; i < (int) threadData[0]->energyExpressions.size(); i++) {
+    int numPhases = threadData[0]->energyExpressions.size()+4;
+    for (int phase = 0; phase < numPhases; phase++) {
+        ComputeForceTask task(*this, phase);
         gmx_atomic_set(&counter, 0);
         threads.execute(task);
         threads.waitForThreads();
     }
 
-    // Sum the energy derivatives.
-
-    threads.resumeThreads();
-    threads.waitForThreads();
-    
-    // Apply the chain rule to evaluate forces.
-
-    gmx_atomic_set(&counter, 0);
-    threads.resumeThreads();
-    threads.waitForThreads();
-
     // Combine the energies from all the threads.
     
     if (includeEnergy) {
@@ -207,79 +189,80 @@ void CpuCustomGBForce::calculateIxn(int numberOfAtoms, float* posq, RealOpenMM**
     }
 }
 
-void CpuCustomGBForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
+void CpuCustomGBForce::threadComputeForce(ThreadPool& threads, int threadIndex, int phase) {
     // Compute this thread's subset of interactions.
 
-    int numThreads = threads.getNumThreads();
-    threadEnergy[threadIndex] = 0;
     double& energy = threadEnergy[threadIndex];
     float* forces = &(*threadForce)[threadIndex][0];
     ThreadData& data = *threadData[threadIndex];
     fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
     fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
-    for (map<string, double>::const_iterator iter = globalParameters->begin(); iter != globalParameters->end(); ++iter)
-        data.expressionSet.setVariable(data.expressionSet.getVariableIndex(iter->first), iter->second);
-
-    // Calculate the first computed value.
-
-    for (int i = 0; i < (int) data.value0.size(); i++)
-        data.value0[i] = 0.0f;
-    if (valueTypes[0] == CustomGBForce::ParticlePair)
-        calculateParticlePairValue(0, data, numberOfAtoms, posq, atomParameters, true, boxSize, invBoxSize);
-    else
-        calculateParticlePairValue(0, data, numberOfAtoms, posq, atomParameters, false, boxSize, invBoxSize);
-    threads.syncThreads();
-
-    // Sum the first computed value and calculate the remaining ones.
-
-    int numValues = valueTypes.size();
-    for (int atom = data.firstAtom; atom < data.lastAtom; atom++) {
-        float sum = 0.0f;
-        for (int j = 0; j < (int) threadData.size(); j++)
-            sum += threadData[j]->value0[atom];
-        values[0][atom] = sum;
-        data.expressionSet.setVariable(data.xindex, posq[4*atom]);
-        data.expressionSet.setVariable(data.yindex, posq[4*atom+1]);
-        data.expressionSet.setVariable(data.zindex, posq[4*atom+2]);
-        for (int j = 0; j < (int) paramNames.size(); j++)
-            data.expressionSet.setVariable(data.paramIndex[j], atomParameters[atom][j]);
-        for (int i = 1; i < numValues; i++) {
-            data.expressionSet.setVariable(data.valueIndex[i-1], values[i-1][atom]);
-            values[i][atom] = (float) data.valueExpressions[i].evaluate();
-        }
+    int numTerms = data.energyExpressions.size();
+    if (phase == 0) {
+        threadEnergy[threadIndex] = 0;
+        for (map<string, double>::const_iterator iter = globalParameters->begin(); iter != globalParameters->end(); ++iter)
+            data.expressionSet.setVariable(data.expressionSet.getVariableIndex(iter->first), iter->second);
+
+        // Calculate the first computed value.
+
+        for (int i = 0; i < (int) data.value0.size(); i++)
+            data.value0[i] = 0.0f;
+        if (valueTypes[0] == CustomGBForce::ParticlePair)
+            calculateParticlePairValue(0, data, numberOfAtoms, posq, atomParameters, true, boxSize, invBoxSize);
+        else
+            calculateParticlePairValue(0, data, numberOfAtoms, posq, atomParameters, false, boxSize, invBoxSize);
     }
-    threads.syncThreads();
+    else if (phase == 1) {
+        // Sum the first computed value and calculate the remaining ones.
 
-    // Now calculate the energy and its derivatives.
+        int numValues = valueTypes.size();
+        for (int atom = data.firstAtom; atom < data.lastAtom; atom++) {
+            float sum = 0.0f;
+            for (int j = 0; j < (int) threadData.size(); j++)
+                sum += threadData[j]->value0[atom];
+            values[0][atom] = sum;
+            data.expressionSet.setVariable(data.xindex, posq[4*atom]);
+            data.expressionSet.setVariable(data.yindex, posq[4*atom+1]);
+            data.expressionSet.setVariable(data.zindex, posq[4*atom+2]);
+            for (int j = 0; j < (int) paramNames.size(); j++)
+                data.expressionSet.setVariable(data.paramIndex[j], atomParameters[atom][j]);
+            for (int i = 1; i < numValues; i++) {
+                data.expressionSet.setVariable(data.valueIndex[i-1], values[i-1][atom]);
+                values[i][atom] = (float) data.valueExpressions[i].evaluate();
+            }
+        }
+        for (int i = 0; i < (int) data.dEdV.size(); i++)
+            for (int j = 0; j < (int) data.dEdV[i].size(); j++)
+                data.dEdV[i][j] = 0.0;
+    }
+    else if (phase < numTerms+2) {
+        // Calculate one energy term and its derivatives.
 
-    for (int i = 0; i < (int) data.dEdV.size(); i++)
-        for (int j = 0; j < (int) data.dEdV[i].size(); j++)
-            data.dEdV[i][j] = 0.0;
-    for (int termIndex = 0; termIndex < (int) data.energyExpressions.size(); termIndex++) {
+        int termIndex = phase-2;
         if (energyTypes[termIndex] == CustomGBForce::SingleParticle)
             calculateSingleParticleEnergyTerm(termIndex, data, numberOfAtoms, posq, atomParameters, forces, energy);
         else if (energyTypes[termIndex] == CustomGBForce::ParticlePair)
             calculateParticlePairEnergyTerm(termIndex, data, numberOfAtoms, posq, atomParameters, true, forces, energy, boxSize, invBoxSize);
         else
             calculateParticlePairEnergyTerm(termIndex, data, numberOfAtoms, posq, atomParameters, false, forces, energy, boxSize, invBoxSize);
-        threads.syncThreads();
     }
-
-    // Sum the energy derivatives.
-
-    for (int atom = data.firstAtom; atom < data.lastAtom; atom++) {
-        for (int i = 0; i < (int) dEdV.size(); i++) {
-            float sum = 0.0f;
-            for (int j = 0; j < (int) threadData.size(); j++)
-                sum += threadData[j]->dEdV[i][atom];
-            dEdV[i][atom] = sum;
+    else if (phase == numTerms+2) {
+        // Sum the energy derivatives.
+
+        for (int atom = data.firstAtom; atom < data.lastAtom; atom++) {
+            for (int i = 0; i < (int) dEdV.size(); i++) {
+                float sum = 0.0f;
+                for (int j = 0; j < (int) threadData.size(); j++)
+                    sum += threadData[j]->dEdV[i][atom];
+                dEdV[i][atom] = sum;
+            }
         }
     }
-    threads.syncThreads();
-
-    // Apply the chain rule to evaluate forces.
+    else {
+        // Apply the chain rule to evaluate forces.
 
-    calculateChainRuleForces(data, numberOfAtoms, posq, atomParameters, forces, boxSize, invBoxSize);
+        calculateChainRuleForces(data, numberOfAtoms, posq, atomParameters, forces, boxSize, invBoxSize);
+    }
 }
 
 void CpuCustomGBForce::calculateParticlePairValue(int index, ThreadData& data, int numAtoms, float* posq, RealOpenMM** atomParameters,
@@ -294,15 +277,16 @@ void CpuCustomGBForce::calculateParticlePairValue(int index, ThreadData& data, i
             int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (blockIndex >= neighborList->getNumBlocks())
                 break;
-            const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+            const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
             const vector<char>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
-                int first = neighbors[i];
+                int first = sortedAtoms[neighbors[i]];
                 for (int k = 0; k < 4; k++) {
                     if ((blockExclusions[i] & (1<<k)) == 0) {
                         int second = blockAtom[k];
-                        if (useExclusions && exclusions[first].find(second) != exclusions[first].end())
+                        if (useExclusions && exclusions.isExcluded(first, second))
                             continue;
                         calculateOnePairValue(index, first, second, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
                         calculateOnePairValue(index, second, first, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
@@ -319,7 +303,7 @@ void CpuCustomGBForce::calculateParticlePairValue(int index, ThreadData& data, i
             if (i >= numAtoms)
                 break;
             for (int j = i+1; j < numAtoms; j++) {
-                if (useExclusions && exclusions[i].find(j) != exclusions[i].end())
+                if (useExclusions && exclusions.isExcluded(i, j))
                     continue;
                 calculateOnePairValue(index, i, j, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
                 calculateOnePairValue(index, j, i, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
@@ -379,15 +363,16 @@ void CpuCustomGBForce::calculateParticlePairEnergyTerm(int index, ThreadData& da
             int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (blockIndex >= neighborList->getNumBlocks())
                 break;
-            const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+            const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
             const vector<char>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
-                int first = neighbors[i];
+                int first = sortedAtoms[neighbors[i]];
                 for (int k = 0; k < 4; k++) {
                     if ((blockExclusions[i] & (1<<k)) == 0) {
                         int second = blockAtom[k];
-                        if (useExclusions && exclusions[first].find(second) != exclusions[first].end())
+                        if (useExclusions && exclusions.isExcluded(first, second))
                             continue;
                         calculateOnePairEnergyTerm(index, first, second, data, posq, atomParameters, forces, totalEnergy, boxSize, invBoxSize);
                     }
@@ -403,7 +388,7 @@ void CpuCustomGBForce::calculateParticlePairEnergyTerm(int index, ThreadData& da
             if (i >= numAtoms)
                 break;
             for (int j = i+1; j < numAtoms; j++) {
-                if (useExclusions && exclusions[i].find(j) != exclusions[i].end())
+                if (useExclusions && exclusions.isExcluded(i, j))
                     continue;
                 calculateOnePairEnergyTerm(index, i, j, data, posq, atomParameters, forces, totalEnergy, boxSize, invBoxSize);
            }
@@ -460,15 +445,16 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
             int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (blockIndex >= neighborList->getNumBlocks())
                 break;
-            const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+            const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
             const vector<char>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
-                int first = neighbors[i];
+                int first = sortedAtoms[neighbors[i]];
                 for (int k = 0; k < 4; k++) {
                     if ((blockExclusions[i] & (1<<k)) == 0) {
                         int second = blockAtom[k];
-                        bool isExcluded = (exclusions[first].find(second) != exclusions[first].end());
+                        bool isExcluded = exclusions.isExcluded(first, second);
                         calculateOnePairChainRule(first, second, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
                         calculateOnePairChainRule(second, first, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
                     }
@@ -484,7 +470,7 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
             if (i >= numAtoms)
                 break;
             for (int j = i+1; j < numAtoms; j++) {
-                bool isExcluded = (exclusions[i].find(j) != exclusions[i].end());
+                bool isExcluded = exclusions.isExcluded(i, j);
                 calculateOnePairChainRule(i, j, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
                 calculateOnePairChainRule(j, i, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
            }
@@ -29,10 +29,11 @@
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceForce.h"
 #include "CpuCustomManyParticleForce.h"
-#include "ReferenceTabulatedFunction.h"
+#include "CpuTabulatedFunction.h"
 #include "openmm/internal/CustomManyParticleForceImpl.h"
 #include "lepton/CustomFunction.h"
 #include "gmx_atomic.h"
+#include <algorithm>
 
 using namespace OpenMM;
 using namespace std;
@@ -47,8 +48,18 @@ public:
     CpuCustomManyParticleForce& owner;
 };
 
+class CpuCustomManyParticleForce::BuildNeighborsTask : public ThreadPool::Task {
+public:
+    BuildNeighborsTask(CpuCustomManyParticleForce& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadBuildNeighbors(threads, threadIndex);
+    }
+    CpuCustomManyParticleForce& owner;
+};
+
 CpuCustomManyParticleForce::CpuCustomManyParticleForce(const CustomManyParticleForce& force, ThreadPool& threads) :
-            threads(threads), useCutoff(false), usePeriodic(false), neighborList(NULL) {
+            useCutoff(false), usePeriodic(false), threads(threads), exclusions(force.getNumParticles()), neighborListValid(false) {
     numParticles = force.getNumParticles();
     numParticlesPerSet = force.getNumParticlesPerSet();
     numPerParticleParameters = force.getNumPerParticleParameters();
@@ -58,7 +69,7 @@ CpuCustomManyParticleForce::CpuCustomManyParticleForce(const CustomManyParticleF
 
     map<string, Lepton::CustomFunction*> functions;
     for (int i = 0; i < (int) force.getNumTabulatedFunctions(); i++)
-        functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
+        functions[force.getTabulatedFunctionName(i)] = createCpuTabulatedFunction(force.getTabulatedFunction(i));
 
     // Parse the expression and create the objects used to calculate the interaction.
 
@@ -78,13 +89,10 @@ CpuCustomManyParticleForce::CpuCustomManyParticleForce(const CustomManyParticleF
     
     // Record exclusions.
     
-    exclusions.resize(force.getNumParticles());
-    for (int i = 0; i < (int) force.getNumExclusions(); i++) {
-        int p1, p2;
-        force.getExclusionParticles(i, p1, p2);
-        exclusions[p1].insert(p2);
-        exclusions[p2].insert(p1);
-    }
+    vector<pair<int, int> > excludedPairs(force.getNumExclusions());
+    for (int i = 0; i < (int) force.getNumExclusions(); i++)
+        force.getExclusionParticles(i, excludedPairs[i].first, excludedPairs[i].second);
+    exclusions = CpuExclusions(numParticles, excludedPairs, threads);
     
     // Record information about type filters.
     
@@ -92,8 +100,6 @@ CpuCustomManyParticleForce::CpuCustomManyParticleForce(const CustomManyParticleF
 }
 
 CpuCustomManyParticleForce::~CpuCustomManyParticleForce() {
-    if (neighborList != NULL)
-        delete neighborList;
     for (int i = 0; i < (int) threadData.size(); i++)
         delete threadData[i];
 }
@@ -112,31 +118,23 @@ void CpuCustomManyParticleForce::calculateIxn(AlignedArray<float>& posq, RealOpe
     gmx_atomic_t counter;
     gmx_atomic_set(&counter, 0);
     this->atomicCounter = &counter;
-    if (useCutoff) {
-        // Construct a neighbor list.  We use CpuNeighborList to do this, but then copy the result
-        // into a new data structure.  This is needed because in UniqueCentralParticle mode, the
-        // the neighbor list needs to include symmetric pairs.
+    if (useCutoff && !isNeighborListValid()) {
+        // Build a new neighbor list.  It includes every pair within the cutoff plus padding, so it
+        // can be reused until some particle moves far enough that a missing pair might come within
+        // the cutoff.  In UniqueCentralParticle mode each pair appears in the lists of both particles.
+        // Otherwise it only appears in the list of the lower index particle, so every set of particles
+        // is enumerated once.
         
+        buildCells();
         particleNeighbors.resize(numParticles);
-        for (int i = 0; i < numParticles; i++)
-            particleNeighbors[i].clear();
-        neighborList->computeNeighborList(numParticles, posq, exclusions, periodicBoxVectors, usePeriodic, cutoffDistance, threads);
-        for (int blockIndex = 0; blockIndex < neighborList->getNumBlocks(); blockIndex++) {
-            const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
-            int numNeighbors = neighbors.size();
-            for (int i = 0; i < 4; i++) {
-                int p1 = neighborList->getSortedAtoms()[4*blockIndex+i];
-                for (int j = 0; j < numNeighbors; j++) {
-                    if ((exclusions[j] & (1<<i)) == 0) {
-                        int p2 = neighbors[j];
-                        particleNeighbors[p1].push_back(p2);
-                        if (centralParticleMode)
-                            particleNeighbors[p2].push_back(p1);
-                    }
-                }
-            }
-        }
+        BuildNeighborsTask task(*this);
+        threads.execute(task);
+        threads.waitForThreads();
+        neighborListPositions.assign(this->posq, this->posq+4*numParticles);
+        for (int i = 0; i < 3; i++)
+            neighborListBoxVectors[i] = periodicBoxVectors[i];
+        neighborListValid = true;
+        gmx_atomic_set(&counter, 0);
     }
     
     // Signal the threads to start running and wait for them to finish.
@@ -191,11 +189,163 @@ void CpuCustomManyParticleForce::threadComputeForce(ThreadPool& threads, int thr
     }
 }
 
+bool CpuCustomManyParticleForce::isNeighborListValid() const {
+    if (!neighborListValid)
+        return false;
+    if (usePeriodic)
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                if (neighborListBoxVectors[i][j] != periodicBoxVectors[i][j])
+                    return false;
+    float maxDelta2 = (float) (0.25*neighborPadding*neighborPadding);
+    for (int i = 0; i < numParticles; i++) {
+        fvec4 delta = fvec4(posq+4*i)-fvec4(&neighborListPositions[4*i]);
+        if (dot3(delta, delta) > maxDelta2)
+            return false;
+    }
+    return true;
+}
+
+void CpuCustomManyParticleForce::buildCells() {
+    // Select the cell size and the function for mapping positions to cells.  With periodic boundary
+    // conditions we work in fractional coordinates, and the number of cells along each axis is chosen
+    // based on the distance between opposite faces of the box.  This guarantees that all neighbors
+    // of a particle are in adjacent cells, even for triclinic boxes.
+    
+    double cellSize = cutoffDistance+neighborPadding;
+    double recipBox[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    double minPos[3] = {0, 0, 0};
+    if (usePeriodic) {
+        const RealVec* box = periodicBoxVectors;
+        double volume = box[0][0]*box[1][1]*box[2][2];
+        double width[3];
+        width[0] = volume/sqrt(box[1].cross(box[2]).dot(box[1].cross(box[2])));
+        width[1] = volume/sqrt(box[2].cross(box[0]).dot(box[2].cross(box[0])));
+        width[2] = volume/sqrt(box[0].cross(box[1]).dot(box[0].cross(box[1])));
+        for (int i = 0; i < 3; i++)
+            numCells[i] = max(1, (int) floor(width[i]/cellSize));
+        
+        // The box vectors form a lower triangular matrix, so its inverse is easy to compute.
+        
+        recipBox[2][2] = 1.0/box[2][2];
+        recipBox[1][1] = 1.0/box[1][1];
+        recipBox[1][2] = -box[2][1]*recipBox[2][2]*recipBox[1][1];
+        recipBox[0][0] = 1.0/box[0][0];
+        recipBox[0][1] = -box[1][0]*recipBox[1][1]*recipBox[0][0];
+        recipBox[0][2] = -(box[2][0]*recipBox[0][0]+box[2][1]*recipBox[0][1])*recipBox[2][2];
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                recipBox[i][j] *= numCells[i];
+    }
+    else {
+        double maxPos[3];
+        for (int i = 0; i < 3; i++)
+            minPos[i] = maxPos[i] = posq[i];
+        for (int i = 1; i < numParticles; i++)
+            for (int j = 0; j < 3; j++) {
+                minPos[j] = min(minPos[j], (double) posq[4*i+j]);
+                maxPos[j] = max(maxPos[j], (double) posq[4*i+j]);
+            }
+        // Limit the number of cells along each axis, so a single distant particle cannot make the grid huge.
+        // Making the cells wider than the cutoff is still correct, since only adjacent cells are searched.
+
+        int maxCells = max(1, (int) (2*pow((double) numParticles, 1.0/3.0)));
+        for (int i = 0; i < 3; i++) {
+            double width = max(cellSize, (maxPos[i]-minPos[i])/maxCells);
+            numCells[i] = min(maxCells, (int) floor((maxPos[i]-minPos[i])/width)+1);
+            recipBox[i][i] = 1.0/width;
+        }
+    }
+    
+    // Assign particles to cells.
+    
+    int totalCells = numCells[0]*numCells[1]*numCells[2];
+    particleCell.resize(3*numParticles);
+    cellStart.resize(totalCells+1);
+    cellParticles.resize(numParticles);
+    vector<int> cellIndex(numParticles);
+    for (int i = 0; i < totalCells+1; i++)
+        cellStart[i] = 0;
+    for (int i = 0; i < numParticles; i++) {
+        for (int j = 0; j < 3; j++) {
+            double x = 0;
+            for (int k = 0; k < 3; k++)
+                x += (posq[4*i+k]-minPos[k])*recipBox[j][k];
+            int cell = (int) floor(x);
+            if (usePeriodic)
+                cell = ((cell%numCells[j])+numCells[j])%numCells[j];
+            else
+                cell = min(max(cell, 0), numCells[j]-1);
+            particleCell[3*i+j] = cell;
+        }
+        cellIndex[i] = particleCell[3*i]+numCells[0]*(particleCell[3*i+1]+numCells[1]*particleCell[3*i+2]);
+        cellStart[cellIndex[i]+1]++;
+    }
+    for (int i = 0; i < totalCells; i++)
+        cellStart[i+1] += cellStart[i];
+    vector<int> cellFill(cellStart.begin(), cellStart.end()-1);
+    for (int i = 0; i < numParticles; i++)
+        cellParticles[cellFill[cellIndex[i]]++] = i;
+}
+
+void CpuCustomManyParticleForce::threadBuildNeighbors(ThreadPool& threads, int threadIndex) {
+    fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
+    fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
+    float maxDistance = (float) (cutoffDistance+neighborPadding);
+    float maxDistance2 = maxDistance*maxDistance;
+    vector<int> cellRange[3];
+    while (true) {
+        int i = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+        if (i >= numParticles)
+            break;
+        
+        // Find the range of cells to search along each axis.  When there are fewer than three cells
+        // along a periodic axis, every cell along it is a neighbor, and must only be searched once.
+        
+        for (int j = 0; j < 3; j++) {
+            cellRange[j].clear();
+            if (usePeriodic && numCells[j] < 3) {
+                for (int k = 0; k < numCells[j]; k++)
+                    cellRange[j].push_back(k);
+            }
+            else {
+                for (int k = particleCell[3*i+j]-1; k <= particleCell[3*i+j]+1; k++) {
+                    if (usePeriodic)
+                        cellRange[j].push_back((k+numCells[j])%numCells[j]);
+                    else if (k >= 0 && k < numCells[j])
+                        cellRange[j].push_back(k);
+                }
+            }
+        }
+        
+        // Loop over particles in the neighboring cells.
+        
+        vector<int>& neighbors = particleNeighbors[i];
+        neighbors.clear();
+        fvec4 posI(posq+4*i);
+        for (int z = 0; z < (int) cellRange[2].size(); z++)
+            for (int y = 0; y < (int) cellRange[1].size(); y++)
+                for (int x = 0; x < (int) cellRange[0].size(); x++) {
+                    int cell = cellRange[0][x]+numCells[0]*(cellRange[1][y]+numCells[1]*cellRange[2][z]);
+                    for (int k = cellStart[cell]; k < cellStart[cell+1]; k++) {
+                        int j = cellParticles[k];
+                        if (j == i || (!centralParticleMode && j < i))
+                            continue;
+                        fvec4 deltaR;
+                        float r2;
+                        computeDelta(posI, fvec4(posq+4*j), deltaR, r2, boxSize, invBoxSize);
+                        if (r2 < maxDistance2)
+                            neighbors.push_back(j);
+                    }
+                }
+    }
+}
+
 void CpuCustomManyParticleForce::setUseCutoff(RealOpenMM distance) {
     useCutoff = true;
     cutoffDistance = distance;
-    if (neighborList == NULL)
-        neighborList = new CpuNeighborList(4);
+    neighborPadding = 0.1*distance;
+    neighborListValid = false;
 }
 
 void CpuCustomManyParticleForce::setPeriodic(RealVec* periodicBoxVectors) {
@@ -241,7 +391,7 @@ void CpuCustomManyParticleForce::loopOverInteractions(vector<int>& availablePart
             }
         }
         for (int j = 0; j < loopIndex && include; j++)
-            include &= (exclusions[particle].find(particleSet[j]) == exclusions[particle].end());
+            include &= !exclusions.isExcluded(particle, particleSet[j]);
         if (include) {
             if (loopIndex > 0 && availableParticles[i] == particleSet[0])
                 continue;
@@ -293,7 +443,16 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
         int p1 = permutedParticles[data.deltaPairs[i].first];
         int p2 = permutedParticles[data.deltaPairs[i].second];
         computeDelta(fvec4(posq+4*p1), fvec4(posq+4*p2), delta[i], norm2Delta[i], boxSize, invBoxSize);
-        normDelta[i] = sqrtf(norm2Delta[i]);
+    }
+    
+    // Compute the distances four at a time.  The arrays are padded to a multiple of 4.
+    
+    for (int i = 0; i < numDeltas; i += 4) {
+        fvec4 dx = delta[i], dy = delta[i+1], dz = delta[i+2], dw = delta[i+3];
+        transpose(dx, dy, dz, dw);
+        fvec4 r2 = dx*dx + dy*dy + dz*dz;
+        r2.store(&norm2Delta[i]);
+        sqrt(r2).store(&normDelta[i]);
     }
     
     // Compute all of the variables the energy can depend on.
@@ -306,16 +465,22 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
         const DistanceTermInfo& term = data.distanceTerms[i];
         expressionSet.setVariable(term.variableIndex, normDelta[term.delta]);
     }
-    for (int i = 0; i < (int) data.angleTerms.size(); i++) {
-        const AngleTermInfo& term = data.angleTerms[i];
-        expressionSet.setVariable(term.variableIndex, computeAngle(delta[term.delta1], delta[term.delta2], norm2Delta[term.delta1], norm2Delta[term.delta2], term.delta1Sign*term.delta2Sign));
-    }
+    int numAngles = data.angleTerms.size();
+    for (int i = 0; i < numAngles; i += 4)
+        computeAngles(data, i);
+    for (int i = 0; i < numAngles; i++)
+        expressionSet.setVariable(data.angleTerms[i].variableIndex, data.angles[i]);
     for (int i = 0; i < (int) data.dihedralTerms.size(); i++) {
         const DihedralTermInfo& term = data.dihedralTerms[i];
         expressionSet.setVariable(term.variableIndex, getDihedralAngleBetweenThreeVectors(delta[term.delta1], delta[term.delta2], delta[term.delta3], cross1[i], cross2[i], delta[term.delta1]));
     }
     
     if (includeForces) {
+        // Evaluate the energy and all its derivatives in a single pass.
+
+        const Lepton::CompiledExpression& forceExpression = data.energyAndForceExpression;
+        forceExpression.evaluate();
+
         // Apply forces based on individual particle coordinates.
 
         AlignedArray<fvec4>& f = data.f;
@@ -325,7 +490,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
             const ParticleTermInfo& term = data.particleTerms[i];
             float temp[4];
             f[term.atom].store(temp);
-            temp[term.component] -= term.forceExpression.evaluate();
+            temp[term.component] -= forceExpression.getOutput(term.outputIndex);
             f[term.atom] = fvec4(temp);
         }
 
@@ -333,7 +498,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
 
         for (int i = 0; i < (int) data.distanceTerms.size(); i++) {
             const DistanceTermInfo& term = data.distanceTerms[i];
-            float dEdR = (float) (term.forceExpression.evaluate()*term.deltaSign/(normDelta[term.delta]));
+            float dEdR = (float) (forceExpression.getOutput(term.outputIndex)*term.deltaSign/(normDelta[term.delta]));
             fvec4 force = -dEdR*delta[term.delta];
             f[term.p1] -= force;
             f[term.p2] += force;
@@ -343,7 +508,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
 
         for (int i = 0; i < (int) data.angleTerms.size(); i++) {
             const AngleTermInfo& term = data.angleTerms[i];
-            float dEdTheta = (float) term.forceExpression.evaluate();
+            float dEdTheta = (float) forceExpression.getOutput(term.outputIndex);
             fvec4 thetaCross = cross(delta[term.delta1], delta[term.delta2]);
             float lengthThetaCross = sqrtf(dot3(thetaCross, thetaCross));
             if (lengthThetaCross < 1.0e-6f)
@@ -364,7 +529,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
 
         for (int i = 0; i < (int) data.dihedralTerms.size(); i++) {
             const DihedralTermInfo& term = data.dihedralTerms[i];
-            float dEdTheta = (float) term.forceExpression.evaluate();
+            float dEdTheta = (float) forceExpression.getOutput(term.outputIndex);
             float normCross1 = dot3(cross1[i], cross1[i]);
             float normBC = normDelta[term.delta2];
             float forceFactors[4];
@@ -395,7 +560,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
     // Add the energy
 
     if (includeEnergy)
-        data.energy += data.energyExpression.evaluate();
+        data.energy += (includeForces ? data.energyAndForceExpression.getOutput(0) : data.energyExpression.evaluate());
 }
 
 void CpuCustomManyParticleForce::computeDelta(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, const fvec4& boxSize, const fvec4& invBoxSize) const {
@@ -430,6 +595,38 @@ float CpuCustomManyParticleForce::computeAngle(const fvec4& vi, const fvec4& vj,
     return acosf(cosine);
 }
 
+void CpuCustomManyParticleForce::computeAngles(ThreadData& data, int firstTerm) {
+    // Load the vectors for up to four angles and compute the cosines with vector operations.
+    
+    int numAngles = min(4, (int) data.angleTerms.size()-firstTerm);
+    fvec4 v1[4], v2[4];
+    float v2i[4], v2j[4], sign[4];
+    for (int i = 0; i < 4; i++) {
+        const AngleTermInfo& term = data.angleTerms[firstTerm+min(i, numAngles-1)];
+        v1[i] = data.delta[term.delta1];
+        v2[i] = data.delta[term.delta2];
+        v2i[i] = data.norm2Delta[term.delta1];
+        v2j[i] = data.norm2Delta[term.delta2];
+        sign[i] = term.delta1Sign*term.delta2Sign;
+    }
+    transpose(v1[0], v1[1], v1[2], v1[3]);
+    transpose(v2[0], v2[1], v2[2], v2[3]);
+    fvec4 dot = (v1[0]*v2[0] + v1[1]*v2[1] + v1[2]*v2[2])*fvec4(sign);
+    float cosine[4];
+    (dot/sqrt(fvec4(v2i)*fvec4(v2j))).store(cosine);
+    
+    // Compute the angles.  Close to the singularity in acos(), fall back to the more careful scalar version.
+    
+    for (int i = 0; i < numAngles; i++) {
+        if (cosine[i] > 0.99f || cosine[i] < -0.99f) {
+            const AngleTermInfo& term = data.angleTerms[firstTerm+i];
+            data.angles[firstTerm+i] = computeAngle(data.delta[term.delta1], data.delta[term.delta2], v2i[i], v2j[i], sign[i]);
+        }
+        else
+            data.angles[firstTerm+i] = acosf(cosine[i]);
+    }
+}
+
 float CpuCustomManyParticleForce::getDihedralAngleBetweenThreeVectors(const fvec4& v1, const fvec4& v2, const fvec4& v3, fvec4& cross1, fvec4& cross2, const fvec4& signVector) {
     cross1 = cross(v1, v2);
     cross2 = cross(v2, v3);
@@ -440,26 +637,26 @@ float CpuCustomManyParticleForce::getDihedralAngleBetweenThreeVectors(const fvec
     return angle;
 }
 
-CpuCustomManyParticleForce::ParticleTermInfo::ParticleTermInfo(const string& name, int atom, int component, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), atom(atom), component(component), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::ParticleTermInfo::ParticleTermInfo(const string& name, int atom, int component, int outputIndex, ThreadData& data) :
+        name(name), atom(atom), component(component), outputIndex(outputIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
 }
 
-CpuCustomManyParticleForce::DistanceTermInfo::DistanceTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), p1(atoms[0]), p2(atoms[1]), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::DistanceTermInfo::DistanceTermInfo(const string& name, const vector<int>& atoms, int outputIndex, ThreadData& data) :
+        name(name), p1(atoms[0]), p2(atoms[1]), outputIndex(outputIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
     data.requestDeltaPair(p1, p2, delta, deltaSign, true);
 }
 
-CpuCustomManyParticleForce::AngleTermInfo::AngleTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::AngleTermInfo::AngleTermInfo(const string& name, const vector<int>& atoms, int outputIndex, ThreadData& data) :
+        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), outputIndex(outputIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
     data.requestDeltaPair(p1, p2,delta1, delta1Sign, true);
     data.requestDeltaPair(p3, p2, delta2, delta2Sign, true);
 }
 
-CpuCustomManyParticleForce::DihedralTermInfo::DihedralTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), p4(atoms[3]), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::DihedralTermInfo::DihedralTermInfo(const string& name, const vector<int>& atoms, int outputIndex, ThreadData& data) :
+        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), p4(atoms[3]), outputIndex(outputIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
     float sign;
     data.requestDeltaPair(p2, p1, delta1, sign, false);
@@ -475,45 +672,54 @@ CpuCustomManyParticleForce::ThreadData::ThreadData(const CustomManyParticleForce
     permutedParticles.resize(numParticlesPerSet);
     f.resize(numParticlesPerSet);
     energyExpression = energyExpr.createCompiledExpression();
-    expressionSet.registerExpression(energyExpression);
 
-    // Differentiate the energy to get expressions for the force.
+    // Differentiate the energy to get expressions for the force.  The energy and all its derivatives are
+    // compiled into a single program, so subexpressions they share are only evaluated once.
 
+    vector<Lepton::ParsedExpression> outputs;
+    outputs.push_back(energyExpr);
     for (int i = 0; i < numParticlesPerSet; i++) {
         stringstream xname, yname, zname;
         xname << 'x' << (i+1);
         yname << 'y' << (i+1);
         zname << 'z' << (i+1);
-        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(xname.str(), i, 0, energyExpr.differentiate(xname.str()).optimize().createCompiledExpression(), *this));
-        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(yname.str(), i, 1, energyExpr.differentiate(yname.str()).optimize().createCompiledExpression(), *this));
-        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(zname.str(), i, 2, energyExpr.differentiate(zname.str()).optimize().createCompiledExpression(), *this));
+        outputs.push_back(energyExpr.differentiate(xname.str()));
+        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(xname.str(), i, 0, outputs.size()-1, *this));
+        outputs.push_back(energyExpr.differentiate(yname.str()));
+        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(yname.str(), i, 1, outputs.size()-1, *this));
+        outputs.push_back(energyExpr.differentiate(zname.str()));
+        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(zname.str(), i, 2, outputs.size()-1, *this));
         for (int j = 0; j < numPerParticleParameters; j++) {
             stringstream paramname;
             paramname << force.getPerParticleParameterName(j) << (i+1);
             particleParamIndices[i].push_back(expressionSet.getVariableIndex(paramname.str()));
         }
     }
-    for (map<string, vector<int> >::const_iterator iter = dihedrals.begin(); iter != dihedrals.end(); ++iter)
-        dihedralTerms.push_back(CpuCustomManyParticleForce::DihedralTermInfo(iter->first, iter->second, energyExpr.differentiate(iter->first).optimize().createCompiledExpression(), *this));
-    for (map<string, vector<int> >::const_iterator iter = distances.begin(); iter != distances.end(); ++iter)
-        distanceTerms.push_back(CpuCustomManyParticleForce::DistanceTermInfo(iter->first, iter->second, energyExpr.differentiate(iter->first).optimize().createCompiledExpression(), *this));
-    for (map<string, vector<int> >::const_iterator iter = angles.begin(); iter != angles.end(); ++iter)
-        angleTerms.push_back(CpuCustomManyParticleForce::AngleTermInfo(iter->first, iter->second, energyExpr.differentiate(iter->first).optimize().createCompiledExpression(), *this));
-    for (int i = 0; i < particleTerms.size(); i++)
-        expressionSet.registerExpression(particleTerms[i].forceExpression);
-    for (int i = 0; i < distanceTerms.size(); i++)
-        expressionSet.registerExpression(distanceTerms[i].forceExpression);
-    for (int i = 0; i < angleTerms.size(); i++)
-        expressionSet.registerExpression(angleTerms[i].forceExpression);
-    for (int i = 0; i < dihedralTerms.size(); i++)
-        expressionSet.registerExpression(dihedralTerms[i].forceExpression);
+    for (map<string, vector<int> >::const_iterator iter = dihedrals.begin(); iter != dihedrals.end(); ++iter) {
+        outputs.push_back(energyExpr.differentiate(iter->first));
+        dihedralTerms.push_back(CpuCustomManyParticleForce::DihedralTermInfo(iter->first, iter->second, outputs.size()-1, *this));
+    }
+    for (map<string, vector<int> >::const_iterator iter = distances.begin(); iter != distances.end(); ++iter) {
+        outputs.push_back(energyExpr.differentiate(iter->first));
+        distanceTerms.push_back(CpuCustomManyParticleForce::DistanceTermInfo(iter->first, iter->second, outputs.size()-1, *this));
+    }
+    for (map<string, vector<int> >::const_iterator iter = angles.begin(); iter != angles.end(); ++iter) {
+        outputs.push_back(energyExpr.differentiate(iter->first));
+        angleTerms.push_back(CpuCustomManyParticleForce::AngleTermInfo(iter->first, iter->second, outputs.size()-1, *this));
+    }
+    energyAndForceExpression = Lepton::CompiledExpression(outputs);
+    expressionSet.registerExpression(energyExpression);
+    expressionSet.registerExpression(energyAndForceExpression);
     int numDeltas = deltaPairs.size();
-    delta.resize(numDeltas);
-    normDelta.resize(numDeltas);
-    norm2Delta.resize(numDeltas);
+    int paddedNumDeltas = 4*((numDeltas+3)/4);
+    delta.resize(paddedNumDeltas);
+    for (int i = numDeltas; i < paddedNumDeltas; i++)
+        delta[i] = fvec4(1.0f, 0.0f, 0.0f, 0.0f);
+    normDelta.resize(paddedNumDeltas);
+    norm2Delta.resize(paddedNumDeltas);
     cross1.resize(numDeltas);
     cross2.resize(numDeltas);
-    
+    this->angles.resize(angleTerms.size());
 }
 
 void CpuCustomManyParticleForce::ThreadData::requestDeltaPair(int p1, int p2, int& pairIndex, float& pairSign, bool allowReversed) {
@@ -43,25 +43,25 @@ public:
     CpuCustomNonbondedForce& owner;
 };
 
-CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames) :
-            energyExpression(energyExpression), forceExpression(forceExpression) {
+CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& energyAndForceExpression, const vector<string>& parameterNames) :
+            energyExpression(energyExpression), energyAndForceExpression(energyAndForceExpression) {
     energyR = ReferenceForce::getVariablePointer(this->energyExpression, "r");
-    forceR = ReferenceForce::getVariablePointer(this->forceExpression, "r");
+    forceR = ReferenceForce::getVariablePointer(this->energyAndForceExpression, "r");
     for (int i = 0; i < (int) parameterNames.size(); i++) {
         for (int j = 1; j < 3; j++) {
             stringstream name;
             name << parameterNames[i] << j;
             energyParticleParams.push_back(ReferenceForce::getVariablePointer(this->energyExpression, name.str()));
-            forceParticleParams.push_back(ReferenceForce::getVariablePointer(this->forceExpression, name.str()));
+            forceParticleParams.push_back(ReferenceForce::getVariablePointer(this->energyAndForceExpression, name.str()));
         }
     }
 }
 
 CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression,
-            const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames, const vector<set<int> >& exclusions,ThreadPool& threads) :
-            cutoff(false), useSwitch(false), periodic(false), paramNames(parameterNames), exclusions(exclusions), threads(threads) {
+            const Lepton::CompiledExpression& energyAndForceExpression, const vector<string>& parameterNames, const CpuExclusions& exclusions, ThreadPool& threads) :
+            cutoff(false), useSwitch(false), periodic(false), useTable(false), paramNames(parameterNames), exclusions(exclusions), threads(threads) {
     for (int i = 0; i < threads.getNumThreads(); i++)
-        threadData.push_back(new ThreadData(energyExpression, forceExpression, parameterNames));
+        threadData.push_back(new ThreadData(energyExpression, energyAndForceExpression, parameterNames));
 }
 
 CpuCustomNonbondedForce::~CpuCustomNonbondedForce() {
@@ -81,7 +81,7 @@ void CpuCustomNonbondedForce::setInteractionGroups(const vector<pair<set<int>, s
         const set<int>& set2 = groups[group].second;
         for (set<int>::const_iterator atom1 = set1.begin(); atom1 != set1.end(); ++atom1) {
             for (set<int>::const_iterator atom2 = set2.begin(); atom2 != set2.end(); ++atom2) {
-                if (*atom1 == *atom2 || exclusions[*atom1].find(*atom2) != exclusions[*atom1].end())
+                if (*atom1 == *atom2 || exclusions.isExcluded(*atom1, *atom2))
                     continue; // This is an excluded interaction.
                 if (*atom1 > *atom2 && set1.find(*atom2) != set1.end() && set2.find(*atom1) != set2.end())
                     continue; // Both atoms are in both sets, so skip duplicate interactions.
@@ -117,6 +117,22 @@ void CpuCustomNonbondedForce::setPeriodic(RealVec* periodicBoxVectors) {
                  periodicBoxVectors[2][0] != 0.0 || periodicBoxVectors[2][1] != 0.0);
 }
 
+void CpuCustomNonbondedForce::setTabulatedPotential(const CpuContinuous1DFunction& function, double scale) {
+    // Store the coefficients for each interval as a single fvec4, so one aligned load fetches
+    // everything needed to evaluate the spline.
+
+    double min, max;
+    vector<double> coeff;
+    function.getCoefficients(min, max, coeff);
+    useTable = true;
+    tableIntervals = coeff.size()/4;
+    tableMin = (float) min;
+    tableMax = (float) max;
+    tableInvDelta = (float) (tableIntervals/(max-min));
+    tableCoeff.resize(coeff.size());
+    for (int i = 0; i < (int) coeff.size(); i++)
+        tableCoeff[i] = (float) (scale*coeff[i]);
+}
 
 void CpuCustomNonbondedForce::calculatePairIxn(int numberOfAtoms, float* posq, vector<RealVec>& atomCoordinates, RealOpenMM** atomParameters,
                                              RealOpenMM* fixedParameters, const map<string, double>& globalParameters,
@@ -161,7 +177,7 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
     ThreadData& data = *threadData[threadIndex];
     for (map<string, double>::const_iterator iter = globalParameters->begin(); iter != globalParameters->end(); ++iter) {
         ReferenceForce::setVariable(ReferenceForce::getVariablePointer(data.energyExpression, iter->first), iter->second);
-        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(data.forceExpression, iter->first), iter->second);
+        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(data.energyAndForceExpression, iter->first), iter->second);
     }
     fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
     fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
@@ -190,11 +206,16 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
             int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (blockIndex >= neighborList->getNumBlocks())
                 break;
-            const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+            if (useTable) {
+                calculateBlockTableIxn(blockIndex, forces, energy, boxSize, invBoxSize);
+                continue;
+            }
+            const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
             const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
-                int first = neighbors[i];
+                int first = sortedAtoms[neighbors[i]];
                 for (int j = 0; j < (int) paramNames.size(); j++) {
                     ReferenceForce::setVariable(data.energyParticleParams[j*2], atomParameters[first][j]);
                     ReferenceForce::setVariable(data.forceParticleParams[j*2], atomParameters[first][j]);
@@ -220,7 +241,7 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
             if (ii >= numberOfAtoms)
                 break;
             for (int jj = ii+1; jj < numberOfAtoms; jj++) {
-                if (exclusions[jj].find(ii) == exclusions[jj].end()) {
+                if (!exclusions.isExcluded(ii, jj)) {
                     for (int j = 0; j < (int) paramNames.size(); j++) {
                         ReferenceForce::setVariable(data.energyParticleParams[j*2], atomParameters[ii][j]);
                         ReferenceForce::setVariable(data.energyParticleParams[j*2+1], atomParameters[jj][j]);
@@ -251,8 +272,15 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
 
     ReferenceForce::setVariable(data.energyR, r);
     ReferenceForce::setVariable(data.forceR, r);
-    double dEdR = (includeForce ? data.forceExpression.evaluate()/r : 0.0);
-    double energy = (includeEnergy ? data.energyExpression.evaluate() : 0.0);
+    double dEdR = 0.0, energy = 0.0;
+    if (includeForce) {
+        // The energy and its derivative are evaluated together in a single pass.
+
+        energy = data.energyAndForceExpression.evaluate();
+        dEdR = data.energyAndForceExpression.getOutput(1)/r;
+    }
+    else if (includeEnergy)
+        energy = data.energyExpression.evaluate();
     if (useSwitch) {
         if (r > switchingDistance) {
             RealOpenMM t = (r-switchingDistance)/(cutoffDistance-switchingDistance);
@@ -262,15 +290,129 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
             energy *= switchValue;
         }
     }
-    fvec4 result = deltaR*dEdR;
-    (fvec4(forces+4*ii)+result).store(forces+4*ii);
-    (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    if (includeForce) {
+        fvec4 result = deltaR*dEdR;
+        (fvec4(forces+4*ii)+result).store(forces+4*ii);
+        (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    }
 
     // accumulate energies
 
     totalEnergy += energy;
 }
 
+void CpuCustomNonbondedForce::calculateBlockTableIxn(int blockIndex, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
+    // Load the positions of the atoms in the block.
+
+    const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+    const int* blockAtom = &sortedAtoms[4*blockIndex];
+    fvec4 blockAtomPos[4];
+    for (int k = 0; k < 4; k++)
+        blockAtomPos[k] = fvec4(posq+4*blockAtom[k]);
+    transpose(blockAtomPos[0], blockAtomPos[1], blockAtomPos[2], blockAtomPos[3]);
+    fvec4 blockAtomX = blockAtomPos[0], blockAtomY = blockAtomPos[1], blockAtomZ = blockAtomPos[2];
+    fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+    const float invSwitchingInterval = 1/(cutoffDistance-switchingDistance);
+    const float cutoff2 = cutoffDistance*cutoffDistance;
+    const ivec4 lastInterval(tableIntervals-1), firstInterval(0);
+    fvec4 one(1.0f);
+
+    // Loop over neighbors for this block.
+
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    for (int i = 0; i < (int) neighbors.size(); i++) {
+        // Compute the distances to the block atoms.
+
+        int atom = sortedAtoms[neighbors[i]];
+        const float* atomPos = posq+4*atom;
+        fvec4 dx = blockAtomX-atomPos[0];
+        fvec4 dy = blockAtomY-atomPos[1];
+        fvec4 dz = blockAtomZ-atomPos[2];
+        if (periodic) {
+            if (triclinic) {
+                fvec4 scale3 = floor(dz*recipBoxSize[2]+0.5f);
+                dx -= scale3*periodicBoxVectors[2][0];
+                dy -= scale3*periodicBoxVectors[2][1];
+                dz -= scale3*periodicBoxVectors[2][2];
+                fvec4 scale2 = floor(dy*recipBoxSize[1]+0.5f);
+                dx -= scale2*periodicBoxVectors[1][0];
+                dy -= scale2*periodicBoxVectors[1][1];
+                fvec4 scale1 = floor(dx*recipBoxSize[0]+0.5f);
+                dx -= scale1*periodicBoxVectors[0][0];
+            }
+            else {
+                dx -= round(dx*invBoxSize[0])*boxSize[0];
+                dy -= round(dy*invBoxSize[1])*boxSize[1];
+                dz -= round(dz*invBoxSize[2])*boxSize[2];
+            }
+        }
+        fvec4 r2 = dx*dx + dy*dy + dz*dz;
+        ivec4 include;
+        char excl = exclusions[i];
+        if (excl == 0)
+            include = -1;
+        else
+            include = ivec4(excl&1 ? 0 : -1, excl&2 ? 0 : -1, excl&4 ? 0 : -1, excl&8 ? 0 : -1);
+        fvec4 r = sqrt(r2);
+        include = include & (r2 < cutoff2) & ((r >= tableMin) & (r <= tableMax));
+        if (!any(include))
+            continue; // No interactions to compute.
+
+        // Find the spline interval for each pair and load its coefficients.  After the transpose,
+        // c[j] holds coefficient j for all four pairs.
+
+        fvec4 scaled = (r-tableMin)*tableInvDelta;
+        ivec4 index = max(min((ivec4) scaled, lastInterval), firstInterval);
+        fvec4 s = scaled-(fvec4) index;
+        int interval[4];
+        index.store(interval);
+        fvec4 c[4];
+        for (int k = 0; k < 4; k++)
+            c[k] = fvec4(&tableCoeff[4*interval[k]]);
+        transpose(c[0], c[1], c[2], c[3]);
+        fvec4 energy = c[0]+s*(c[1]+s*(c[2]+s*c[3]));
+        fvec4 dEdR = (c[1]+s*(2.0f*c[2]+s*(3.0f*c[3])))*tableInvDelta/r;
+        if (useSwitch) {
+            fvec4 t = blend(0.0f, (r-switchingDistance)*invSwitchingInterval, r>switchingDistance);
+            fvec4 switchValue = 1+t*t*t*(-10.0f+t*(15.0f-t*6.0f));
+            fvec4 switchDeriv = t*t*(-30.0f+t*(60.0f-t*30.0f))*invSwitchingInterval;
+            dEdR = switchValue*dEdR + energy*switchDeriv/r;
+            energy *= switchValue;
+        }
+
+        // Accumulate energies.
+
+        if (includeEnergy)
+            totalEnergy += dot4(blend(0.0f, energy, include), one);
+
+        // Accumulate forces.
+
+        if (includeForce) {
+            dEdR = blend(0.0f, dEdR, include);
+            fvec4 fx = dx*dEdR;
+            fvec4 fy = dy*dEdR;
+            fvec4 fz = dz*dEdR;
+            blockAtomForceX -= fx;
+            blockAtomForceY -= fy;
+            blockAtomForceZ -= fz;
+            float* atomForce = forces+4*atom;
+            atomForce[0] += dot4(fx, one);
+            atomForce[1] += dot4(fy, one);
+            atomForce[2] += dot4(fz, one);
+        }
+    }
+
+    // Record the forces on the block atoms.
+
+    if (includeForce) {
+        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+        transpose(f[0], f[1], f[2], f[3]);
+        for (int k = 0; k < 4; k++)
+            (fvec4(forces+4*blockAtom[k])+f[k]).store(forces+4*blockAtom[k]);
+    }
+}
+
 void CpuCustomNonbondedForce::getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, const fvec4& boxSize, const fvec4& invBoxSize) const {
     deltaR = posJ-posI;
     if (periodic) {
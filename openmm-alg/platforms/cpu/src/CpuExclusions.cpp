@@ -0,0 +1,155 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuExclusions.h"
+
+using namespace OpenMM;
+using namespace std;
+
+CpuExclusions::CpuExclusions(int numAtoms) : rowStart(numAtoms+1, 0), excluded(1) {
+}
+
+/**
+ * Sort the unsorted exclusions of each atom in a range and remove duplicates, recording the number
+ * that remain.
+ */
+class CpuExclusions::SortRowsTask : public ThreadPool::Task {
+public:
+    SortRowsTask(const vector<int>& bucketStart, vector<int>& buckets, vector<int>& rowLength) :
+            bucketStart(bucketStart), buckets(buckets), rowLength(rowLength) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        int numAtoms = rowLength.size();
+        int numThreads = threads.getNumThreads();
+        sortRows(threadIndex*numAtoms/numThreads, (threadIndex+1)*numAtoms/numThreads);
+    }
+    void sortRows(int start, int end) {
+        for (int i = start; i < end; i++) {
+            vector<int>::iterator first = buckets.begin()+bucketStart[i];
+            vector<int>::iterator last = buckets.begin()+bucketStart[i+1];
+            sort(first, last);
+            rowLength[i] = unique(first, last)-first;
+        }
+    }
+    const vector<int>& bucketStart;
+    vector<int>& buckets;
+    vector<int>& rowLength;
+};
+
+/**
+ * Copy the sorted exclusions of each atom in a range into the final array.
+ */
+class CpuExclusions::CopyRowsTask : public ThreadPool::Task {
+public:
+    CopyRowsTask(const vector<int>& bucketStart, const vector<int>& buckets, const vector<int>& rowStart, vector<int>& excluded) :
+            bucketStart(bucketStart), buckets(buckets), rowStart(rowStart), excluded(excluded) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        int numAtoms = rowStart.size()-1;
+        int numThreads = threads.getNumThreads();
+        copyRows(threadIndex*numAtoms/numThreads, (threadIndex+1)*numAtoms/numThreads);
+    }
+    void copyRows(int start, int end) {
+        for (int i = start; i < end; i++)
+            copy(buckets.begin()+bucketStart[i], buckets.begin()+bucketStart[i]+(rowStart[i+1]-rowStart[i]), excluded.begin()+rowStart[i]);
+    }
+    const vector<int>& bucketStart;
+    const vector<int>& buckets;
+    const vector<int>& rowStart;
+    vector<int>& excluded;
+};
+
+CpuExclusions::CpuExclusions(int numAtoms, const vector<pair<int, int> >& excludedPairs) : rowStart(numAtoms+1, 0) {
+    build(excludedPairs, NULL);
+}
+
+CpuExclusions::CpuExclusions(int numAtoms, const vector<pair<int, int> >& excludedPairs, ThreadPool& threads) : rowStart(numAtoms+1, 0) {
+    build(excludedPairs, &threads);
+}
+
+void CpuExclusions::build(const vector<pair<int, int> >& excludedPairs, ThreadPool* threads) {
+    int numAtoms = rowStart.size()-1;
+
+    // Place both directions of every pair into a bucket for the first atom.  The buckets are unsorted
+    // and may contain duplicates.
+
+    vector<int> bucketStart(numAtoms+1, 0);
+    for (int i = 0; i < (int) excludedPairs.size(); i++) {
+        int atom1 = excludedPairs[i].first;
+        int atom2 = excludedPairs[i].second;
+        if (atom1 != atom2) {
+            bucketStart[atom1+1]++;
+            bucketStart[atom2+1]++;
+        }
+    }
+    for (int i = 0; i < numAtoms; i++)
+        bucketStart[i+1] += bucketStart[i];
+    vector<int> buckets(bucketStart[numAtoms]);
+    vector<int> bucketEnd(bucketStart.begin(), bucketStart.end()-1);
+    for (int i = 0; i < (int) excludedPairs.size(); i++) {
+        int atom1 = excludedPairs[i].first;
+        int atom2 = excludedPairs[i].second;
+        if (atom1 != atom2) {
+            buckets[bucketEnd[atom1]++] = atom2;
+            buckets[bucketEnd[atom2]++] = atom1;
+        }
+    }
+
+    // Sort each bucket and remove duplicates.  Every atom is independent, so this is divided between
+    // the threads.
+
+    vector<int> rowLength(numAtoms);
+    SortRowsTask sortTask(bucketStart, buckets, rowLength);
+    if (threads == NULL)
+        sortTask.sortRows(0, numAtoms);
+    else {
+        threads->execute(sortTask);
+        threads->waitForThreads();
+    }
+
+    // Record the rows.  An extra element at the end means begin() and end() are always valid, even
+    // when there are no exclusions at all.
+
+    for (int i = 0; i < numAtoms; i++)
+        rowStart[i+1] = rowStart[i]+rowLength[i];
+    excluded.resize(rowStart[numAtoms]+1);
+    CopyRowsTask copyTask(bucketStart, buckets, rowStart, excluded);
+    if (threads == NULL)
+        copyTask.copyRows(0, numAtoms);
+    else {
+        threads->execute(copyTask);
+        threads->waitForThreads();
+    }
+}
+
+bool CpuExclusions::operator==(const CpuExclusions& other) const {
+    return (rowStart == other.rowStart && excluded == other.excluded);
+}
@@ -39,15 +39,23 @@ const float CpuGBSAOBCForce::TABLE_MAX = 1.5f;
 
 class CpuGBSAOBCForce::ComputeTask : public ThreadPool::Task {
 public:
-    ComputeTask(CpuGBSAOBCForce& owner) : owner(owner) {
+    ComputeTask(CpuGBSAOBCForce& owner, int phase) : owner(owner), phase(phase) {
     }
     void execute(ThreadPool& threads, int threadIndex) {
-        owner.threadComputeForce(threads, threadIndex);
+        owner.threadComputeForce(threads, threadIndex, phase);
     }
     CpuGBSAOBCForce& owner;
+    int phase;
 };
 
-CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
+/**
+ * Convert the exclusion flags for a neighbor of a block into a mask of the atoms it interacts with.
+ */
+static inline ivec4 getIncludeMask(char exclusions) {
+    return ivec4((exclusions&1) ? 0 : -1, (exclusions&2) ? 0 : -1, (exclusions&4) ? 0 : -1, (exclusions&8) ? 0 : -1);
+}
+
+CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false), neighborList(NULL) {
     logDX = (TABLE_MAX-TABLE_MIN)/NUM_TABLE_POINTS;
     logDXInv = 1.0f/logDX;
     logTable.resize(NUM_TABLE_POINTS+4);
@@ -57,9 +65,10 @@ CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
     }
 }
 
-void CpuGBSAOBCForce::setUseCutoff(float distance) {
+void CpuGBSAOBCForce::setUseCutoff(float distance, const CpuNeighborList& neighbors) {
     cutoff = true;
     cutoffDistance = distance;
+    neighborList = &neighbors;
 }
 
 void CpuGBSAOBCForce::setPeriodic(float* periodicBoxSize) {
@@ -89,6 +98,7 @@ void CpuGBSAOBCForce::setParticleParameters(const std::vector<std::pair<float, f
     particleParams = params;
     bornRadii.resize(params.size()+3);
     obcChain.resize(params.size()+3);
+    bornForceTotal.resize(params.size()+3);
 }
 
 void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
@@ -102,24 +112,28 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
     threadBornForces.resize(numThreads);
     for (int i = 0; i < numThreads; i++)
         threadBornForces[i].resize(particleParams.size()+3);
+    if (cutoff) {
+        threadBornSums.resize(numThreads);
+        for (int i = 0; i < numThreads; i++)
+            threadBornSums[i].resize(particleParams.size()+3);
+    }
     gmx_atomic_t counter;
     this->atomicCounter = &counter;
     
-    // Signal the threads to start running and wait for them to finish.
+    // Signal the threads to start running and wait for them to finish.  The all pairs path
+    // has four phases (Born radii, surface area term, first loop, second loop).  The neighbor
+    // list path has five (Born radius sums, Born radii with surface area and self terms, pair
+    // energy, Born force reduction, chain rule).
     
-    ComputeTask task(*this);
-    gmx_atomic_set(&counter, 0);
-    threads.execute(task);
-    threads.waitForThreads(); // Compute Born radii
-    gmx_atomic_set(&counter, 0);
-    threads.resumeThreads();
-    threads.waitForThreads(); // Compute surface area term
-    gmx_atomic_set(&counter, 0);
-    threads.resumeThreads();
-    threads.waitForThreads(); // First loop
-    gmx_atomic_set(&counter, 0);
-    threads.resumeThreads();
-    threads.waitForThreads(); // Second loop
+    int numPhases = (cutoff ? 5 : 4);
+    for (int i = 0; i < numThreads; i++)
+        threadEnergy[i] = 0.0;
+    for (int phase = 0; phase < numPhases; phase++) {
+        ComputeTask task(*this, phase);
+        gmx_atomic_set(&counter, 0);
+        threads.execute(task);
+        threads.waitForThreads();
+    }
     
     // Combine the energies from all the threads.
     
@@ -131,7 +145,14 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
     }
 }
 
-void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
+void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex, int phase) {
+    if (cutoff)
+        threadComputeNeighborPairs(threads, threadIndex, phase);
+    else
+        threadComputeAllPairs(threads, threadIndex, phase);
+}
+
+void CpuGBSAOBCForce::threadComputeAllPairs(ThreadPool& threads, int threadIndex, int phase) {
     int numParticles = particleParams.size();
     int numThreads = threads.getNumThreads();
     const float dielectricOffset = 0.009;
@@ -140,261 +161,520 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
     const float gammaObc = 4.85f;
     fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
     fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
-    int start = (threadIndex*numParticles)/numThreads;
-    int end = ((threadIndex+1)*numParticles)/numThreads;
+    float preFactor;
+    if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
+        preFactor = ONE_4PI_EPS0*((1.0f/solventDielectric) - (1.0f/soluteDielectric));
+    else
+        preFactor = 0.0f;
+    const float probeRadius = 0.14f;
+    double energy = 0.0;
+    AlignedArray<float>& bornForces = threadBornForces[threadIndex];
+    float* forces = &(*threadForce)[threadIndex][0];
 
-    // Calculate Born radii
-
-    while (true) {
-        int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
-        if (blockStart >= numParticles)
-            break;
-        int numInBlock = min(4, numParticles-blockStart);
-        ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
-        float atomRadius[4], atomx[4], atomy[4], atomz[4];
-        int blockMask[4] = {0, 0, 0, 0};
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            atomRadius[i] = particleParams[atomIndex].first;
-            atomx[i] = posq[4*atomIndex];
-            atomy[i] = posq[4*atomIndex+1];
-            atomz[i] = posq[4*atomIndex+2];
-            blockMask[i] = 0xFFFFFFFF;
-        }
-        fvec4 offsetRadiusI(atomRadius);
-        fvec4 radiusIInverse = 1.0f/offsetRadiusI;
-        fvec4 x(atomx);
-        fvec4 y(atomy);
-        fvec4 z(atomz);
-        ivec4 mask(blockMask);
-        float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
-        for (int atomJ = 0; atomJ < numParticles; atomJ++) {
-            fvec4 posJ(posq+4*atomJ);
-            fvec4 dx, dy, dz, r2;
-            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
-            ivec4 include = mask & (blockAtomIndex != ivec4(atomJ));
-            if (cutoff)
-                include = include & (r2 < cutoffDistance*cutoffDistance);
-            if (!any(include))
-                continue;
-            fvec4 r = sqrt(r2);
-            float scaledRadiusJ = particleParams[atomJ].second;
-            float scaledRadiusJ2 = scaledRadiusJ*scaledRadiusJ;
-            fvec4 rScaledRadiusJ = r + scaledRadiusJ;
-            include = include & (offsetRadiusI < rScaledRadiusJ);
-            fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
-            fvec4 u_ij = 1.0f/rScaledRadiusJ;
-            fvec4 l_ij2 = l_ij*l_ij;
-            fvec4 u_ij2 = u_ij*u_ij;
-            fvec4 rInverse = 1.0f/r;
-            fvec4 r2Inverse = rInverse*rInverse;
-            fvec4 logRatio = fastLog(u_ij/l_ij);
-            fvec4 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadiusJ*scaledRadiusJ*rInverse)*(l_ij2 - u_ij2);
-            for (int j = 0; j < 4; j++) {
-                if (include[j]) {
-                    sum[j] += term[j];
-                    if (offsetRadiusI[j] < scaledRadiusJ-r[j])
-                        sum[j] += 2.0f*(radiusIInverse[j]-l_ij[j]);
+    if (phase == 0) {
+        // Calculate Born radii
+
+        while (true) {
+            int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
+            if (blockStart >= numParticles)
+                break;
+            int numInBlock = min(4, numParticles-blockStart);
+            ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
+            float atomRadius[4], atomx[4], atomy[4], atomz[4];
+            int blockMask[4] = {0, 0, 0, 0};
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                atomRadius[i] = particleParams[atomIndex].first;
+                atomx[i] = posq[4*atomIndex];
+                atomy[i] = posq[4*atomIndex+1];
+                atomz[i] = posq[4*atomIndex+2];
+                blockMask[i] = 0xFFFFFFFF;
+            }
+            fvec4 offsetRadiusI(atomRadius);
+            fvec4 radiusIInverse = 1.0f/offsetRadiusI;
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            ivec4 mask(blockMask);
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int atomJ = 0; atomJ < numParticles; atomJ++) {
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = mask & (blockAtomIndex != ivec4(atomJ));
+                if (!any(include))
+                    continue;
+                fvec4 r = sqrt(r2);
+                float scaledRadiusJ = particleParams[atomJ].second;
+                float scaledRadiusJ2 = scaledRadiusJ*scaledRadiusJ;
+                fvec4 rScaledRadiusJ = r + scaledRadiusJ;
+                include = include & (offsetRadiusI < rScaledRadiusJ);
+                fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+                fvec4 u_ij = 1.0f/rScaledRadiusJ;
+                fvec4 l_ij2 = l_ij*l_ij;
+                fvec4 u_ij2 = u_ij*u_ij;
+                fvec4 rInverse = 1.0f/r;
+                fvec4 r2Inverse = rInverse*rInverse;
+                fvec4 logRatio = fastLog(u_ij/l_ij);
+                fvec4 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadiusJ*scaledRadiusJ*rInverse)*(l_ij2 - u_ij2);
+                for (int j = 0; j < 4; j++) {
+                    if (include[j]) {
+                        sum[j] += term[j];
+                        if (offsetRadiusI[j] < scaledRadiusJ-r[j])
+                            sum[j] += 2.0f*(radiusIInverse[j]-l_ij[j]);
+                    }
                 }
             }
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                sum[i] *= 0.5f*atomRadius[i];
+                float sum2 = sum[i]*sum[i];
+                float sum3 = sum[i]*sum2;
+                float tanhSum = tanh(alphaObc*sum[i] - betaObc*sum2 + gammaObc*sum3);
+                float radiusI = atomRadius[i] + dielectricOffset;
+                bornRadii[atomIndex] = 1.0f/(1.0f/atomRadius[i] - tanhSum/radiusI);
+                obcChain[atomIndex] = atomRadius[i]*(alphaObc - 2.0f*betaObc*sum[i] + 3.0f*gammaObc*sum2);
+                obcChain[atomIndex] = (1.0f - tanhSum*tanhSum)*obcChain[atomIndex]/radiusI;
+            }
         }
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            sum[i] *= 0.5f*atomRadius[i];
-            float sum2 = sum[i]*sum[i];
-            float sum3 = sum[i]*sum2;
-            float tanhSum = tanh(alphaObc*sum[i] - betaObc*sum2 + gammaObc*sum3);
-            float radiusI = atomRadius[i] + dielectricOffset;
-            bornRadii[atomIndex] = 1.0f/(1.0f/atomRadius[i] - tanhSum/radiusI);
-            obcChain[atomIndex] = atomRadius[i]*(alphaObc - 2.0f*betaObc*sum[i] + 3.0f*gammaObc*sum2);
-            obcChain[atomIndex] = (1.0f - tanhSum*tanhSum)*obcChain[atomIndex]/radiusI;
+    }
+    else if (phase == 1) {
+        // Calculate ACE surface area term.
+
+        for (int i = 0; i < numParticles; i++)
+            bornForces[i] = 0.0f;
+        while (true) {
+            int atomI = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (atomI >= numParticles)
+                break;
+            if (bornRadii[atomI] > 0) {
+                float radiusI = particleParams[atomI].first + dielectricOffset;
+                float r = radiusI + probeRadius;
+                float ratio6 = powf(radiusI/bornRadii[atomI], 6.0f);
+                float saTerm = surfaceAreaFactor*r*r*ratio6;
+                energy += saTerm;
+                bornForces[atomI] = -6.0f*saTerm/bornRadii[atomI]; 
+            }
+            else
+                bornForces[atomI] = 0.0f;
         }
     }
-    threads.syncThreads();
+    else if (phase == 2) {
+        // First loop of Born energy computation.
 
-    // Calculate ACE surface area term.
+        while (true) {
+            int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
+            if (blockStart >= numParticles)
+                break;
+            int numInBlock = min(4, numParticles-blockStart);
+            ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
+            float atomCharge[4], atomx[4], atomy[4], atomz[4];
+            int blockMask[4] = {0, 0, 0, 0};
+            fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                atomx[i] = posq[4*atomIndex];
+                atomy[i] = posq[4*atomIndex+1];
+                atomz[i] = posq[4*atomIndex+2];
+                atomCharge[i] = preFactor*posq[4*atomIndex+3];
+                blockMask[i] = 0xFFFFFFFF;
+            }
+            fvec4 radii(&bornRadii[blockStart]);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            fvec4 partialChargeI(atomCharge);
+            ivec4 mask(blockMask);
+            for (int atomJ = blockStart; atomJ < numParticles; atomJ++) {
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = mask & (blockAtomIndex <= ivec4(atomJ));
+                if (!any(include))
+                    continue;
+                fvec4 r = sqrt(r2);
+                fvec4 alpha2_ij = radii*bornRadii[atomJ];
+                fvec4 D_ij = r2/(4.0f*alpha2_ij);
+                fvec4 expTerm(expf(-D_ij[0]), expf(-D_ij[1]), expf(-D_ij[2]), expf(-D_ij[3]));
+                fvec4 denominator2 = r2 + alpha2_ij*expTerm;
+                fvec4 denominator = sqrt(denominator2);
+                fvec4 Gpol = (partialChargeI*posJ[3])/denominator; 
+                fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;  
+                fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
+                dGpol_dr = blend(0.0f, dGpol_dr, include);
+                dGpol_dalpha2_ij = blend(0.0f, dGpol_dalpha2_ij, include);
+                fvec4 fx = dx*dGpol_dr;
+                fvec4 fy = dy*dGpol_dr;
+                fvec4 fz = dz*dGpol_dr;
+                blockAtomForceX -= fx;
+                blockAtomForceY -= fy;
+                blockAtomForceZ -= fz;
+                blockAtomBornForce += dGpol_dalpha2_ij*bornRadii[atomJ];
+                float* atomForce = forces+4*atomJ;
+                fvec4 one(1.0f);
+                atomForce[0] += dot4(fx, one);
+                atomForce[1] += dot4(fy, one);
+                atomForce[2] += dot4(fz, one);
+                ivec4 atomJMask = include & (blockAtomIndex != ivec4(atomJ));
+                fvec4 termEnergy = blend(0.0f, Gpol, include);
+                termEnergy *= blend(0.5f, 1.0f, atomJMask);
+                energy += dot4(termEnergy, one);
+                bornForces[atomJ] += dot4(blend(0.0f, dGpol_dalpha2_ij, atomJMask), radii);
+            }
+            fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+            transpose(f[0], f[1], f[2], f[3]);
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+                bornForces[atomIndex] += blockAtomBornForce[i];
+            }
+        }
+    }
+    else {
+        // Second loop of Born energy computation.
 
-    const float probeRadius = 0.14f;
-    double energy = 0.0;
-    AlignedArray<float>& bornForces = threadBornForces[threadIndex];
-    for (int i = 0; i < numParticles; i++)
-        bornForces[i] = 0.0f;
-    while (true) {
-        int atomI = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
-        if (atomI >= numParticles)
-            break;
-        if (bornRadii[atomI] > 0) {
-            float radiusI = particleParams[atomI].first + dielectricOffset;
-            float r = radiusI + probeRadius;
-            float ratio6 = powf(radiusI/bornRadii[atomI], 6.0f);
-            float saTerm = surfaceAreaFactor*r*r*ratio6;
-            energy += saTerm;
-            bornForces[atomI] = -6.0f*saTerm/bornRadii[atomI]; 
+        while (true) {
+            int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
+            if (blockStart >= numParticles)
+                break;
+            fvec4 bornForce(0.0f);
+            for (int i = 0; i < numThreads; i++)
+                bornForce += fvec4(&threadBornForces[i][blockStart]);
+            fvec4 radii(&bornRadii[blockStart]);
+            bornForce *= radii*radii*fvec4(&obcChain[blockStart]);
+            int numInBlock = min(4, numParticles-blockStart);
+            ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
+            float atomRadius[4], atomx[4], atomy[4], atomz[4];
+            int blockMask[4] = {0, 0, 0, 0};
+            fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                atomRadius[i] = particleParams[atomIndex].first;
+                atomx[i] = posq[4*atomIndex];
+                atomy[i] = posq[4*atomIndex+1];
+                atomz[i] = posq[4*atomIndex+2];
+                blockMask[i] = 0xFFFFFFFF;
+            }
+            for (int i = numInBlock; i < 4; i++) {
+                atomx[i] = 0.0f;
+                atomy[i] = 0.0f;
+                atomz[i] = 0.0f;
+            }
+            fvec4 offsetRadiusI(atomRadius);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            ivec4 mask(blockMask);
+            for (int atomJ = 0; atomJ < numParticles; atomJ++) {
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = mask & (blockAtomIndex != ivec4(atomJ));
+                if (!any(include))
+                    continue;
+                fvec4 r = sqrt(r2);
+                float scaledRadiusJ = particleParams[atomJ].second;
+                float scaledRadiusJ2 = scaledRadiusJ*scaledRadiusJ;
+                fvec4 rScaledRadiusJ = r + scaledRadiusJ;
+                include = include & (offsetRadiusI < rScaledRadiusJ);
+                fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+                fvec4 u_ij = 1.0f/rScaledRadiusJ;
+                fvec4 l_ij2 = l_ij*l_ij;
+                fvec4 u_ij2 = u_ij*u_ij;
+                fvec4 rInverse = 1.0f/r;
+                fvec4 r2Inverse = rInverse*rInverse;
+                fvec4 logRatio = fastLog(u_ij/l_ij);
+                fvec4 t3 = 0.125f*(1.0f + scaledRadiusJ2*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
+                fvec4 de = bornForce*t3*rInverse;
+                de = blend(0.0f, de, include);
+                fvec4 fx = dx*de;
+                fvec4 fy = dy*de;
+                fvec4 fz = dz*de;
+                blockAtomForceX += fx;
+                blockAtomForceY += fy;
+                blockAtomForceZ += fz;
+                float* atomForce = forces+4*atomJ;
+                fvec4 one(1.0f);
+                atomForce[0] -= dot4(fx, one);
+                atomForce[1] -= dot4(fy, one);
+                atomForce[2] -= dot4(fz, one);
+            }
+            fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+            transpose(f[0], f[1], f[2], f[3]);
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+            }
         }
-        else
-            bornForces[atomI] = 0.0f;
     }
-    threads.syncThreads();
- 
-    // First loop of Born energy computation.
+    threadEnergy[threadIndex] += energy;
+}
 
-    float* forces = &(*threadForce)[threadIndex][0];
+void CpuGBSAOBCForce::threadComputeNeighborPairs(ThreadPool& threads, int threadIndex, int phase) {
+    int numParticles = particleParams.size();
+    int numThreads = threads.getNumThreads();
+    int numBlocks = neighborList->getNumBlocks();
+    const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+    const float dielectricOffset = 0.009;
+    const float alphaObc = 1.0f;
+    const float betaObc = 0.8f;
+    const float gammaObc = 4.85f;
+    const float cutoffDistance2 = cutoffDistance*cutoffDistance;
+    const fvec4 one(1.0f);
+    fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
+    fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
+    int start = (threadIndex*numParticles)/numThreads;
+    int end = ((threadIndex+1)*numParticles)/numThreads;
     float preFactor;
     if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
         preFactor = ONE_4PI_EPS0*((1.0f/solventDielectric) - (1.0f/soluteDielectric));
     else
         preFactor = 0.0f;
-    while (true) {
-        int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
-        if (blockStart >= numParticles)
-            break;
-        int numInBlock = min(4, numParticles-blockStart);
-        ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
-        float atomCharge[4], atomx[4], atomy[4], atomz[4];
-        int blockMask[4] = {0, 0, 0, 0};
-        fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            atomx[i] = posq[4*atomIndex];
-            atomy[i] = posq[4*atomIndex+1];
-            atomz[i] = posq[4*atomIndex+2];
-            atomCharge[i] = preFactor*posq[4*atomIndex+3];
-            blockMask[i] = 0xFFFFFFFF;
-        }
-        fvec4 radii(&bornRadii[blockStart]);
-        fvec4 x(atomx);
-        fvec4 y(atomy);
-        fvec4 z(atomz);
-        fvec4 partialChargeI(atomCharge);
-        ivec4 mask(blockMask);
-        for (int atomJ = blockStart; atomJ < numParticles; atomJ++) {
-            fvec4 posJ(posq+4*atomJ);
-            fvec4 dx, dy, dz, r2;
-            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
-            ivec4 include = mask & (blockAtomIndex <= ivec4(atomJ));
-            if (cutoff)
-                include = include & (r2 < cutoffDistance*cutoffDistance);
-            if (!any(include))
-                continue;
-            fvec4 r = sqrt(r2);
-            fvec4 alpha2_ij = radii*bornRadii[atomJ];
-            fvec4 D_ij = r2/(4.0f*alpha2_ij);
-            fvec4 expTerm(expf(-D_ij[0]), expf(-D_ij[1]), expf(-D_ij[2]), expf(-D_ij[3]));
-            fvec4 denominator2 = r2 + alpha2_ij*expTerm;
-            fvec4 denominator = sqrt(denominator2);
-            fvec4 Gpol = (partialChargeI*posJ[3])/denominator; 
-            fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;  
-            fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
-            dGpol_dr = blend(0.0f, dGpol_dr, include);
-            dGpol_dalpha2_ij = blend(0.0f, dGpol_dalpha2_ij, include);
-            fvec4 fx = dx*dGpol_dr;
-            fvec4 fy = dy*dGpol_dr;
-            fvec4 fz = dz*dGpol_dr;
-            blockAtomForceX -= fx;
-            blockAtomForceY -= fy;
-            blockAtomForceZ -= fz;
-            blockAtomBornForce += dGpol_dalpha2_ij*bornRadii[atomJ];
-            float* atomForce = forces+4*atomJ;
-            fvec4 one(1.0f);
-            atomForce[0] += dot4(fx, one);
-            atomForce[1] += dot4(fy, one);
-            atomForce[2] += dot4(fz, one);
-            ivec4 atomJMask = include & (blockAtomIndex != ivec4(atomJ));
-            fvec4 termEnergy = blend(0.0f, Gpol, include);
-            if (cutoff)
-                termEnergy -= blend(0.0f, partialChargeI*posJ[3]/cutoffDistance, atomJMask);
-            termEnergy *= blend(0.5f, 1.0f, atomJMask);
-            energy += dot4(termEnergy, one);
-            bornForces[atomJ] += dot4(blend(0.0f, dGpol_dalpha2_ij, atomJMask), radii);
-        }
-        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
-        transpose(f[0], f[1], f[2], f[3]);
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
-            bornForces[atomIndex] += blockAtomBornForce[i];
+    const float probeRadius = 0.14f;
+    double energy = 0.0;
+    AlignedArray<float>& bornForces = threadBornForces[threadIndex];
+    float* forces = &(*threadForce)[threadIndex][0];
+
+    if (phase == 0) {
+        // Accumulate the Born radius sums.  Each pair in the neighbor list contributes to both of its
+        // atoms, so every thread accumulates into its own array.
+
+        AlignedArray<float>& bornSums = threadBornSums[threadIndex];
+        for (int i = 0; i < numParticles; i++)
+            bornSums[i] = 0.0f;
+        while (true) {
+            int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (blockIndex >= numBlocks)
+                break;
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
+            const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            float atomRadius[4], atomScaledRadius[4], atomx[4], atomy[4], atomz[4];
+            for (int i = 0; i < 4; i++) {
+                atomRadius[i] = particleParams[blockAtom[i]].first;
+                atomScaledRadius[i] = particleParams[blockAtom[i]].second;
+                atomx[i] = posq[4*blockAtom[i]];
+                atomy[i] = posq[4*blockAtom[i]+1];
+                atomz[i] = posq[4*blockAtom[i]+2];
+            }
+            fvec4 offsetRadiusI(atomRadius);
+            fvec4 scaledRadiusI(atomScaledRadius);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            fvec4 blockSum(0.0f);
+            for (int i = 0; i < (int) neighbors.size(); i++) {
+                int atomJ = sortedAtoms[neighbors[i]];
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = getIncludeMask(exclusions[i]) & (r2 < cutoffDistance2);
+                if (!any(include))
+                    continue;
+                fvec4 r = sqrt(r2);
+                fvec4 termI = computeBornSumTerm(r, offsetRadiusI, particleParams[atomJ].second);
+                fvec4 termJ = computeBornSumTerm(r, particleParams[atomJ].first, scaledRadiusI);
+                blockSum += blend(0.0f, termI, include);
+                bornSums[atomJ] += dot4(blend(0.0f, termJ, include), one);
+            }
+            for (int i = 0; i < 4; i++)
+                bornSums[blockAtom[i]] += blockSum[i];
         }
     }
-    threads.syncThreads();
-
-    // Second loop of Born energy computation.
+    else if (phase == 1) {
+        // Combine the sums from all threads, then compute each atom's Born radius together with its
+        // surface area term and self energy, since all of these depend only on the atom itself.
 
-    while (true) {
-        int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
-        if (blockStart >= numParticles)
-            break;
-        fvec4 bornForce(0.0f);
-        for (int i = 0; i < numThreads; i++)
-            bornForce += fvec4(&threadBornForces[i][blockStart]);
-        fvec4 radii(&bornRadii[blockStart]);
-        bornForce *= radii*radii*fvec4(&obcChain[blockStart]);
-        int numInBlock = min(4, numParticles-blockStart);
-        ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
-        float atomRadius[4], atomx[4], atomy[4], atomz[4];
-        int blockMask[4] = {0, 0, 0, 0};
-        fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            atomRadius[i] = particleParams[atomIndex].first;
-            atomx[i] = posq[4*atomIndex];
-            atomy[i] = posq[4*atomIndex+1];
-            atomz[i] = posq[4*atomIndex+2];
-            blockMask[i] = 0xFFFFFFFF;
+        for (int i = 0; i < numParticles; i++)
+            bornForces[i] = 0.0f;
+        for (int atomI = start; atomI < end; atomI++) {
+            float sum = 0.0f;
+            for (int i = 0; i < numThreads; i++)
+                sum += threadBornSums[i][atomI];
+            float offsetRadius = particleParams[atomI].first;
+            sum *= 0.5f*offsetRadius;
+            float sum2 = sum*sum;
+            float sum3 = sum*sum2;
+            float tanhSum = tanh(alphaObc*sum - betaObc*sum2 + gammaObc*sum3);
+            float radiusI = offsetRadius + dielectricOffset;
+            float bornRadius = 1.0f/(1.0f/offsetRadius - tanhSum/radiusI);
+            bornRadii[atomI] = bornRadius;
+            obcChain[atomI] = offsetRadius*(alphaObc - 2.0f*betaObc*sum + 3.0f*gammaObc*sum2);
+            obcChain[atomI] = (1.0f - tanhSum*tanhSum)*obcChain[atomI]/radiusI;
+            float bornForce = 0.0f;
+            if (bornRadius > 0) {
+                float r = radiusI + probeRadius;
+                float ratio6 = powf(radiusI/bornRadius, 6.0f);
+                float saTerm = surfaceAreaFactor*r*r*ratio6;
+                energy += saTerm;
+                bornForce = -6.0f*saTerm/bornRadius;
+            }
+            float charge = posq[4*atomI+3];
+            float selfGpol = preFactor*charge*charge/bornRadius;
+            energy += 0.5f*selfGpol;
+            bornForces[atomI] = bornForce - 0.5f*selfGpol/bornRadius;
         }
-        for (int i = numInBlock; i < 4; i++) {
-            atomx[i] = 0.0f;
-            atomy[i] = 0.0f;
-            atomz[i] = 0.0f;
+    }
+    else if (phase == 2) {
+        // Compute the pair terms of the Born energy.
+
+        while (true) {
+            int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (blockIndex >= numBlocks)
+                break;
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
+            const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            float atomCharge[4], atomBornRadius[4], atomx[4], atomy[4], atomz[4];
+            for (int i = 0; i < 4; i++) {
+                atomCharge[i] = preFactor*posq[4*blockAtom[i]+3];
+                atomBornRadius[i] = bornRadii[blockAtom[i]];
+                atomx[i] = posq[4*blockAtom[i]];
+                atomy[i] = posq[4*blockAtom[i]+1];
+                atomz[i] = posq[4*blockAtom[i]+2];
+            }
+            fvec4 radii(atomBornRadius);
+            fvec4 partialChargeI(atomCharge);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
+            for (int i = 0; i < (int) neighbors.size(); i++) {
+                int atomJ = sortedAtoms[neighbors[i]];
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = getIncludeMask(exclusions[i]) & (r2 < cutoffDistance2);
+                if (!any(include))
+                    continue;
+                fvec4 alpha2_ij = radii*bornRadii[atomJ];
+                fvec4 D_ij = r2/(4.0f*alpha2_ij);
+                fvec4 expTerm(expf(-D_ij[0]), expf(-D_ij[1]), expf(-D_ij[2]), expf(-D_ij[3]));
+                fvec4 denominator2 = r2 + alpha2_ij*expTerm;
+                fvec4 denominator = sqrt(denominator2);
+                fvec4 chargeProduct = partialChargeI*posJ[3];
+                fvec4 Gpol = chargeProduct/denominator;
+                fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;
+                fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
+                dGpol_dr = blend(0.0f, dGpol_dr, include);
+                dGpol_dalpha2_ij = blend(0.0f, dGpol_dalpha2_ij, include);
+                fvec4 fx = dx*dGpol_dr;
+                fvec4 fy = dy*dGpol_dr;
+                fvec4 fz = dz*dGpol_dr;
+                blockAtomForceX -= fx;
+                blockAtomForceY -= fy;
+                blockAtomForceZ -= fz;
+                blockAtomBornForce += dGpol_dalpha2_ij*bornRadii[atomJ];
+                float* atomForce = forces+4*atomJ;
+                atomForce[0] += dot4(fx, one);
+                atomForce[1] += dot4(fy, one);
+                atomForce[2] += dot4(fz, one);
+                energy += dot4(blend(0.0f, Gpol-chargeProduct/cutoffDistance, include), one);
+                bornForces[atomJ] += dot4(dGpol_dalpha2_ij, radii);
+            }
+            fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+            transpose(f[0], f[1], f[2], f[3]);
+            for (int i = 0; i < 4; i++) {
+                int atomIndex = blockAtom[i];
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+                bornForces[atomIndex] += blockAtomBornForce[i];
+            }
         }
-        fvec4 offsetRadiusI(atomRadius);
-        fvec4 x(atomx);
-        fvec4 y(atomy);
-        fvec4 z(atomz);
-        ivec4 mask(blockMask);
-        for (int atomJ = 0; atomJ < numParticles; atomJ++) {
-            fvec4 posJ(posq+4*atomJ);
-            fvec4 dx, dy, dz, r2;
-            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
-            ivec4 include = mask & (blockAtomIndex != ivec4(atomJ));
-            if (cutoff)
-                include = include & (r2 < cutoffDistance*cutoffDistance);
-            if (!any(include))
-                continue;
-            fvec4 r = sqrt(r2);
-            float scaledRadiusJ = particleParams[atomJ].second;
-            float scaledRadiusJ2 = scaledRadiusJ*scaledRadiusJ;
-            fvec4 rScaledRadiusJ = r + scaledRadiusJ;
-            include = include & (offsetRadiusI < rScaledRadiusJ);
-            fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
-            fvec4 u_ij = 1.0f/rScaledRadiusJ;
-            fvec4 l_ij2 = l_ij*l_ij;
-            fvec4 u_ij2 = u_ij*u_ij;
-            fvec4 rInverse = 1.0f/r;
-            fvec4 r2Inverse = rInverse*rInverse;
-            fvec4 logRatio = fastLog(u_ij/l_ij);
-            fvec4 t3 = 0.125f*(1.0f + scaledRadiusJ2*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
-            fvec4 de = bornForce*t3*rInverse;
-            de = blend(0.0f, de, include);
-            fvec4 fx = dx*de;
-            fvec4 fy = dy*de;
-            fvec4 fz = dz*de;
-            blockAtomForceX += fx;
-            blockAtomForceY += fy;
-            blockAtomForceZ += fz;
-            float* atomForce = forces+4*atomJ;
-            fvec4 one(1.0f);
-            atomForce[0] -= dot4(fx, one);
-            atomForce[1] -= dot4(fy, one);
-            atomForce[2] -= dot4(fz, one);
+    }
+    else if (phase == 3) {
+        // Combine the Born forces from all threads and fold in the chain rule factors.
+
+        for (int atomI = start; atomI < end; atomI++) {
+            float bornForce = 0.0f;
+            for (int i = 0; i < numThreads; i++)
+                bornForce += threadBornForces[i][atomI];
+            bornForceTotal[atomI] = bornForce*bornRadii[atomI]*bornRadii[atomI]*obcChain[atomI];
         }
-        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
-        transpose(f[0], f[1], f[2], f[3]);
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+    }
+    else {
+        // Apply the chain rule through the Born radii of both atoms in each pair.
+
+        while (true) {
+            int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (blockIndex >= numBlocks)
+                break;
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
+            const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            float atomRadius[4], atomScaledRadius[4], atomBornForce[4], atomx[4], atomy[4], atomz[4];
+            for (int i = 0; i < 4; i++) {
+                atomRadius[i] = particleParams[blockAtom[i]].first;
+                atomScaledRadius[i] = particleParams[blockAtom[i]].second;
+                atomBornForce[i] = bornForceTotal[blockAtom[i]];
+                atomx[i] = posq[4*blockAtom[i]];
+                atomy[i] = posq[4*blockAtom[i]+1];
+                atomz[i] = posq[4*blockAtom[i]+2];
+            }
+            fvec4 offsetRadiusI(atomRadius);
+            fvec4 scaledRadiusI(atomScaledRadius);
+            fvec4 bornForceI(atomBornForce);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+            for (int i = 0; i < (int) neighbors.size(); i++) {
+                int atomJ = sortedAtoms[neighbors[i]];
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = getIncludeMask(exclusions[i]) & (r2 < cutoffDistance2);
+                if (!any(include))
+                    continue;
+                fvec4 r = sqrt(r2);
+                fvec4 termI = bornForceI*computeBornChainTerm(r, offsetRadiusI, particleParams[atomJ].second);
+                fvec4 termJ = bornForceTotal[atomJ]*computeBornChainTerm(r, particleParams[atomJ].first, scaledRadiusI);
+                fvec4 de = blend(0.0f, (termI+termJ)/r, include);
+                fvec4 fx = dx*de;
+                fvec4 fy = dy*de;
+                fvec4 fz = dz*de;
+                blockAtomForceX += fx;
+                blockAtomForceY += fy;
+                blockAtomForceZ += fz;
+                float* atomForce = forces+4*atomJ;
+                atomForce[0] -= dot4(fx, one);
+                atomForce[1] -= dot4(fy, one);
+                atomForce[2] -= dot4(fz, one);
+            }
+            fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+            transpose(f[0], f[1], f[2], f[3]);
+            for (int i = 0; i < 4; i++) {
+                int atomIndex = blockAtom[i];
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+            }
         }
     }
-    threadEnergy[threadIndex] = energy;
+    threadEnergy[threadIndex] += energy;
+}
+
+fvec4 CpuGBSAOBCForce::computeBornSumTerm(const fvec4& r, const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ) {
+    fvec4 rScaledRadiusJ = r + scaledRadiusJ;
+    fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec4 u_ij = 1.0f/rScaledRadiusJ;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 rInverse = 1.0f/r;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadiusJ*scaledRadiusJ*rInverse)*(l_ij2 - u_ij2);
+    term += blend(0.0f, 2.0f*(1.0f/offsetRadiusI-l_ij), offsetRadiusI < scaledRadiusJ-r);
+    return blend(0.0f, term, offsetRadiusI < rScaledRadiusJ);
+}
+
+fvec4 CpuGBSAOBCForce::computeBornChainTerm(const fvec4& r, const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ) {
+    fvec4 rScaledRadiusJ = r + scaledRadiusJ;
+    fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec4 u_ij = 1.0f/rScaledRadiusJ;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 rInverse = 1.0f/r;
+    fvec4 r2Inverse = rInverse*rInverse;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 t3 = 0.125f*(1.0f + scaledRadiusJ*scaledRadiusJ*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
+    return blend(0.0f, t3, offsetRadiusI < rScaledRadiusJ);
 }
 
 void CpuGBSAOBCForce::getDeltaR(const fvec4& posI, const fvec4& x, const fvec4& y, const fvec4& z, fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
@@ -0,0 +1,663 @@
+
+/* Portions copyright (c) 2015 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CpuGBVIForce.h"
+#include "SimTKOpenMMRealType.h"
+#include "openmm/internal/vectorize.h"
+#include "gmx_atomic.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace OpenMM;
+
+class CpuGBVIForce::ComputeTask : public ThreadPool::Task {
+public:
+    ComputeTask(CpuGBVIForce& owner, int phase) : owner(owner), phase(phase) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadComputeForce(threads, threadIndex, phase);
+    }
+    CpuGBVIForce& owner;
+    int phase;
+};
+
+/**
+ * Convert the exclusion flags for a neighbor of a block into a mask of the atoms it interacts with.
+ */
+static inline ivec4 getIncludeMask(char exclusions) {
+    return ivec4((exclusions&1) ? 0 : -1, (exclusions&2) ? 0 : -1, (exclusions&4) ? 0 : -1, (exclusions&8) ? 0 : -1);
+}
+
+/**
+ * Evaluate the function L(r, x, S) used in the analytical volume integrals, along with its partial
+ * derivatives with respect to r and x.
+ */
+static inline void computeL(const fvec4& r, const fvec4& x, const fvec4& S, fvec4& L, fvec4& dLdr, fvec4& dLdx) {
+    fvec4 rInv = 1.0f/r;
+    fvec4 xInv = 1.0f/x;
+    fvec4 xInv2 = xInv*xInv;
+    fvec4 xInv3 = xInv2*xInv;
+    fvec4 diff2 = (r+S)*(r-S);
+    L = (1.5f*xInv)*(0.25f*xInv*rInv - xInv2*(1.0f/3.0f) + 0.125f*diff2*xInv3*rInv);
+    dLdr = (-1.5f*xInv2*rInv*rInv)*(0.25f + 0.125f*diff2*xInv2) + 0.375f*xInv3*xInv;
+    dLdx = (-1.5f*xInv3)*(0.5f*rInv - xInv + 0.5f*diff2*xInv2*rInv);
+}
+
+CpuGBVIForce::CpuGBVIForce() : cutoff(false), periodic(false), useQuinticSpline(false), neighborList(NULL) {
+}
+
+void CpuGBVIForce::setUseCutoff(float distance, const CpuNeighborList& neighbors) {
+    cutoff = true;
+    cutoffDistance = distance;
+    neighborList = &neighbors;
+}
+
+void CpuGBVIForce::setPeriodic(float* periodicBoxSize) {
+    periodic = true;
+    this->periodicBoxSize[0] = periodicBoxSize[0];
+    this->periodicBoxSize[1] = periodicBoxSize[1];
+    this->periodicBoxSize[2] = periodicBoxSize[2];
+}
+
+void CpuGBVIForce::setSoluteDielectric(float dielectric) {
+    soluteDielectric = dielectric;
+}
+
+void CpuGBVIForce::setSolventDielectric(float dielectric) {
+    solventDielectric = dielectric;
+}
+
+void CpuGBVIForce::setUseQuinticSpline(bool useSpline, float lowerLimitFactor, float upperLimit) {
+    useQuinticSpline = useSpline;
+    quinticLowerLimitFactor = lowerLimitFactor;
+    quinticUpperLimit = upperLimit;
+}
+
+const vector<float>& CpuGBVIForce::getAtomicRadii() const {
+    return atomicRadii;
+}
+
+void CpuGBVIForce::setParticleParameters(const vector<float>& radii, const vector<float>& scaledRadii, const vector<float>& gammas) {
+    atomicRadii = radii;
+    this->scaledRadii = scaledRadii;
+    this->gammas = gammas;
+    bornRadii.resize(radii.size()+3);
+    switchDerivative.resize(radii.size()+3);
+    bornForceTotal.resize(radii.size()+3);
+}
+
+void CpuGBVIForce::computeForce(const AlignedArray<float>& posq, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
+    // Record the parameters for the threads.
+    
+    this->posq = &posq[0];
+    this->threadForce = &threadForce;
+    includeEnergy = (totalEnergy != NULL);
+    int numThreads = threads.getNumThreads();
+    threadEnergy.resize(numThreads);
+    threadBornForces.resize(numThreads);
+    for (int i = 0; i < numThreads; i++)
+        threadBornForces[i].resize(atomicRadii.size()+3);
+    if (cutoff) {
+        threadBornSums.resize(numThreads);
+        for (int i = 0; i < numThreads; i++)
+            threadBornSums[i].resize(atomicRadii.size()+3);
+    }
+    gmx_atomic_t counter;
+    this->atomicCounter = &counter;
+    
+    // Signal the threads to start running and wait for them to finish.  The all pairs path
+    // has four phases (Born radii, cavity term, first loop, second loop).  The neighbor list
+    // path has five (Born radius sums, Born radii with cavity and self terms, pair energy,
+    // Born force reduction, chain rule).
+    
+    int numPhases = (cutoff ? 5 : 4);
+    for (int i = 0; i < numThreads; i++)
+        threadEnergy[i] = 0.0;
+    for (int phase = 0; phase < numPhases; phase++) {
+        ComputeTask task(*this, phase);
+        gmx_atomic_set(&counter, 0);
+        threads.execute(task);
+        threads.waitForThreads();
+    }
+    
+    // Combine the energies from all the threads.
+    
+    if (totalEnergy != NULL) {
+        double energy = 0;
+        for (int i = 0; i < numThreads; i++)
+            energy += threadEnergy[i];
+        *totalEnergy += energy;
+    }
+}
+
+void CpuGBVIForce::threadComputeForce(ThreadPool& threads, int threadIndex, int phase) {
+    if (cutoff)
+        threadComputeNeighborPairs(threads, threadIndex, phase);
+    else
+        threadComputeAllPairs(threads, threadIndex, phase);
+}
+
+void CpuGBVIForce::computeBornRadius(int atom, float sum) {
+    // Eq. 3 of the Labute paper, optionally with a quintic spline to keep the Born radius from
+    // diverging as the volume sum approaches the inverse cubed atomic radius.
+
+    float radius = atomicRadii[atom];
+    float atomicRadius3 = 1.0f/(radius*radius*radius);
+    float value, derivative;
+    float splineL = quinticLowerLimitFactor*atomicRadius3;
+    if (!useQuinticSpline || sum <= splineL) {
+        value = atomicRadius3-sum;
+        derivative = 1.0f;
+    }
+    else if (sum < atomicRadius3) {
+        float denominator = atomicRadius3-splineL;
+        float ratio = (sum-splineL)/denominator;
+        float ratio2 = ratio*ratio;
+        float ratio3 = ratio2*ratio;
+        float splineValue = 1.0f + ratio3*(-10.0f + 15.0f*ratio - 6.0f*ratio2);
+        float splineDerivative = ratio2*(-30.0f + 60.0f*ratio - 30.0f*ratio2)/denominator;
+        value = (atomicRadius3-sum)*splineValue + quinticUpperLimit;
+        derivative = splineValue - (atomicRadius3-sum)*splineDerivative;
+    }
+    else {
+        value = quinticUpperLimit;
+        derivative = 0.0f;
+    }
+    bornRadii[atom] = powf(value, -1.0f/3.0f);
+    switchDerivative[atom] = derivative;
+}
+
+void CpuGBVIForce::threadComputeAllPairs(ThreadPool& threads, int threadIndex, int phase) {
+    int numParticles = atomicRadii.size();
+    int numThreads = threads.getNumThreads();
+    fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
+    fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
+    float tau;
+    if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
+        tau = (1.0f/soluteDielectric) - (1.0f/solventDielectric);
+    else
+        tau = 0.0f;
+    float preFactor = -ONE_4PI_EPS0*tau;
+    double energy = 0.0;
+    AlignedArray<float>& bornForces = threadBornForces[threadIndex];
+    float* forces = &(*threadForce)[threadIndex][0];
+
+    if (phase == 0) {
+        // Calculate Born radii
+
+        while (true) {
+            int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
+            if (blockStart >= numParticles)
+                break;
+            int numInBlock = min(4, numParticles-blockStart);
+            ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
+            float atomRadius[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+            float atomx[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            float atomy[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            float atomz[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            int blockMask[4] = {0, 0, 0, 0};
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                atomRadius[i] = atomicRadii[atomIndex];
+                atomx[i] = posq[4*atomIndex];
+                atomy[i] = posq[4*atomIndex+1];
+                atomz[i] = posq[4*atomIndex+2];
+                blockMask[i] = 0xFFFFFFFF;
+            }
+            fvec4 radiusI(atomRadius);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            ivec4 mask(blockMask);
+            fvec4 sum(0.0f);
+            for (int atomJ = 0; atomJ < numParticles; atomJ++) {
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = mask & (blockAtomIndex != ivec4(atomJ));
+                if (!any(include))
+                    continue;
+                fvec4 volume = computeVolume(sqrt(r2), radiusI, scaledRadii[atomJ]);
+                sum += blend(0.0f, volume, include);
+            }
+            for (int i = 0; i < numInBlock; i++)
+                computeBornRadius(blockStart+i, sum[i]);
+        }
+    }
+    else if (phase == 1) {
+        // Calculate the cavity term.
+
+        for (int i = 0; i < numParticles; i++)
+            bornForces[i] = 0.0f;
+        while (true) {
+            int atomI = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (atomI >= numParticles)
+                break;
+            float ratio = atomicRadii[atomI]/bornRadii[atomI];
+            float cavityTerm = tau*gammas[atomI]*ratio*ratio*ratio;
+            energy -= cavityTerm;
+            bornForces[atomI] = 3.0f*cavityTerm/bornRadii[atomI];
+        }
+    }
+    else if (phase == 2) {
+        // First loop of Born energy computation.
+
+        while (true) {
+            int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
+            if (blockStart >= numParticles)
+                break;
+            int numInBlock = min(4, numParticles-blockStart);
+            ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
+            float atomCharge[4], atomx[4], atomy[4], atomz[4];
+            int blockMask[4] = {0, 0, 0, 0};
+            fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                atomx[i] = posq[4*atomIndex];
+                atomy[i] = posq[4*atomIndex+1];
+                atomz[i] = posq[4*atomIndex+2];
+                atomCharge[i] = preFactor*posq[4*atomIndex+3];
+                blockMask[i] = 0xFFFFFFFF;
+            }
+            fvec4 radii(&bornRadii[blockStart]);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            fvec4 partialChargeI(atomCharge);
+            ivec4 mask(blockMask);
+            for (int atomJ = blockStart; atomJ < numParticles; atomJ++) {
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = mask & (blockAtomIndex <= ivec4(atomJ));
+                if (!any(include))
+                    continue;
+                fvec4 alpha2_ij = radii*bornRadii[atomJ];
+                fvec4 D_ij = r2/(4.0f*alpha2_ij);
+                fvec4 expTerm(expf(-D_ij[0]), expf(-D_ij[1]), expf(-D_ij[2]), expf(-D_ij[3]));
+                fvec4 denominator2 = r2 + alpha2_ij*expTerm;
+                fvec4 denominator = sqrt(denominator2);
+                fvec4 Gpol = (partialChargeI*posJ[3])/denominator; 
+                fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;  
+                fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
+                dGpol_dr = blend(0.0f, dGpol_dr, include);
+                dGpol_dalpha2_ij = blend(0.0f, dGpol_dalpha2_ij, include);
+                fvec4 fx = dx*dGpol_dr;
+                fvec4 fy = dy*dGpol_dr;
+                fvec4 fz = dz*dGpol_dr;
+                blockAtomForceX -= fx;
+                blockAtomForceY -= fy;
+                blockAtomForceZ -= fz;
+                blockAtomBornForce += dGpol_dalpha2_ij*bornRadii[atomJ];
+                float* atomForce = forces+4*atomJ;
+                fvec4 one(1.0f);
+                atomForce[0] += dot4(fx, one);
+                atomForce[1] += dot4(fy, one);
+                atomForce[2] += dot4(fz, one);
+                ivec4 atomJMask = include & (blockAtomIndex != ivec4(atomJ));
+                fvec4 termEnergy = blend(0.0f, Gpol, include);
+                termEnergy *= blend(0.5f, 1.0f, atomJMask);
+                energy += dot4(termEnergy, one);
+                bornForces[atomJ] += dot4(blend(0.0f, dGpol_dalpha2_ij, atomJMask), radii);
+            }
+            fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+            transpose(f[0], f[1], f[2], f[3]);
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+                bornForces[atomIndex] += blockAtomBornForce[i];
+            }
+        }
+    }
+    else {
+        // Second loop of Born energy computation: apply the chain rule through the Born radii.
+
+        while (true) {
+            int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
+            if (blockStart >= numParticles)
+                break;
+            fvec4 bornForce(0.0f);
+            for (int i = 0; i < numThreads; i++)
+                bornForce += fvec4(&threadBornForces[i][blockStart]);
+            fvec4 radii(&bornRadii[blockStart]);
+            fvec4 radii2 = radii*radii;
+            bornForce *= (1.0f/3.0f)*radii2*radii2*fvec4(&switchDerivative[blockStart]);
+            int numInBlock = min(4, numParticles-blockStart);
+            ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
+            float atomRadius[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+            float atomx[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            float atomy[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            float atomz[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            int blockMask[4] = {0, 0, 0, 0};
+            fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                atomRadius[i] = atomicRadii[atomIndex];
+                atomx[i] = posq[4*atomIndex];
+                atomy[i] = posq[4*atomIndex+1];
+                atomz[i] = posq[4*atomIndex+2];
+                blockMask[i] = 0xFFFFFFFF;
+            }
+            fvec4 radiusI(atomRadius);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            ivec4 mask(blockMask);
+            for (int atomJ = 0; atomJ < numParticles; atomJ++) {
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = mask & (blockAtomIndex != ivec4(atomJ));
+                if (!any(include))
+                    continue;
+                fvec4 r = sqrt(r2);
+                fvec4 de = bornForce*computeVolumeDerivative(r, radiusI, scaledRadii[atomJ])/r;
+                de = blend(0.0f, de, include);
+                fvec4 fx = dx*de;
+                fvec4 fy = dy*de;
+                fvec4 fz = dz*de;
+                blockAtomForceX -= fx;
+                blockAtomForceY -= fy;
+                blockAtomForceZ -= fz;
+                float* atomForce = forces+4*atomJ;
+                fvec4 one(1.0f);
+                atomForce[0] += dot4(fx, one);
+                atomForce[1] += dot4(fy, one);
+                atomForce[2] += dot4(fz, one);
+            }
+            fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+            transpose(f[0], f[1], f[2], f[3]);
+            for (int i = 0; i < numInBlock; i++) {
+                int atomIndex = blockStart+i;
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+            }
+        }
+    }
+    threadEnergy[threadIndex] += energy;
+}
+
+void CpuGBVIForce::threadComputeNeighborPairs(ThreadPool& threads, int threadIndex, int phase) {
+    int numParticles = atomicRadii.size();
+    int numThreads = threads.getNumThreads();
+    int numBlocks = neighborList->getNumBlocks();
+    const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+    const float cutoffDistance2 = cutoffDistance*cutoffDistance;
+    const fvec4 one(1.0f);
+    fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
+    fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
+    int start = (threadIndex*numParticles)/numThreads;
+    int end = ((threadIndex+1)*numParticles)/numThreads;
+    float tau;
+    if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
+        tau = (1.0f/soluteDielectric) - (1.0f/solventDielectric);
+    else
+        tau = 0.0f;
+    float preFactor = -ONE_4PI_EPS0*tau;
+    double energy = 0.0;
+    AlignedArray<float>& bornForces = threadBornForces[threadIndex];
+    float* forces = &(*threadForce)[threadIndex][0];
+
+    if (phase == 0) {
+        // Accumulate the Born radius sums.  Each pair in the neighbor list contributes to both of its
+        // atoms, so every thread accumulates into its own array.
+
+        AlignedArray<float>& bornSums = threadBornSums[threadIndex];
+        for (int i = 0; i < numParticles; i++)
+            bornSums[i] = 0.0f;
+        while (true) {
+            int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (blockIndex >= numBlocks)
+                break;
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
+            const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            float atomRadius[4], atomScaledRadius[4], atomx[4], atomy[4], atomz[4];
+            for (int i = 0; i < 4; i++) {
+                atomRadius[i] = atomicRadii[blockAtom[i]];
+                atomScaledRadius[i] = scaledRadii[blockAtom[i]];
+                atomx[i] = posq[4*blockAtom[i]];
+                atomy[i] = posq[4*blockAtom[i]+1];
+                atomz[i] = posq[4*blockAtom[i]+2];
+            }
+            fvec4 radiusI(atomRadius);
+            fvec4 scaledRadiusI(atomScaledRadius);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            fvec4 blockSum(0.0f);
+            for (int i = 0; i < (int) neighbors.size(); i++) {
+                int atomJ = sortedAtoms[neighbors[i]];
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = getIncludeMask(exclusions[i]) & (r2 < cutoffDistance2);
+                if (!any(include))
+                    continue;
+                fvec4 r = sqrt(r2);
+                fvec4 termI = computeVolume(r, radiusI, scaledRadii[atomJ]);
+                fvec4 termJ = computeVolume(r, atomicRadii[atomJ], scaledRadiusI);
+                blockSum += blend(0.0f, termI, include);
+                bornSums[atomJ] += dot4(blend(0.0f, termJ, include), one);
+            }
+            for (int i = 0; i < 4; i++)
+                bornSums[blockAtom[i]] += blockSum[i];
+        }
+    }
+    else if (phase == 1) {
+        // Combine the sums from all threads, then compute each atom's Born radius together with its
+        // cavity term and self energy, since all of these depend only on the atom itself.
+
+        for (int i = 0; i < numParticles; i++)
+            bornForces[i] = 0.0f;
+        for (int atomI = start; atomI < end; atomI++) {
+            float sum = 0.0f;
+            for (int i = 0; i < numThreads; i++)
+                sum += threadBornSums[i][atomI];
+            computeBornRadius(atomI, sum);
+            float bornRadius = bornRadii[atomI];
+            float ratio = atomicRadii[atomI]/bornRadius;
+            float cavityTerm = tau*gammas[atomI]*ratio*ratio*ratio;
+            float charge = posq[4*atomI+3];
+            float selfGpol = preFactor*charge*charge/bornRadius;
+            energy += 0.5f*selfGpol - cavityTerm;
+            bornForces[atomI] = (3.0f*cavityTerm - 0.5f*selfGpol)/bornRadius;
+        }
+    }
+    else if (phase == 2) {
+        // Compute the pair terms of the Born energy.
+
+        while (true) {
+            int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (blockIndex >= numBlocks)
+                break;
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
+            const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            float atomCharge[4], atomBornRadius[4], atomx[4], atomy[4], atomz[4];
+            for (int i = 0; i < 4; i++) {
+                atomCharge[i] = preFactor*posq[4*blockAtom[i]+3];
+                atomBornRadius[i] = bornRadii[blockAtom[i]];
+                atomx[i] = posq[4*blockAtom[i]];
+                atomy[i] = posq[4*blockAtom[i]+1];
+                atomz[i] = posq[4*blockAtom[i]+2];
+            }
+            fvec4 radii(atomBornRadius);
+            fvec4 partialChargeI(atomCharge);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
+            for (int i = 0; i < (int) neighbors.size(); i++) {
+                int atomJ = sortedAtoms[neighbors[i]];
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = getIncludeMask(exclusions[i]) & (r2 < cutoffDistance2);
+                if (!any(include))
+                    continue;
+                fvec4 alpha2_ij = radii*bornRadii[atomJ];
+                fvec4 D_ij = r2/(4.0f*alpha2_ij);
+                fvec4 expTerm(expf(-D_ij[0]), expf(-D_ij[1]), expf(-D_ij[2]), expf(-D_ij[3]));
+                fvec4 denominator2 = r2 + alpha2_ij*expTerm;
+                fvec4 denominator = sqrt(denominator2);
+                fvec4 Gpol = (partialChargeI*posJ[3])/denominator;
+                fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;
+                fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
+                dGpol_dr = blend(0.0f, dGpol_dr, include);
+                dGpol_dalpha2_ij = blend(0.0f, dGpol_dalpha2_ij, include);
+                fvec4 fx = dx*dGpol_dr;
+                fvec4 fy = dy*dGpol_dr;
+                fvec4 fz = dz*dGpol_dr;
+                blockAtomForceX -= fx;
+                blockAtomForceY -= fy;
+                blockAtomForceZ -= fz;
+                blockAtomBornForce += dGpol_dalpha2_ij*bornRadii[atomJ];
+                float* atomForce = forces+4*atomJ;
+                atomForce[0] += dot4(fx, one);
+                atomForce[1] += dot4(fy, one);
+                atomForce[2] += dot4(fz, one);
+                energy += dot4(blend(0.0f, Gpol, include), one);
+                bornForces[atomJ] += dot4(dGpol_dalpha2_ij, radii);
+            }
+            fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+            transpose(f[0], f[1], f[2], f[3]);
+            for (int i = 0; i < 4; i++) {
+                int atomIndex = blockAtom[i];
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+                bornForces[atomIndex] += blockAtomBornForce[i];
+            }
+        }
+    }
+    else if (phase == 3) {
+        // Combine the Born forces from all threads and fold in the derivative of each Born radius
+        // with respect to its volume sum.
+
+        for (int atomI = start; atomI < end; atomI++) {
+            float bornForce = 0.0f;
+            for (int i = 0; i < numThreads; i++)
+                bornForce += threadBornForces[i][atomI];
+            float radius2 = bornRadii[atomI]*bornRadii[atomI];
+            bornForceTotal[atomI] = (1.0f/3.0f)*bornForce*radius2*radius2*switchDerivative[atomI];
+        }
+    }
+    else {
+        // Apply the chain rule through the Born radii of both atoms in each pair.
+
+        while (true) {
+            int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (blockIndex >= numBlocks)
+                break;
+            const int* blockAtom = &sortedAtoms[4*blockIndex];
+            const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            float atomRadius[4], atomScaledRadius[4], atomBornForce[4], atomx[4], atomy[4], atomz[4];
+            for (int i = 0; i < 4; i++) {
+                atomRadius[i] = atomicRadii[blockAtom[i]];
+                atomScaledRadius[i] = scaledRadii[blockAtom[i]];
+                atomBornForce[i] = bornForceTotal[blockAtom[i]];
+                atomx[i] = posq[4*blockAtom[i]];
+                atomy[i] = posq[4*blockAtom[i]+1];
+                atomz[i] = posq[4*blockAtom[i]+2];
+            }
+            fvec4 radiusI(atomRadius);
+            fvec4 scaledRadiusI(atomScaledRadius);
+            fvec4 bornForceI(atomBornForce);
+            fvec4 x(atomx);
+            fvec4 y(atomy);
+            fvec4 z(atomz);
+            fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+            for (int i = 0; i < (int) neighbors.size(); i++) {
+                int atomJ = sortedAtoms[neighbors[i]];
+                fvec4 posJ(posq+4*atomJ);
+                fvec4 dx, dy, dz, r2;
+                getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+                ivec4 include = getIncludeMask(exclusions[i]) & (r2 < cutoffDistance2);
+                if (!any(include))
+                    continue;
+                fvec4 r = sqrt(r2);
+                fvec4 termI = bornForceI*computeVolumeDerivative(r, radiusI, scaledRadii[atomJ]);
+                fvec4 termJ = bornForceTotal[atomJ]*computeVolumeDerivative(r, atomicRadii[atomJ], scaledRadiusI);
+                fvec4 de = blend(0.0f, (termI+termJ)/r, include);
+                fvec4 fx = dx*de;
+                fvec4 fy = dy*de;
+                fvec4 fz = dz*de;
+                blockAtomForceX -= fx;
+                blockAtomForceY -= fy;
+                blockAtomForceZ -= fz;
+                float* atomForce = forces+4*atomJ;
+                atomForce[0] += dot4(fx, one);
+                atomForce[1] += dot4(fy, one);
+                atomForce[2] += dot4(fz, one);
+            }
+            fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+            transpose(f[0], f[1], f[2], f[3]);
+            for (int i = 0; i < 4; i++) {
+                int atomIndex = blockAtom[i];
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+            }
+        }
+    }
+    threadEnergy[threadIndex] += energy;
+}
+
+fvec4 CpuGBVIForce::computeVolume(const fvec4& r, const fvec4& radiusI, const fvec4& scaledRadiusJ) const {
+    // If atom J's scaled sphere lies entirely inside atom I, it contributes nothing.  If atom I lies
+    // entirely inside it, the integral runs from r-S instead of from the surface of atom I, and
+    // picks up the volume of atom I itself.
+
+    ivec4 iInsideJ = (r <= scaledRadiusJ-radiusI);
+    ivec4 lowerIsRadius = (radiusI > r-scaledRadiusJ) & (r > scaledRadiusJ-radiusI);
+    fvec4 lower = blend(r-scaledRadiusJ, radiusI, lowerIsRadius);
+    fvec4 upperL, lowerL, dLdr, dLdx;
+    computeL(r, r+scaledRadiusJ, scaledRadiusJ, upperL, dLdr, dLdx);
+    computeL(r, lower, scaledRadiusJ, lowerL, dLdr, dLdx);
+    fvec4 volume = upperL-lowerL + blend(0.0f, 1.0f/(radiusI*radiusI*radiusI), iInsideJ);
+    return blend(0.0f, volume, radiusI-scaledRadiusJ < r);
+}
+
+fvec4 CpuGBVIForce::computeVolumeDerivative(const fvec4& r, const fvec4& radiusI, const fvec4& scaledRadiusJ) const {
+    // When a limit of integration depends on r, its contribution includes the derivative with respect to x.
+
+    ivec4 lowerIsRadius = (radiusI > r-scaledRadiusJ) & (r >= scaledRadiusJ-radiusI);
+    fvec4 lower = blend(r-scaledRadiusJ, radiusI, lowerIsRadius);
+    fvec4 L, upperDLdr, upperDLdx, lowerDLdr, lowerDLdx;
+    computeL(r, r+scaledRadiusJ, scaledRadiusJ, L, upperDLdr, upperDLdx);
+    computeL(r, lower, scaledRadiusJ, L, lowerDLdr, lowerDLdx);
+    fvec4 derivative = upperDLdr+upperDLdx - lowerDLdr - blend(lowerDLdx, 0.0f, lowerIsRadius);
+    return blend(0.0f, derivative, radiusI-scaledRadiusJ < r);
+}
+
+void CpuGBVIForce::getDeltaR(const fvec4& posI, const fvec4& x, const fvec4& y, const fvec4& z, fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
+    dx = x-posI[0];
+    dy = y-posI[1];
+    dz = z-posI[2];
+    if (periodic) {
+        dx -= round(dx*invBoxSize[0])*boxSize[0];
+        dy -= round(dy*invBoxSize[1])*boxSize[1];
+        dz -= round(dz*invBoxSize[2])*boxSize[2];
+    }
+    r2 = dx*dx + dy*dy + dz*dz;
+}
@@ -32,6 +32,7 @@
 #include "CpuKernelFactory.h"
 #include "CpuKernels.h"
 #include "CpuPlatform.h"
+#include "ReferenceKernelFactory.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/OpenMMException.h"
 
@@ -41,6 +42,14 @@ KernelImpl* CpuKernelFactory::createKernelImpl(std::string name, const Platform&
     CpuPlatform::PlatformData& data = CpuPlatform::getPlatformData(context);
     if (name == CalcForcesAndEnergyKernel::Name())
         return new CpuCalcForcesAndEnergyKernel(name, platform, data, context);
+    if (data.useDoublePrecision && (name == CalcNonbondedForceKernel::Name() || name == CalcCustomNonbondedForceKernel::Name() ||
+            name == CalcCustomManyParticleForceKernel::Name() || name == CalcGBSAOBCForceKernel::Name() || name == CalcGBVIForceKernel::Name() || name == CalcCustomGBForceKernel::Name() ||
+            name == CalcCustomExternalForceKernel::Name() || name == CalcCustomCompoundBondForceKernel::Name())) {
+        // These kernels compute forces in single precision, so use the double precision Reference versions instead.
+
+        ReferenceKernelFactory referenceFactory;
+        return referenceFactory.createKernelImpl(name, platform, context);
+    }
     if (name == CalcPeriodicTorsionForceKernel::Name())
         return new CpuCalcPeriodicTorsionForceKernel(name, platform, data);
     if (name == CalcRBTorsionForceKernel::Name())
@@ -53,9 +62,19 @@ KernelImpl* CpuKernelFactory::createKernelImpl(std::string name, const Platform&
         return new CpuCalcCustomManyParticleForceKernel(name, platform, data);
     if (name == CalcGBSAOBCForceKernel::Name())
         return new CpuCalcGBSAOBCForceKernel(name, platform, data);
+    if (name == CalcGBVIForceKernel::Name())
+        return new CpuCalcGBVIForceKernel(name, platform, data);
     if (name == CalcCustomGBForceKernel::Name())
         return new CpuCalcCustomGBForceKernel(name, platform, data);
+    if (name == CalcCustomExternalForceKernel::Name())
+        return new CpuCalcCustomExternalForceKernel(name, platform, data);
+    if (name == CalcCustomCompoundBondForceKernel::Name())
+        return new CpuCalcCustomCompoundBondForceKernel(name, platform, data);
     if (name == IntegrateLangevinStepKernel::Name())
         return new CpuIntegrateLangevinStepKernel(name, platform, data);
+    if (name == IntegrateVariableLangevinStepKernel::Name())
+        return new CpuIntegrateVariableLangevinStepKernel(name, platform, data);
+    if (name == IntegrateVariableVerletStepKernel::Name())
+        return new CpuIntegrateVariableVerletStepKernel(name, platform, data);
     throw OpenMMException((std::string("Tried to create kernel with illegal kernel name '") + name + "'").c_str());
 }
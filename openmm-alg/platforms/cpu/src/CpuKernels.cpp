@@ -30,25 +30,28 @@
  * -------------------------------------------------------------------------- */
 
 #include "CpuKernels.h"
-#include "ReferenceBondForce.h"
+#include "CpuTabulatedFunction.h"
+#include "ReferenceCCMAAlgorithm.h"
 #include "ReferenceConstraints.h"
 #include "ReferenceKernelFactory.h"
 #include "ReferenceKernels.h"
-#include "ReferenceLJCoulomb14.h"
 #include "ReferenceProperDihedralBond.h"
 #include "ReferenceRbDihedralBond.h"
-#include "ReferenceTabulatedFunction.h"
 #include "openmm/Context.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/CustomCompoundBondForceImpl.h"
 #include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/internal/NonbondedForceImpl.h"
 #include "openmm/internal/vectorize.h"
 #include "RealVec.h"
 #include "lepton/CompiledExpression.h"
 #include "lepton/CustomFunction.h"
+#include "lepton/Operation.h"
 #include "lepton/Parser.h"
 #include "lepton/ParsedExpression.h"
+#include <set>
+#include <sstream>
 
 using namespace OpenMM;
 using namespace std;
@@ -83,6 +86,32 @@ static ReferenceConstraints& extractConstraints(ContextImpl& context) {
     return *(ReferenceConstraints*) data->constraints;
 }
 
+/**
+ * Allocate a two dimensional array in the form expected by the reference code, but with all the rows
+ * stored in a single contiguous block of memory.  This makes building large parameter arrays much faster
+ * than allocating every row separately.  The array must be freed with deleteContiguousArray().
+ */
+template <class T>
+static T** allocateContiguousArray(int rows, int columns) {
+    T** array = new T*[rows];
+    if (rows > 0) {
+        T* block = new T[rows*columns];
+        for (int i = 0; i < rows; i++)
+            array[i] = block+i*columns;
+    }
+    return array;
+}
+
+/**
+ * Free an array that was created by allocateContiguousArray().
+ */
+template <class T>
+static void deleteContiguousArray(T** array, int rows) {
+    if (rows > 0)
+        delete[] array[0];
+    delete[] array;
+}
+
 /**
  * Compute the kinetic energy of the system, possibly shifting the velocities in time to account
  * for a leapfrog integrator.
@@ -119,6 +148,20 @@ static double computeShiftedKineticEnergy(ContextImpl& context, vector<double>&
     return 0.5*energy;
 }
 
+/**
+ * Count the number of atom pairs that are evaluated for each force computation using a neighbor list.
+ */
+static long long countNeighborPairs(const CpuNeighborList& neighborList) {
+    int numBlocks = neighborList.getNumBlocks();
+    if (numBlocks == 0)
+        return 0;
+    long long blockSize = neighborList.getSortedAtoms().size()/numBlocks;
+    long long numPairs = 0;
+    for (int i = 0; i < numBlocks; i++)
+        numPairs += blockSize*neighborList.getBlockNeighbors(i).size();
+    return numPairs;
+}
+
 class CpuCalcForcesAndEnergyKernel::SumForceTask : public ThreadPool::Task {
 public:
     SumForceTask(int numParticles, vector<RealVec>& forceData, CpuPlatform::PlatformData& data) : numParticles(numParticles), forceData(forceData), data(data) {
@@ -220,10 +263,17 @@ void CpuCalcForcesAndEnergyKernel::initialize(const System& system) {
 }
 
 void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups) {
+    if (data.statistics.isEnabled()) {
+        computationStartTime = CpuStatistics::getCurrentTime();
+        data.statistics.increment(CpuStatistics::ForceEvaluations);
+    }
     referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().beginComputation(context, includeForce, includeEnergy, groups);
+    if (includeEnergy)
+        data.lambdaDerivatives[0] = data.lambdaDerivatives[1] = 0.0;
     
     // Convert positions to single precision and clear the forces.
 
+    CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::InitForces);
     InitForceTask task(context.getSystem().getNumParticles(), context, data);
     data.threads.execute(task);
     data.threads.waitForThreads();
@@ -234,43 +284,70 @@ void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool i
 double CpuCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups) {
     // Sum the forces from all the threads.
     
-    SumForceTask task(context.getSystem().getNumParticles(), extractForces(context), data);
-    data.threads.execute(task);
-    data.threads.waitForThreads();
-    return referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().finishComputation(context, includeForce, includeEnergy, groups);
+    {
+        CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::SumForces);
+        SumForceTask task(context.getSystem().getNumParticles(), extractForces(context), data);
+        data.threads.execute(task);
+        data.threads.waitForThreads();
+    }
+    double energy = 0.0;
+    if (includeForce) {
+        // Distribute forces from virtual sites.  We do this in parallel instead of letting the Reference
+        // kernel do it.
+        
+        data.virtualSites->distributeForces(context.getSystem(), extractPositions(context), extractForces(context));
+    }
+    else
+        energy = referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().finishComputation(context, includeForce, includeEnergy, groups);
+    if (data.statistics.isEnabled())
+        data.statistics.addTime(CpuStatistics::ForceComputation, CpuStatistics::getCurrentTime()-computationStartTime);
+    return energy;
 }
 
 CpuCalcPeriodicTorsionForceKernel::~CpuCalcPeriodicTorsionForceKernel() {
     if (torsionIndexArray != NULL) {
-        for (int i = 0; i < numTorsions; i++) {
-            delete[] torsionIndexArray[i];
-            delete[] torsionParamArray[i];
-        }
-        delete[] torsionIndexArray;
-        delete[] torsionParamArray;
+        deleteContiguousArray(torsionIndexArray, numTorsions);
+        deleteContiguousArray(torsionParamArray, numTorsions);
     }
 }
 
+class CpuCalcPeriodicTorsionForceKernel::CopyParametersTask : public ThreadPool::Task {
+public:
+    CopyParametersTask(const PeriodicTorsionForce& force, int** torsionIndexArray, RealOpenMM** torsionParamArray) :
+            force(force), torsionIndexArray(torsionIndexArray), torsionParamArray(torsionParamArray) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        // Copy the parameters of this thread's share of the torsions.
+
+        int numTorsions = force.getNumTorsions();
+        int numThreads = threads.getNumThreads();
+        int start = threadIndex*numTorsions/numThreads;
+        int end = (threadIndex+1)*numTorsions/numThreads;
+        for (int i = start; i < end; ++i) {
+            int particle1, particle2, particle3, particle4, periodicity;
+            double phase, k;
+            force.getTorsionParameters(i, particle1, particle2, particle3, particle4, periodicity, phase, k);
+            torsionIndexArray[i][0] = particle1;
+            torsionIndexArray[i][1] = particle2;
+            torsionIndexArray[i][2] = particle3;
+            torsionIndexArray[i][3] = particle4;
+            torsionParamArray[i][0] = (RealOpenMM) k;
+            torsionParamArray[i][1] = (RealOpenMM) phase;
+            torsionParamArray[i][2] = (RealOpenMM) periodicity;
+        }
+    }
+    const PeriodicTorsionForce& force;
+    int** torsionIndexArray;
+    RealOpenMM** torsionParamArray;
+};
+
 void CpuCalcPeriodicTorsionForceKernel::initialize(const System& system, const PeriodicTorsionForce& force) {
     numTorsions = force.getNumTorsions();
-    torsionIndexArray = new int*[numTorsions];
-    for (int i = 0; i < numTorsions; i++)
-        torsionIndexArray[i] = new int[4];
-    torsionParamArray = new RealOpenMM*[numTorsions];
-    for (int i = 0; i < numTorsions; i++)
-        torsionParamArray[i] = new RealOpenMM[3];
-    for (int i = 0; i < numTorsions; ++i) {
-        int particle1, particle2, particle3, particle4, periodicity;
-        double phase, k;
-        force.getTorsionParameters(i, particle1, particle2, particle3, particle4, periodicity, phase, k);
-        torsionIndexArray[i][0] = particle1;
-        torsionIndexArray[i][1] = particle2;
-        torsionIndexArray[i][2] = particle3;
-        torsionIndexArray[i][3] = particle4;
-        torsionParamArray[i][0] = (RealOpenMM) k;
-        torsionParamArray[i][1] = (RealOpenMM) phase;
-        torsionParamArray[i][2] = (RealOpenMM) periodicity;
-    }
+    torsionIndexArray = allocateContiguousArray<int>(numTorsions, 4);
+    torsionParamArray = allocateContiguousArray<RealOpenMM>(numTorsions, 3);
+    CopyParametersTask task(force, torsionIndexArray, torsionParamArray);
+    data.threads.execute(task);
+    data.threads.waitForThreads();
     bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads);
 }
 
@@ -278,6 +355,7 @@ double CpuCalcPeriodicTorsionForceKernel::execute(ContextImpl& context, bool inc
     vector<RealVec>& posData = extractPositions(context);
     vector<RealVec>& forceData = extractForces(context);
     RealOpenMM energy = 0;
+    CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::BondedForces);
     ReferenceProperDihedralBond periodicTorsionBond;
     bondForce.calculateForce(posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, periodicTorsionBond);
     return energy;
@@ -303,38 +381,51 @@ void CpuCalcPeriodicTorsionForceKernel::copyParametersToContext(ContextImpl& con
 
 CpuCalcRBTorsionForceKernel::~CpuCalcRBTorsionForceKernel() {
     if (torsionIndexArray != NULL) {
-        for (int i = 0; i < numTorsions; i++) {
-            delete[] torsionIndexArray[i];
-            delete[] torsionParamArray[i];
-        }
-        delete[] torsionIndexArray;
-        delete[] torsionParamArray;
+        deleteContiguousArray(torsionIndexArray, numTorsions);
+        deleteContiguousArray(torsionParamArray, numTorsions);
     }
 }
 
+class CpuCalcRBTorsionForceKernel::CopyParametersTask : public ThreadPool::Task {
+public:
+    CopyParametersTask(const RBTorsionForce& force, int** torsionIndexArray, RealOpenMM** torsionParamArray) :
+            force(force), torsionIndexArray(torsionIndexArray), torsionParamArray(torsionParamArray) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        // Copy the parameters of this thread's share of the torsions.
+
+        int numTorsions = force.getNumTorsions();
+        int numThreads = threads.getNumThreads();
+        int start = threadIndex*numTorsions/numThreads;
+        int end = (threadIndex+1)*numTorsions/numThreads;
+        for (int i = start; i < end; ++i) {
+            int particle1, particle2, particle3, particle4;
+            double c0, c1, c2, c3, c4, c5;
+            force.getTorsionParameters(i, particle1, particle2, particle3, particle4, c0, c1, c2, c3, c4, c5);
+            torsionIndexArray[i][0] = particle1;
+            torsionIndexArray[i][1] = particle2;
+            torsionIndexArray[i][2] = particle3;
+            torsionIndexArray[i][3] = particle4;
+            torsionParamArray[i][0] = (RealOpenMM) c0;
+            torsionParamArray[i][1] = (RealOpenMM) c1;
+            torsionParamArray[i][2] = (RealOpenMM) c2;
+            torsionParamArray[i][3] = (RealOpenMM) c3;
+            torsionParamArray[i][4] = (RealOpenMM) c4;
+            torsionParamArray[i][5] = (RealOpenMM) c5;
+        }
+    }
+    const RBTorsionForce& force;
+    int** torsionIndexArray;
+    RealOpenMM** torsionParamArray;
+};
+
 void CpuCalcRBTorsionForceKernel::initialize(const System& system, const RBTorsionForce& force) {
     numTorsions = force.getNumTorsions();
-    torsionIndexArray = new int*[numTorsions];
-    for (int i = 0; i < numTorsions; i++)
-        torsionIndexArray[i] = new int[4];
-    torsionParamArray = new RealOpenMM*[numTorsions];
-    for (int i = 0; i < numTorsions; i++)
-        torsionParamArray[i] = new RealOpenMM[6];
-    for (int i = 0; i < numTorsions; ++i) {
-        int particle1, particle2, particle3, particle4;
-        double c0, c1, c2, c3, c4, c5;
-        force.getTorsionParameters(i, particle1, particle2, particle3, particle4, c0, c1, c2, c3, c4, c5);
-        torsionIndexArray[i][0] = particle1;
-        torsionIndexArray[i][1] = particle2;
-        torsionIndexArray[i][2] = particle3;
-        torsionIndexArray[i][3] = particle4;
-        torsionParamArray[i][0] = (RealOpenMM) c0;
-        torsionParamArray[i][1] = (RealOpenMM) c1;
-        torsionParamArray[i][2] = (RealOpenMM) c2;
-        torsionParamArray[i][3] = (RealOpenMM) c3;
-        torsionParamArray[i][4] = (RealOpenMM) c4;
-        torsionParamArray[i][5] = (RealOpenMM) c5;
-    }
+    torsionIndexArray = allocateContiguousArray<int>(numTorsions, 4);
+    torsionParamArray = allocateContiguousArray<RealOpenMM>(numTorsions, 6);
+    CopyParametersTask task(force, torsionIndexArray, torsionParamArray);
+    data.threads.execute(task);
+    data.threads.waitForThreads();
     bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads);
 }
 
@@ -342,6 +433,7 @@ double CpuCalcRBTorsionForceKernel::execute(ContextImpl& context, bool includeFo
     vector<RealVec>& posData = extractPositions(context);
     vector<RealVec>& forceData = extractForces(context);
     RealOpenMM energy = 0;
+    CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::BondedForces);
     ReferenceRbDihedralBond rbTorsionBond;
     bondForce.calculateForce(posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, rbTorsionBond);
     return energy;
@@ -370,22 +462,23 @@ void CpuCalcRBTorsionForceKernel::copyParametersToContext(ContextImpl& context,
 
 class CpuCalcNonbondedForceKernel::PmeIO : public CalcPmeReciprocalForceKernel::IO {
 public:
-    PmeIO(float* posq, float* force, int numParticles) : posq(posq), force(force), numParticles(numParticles) {
+    PmeIO(float* posq, float* force, int numParticles, float scale=1.0f) : posq(posq), force(force), numParticles(numParticles), scale(scale) {
     }
     float* getPosq() {
         return posq;
     }
     void setForce(float* f) {
         for (int i = 0; i < numParticles; i++) {
-            force[4*i] += f[4*i];
-            force[4*i+1] += f[4*i+1];
-            force[4*i+2] += f[4*i+2];
+            force[4*i] += scale*f[4*i];
+            force[4*i+1] += scale*f[4*i+1];
+            force[4*i+2] += scale*f[4*i+2];
         }
     }
 private:
     float* posq;
     float* force;
     int numParticles;
+    float scale;
 };
 
 bool isVec8Supported();
@@ -393,7 +486,7 @@ CpuNonbondedForce* createCpuNonbondedForceVec4();
 CpuNonbondedForce* createCpuNonbondedForceVec8();
 
 CpuCalcNonbondedForceKernel::CpuCalcNonbondedForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcNonbondedForceKernel(name, platform),
-        data(data), bonded14IndexArray(NULL), bonded14ParamArray(NULL), hasInitializedPme(false), neighborList(NULL), nonbonded(NULL) {
+        data(data), bonded14IndexArray(NULL), bonded14ParamArray(NULL), numNeighborPairs(0), hasInitializedPme(false), canTunePme(false), hasAlchemical(false), neighborList(NULL), nonbonded(NULL) {
     if (isVec8Supported()) {
         neighborList = new CpuNeighborList(8);
         nonbonded = createCpuNonbondedForceVec8();
@@ -406,12 +499,8 @@ CpuCalcNonbondedForceKernel::CpuCalcNonbondedForceKernel(string name, const Plat
 
 CpuCalcNonbondedForceKernel::~CpuCalcNonbondedForceKernel() {
     if (bonded14ParamArray != NULL) {
-        for (int i = 0; i < num14; i++) {
-            delete[] bonded14IndexArray[i];
-            delete[] bonded14ParamArray[i];
-        }
-        delete[] bonded14IndexArray;
-        delete[] bonded14ParamArray;
+        deleteContiguousArray(bonded14IndexArray, num14);
+        deleteContiguousArray(bonded14ParamArray, num14);
     }
     if (nonbonded != NULL)
         delete nonbonded;
@@ -419,54 +508,89 @@ CpuCalcNonbondedForceKernel::~CpuCalcNonbondedForceKernel() {
         delete neighborList;
 }
 
+/**
+ * Copy the particle and exception parameters out of a NonbondedForce.  This is done in two passes.  The
+ * first one records the particle parameters and the excluded pairs, and marks which exceptions are 1-4
+ * interactions.  Once those have been numbered, the second pass records their parameters.
+ */
+class CpuCalcNonbondedForceKernel::CopyParametersTask : public ThreadPool::Task {
+public:
+    CopyParametersTask(CpuCalcNonbondedForceKernel& owner, const NonbondedForce& force, vector<pair<int, int> >& excludedPairs, const vector<int>& nb14s) :
+            owner(owner), force(force), excludedPairs(excludedPairs), nb14s(nb14s), copy14(false) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        int numThreads = threads.getNumThreads();
+        if (copy14) {
+            int num14 = nb14s.size();
+            for (int i = threadIndex*num14/numThreads; i < (threadIndex+1)*num14/numThreads; ++i) {
+                int particle1, particle2;
+                double charge, radius, depth;
+                force.getExceptionParameters(nb14s[i], particle1, particle2, charge, radius, depth);
+                owner.bonded14IndexArray[i][0] = particle1;
+                owner.bonded14IndexArray[i][1] = particle2;
+                owner.bonded14ParamArray[i][0] = static_cast<RealOpenMM>(radius);
+                owner.bonded14ParamArray[i][1] = static_cast<RealOpenMM>(4.0*depth);
+                owner.bonded14ParamArray[i][2] = static_cast<RealOpenMM>(charge);
+            }
+            return;
+        }
+        int numParticles = owner.numParticles;
+        for (int i = threadIndex*numParticles/numThreads; i < (threadIndex+1)*numParticles/numThreads; ++i) {
+            double charge, radius, depth;
+            force.getParticleParameters(i, charge, radius, depth);
+            owner.data.posq[4*i+3] = (float) charge;
+            owner.particleCharges[i] = charge;
+            owner.particleParams[i] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
+        }
+        int numExceptions = force.getNumExceptions();
+        for (int i = threadIndex*numExceptions/numThreads; i < (threadIndex+1)*numExceptions/numThreads; i++) {
+            int particle1, particle2;
+            double chargeProd, sigma, epsilon;
+            force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
+            excludedPairs[i] = make_pair(particle1, particle2);
+            if (chargeProd != 0.0 || epsilon != 0.0)
+                owner.exceptionIndex[i] = 0;
+        }
+    }
+    CpuCalcNonbondedForceKernel& owner;
+    const NonbondedForce& force;
+    vector<pair<int, int> >& excludedPairs;
+    const vector<int>& nb14s;
+    bool copy14;
+};
+
 void CpuCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
 
-    // Identify which exceptions are 1-4 interactions.
+    // Record the particle parameters and the exclusions, and identify which exceptions are 1-4 interactions.
 
     numParticles = force.getNumParticles();
-    exclusions.resize(numParticles);
+    exceptionIndex.resize(force.getNumExceptions(), -1);
+    particleParams.resize(numParticles);
+    particleCharges.resize(numParticles);
+    vector<pair<int, int> > excludedPairs(force.getNumExceptions());
     vector<int> nb14s;
-    for (int i = 0; i < force.getNumExceptions(); i++) {
-        int particle1, particle2;
-        double chargeProd, sigma, epsilon;
-        force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
-        exclusions[particle1].insert(particle2);
-        exclusions[particle2].insert(particle1);
-        if (chargeProd != 0.0 || epsilon != 0.0)
+    CopyParametersTask task(*this, force, excludedPairs, nb14s);
+    data.threads.execute(task);
+    data.threads.waitForThreads();
+    for (int i = 0; i < force.getNumExceptions(); i++)
+        if (exceptionIndex[i] != -1) {
+            exceptionIndex[i] = nb14s.size();
             nb14s.push_back(i);
-    }
-
-    // Record the particle parameters.
-
-    num14 = nb14s.size();
-    bonded14IndexArray = new int*[num14];
-    for (int i = 0; i < num14; i++)
-        bonded14IndexArray[i] = new int[2];
-    bonded14ParamArray = new double*[num14];
-    for (int i = 0; i < num14; i++)
-        bonded14ParamArray[i] = new double[3];
-    particleParams.resize(numParticles);
-    double sumSquaredCharges = 0.0;
-    for (int i = 0; i < numParticles; ++i) {
-        double charge, radius, depth;
-        force.getParticleParameters(i, charge, radius, depth);
-        data.posq[4*i+3] = (float) charge;
-        particleParams[i] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
-        sumSquaredCharges += charge*charge;
-    }
+        }
+    exclusions = &data.shareExclusions(new CpuExclusions(numParticles, excludedPairs, data.threads));
+    sumSquaredCharges = 0.0;
+    for (int i = 0; i < numParticles; ++i)
+        sumSquaredCharges += particleCharges[i]*particleCharges[i];
     
     // Recorded exception parameters.
     
-    for (int i = 0; i < num14; ++i) {
-        int particle1, particle2;
-        double charge, radius, depth;
-        force.getExceptionParameters(nb14s[i], particle1, particle2, charge, radius, depth);
-        bonded14IndexArray[i][0] = particle1;
-        bonded14IndexArray[i][1] = particle2;
-        bonded14ParamArray[i][0] = static_cast<RealOpenMM>(radius);
-        bonded14ParamArray[i][1] = static_cast<RealOpenMM>(4.0*depth);
-        bonded14ParamArray[i][2] = static_cast<RealOpenMM>(charge);
-    }
+    num14 = nb14s.size();
+    bonded14IndexArray = allocateContiguousArray<int>(num14, 2);
+    bonded14ParamArray = allocateContiguousArray<double>(num14, 3);
+    task.copy14 = true;
+    data.threads.execute(task);
+    data.threads.waitForThreads();
+    nonbonded14.initialize(numParticles, num14, bonded14IndexArray, data.threads);
     
     // Record other parameters.
     
@@ -485,6 +609,10 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
     }
     else if (nonbondedMethod == PME) {
         double alpha;
+        int nx, ny, nz;
+        force.getPMEParameters(alpha, nx, ny, nz);
+        canTunePme = (alpha == 0.0);
+        ewaldErrorTolerance = force.getEwaldErrorTolerance();
         NonbondedForceImpl::calcPMEParameters(system, force, alpha, gridSize[0], gridSize[1], gridSize[2]);
         ewaldAlpha = alpha;
     }
@@ -499,6 +627,22 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
         dispersionCoefficient = 0.0;
     lastPositions.resize(numParticles, Vec3(1e10, 1e10, 1e10));
     data.isPeriodic = (nonbondedMethod == CutoffPeriodic || nonbondedMethod == Ewald || nonbondedMethod == PME);
+    
+    // Record which particles are alchemical.
+    
+    set<int> alchemicalParticles;
+    force.getAlchemicalParticles(alchemicalParticles);
+    hasAlchemical = (alchemicalParticles.size() > 0);
+    softcoreAlpha = force.getSoftcoreAlpha();
+    if (hasAlchemical) {
+        isAlchemical.resize(numParticles, 0.0f);
+        for (set<int>::const_iterator iter = alchemicalParticles.begin(); iter != alchemicalParticles.end(); ++iter)
+            isAlchemical[*iter] = 1.0f;
+        if (nonbondedMethod == Ewald || nonbondedMethod == PME) {
+            alchemicalPosq[0].resize(4*numParticles);
+            alchemicalPosq[1].resize(4*numParticles);
+        }
+    }
 }
 
 double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
@@ -512,8 +656,12 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
             kernelNames.push_back("CalcPmeReciprocalForce");
             useOptimizedPme = getPlatform().supportsKernels(kernelNames);
             if (useOptimizedPme) {
-                optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
-                optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha);
+                if (data.tunePme && canTunePme)
+                    tunePmeParameters(context);
+                else {
+                    optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
+                    optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha);
+                }
             }
         }
     }
@@ -524,9 +672,11 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
     double energy = (includeReciprocal ? ewaldSelfEnergy : 0.0);
     bool ewald  = (nonbondedMethod == Ewald);
     bool pme  = (nonbondedMethod == PME);
+    CpuStatistics& statistics = data.statistics;
     if (nonbondedMethod != NoCutoff) {
         // Determine whether we need to recompute the neighbor list.
         
+        CpuStatistics::ScopedTimer timer(statistics, CpuStatistics::NeighborList);
         double padding = 0.15*nonbondedCutoff;
         bool needRecompute = false;
         double closeCutoff2 = 0.25*padding*padding;
@@ -566,8 +716,13 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
                 }
         }
         if (needRecompute) {
-            neighborList->computeNeighborList(numParticles, posq, exclusions, boxVectors, data.isPeriodic, nonbondedCutoff+padding, data.threads);
+            neighborList->computeNeighborList(numParticles, posq, *exclusions, boxVectors, data.isPeriodic, nonbondedCutoff+padding, data.threads);
+            nonbonded->invalidateSortedParameters();
             lastPositions = posData;
+            if (statistics.isEnabled()) {
+                statistics.increment(CpuStatistics::NeighborListBuilds);
+                numNeighborPairs = countNeighborPairs(*neighborList);
+            }
         }
         nonbonded->setUseCutoff(nonbondedCutoff, *neighborList, rfDielectric);
     }
@@ -584,30 +739,147 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
         nonbonded->setUsePME(ewaldAlpha, gridSize);
     if (useSwitchingFunction)
         nonbonded->setUseSwitchingFunction(switchingDistance);
+    double lambdaElectrostatics = 1.0, lambdaSterics = 1.0;
+    if (hasAlchemical) {
+        lambdaElectrostatics = context.getParameter(NonbondedForce::LambdaElectrostatics());
+        lambdaSterics = context.getParameter(NonbondedForce::LambdaSterics());
+        nonbonded->setUseAlchemical(isAlchemical, (float) softcoreAlpha, (float) lambdaElectrostatics, (float) lambdaSterics);
+    }
+    double lambdaDerivatives[2] = {0.0, 0.0};
     double nonbondedEnergy = 0;
-    if (includeDirect)
-        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
+    if (includeDirect) {
+        CpuStatistics::ScopedTimer timer(statistics, CpuStatistics::NonbondedDirect);
+        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, *exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL,
+                hasAlchemical ? lambdaDerivatives : NULL, data.threads, includeForces);
+        statistics.increment(CpuStatistics::PairsEvaluated, nonbondedMethod == NoCutoff ? numParticles*(long long) (numParticles-1)/2 : numNeighborPairs);
+    }
     if (includeReciprocal) {
-        if (useOptimizedPme) {
-            PmeIO io(&posq[0], &data.threadForce[0][0], numParticles);
-            Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
-            optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy);
-            nonbondedEnergy += optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(io);
+        CpuStatistics::ScopedTimer timer(statistics, CpuStatistics::NonbondedReciprocal);
+        if (hasAlchemical && (ewald || pme) && (lambdaElectrostatics != 1.0 || includeEnergy)) {
+            // Interactions between alchemical and non-alchemical particles are scaled by lambdaElectrostatics.  Write the
+            // reciprocal space energy as lambda*E(all) + (1-lambda)*(E(non-alchemical) + E(alchemical)), where each term
+            // is the energy of a subset of the charges.  The self energies of the subsets add up to that of the full set.
+            // This takes three reciprocal space passes.  When lambdaElectrostatics is 1 the forces only need the first
+            // one, but whenever the energy is computed the others are still needed for the derivative.
+
+            for (int i = 0; i < numParticles; i++) {
+                for (int j = 0; j < 3; j++) {
+                    alchemicalPosq[0][4*i+j] = posq[4*i+j];
+                    alchemicalPosq[1][4*i+j] = posq[4*i+j];
+                }
+                alchemicalPosq[0][4*i+3] = (isAlchemical[i] == 0.0f ? posq[4*i+3] : 0.0f);
+                alchemicalPosq[1][4*i+3] = (isAlchemical[i] == 0.0f ? 0.0f : posq[4*i+3]);
+            }
+            double fullEnergy = computeReciprocal(context, &posq[0], lambdaElectrostatics, includeForces, includeEnergy);
+            double separateEnergy = computeReciprocal(context, &alchemicalPosq[0][0], 1.0-lambdaElectrostatics, includeForces, includeEnergy);
+            separateEnergy += computeReciprocal(context, &alchemicalPosq[1][0], 1.0-lambdaElectrostatics, includeForces, includeEnergy);
+            nonbondedEnergy += lambdaElectrostatics*fullEnergy + (1.0-lambdaElectrostatics)*separateEnergy;
+            lambdaDerivatives[0] += fullEnergy-separateEnergy;
         }
         else
-            nonbonded->calculateReciprocalIxn(numParticles, &posq[0], posData, particleParams, exclusions, forceData, includeEnergy ? &nonbondedEnergy : NULL);
+            nonbondedEnergy += computeReciprocal(context, &posq[0], 1.0, includeForces, includeEnergy);
     }
     energy += nonbondedEnergy;
+    if (includeEnergy && hasAlchemical) {
+        data.lambdaDerivatives[0] += lambdaDerivatives[0];
+        data.lambdaDerivatives[1] += lambdaDerivatives[1];
+    }
     if (includeDirect) {
-        ReferenceBondForce refBondForce;
-        ReferenceLJCoulomb14 nonbonded14;
-        refBondForce.calculateForce(num14, bonded14IndexArray, posData, bonded14ParamArray, forceData, includeEnergy ? &energy : NULL, nonbonded14);
+        CpuStatistics::ScopedTimer timer(statistics, CpuStatistics::NonbondedExceptions);
+        nonbonded14.calculateForce(posData, bonded14ParamArray, forceData, includeEnergy ? &energy : NULL);
         if (data.isPeriodic)
             energy += dispersionCoefficient/(boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2]);
     }
     return energy;
 }
 
+double CpuCalcNonbondedForceKernel::computeReciprocal(ContextImpl& context, float* posq, double scale, bool includeForces, bool includeEnergy) {
+    vector<RealVec>& posData = extractPositions(context);
+    vector<RealVec>& forceData = extractForces(context);
+    double energy = 0.0;
+    if (useOptimizedPme) {
+        PmeIO io(posq, &data.threadForce[0][0], numParticles, (float) scale);
+        RealVec* boxVectors = extractBoxVectors(context);
+        Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
+        optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy);
+        CpuStatistics::ScopedTimer waitTimer(data.statistics, CpuStatistics::PmeWait);
+        energy = optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(io);
+    }
+    else if (scale == 1.0)
+        nonbonded->calculateReciprocalIxn(numParticles, posq, posData, particleParams, *exclusions, forceData, includeEnergy ? &energy : NULL, data.threads, includeForces);
+    else {
+        vector<RealVec> scaledForces(numParticles, RealVec());
+        nonbonded->calculateReciprocalIxn(numParticles, posq, posData, particleParams, *exclusions, scaledForces, includeEnergy ? &energy : NULL, data.threads, includeForces);
+        if (includeForces)
+            for (int i = 0; i < numParticles; i++)
+                forceData[i] += scaledForces[i]*scale;
+    }
+    return energy;
+}
+
+void CpuCalcNonbondedForceKernel::tunePmeParameters(ContextImpl& context) {
+    // The cutoff also applies to the Lennard-Jones interaction, so it cannot be changed, and the
+    // Ewald error tolerance then determines alpha.  The direct space calculation is therefore the
+    // same for every candidate.  What can be traded off is the interpolation order against the grid
+    // size: higher orders reach the same accuracy on a coarser grid, but spreading and interpolating
+    // each charge costs more.  Time each order with the grid size it needs and keep the fastest.
+    
+    const int numTimedSteps = 5;
+    RealVec* boxVectors = extractBoxVectors(context);
+    Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
+    vector<float> tempForce(4*numParticles, 0.0f);
+    PmeIO io(&data.posq[0], &tempForce[0], numParticles);
+    double bestTime = 0.0;
+    int bestOrder = 0;
+    int bestGridSize[3];
+    stringstream report;
+    for (int order = 4; order <= 8; order++) {
+        int size[3];
+        for (int i = 0; i < 3; i++) {
+            size[i] = (int) ceil(2*ewaldAlpha*boxVectors[i][i]/(3*pow(ewaldErrorTolerance, 1.0/order)));
+            size[i] = max(size[i], order);
+        }
+        Kernel kernel = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
+        CalcPmeReciprocalForceKernel& pme = kernel.getAs<CalcPmeReciprocalForceKernel>();
+        try {
+            pme.initialize(size[0], size[1], size[2], numParticles, ewaldAlpha, order);
+        }
+        catch (OpenMMException& ex) {
+            // This implementation does not support the order.
+            
+            continue;
+        }
+        
+        // Run it once before timing it, so the time does not include any one-time setup.
+        
+        pme.beginComputation(io, periodicBoxVectors, false);
+        pme.finishComputation(io);
+        double startTime = CpuStatistics::getCurrentTime();
+        for (int step = 0; step < numTimedSteps; step++) {
+            pme.beginComputation(io, periodicBoxVectors, false);
+            pme.finishComputation(io);
+        }
+        double time = (CpuStatistics::getCurrentTime()-startTime)/numTimedSteps;
+        report << "order " << order << ", grid " << size[0] << "x" << size[1] << "x" << size[2] << ": " << (1000*time) << " ms\n";
+        if (bestOrder == 0 || time < bestTime) {
+            bestTime = time;
+            bestOrder = order;
+            bestGridSize[0] = size[0];
+            bestGridSize[1] = size[1];
+            bestGridSize[2] = size[2];
+            optimizedPme = kernel;
+        }
+    }
+    if (bestOrder == 0)
+        throw OpenMMException("Internal error: No PME interpolation order could be tuned");
+    gridSize[0] = bestGridSize[0];
+    gridSize[1] = bestGridSize[1];
+    gridSize[2] = bestGridSize[2];
+    stringstream selected;
+    selected << "Selected order " << bestOrder << ", grid " << gridSize[0] << "x" << gridSize[1] << "x" << gridSize[2] << "\n";
+    data.propertyValues[CpuPlatform::CpuPmeTuningReport()] = selected.str()+report.str();
+}
+
 void CpuCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context, const NonbondedForce& force) {
     if (force.getNumParticles() != numParticles)
         throw OpenMMException("updateParametersInContext: The number of particles has changed");
@@ -621,25 +893,33 @@ void CpuCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
     }
     if (nb14s.size() != num14)
         throw OpenMMException("updateParametersInContext: The number of non-excluded exceptions has changed");
+    exceptionIndex.assign(force.getNumExceptions(), -1);
+    for (int i = 0; i < num14; i++)
+        exceptionIndex[nb14s[i]] = i;
 
     // Record the values.
 
-    double sumSquaredCharges = 0.0;
+    sumSquaredCharges = 0.0;
     for (int i = 0; i < numParticles; ++i) {
         double charge, radius, depth;
         force.getParticleParameters(i, charge, radius, depth);
         data.posq[4*i+3] = (float) charge;
+        particleCharges[i] = charge;
         particleParams[i] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
         sumSquaredCharges += charge*charge;
     }
+    nonbonded->invalidateSortedParameters();
     if (nonbondedMethod == Ewald || nonbondedMethod == PME)
         ewaldSelfEnergy = -ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(M_PI);
     else
         ewaldSelfEnergy = 0.0;
+    bool atomsChanged = false;
     for (int i = 0; i < num14; ++i) {
         int particle1, particle2;
         double charge, radius, depth;
         force.getExceptionParameters(nb14s[i], particle1, particle2, charge, radius, depth);
+        if (bonded14IndexArray[i][0] != particle1 || bonded14IndexArray[i][1] != particle2)
+            atomsChanged = true;
         bonded14IndexArray[i][0] = particle1;
         bonded14IndexArray[i][1] = particle2;
         bonded14ParamArray[i][0] = static_cast<RealOpenMM>(radius);
@@ -647,6 +927,11 @@ void CpuCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
         bonded14ParamArray[i][2] = static_cast<RealOpenMM>(charge);
     }
     
+    // If different exceptions are now non-excluded, the division of them between threads is no longer valid.
+    
+    if (atomsChanged)
+        nonbonded14.initialize(numParticles, num14, bonded14IndexArray, data.threads);
+    
     // Recompute the coefficient for the dispersion correction.
 
     NonbondedForce::NonbondedMethod method = force.getNonbondedMethod();
@@ -654,15 +939,83 @@ void CpuCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
         dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force);
 }
 
+void CpuCalcNonbondedForceKernel::copySomeParametersToContext(ContextImpl& context, const NonbondedForce& force, int firstParticle, int numParticles, int firstException, int numExceptions) {
+    if (force.getNumParticles() != this->numParticles || force.getNumExceptions() != (int) exceptionIndex.size())
+        throw OpenMMException("updateParametersInContext: The number of particles or exceptions has changed");
+    
+    // Update the exceptions.  Only the ones that are 1-4 interactions have parameters stored.
+    
+    for (int i = firstException; i < firstException+numExceptions; i++) {
+        int particle1, particle2;
+        double charge, radius, depth;
+        force.getExceptionParameters(i, particle1, particle2, charge, radius, depth);
+        bool is14 = (charge != 0.0 || depth != 0.0);
+        int index = exceptionIndex[i];
+        if (is14 != (index != -1))
+            throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        if (index == -1)
+            continue;
+        if (bonded14IndexArray[index][0] != particle1 || bonded14IndexArray[index][1] != particle2)
+            throw OpenMMException("updateParametersInContext: The particles in an exception have changed");
+        bonded14ParamArray[index][0] = static_cast<RealOpenMM>(radius);
+        bonded14ParamArray[index][1] = static_cast<RealOpenMM>(4.0*depth);
+        bonded14ParamArray[index][2] = static_cast<RealOpenMM>(charge);
+    }
+    
+    // Update the particles, keeping track of whether any Lennard-Jones parameters changed.
+    
+    bool ljChanged = false;
+    for (int i = firstParticle; i < firstParticle+numParticles; i++) {
+        double charge, radius, depth;
+        force.getParticleParameters(i, charge, radius, depth);
+        pair<float, float> params = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
+        if (params != particleParams[i]) {
+            particleParams[i] = params;
+            ljChanged = true;
+        }
+        sumSquaredCharges += charge*charge-particleCharges[i]*particleCharges[i];
+        particleCharges[i] = charge;
+        data.posq[4*i+3] = (float) charge;
+    }
+    if (ljChanged)
+        nonbonded->invalidateSortedParameters();
+    if (nonbondedMethod == Ewald || nonbondedMethod == PME)
+        ewaldSelfEnergy = -ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(M_PI);
+    
+    // The dispersion correction depends on every particle, so only recompute it if it could have changed.
+
+    NonbondedForce::NonbondedMethod method = force.getNonbondedMethod();
+    if (ljChanged && force.getUseDispersionCorrection() && (method == NonbondedForce::CutoffPeriodic || method == NonbondedForce::Ewald || method == NonbondedForce::PME))
+        dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force);
+}
+
+/**
+ * Determine whether an expression is a tabulated pair potential: a Continuous1DFunction of r,
+ * optionally multiplied by constants.  If so, this records the function name and the constant factor.
+ */
+static bool isTabulatedPairPotential(const Lepton::ExpressionTreeNode& node, string& function, double& scale) {
+    const Lepton::Operation& op = node.getOperation();
+    const vector<Lepton::ExpressionTreeNode>& children = node.getChildren();
+    if (op.getId() == Lepton::Operation::CUSTOM) {
+        if (children.size() != 1 || children[0].getOperation().getId() != Lepton::Operation::VARIABLE || children[0].getOperation().getName() != "r")
+            return false;
+        function = op.getName();
+        return true;
+    }
+    if (op.getId() == Lepton::Operation::MULTIPLY_CONSTANT) {
+        scale *= dynamic_cast<const Lepton::Operation::MultiplyConstant&>(op).getValue();
+        return isTabulatedPairPotential(children[0], function, scale);
+    }
+    return false;
+}
+
 CpuCalcCustomNonbondedForceKernel::CpuCalcCustomNonbondedForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) :
             CalcCustomNonbondedForceKernel(name, platform), data(data), forceCopy(NULL), neighborList(NULL), nonbonded(NULL) {
 }
 
 CpuCalcCustomNonbondedForceKernel::~CpuCalcCustomNonbondedForceKernel() {
     if (particleParamArray != NULL) {
-        for (int i = 0; i < numParticles; i++)
-            delete[] particleParamArray[i];
-        delete[] particleParamArray;
+        deleteContiguousArray(particleParamArray, numParticles);
     }
     if (neighborList != NULL)
         delete neighborList;
@@ -677,20 +1030,15 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
     // Record the exclusions.
 
     numParticles = force.getNumParticles();
-    exclusions.resize(numParticles);
-    for (int i = 0; i < force.getNumExclusions(); i++) {
-        int particle1, particle2;
-        force.getExclusionParticles(i, particle1, particle2);
-        exclusions[particle1].insert(particle2);
-        exclusions[particle2].insert(particle1);
-    }
+    vector<pair<int, int> > excludedPairs(force.getNumExclusions());
+    for (int i = 0; i < force.getNumExclusions(); i++)
+        force.getExclusionParticles(i, excludedPairs[i].first, excludedPairs[i].second);
+    exclusions = &data.shareExclusions(new CpuExclusions(numParticles, excludedPairs, data.threads));
 
     // Build the arrays.
 
     int numParameters = force.getNumPerParticleParameters();
-    particleParamArray = new double*[numParticles];
-    for (int i = 0; i < numParticles; i++)
-        particleParamArray[i] = new double[numParameters];
+    particleParamArray = allocateContiguousArray<double>(numParticles, numParameters);
     for (int i = 0; i < numParticles; ++i) {
         vector<double> parameters;
         force.getParticleParameters(i, parameters);
@@ -711,13 +1059,16 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
 
     map<string, Lepton::CustomFunction*> functions;
     for (int i = 0; i < force.getNumFunctions(); i++)
-        functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
+        functions[force.getTabulatedFunctionName(i)] = createCpuTabulatedFunction(force.getTabulatedFunction(i));
 
     // Parse the various expressions used to calculate the force.
 
     Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).optimize();
     Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
-    Lepton::CompiledExpression forceExpression = expression.differentiate("r").createCompiledExpression();
+    vector<Lepton::ParsedExpression> energyAndForce;
+    energyAndForce.push_back(expression);
+    energyAndForce.push_back(expression.differentiate("r"));
+    Lepton::CompiledExpression energyAndForceExpression(energyAndForce);
     for (int i = 0; i < numParameters; i++)
         parameterNames.push_back(force.getPerParticleParameterName(i));
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
@@ -725,11 +1076,6 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
         globalParamValues[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
     }
 
-    // Delete the custom functions.
-
-    for (map<string, Lepton::CustomFunction*>::iterator iter = functions.begin(); iter != functions.end(); iter++)
-        delete iter->second;
-    
     // Record information for the long range correction.
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection()) {
@@ -749,9 +1095,24 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
         interactionGroups.push_back(make_pair(set1, set2));
     }
     data.isPeriodic = (nonbondedMethod == CutoffPeriodic);
-    nonbonded = new CpuCustomNonbondedForce(energyExpression, forceExpression, parameterNames, exclusions, data.threads);
+    nonbonded = new CpuCustomNonbondedForce(energyExpression, energyAndForceExpression, parameterNames, *exclusions, data.threads);
     if (interactionGroups.size() > 0)
         nonbonded->setInteractionGroups(interactionGroups);
+
+    // If the energy is a tabulated function of r, the spline can be evaluated inline.
+
+    string function;
+    double scale = 1.0;
+    if (isTabulatedPairPotential(expression.getRootNode(), function, scale)) {
+        CpuContinuous1DFunction* table = dynamic_cast<CpuContinuous1DFunction*>(functions[function]);
+        if (table != NULL)
+            nonbonded->setTabulatedPotential(*table, scale);
+    }
+
+    // Delete the custom functions.
+
+    for (map<string, Lepton::CustomFunction*>::iterator iter = functions.begin(); iter != functions.end(); iter++)
+        delete iter->second;
 }
 
 double CpuCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
@@ -760,9 +1121,16 @@ double CpuCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool inc
     RealVec* boxVectors = extractBoxVectors(context);
     double energy = 0;
     bool periodic = (nonbondedMethod == CutoffPeriodic);
+    CpuStatistics& statistics = data.statistics;
+    long long numPairs = numParticles*(long long) (numParticles-1)/2;
     if (nonbondedMethod != NoCutoff) {
-        neighborList->computeNeighborList(numParticles, data.posq, exclusions, boxVectors, data.isPeriodic, nonbondedCutoff, data.threads);
+        CpuStatistics::ScopedTimer timer(statistics, CpuStatistics::NeighborList);
+        neighborList->computeNeighborList(numParticles, data.posq, *exclusions, boxVectors, data.isPeriodic, nonbondedCutoff, data.threads);
         nonbonded->setUseCutoff(nonbondedCutoff, *neighborList);
+        if (statistics.isEnabled()) {
+            statistics.increment(CpuStatistics::NeighborListBuilds);
+            numPairs = countNeighborPairs(*neighborList);
+        }
     }
     if (periodic) {
         double minAllowedSize = 2*nonbondedCutoff;
@@ -779,7 +1147,11 @@ double CpuCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool inc
     }
     if (useSwitchingFunction)
         nonbonded->setUseSwitchingFunction(switchingDistance);
-    nonbonded->calculatePairIxn(numParticles, &data.posq[0], posData, particleParamArray, 0, globalParamValues, data.threadForce, includeForces, includeEnergy, energy);
+    {
+        CpuStatistics::ScopedTimer timer(statistics, CpuStatistics::CustomForces);
+        nonbonded->calculatePairIxn(numParticles, &data.posq[0], posData, particleParamArray, 0, globalParamValues, data.threadForce, includeForces, includeEnergy, energy);
+        statistics.increment(CpuStatistics::PairsEvaluated, numPairs);
+    }
     
     // Add in the long range correction.
     
@@ -816,6 +1188,8 @@ void CpuCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImpl& con
 }
 
 CpuCalcGBSAOBCForceKernel::~CpuCalcGBSAOBCForceKernel() {
+    if (neighborList != NULL)
+        delete neighborList;
 }
 
 void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCForce& force) {
@@ -832,8 +1206,11 @@ void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCFo
     obc.setSolventDielectric((float) force.getSolventDielectric());
     obc.setSoluteDielectric((float) force.getSoluteDielectric());
     obc.setSurfaceAreaEnergy((float) force.getSurfaceAreaEnergy());
-    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff)
-        obc.setUseCutoff((float) force.getCutoffDistance());
+    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff) {
+        cutoffDistance = (float) force.getCutoffDistance();
+        noExclusions = &data.shareExclusions(new CpuExclusions(numParticles));
+        neighborList = new CpuNeighborList(4);
+    }
     data.isPeriodic = (force.getNonbondedMethod() == GBSAOBCForce::CutoffPeriodic);
 }
 
@@ -843,7 +1220,14 @@ double CpuCalcGBSAOBCForceKernel::execute(ContextImpl& context, bool includeForc
         float floatBoxSize[3] = {(float) boxSize[0], (float) boxSize[1], (float) boxSize[2]};
         obc.setPeriodic(floatBoxSize);
     }
+    if (neighborList != NULL) {
+        CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::NeighborList);
+        neighborList->computeNeighborList(particleParams.size(), data.posq, *noExclusions, extractBoxVectors(context), data.isPeriodic, cutoffDistance, data.threads);
+        obc.setUseCutoff(cutoffDistance, *neighborList);
+        data.statistics.increment(CpuStatistics::NeighborListBuilds);
+    }
     double energy = 0.0;
+    CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::ImplicitSolvent);
     obc.computeForce(data.posq, data.threadForce, includeEnergy ? &energy : NULL, data.threads);
     return energy;
 }
@@ -865,11 +1249,55 @@ void CpuCalcGBSAOBCForceKernel::copyParametersToContext(ContextImpl& context, co
     obc.setParticleParameters(particleParams);
 }
 
+CpuCalcGBVIForceKernel::~CpuCalcGBVIForceKernel() {
+    if (neighborList != NULL)
+        delete neighborList;
+}
+
+void CpuCalcGBVIForceKernel::initialize(const System& system, const GBVIForce& force, const vector<double>& scaledRadii) {
+    int numParticles = system.getNumParticles();
+    vector<float> radii(numParticles), scaled(numParticles), gammas(numParticles);
+    for (int i = 0; i < numParticles; ++i) {
+        double charge, radius, gamma;
+        force.getParticleParameters(i, charge, radius, gamma);
+        data.posq[4*i+3] = (float) charge;
+        radii[i] = (float) radius;
+        scaled[i] = (float) scaledRadii[i];
+        gammas[i] = (float) gamma;
+    }
+    gbvi.setParticleParameters(radii, scaled, gammas);
+    gbvi.setSolventDielectric((float) force.getSolventDielectric());
+    gbvi.setSoluteDielectric((float) force.getSoluteDielectric());
+    gbvi.setUseQuinticSpline(force.getBornRadiusScalingMethod() == GBVIForce::QuinticSpline, (float) force.getQuinticLowerLimitFactor(), (float) force.getQuinticUpperBornRadiusLimit());
+    if (force.getNonbondedMethod() != GBVIForce::NoCutoff) {
+        cutoffDistance = (float) force.getCutoffDistance();
+        noExclusions = &data.shareExclusions(new CpuExclusions(numParticles));
+        neighborList = new CpuNeighborList(4);
+    }
+    data.isPeriodic = (force.getNonbondedMethod() == GBVIForce::CutoffPeriodic);
+}
+
+double CpuCalcGBVIForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    if (data.isPeriodic) {
+        RealVec& boxSize = extractBoxSize(context);
+        float floatBoxSize[3] = {(float) boxSize[0], (float) boxSize[1], (float) boxSize[2]};
+        gbvi.setPeriodic(floatBoxSize);
+    }
+    if (neighborList != NULL) {
+        CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::NeighborList);
+        neighborList->computeNeighborList(gbvi.getAtomicRadii().size(), data.posq, *noExclusions, extractBoxVectors(context), data.isPeriodic, cutoffDistance, data.threads);
+        gbvi.setUseCutoff(cutoffDistance, *neighborList);
+        data.statistics.increment(CpuStatistics::NeighborListBuilds);
+    }
+    double energy = 0.0;
+    CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::ImplicitSolvent);
+    gbvi.computeForce(data.posq, data.threadForce, includeEnergy ? &energy : NULL, data.threads);
+    return energy;
+}
+
 CpuCalcCustomGBForceKernel::~CpuCalcCustomGBForceKernel() {
     if (particleParamArray != NULL) {
-        for (int i = 0; i < numParticles; i++)
-            delete[] particleParamArray[i];
-        delete[] particleParamArray;
+        deleteContiguousArray(particleParamArray, numParticles);
     }
     if (neighborList != NULL)
         delete neighborList;
@@ -894,20 +1322,15 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
     // Record the exclusions.
 
     numParticles = force.getNumParticles();
-    exclusions.resize(numParticles);
-    for (int i = 0; i < force.getNumExclusions(); i++) {
-        int particle1, particle2;
-        force.getExclusionParticles(i, particle1, particle2);
-        exclusions[particle1].insert(particle2);
-        exclusions[particle2].insert(particle1);
-    }
+    vector<pair<int, int> > excludedPairs(force.getNumExclusions());
+    for (int i = 0; i < force.getNumExclusions(); i++)
+        force.getExclusionParticles(i, excludedPairs[i].first, excludedPairs[i].second);
+    exclusions = &data.shareExclusions(new CpuExclusions(numParticles, excludedPairs, data.threads));
 
     // Build the arrays.
 
     int numPerParticleParameters = force.getNumPerParticleParameters();
-    particleParamArray = new double*[numParticles];
-    for (int i = 0; i < numParticles; i++)
-        particleParamArray[i] = new double[numPerParticleParameters];
+    particleParamArray = allocateContiguousArray<double>(numParticles, numPerParticleParameters);
     for (int i = 0; i < numParticles; ++i) {
         vector<double> parameters;
         force.getParticleParameters(i, parameters);
@@ -929,7 +1352,7 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
 
     map<string, Lepton::CustomFunction*> functions;
     for (int i = 0; i < force.getNumFunctions(); i++)
-        functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
+        functions[force.getTabulatedFunctionName(i)] = createCpuTabulatedFunction(force.getTabulatedFunction(i));
 
     // Parse the expressions for computed values.
 
@@ -987,7 +1410,7 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
 
     for (map<string, Lepton::CustomFunction*>::iterator iter = functions.begin(); iter != functions.end(); iter++)
         delete iter->second;
-    ixn = new CpuCustomGBForce(numParticles, exclusions, valueExpressions, valueDerivExpressions, valueGradientExpressions, valueNames, valueTypes, energyExpressions,
+    ixn = new CpuCustomGBForce(numParticles, *exclusions, valueExpressions, valueDerivExpressions, valueGradientExpressions, valueNames, valueTypes, energyExpressions,
         energyDerivExpressions, energyGradientExpressions, energyTypes, particleParameterNames, data.threads);
     data.isPeriodic = (force.getNonbondedMethod() == CustomGBForce::CutoffPeriodic);
 }
@@ -999,13 +1422,15 @@ double CpuCalcCustomGBForceKernel::execute(ContextImpl& context, bool includeFor
     if (data.isPeriodic)
         ixn->setPeriodic(extractBoxSize(context));
     if (nonbondedMethod != NoCutoff) {
-        vector<set<int> > noExclusions(numParticles);
-        neighborList->computeNeighborList(numParticles, data.posq, exclusions, boxVectors, data.isPeriodic, nonbondedCutoff, data.threads);
+        CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::NeighborList);
+        neighborList->computeNeighborList(numParticles, data.posq, *exclusions, boxVectors, data.isPeriodic, nonbondedCutoff, data.threads);
         ixn->setUseCutoff(nonbondedCutoff, *neighborList);
+        data.statistics.increment(CpuStatistics::NeighborListBuilds);
     }
     map<string, double> globalParameters;
     for (int i = 0; i < (int) globalParameterNames.size(); i++)
         globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
+    CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::ImplicitSolvent);
     ixn->calculateIxn(numParticles, &data.posq[0], particleParamArray, globalParameters, data.threadForce, includeForces, includeEnergy, energy);
     return energy;
 }
@@ -1028,9 +1453,7 @@ void CpuCalcCustomGBForceKernel::copyParametersToContext(ContextImpl& context, c
 
 CpuCalcCustomManyParticleForceKernel::~CpuCalcCustomManyParticleForceKernel() {
     if (particleParamArray != NULL) {
-        for (int i = 0; i < numParticles; i++)
-            delete[] particleParamArray[i];
-        delete[] particleParamArray;
+        deleteContiguousArray(particleParamArray, numParticles);
     }
     if (ixn != NULL)
         delete ixn;
@@ -1042,9 +1465,7 @@ void CpuCalcCustomManyParticleForceKernel::initialize(const System& system, cons
 
     numParticles = system.getNumParticles();
     int numParticleParameters = force.getNumPerParticleParameters();
-    particleParamArray = new double*[numParticles];
-    for (int i = 0; i < numParticles; i++)
-        particleParamArray[i] = new double[numParticleParameters];
+    particleParamArray = allocateContiguousArray<double>(numParticles, numParticleParameters);
     for (int i = 0; i < numParticles; ++i) {
         vector<double> parameters;
         int type;
@@ -1072,6 +1493,7 @@ double CpuCalcCustomManyParticleForceKernel::execute(ContextImpl& context, bool
         ixn->setPeriodic(boxVectors);
     }
     double energy = 0;
+    CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::CustomForces);
     ixn->calculateIxn(data.posq, particleParamArray, globalParameters, data.threadForce, includeForces, includeEnergy, energy);
     return energy;
 }
@@ -1093,6 +1515,197 @@ void CpuCalcCustomManyParticleForceKernel::copyParametersToContext(ContextImpl&
     }
 }
 
+CpuCalcCustomExternalForceKernel::~CpuCalcCustomExternalForceKernel() {
+    if (ixn != NULL)
+        delete ixn;
+}
+
+void CpuCalcCustomExternalForceKernel::initialize(const System& system, const CustomExternalForce& force) {
+    int numParticles = force.getNumParticles();
+    particles.resize(numParticles);
+    vector<vector<double> > particleParams(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        force.getParticleParameters(i, particles[i], particleParams[i]);
+
+    // Parse the expression used to calculate the force.
+
+    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
+    vector<string> coordinateNames, parameterNames;
+    coordinateNames.push_back("x");
+    coordinateNames.push_back("y");
+    coordinateNames.push_back("z");
+    for (int i = 0; i < force.getNumPerParticleParameters(); i++)
+        parameterNames.push_back(force.getPerParticleParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    ixn = new CpuCustomExternalForce(expression, coordinateNames, parameterNames, data.threads);
+    ixn->setParticles(particles, particleParams);
+}
+
+double CpuCalcCustomExternalForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<RealVec>& posData = extractPositions(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (int i = 0; i < (int) globalParameterNames.size(); i++)
+        globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
+    CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::CustomForces);
+    ixn->calculateIxn(posData, globalParameters, extractForces(context), includeForces, includeEnergy, energy);
+    return energy;
+}
+
+void CpuCalcCustomExternalForceKernel::copyParametersToContext(ContextImpl& context, const CustomExternalForce& force) {
+    int numParticles = particles.size();
+    if (numParticles != force.getNumParticles())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+
+    // Record the values.
+
+    vector<vector<double> > particleParams(numParticles);
+    for (int i = 0; i < numParticles; ++i) {
+        int particle;
+        force.getParticleParameters(i, particle, particleParams[i]);
+        if (particle != particles[i])
+            throw OpenMMException("updateParametersInContext: A particle index has changed");
+    }
+    ixn->setParticles(particles, particleParams);
+}
+
+/**
+ * Determine whether an expression is a grid potential: a Continuous3DFunction of x1, y1, and z1,
+ * optionally multiplied by constants and by a single variable.  If so, this records the function
+ * name, the constant factor, and the variable.
+ */
+static bool isGridPotential(const Lepton::ExpressionTreeNode& node, string& function, double& scale, string& scaleVariable) {
+    const Lepton::Operation& op = node.getOperation();
+    const vector<Lepton::ExpressionTreeNode>& children = node.getChildren();
+    if (op.getId() == Lepton::Operation::CUSTOM) {
+        if (children.size() != 3)
+            return false;
+        const char* coords[] = {"x1", "y1", "z1"};
+        for (int i = 0; i < 3; i++)
+            if (children[i].getOperation().getId() != Lepton::Operation::VARIABLE || children[i].getOperation().getName() != coords[i])
+                return false;
+        function = op.getName();
+        return true;
+    }
+    if (op.getId() == Lepton::Operation::MULTIPLY_CONSTANT) {
+        scale *= dynamic_cast<const Lepton::Operation::MultiplyConstant&>(op).getValue();
+        return isGridPotential(children[0], function, scale, scaleVariable);
+    }
+    if (op.getId() == Lepton::Operation::MULTIPLY && scaleVariable.empty()) {
+        for (int i = 0; i < 2; i++) {
+            const Lepton::Operation& factor = children[i].getOperation();
+            if (factor.getId() == Lepton::Operation::VARIABLE && factor.getName() != "x1" && factor.getName() != "y1" && factor.getName() != "z1") {
+                scaleVariable = factor.getName();
+                return isGridPotential(children[1-i], function, scale, scaleVariable);
+            }
+        }
+    }
+    return false;
+}
+
+CpuCalcCustomCompoundBondForceKernel::~CpuCalcCustomCompoundBondForceKernel() {
+    if (ixn != NULL)
+        delete ixn;
+}
+
+void CpuCalcCustomCompoundBondForceKernel::initialize(const System& system, const CustomCompoundBondForce& force) {
+    if (force.getNumParticlesPerBond() == 1) {
+        // Create custom functions for the tabulated functions.
+
+        map<string, Lepton::CustomFunction*> functions;
+        for (int i = 0; i < force.getNumTabulatedFunctions(); i++)
+            functions[force.getTabulatedFunctionName(i)] = createCpuTabulatedFunction(force.getTabulatedFunction(i));
+
+        // Parse the expression.  If it only depends on the particle position, each bond can be
+        // computed independently.
+
+        map<string, vector<int> > distances;
+        map<string, vector<int> > angles;
+        map<string, vector<int> > dihedrals;
+        Lepton::ParsedExpression energyExpression = CustomCompoundBondForceImpl::prepareExpression(force, functions, distances, angles, dihedrals);
+        if (distances.size() == 0 && angles.size() == 0 && dihedrals.size() == 0) {
+            int numBonds = force.getNumBonds();
+            particles.resize(numBonds);
+            vector<vector<double> > bondParams(numBonds);
+            vector<int> bondParticles;
+            for (int i = 0; i < numBonds; i++) {
+                force.getBondParameters(i, bondParticles, bondParams[i]);
+                particles[i] = bondParticles[0];
+            }
+            vector<string> parameterNames;
+            for (int i = 0; i < force.getNumPerBondParameters(); i++)
+                parameterNames.push_back(force.getPerBondParameterName(i));
+            for (int i = 0; i < force.getNumGlobalParameters(); i++)
+                globalParameterNames.push_back(force.getGlobalParameterName(i));
+            string function, scaleVariable;
+            double scale = 1.0;
+            const Continuous3DFunction* grid = NULL;
+            if (isGridPotential(energyExpression.getRootNode(), function, scale, scaleVariable)) {
+                for (int i = 0; i < force.getNumTabulatedFunctions(); i++)
+                    if (force.getTabulatedFunctionName(i) == function)
+                        grid = dynamic_cast<const Continuous3DFunction*>(&force.getTabulatedFunction(i));
+            }
+            if (grid != NULL)
+                ixn = new CpuCustomExternalForce(*dynamic_cast<CpuContinuous3DFunction*>(functions[function]), scale, scaleVariable, parameterNames, data.threads);
+            else {
+                vector<string> coordinateNames;
+                coordinateNames.push_back("x1");
+                coordinateNames.push_back("y1");
+                coordinateNames.push_back("z1");
+                ixn = new CpuCustomExternalForce(energyExpression, coordinateNames, parameterNames, data.threads);
+            }
+            ixn->setParticles(particles, bondParams);
+        }
+
+        // Delete the custom functions.
+
+        for (map<string, Lepton::CustomFunction*>::iterator iter = functions.begin(); iter != functions.end(); iter++)
+            delete iter->second;
+        if (ixn != NULL)
+            return;
+    }
+
+    // This force cannot be computed in parallel, so use the Reference implementation.
+
+    referenceKernel = Kernel(new ReferenceCalcCustomCompoundBondForceKernel(getName(), getPlatform()));
+    referenceKernel.getAs<ReferenceCalcCustomCompoundBondForceKernel>().initialize(system, force);
+}
+
+double CpuCalcCustomCompoundBondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    if (ixn == NULL)
+        return referenceKernel.getAs<ReferenceCalcCustomCompoundBondForceKernel>().execute(context, includeForces, includeEnergy);
+    vector<RealVec>& posData = extractPositions(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (int i = 0; i < (int) globalParameterNames.size(); i++)
+        globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
+    CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::CustomForces);
+    ixn->calculateIxn(posData, globalParameters, extractForces(context), includeForces, includeEnergy, energy);
+    return energy;
+}
+
+void CpuCalcCustomCompoundBondForceKernel::copyParametersToContext(ContextImpl& context, const CustomCompoundBondForce& force) {
+    if (ixn == NULL) {
+        referenceKernel.getAs<ReferenceCalcCustomCompoundBondForceKernel>().copyParametersToContext(context, force);
+        return;
+    }
+    int numBonds = particles.size();
+    if (numBonds != force.getNumBonds())
+        throw OpenMMException("updateParametersInContext: The number of bonds has changed");
+
+    // Record the values.
+
+    vector<vector<double> > bondParams(numBonds);
+    vector<int> bondParticles;
+    for (int i = 0; i < numBonds; i++) {
+        force.getBondParameters(i, bondParticles, bondParams[i]);
+        if (bondParticles[0] != particles[i])
+            throw OpenMMException("updateParametersInContext: The set of particles in a bond has changed");
+    }
+    ixn->setParticles(particles, bondParams);
+}
+
 CpuIntegrateLangevinStepKernel::~CpuIntegrateLangevinStepKernel() {
     if (dynamics)
         delete dynamics;
@@ -1119,13 +1732,21 @@ void CpuIntegrateLangevinStepKernel::execute(ContextImpl& context, const Langevi
         if (dynamics)
             delete dynamics;
         RealOpenMM tau = (friction == 0.0 ? 0.0 : 1.0/friction);
-        dynamics = new CpuLangevinDynamics(context.getSystem().getNumParticles(), stepSize, tau, temperature, data.threads, data.random);
+        dynamics = new CpuLangevinDynamics(context.getSystem().getNumParticles(), stepSize, tau, temperature, data.threads, data.random, *data.virtualSites);
         dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
         prevTemp = temperature;
         prevFriction = friction;
         prevStepSize = stepSize;
     }
-    dynamics->update(context.getSystem(), posData, velData, forceData, masses, integrator.getConstraintTolerance());
+    {
+        CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::Integration);
+        dynamics->update(context.getSystem(), posData, velData, forceData, masses, integrator.getConstraintTolerance());
+    }
+    if (data.statistics.isEnabled()) {
+        ReferenceCCMAAlgorithm* ccma = dynamic_cast<ReferenceCCMAAlgorithm*>(extractConstraints(context).ccma);
+        if (ccma != NULL)
+            data.statistics.increment(CpuStatistics::ConstraintIterations, ccma->getLastNumberOfIterations());
+    }
     ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
     refData->time += stepSize;
     refData->stepCount++;
@@ -1134,3 +1755,105 @@ void CpuIntegrateLangevinStepKernel::execute(ContextImpl& context, const Langevi
 double CpuIntegrateLangevinStepKernel::computeKineticEnergy(ContextImpl& context, const LangevinIntegrator& integrator) {
     return computeShiftedKineticEnergy(context, masses, 0.5*integrator.getStepSize());
 }
+
+CpuIntegrateVariableLangevinStepKernel::~CpuIntegrateVariableLangevinStepKernel() {
+    if (dynamics)
+        delete dynamics;
+}
+
+void CpuIntegrateVariableLangevinStepKernel::initialize(const System& system, const VariableLangevinIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
+    data.random.initialize(integrator.getRandomNumberSeed(), data.threads.getNumThreads());
+}
+
+double CpuIntegrateVariableLangevinStepKernel::execute(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime) {
+    double temperature = integrator.getTemperature();
+    double friction = integrator.getFriction();
+    double errorTol = integrator.getErrorTolerance();
+    vector<RealVec>& posData = extractPositions(context);
+    vector<RealVec>& velData = extractVelocities(context);
+    vector<RealVec>& forceData = extractForces(context);
+    if (dynamics == 0 || temperature != prevTemp || friction != prevFriction || errorTol != prevErrorTol) {
+        // Recreate the computation objects with the new parameters.
+        
+        if (dynamics)
+            delete dynamics;
+        RealOpenMM tau = (friction == 0.0 ? 0.0 : 1.0/friction);
+        dynamics = new CpuVariableLangevinDynamics(context.getSystem().getNumParticles(), tau, temperature, errorTol, data.threads, data.random, *data.virtualSites);
+        dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
+        prevTemp = temperature;
+        prevFriction = friction;
+        prevErrorTol = errorTol;
+    }
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    RealOpenMM maxStepSize = (RealOpenMM) (maxTime-refData->time);
+    {
+        CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::Integration);
+        dynamics->update(context.getSystem(), posData, velData, forceData, masses, maxStepSize, integrator.getConstraintTolerance());
+    }
+    if (data.statistics.isEnabled()) {
+        ReferenceCCMAAlgorithm* ccma = dynamic_cast<ReferenceCCMAAlgorithm*>(extractConstraints(context).ccma);
+        if (ccma != NULL)
+            data.statistics.increment(CpuStatistics::ConstraintIterations, ccma->getLastNumberOfIterations());
+    }
+    refData->time += dynamics->getDeltaT();
+    if (dynamics->getDeltaT() == maxStepSize)
+        refData->time = maxTime; // Avoid round-off error
+    refData->stepCount++;
+    return dynamics->getDeltaT();
+}
+
+double CpuIntegrateVariableLangevinStepKernel::computeKineticEnergy(ContextImpl& context, const VariableLangevinIntegrator& integrator) {
+    return computeShiftedKineticEnergy(context, masses, 0.5*integrator.getStepSize());
+}
+
+CpuIntegrateVariableVerletStepKernel::~CpuIntegrateVariableVerletStepKernel() {
+    if (dynamics)
+        delete dynamics;
+}
+
+void CpuIntegrateVariableVerletStepKernel::initialize(const System& system, const VariableVerletIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
+}
+
+double CpuIntegrateVariableVerletStepKernel::execute(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime) {
+    double errorTol = integrator.getErrorTolerance();
+    vector<RealVec>& posData = extractPositions(context);
+    vector<RealVec>& velData = extractVelocities(context);
+    vector<RealVec>& forceData = extractForces(context);
+    if (dynamics == 0 || errorTol != prevErrorTol) {
+        // Recreate the computation objects with the new parameters.
+        
+        if (dynamics)
+            delete dynamics;
+        dynamics = new CpuVariableVerletDynamics(context.getSystem().getNumParticles(), errorTol, data.threads, *data.virtualSites);
+        dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
+        prevErrorTol = errorTol;
+    }
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    RealOpenMM maxStepSize = (RealOpenMM) (maxTime-refData->time);
+    {
+        CpuStatistics::ScopedTimer timer(data.statistics, CpuStatistics::Integration);
+        dynamics->update(context.getSystem(), posData, velData, forceData, masses, maxStepSize, integrator.getConstraintTolerance());
+    }
+    if (data.statistics.isEnabled()) {
+        ReferenceCCMAAlgorithm* ccma = dynamic_cast<ReferenceCCMAAlgorithm*>(extractConstraints(context).ccma);
+        if (ccma != NULL)
+            data.statistics.increment(CpuStatistics::ConstraintIterations, ccma->getLastNumberOfIterations());
+    }
+    refData->time += dynamics->getDeltaT();
+    if (dynamics->getDeltaT() == maxStepSize)
+        refData->time = maxTime; // Avoid round-off error
+    refData->stepCount++;
+    return dynamics->getDeltaT();
+}
+
+double CpuIntegrateVariableVerletStepKernel::computeKineticEnergy(ContextImpl& context, const VariableVerletIntegrator& integrator) {
+    return computeShiftedKineticEnergy(context, masses, 0.5*integrator.getStepSize());
+}
@@ -0,0 +1,140 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuLJCoulomb14.h"
+#include "SimTKOpenMMRealType.h"
+#include "openmm/internal/vectorize.h"
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuLJCoulomb14::ComputeForceTask : public ThreadPool::Task {
+public:
+    ComputeForceTask(CpuLJCoulomb14& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadComputeForce(threads, threadIndex);
+    }
+    CpuLJCoulomb14& owner;
+};
+
+CpuLJCoulomb14::CpuLJCoulomb14() : pairAtoms(NULL), threads(NULL) {
+}
+
+void CpuLJCoulomb14::initialize(int numAtoms, int numPairs, int** pairAtoms, ThreadPool& threads) {
+    this->pairAtoms = pairAtoms;
+    this->threads = &threads;
+    partition.initialize(numAtoms, numPairs, 2, pairAtoms, threads);
+}
+
+void CpuLJCoulomb14::calculateForce(vector<RealVec>& atomCoordinates, RealOpenMM** parameters, vector<RealVec>& forces, RealOpenMM* totalEnergy) {
+    // Record the parameters for the threads.
+    
+    this->atomCoordinates = &atomCoordinates;
+    this->parameters = parameters;
+    this->forces = &forces;
+    includeEnergy = (totalEnergy != NULL);
+    
+    // Have the worker threads compute their pairs.
+    
+    threadEnergy.resize(threads->getNumThreads());
+    ComputeForceTask task(*this);
+    threads->execute(task);
+    threads->waitForThreads();
+    
+    // Compute the pairs that could not be assigned to a thread.
+    
+    double energy = 0.0;
+    computePairs(partition.getExtraBonds(), &energy);
+    if (includeEnergy) {
+        for (int i = 0; i < (int) threadEnergy.size(); i++)
+            energy += threadEnergy[i];
+        *totalEnergy += energy;
+    }
+}
+
+void CpuLJCoulomb14::threadComputeForce(ThreadPool& threads, int threadIndex) {
+    threadEnergy[threadIndex] = 0.0;
+    computePairs(partition.getThreadBonds(threadIndex), &threadEnergy[threadIndex]);
+}
+
+void CpuLJCoulomb14::computePairs(const vector<int>& pairs, double* energy) {
+    vector<RealVec>& pos = *atomCoordinates;
+    vector<RealVec>& f = *forces;
+    int numPairs = pairs.size();
+    for (int start = 0; start < numPairs; start += 4) {
+        // Gather the displacements and parameters of up to four pairs.  The displacement is computed in double
+        // precision, since the coordinates may be far from the origin.  Unused elements are given parameters
+        // of zero, so they contribute nothing.
+        
+        int numInBlock = min(4, numPairs-start);
+        float dx[4] = {1, 1, 1, 1}, dy[4] = {0, 0, 0, 0}, dz[4] = {0, 0, 0, 0};
+        float sigma[4] = {0, 0, 0, 0}, epsilon[4] = {0, 0, 0, 0}, chargeProd[4] = {0, 0, 0, 0};
+        for (int i = 0; i < numInBlock; i++) {
+            int pair = pairs[start+i];
+            RealVec delta = pos[pairAtoms[pair][1]]-pos[pairAtoms[pair][0]];
+            dx[i] = (float) delta[0];
+            dy[i] = (float) delta[1];
+            dz[i] = (float) delta[2];
+            sigma[i] = (float) parameters[pair][0];
+            epsilon[i] = (float) parameters[pair][1];
+            chargeProd[i] = (float) parameters[pair][2];
+        }
+        fvec4 deltaX(dx), deltaY(dy), deltaZ(dz);
+        fvec4 r2 = deltaX*deltaX + deltaY*deltaY + deltaZ*deltaZ;
+        fvec4 inverseR = 1.0f/sqrt(r2);
+        fvec4 sig2 = inverseR*fvec4(sigma);
+        sig2 *= sig2;
+        fvec4 sig6 = sig2*sig2*sig2;
+        fvec4 eps(epsilon);
+        fvec4 coulomb = ((float) ONE_4PI_EPS0)*fvec4(chargeProd)*inverseR;
+        fvec4 dEdR = (eps*(12.0f*sig6-6.0f)*sig6 + coulomb)*inverseR*inverseR;
+        
+        // Accumulate the forces and energy.
+        
+        float fx[4], fy[4], fz[4];
+        (dEdR*deltaX).store(fx);
+        (dEdR*deltaY).store(fy);
+        (dEdR*deltaZ).store(fz);
+        for (int i = 0; i < numInBlock; i++) {
+            int pair = pairs[start+i];
+            RealVec force(fx[i], fy[i], fz[i]);
+            f[pairAtoms[pair][0]] -= force;
+            f[pairAtoms[pair][1]] += force;
+        }
+        if (includeEnergy) {
+            float e[4];
+            (eps*(sig6-1.0f)*sig6 + coulomb).store(e);
+            for (int i = 0; i < numInBlock; i++)
+                *energy += e[i];
+        }
+    }
+}
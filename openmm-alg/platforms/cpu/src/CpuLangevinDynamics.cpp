@@ -49,8 +49,22 @@ public:
     CpuLangevinDynamics& owner;
 };
 
-CpuLangevinDynamics::CpuLangevinDynamics(int numberOfAtoms, RealOpenMM deltaT, RealOpenMM tau, RealOpenMM temperature, ThreadPool& threads, CpuRandom& random) : 
-           ReferenceStochasticDynamics(numberOfAtoms, deltaT, tau, temperature), threads(threads), random(random) {
+class CpuLangevinDynamics::Update3Task : public ThreadPool::Task {
+public:
+    Update3Task(CpuLangevinDynamics& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadUpdate3(threadIndex);
+    }
+    CpuLangevinDynamics& owner;
+};
+
+CpuLangevinDynamics::CpuLangevinDynamics(int numberOfAtoms, RealOpenMM deltaT, RealOpenMM tau, RealOpenMM temperature, ThreadPool& threads, CpuRandom& random,
+           CpuVirtualSites& virtualSites) : ReferenceStochasticDynamics(numberOfAtoms, deltaT, tau, temperature), threads(threads), random(random), virtualSites(virtualSites) {
+    int maxAtomsPerStream = numberOfAtoms/random.getNumStreams()+1;
+    threadNoise.resize(threads.getNumThreads());
+    for (int i = 0; i < (int) threadNoise.size(); i++)
+        threadNoise[i].resize(3*maxAtomsPerStream);
 }
 
 CpuLangevinDynamics::~CpuLangevinDynamics() {
@@ -92,33 +106,78 @@ void CpuLangevinDynamics::updatePart2(int numberOfAtoms, vector<RealVec>& atomCo
     threads.waitForThreads();
 }
 
+void CpuLangevinDynamics::updatePart3(const OpenMM::System& system, vector<RealVec>& atomCoordinates, vector<RealVec>& velocities,
+                                      vector<RealOpenMM>& inverseMasses, vector<RealVec>& xPrime) {
+    // Record the parameters for the threads.
+    
+    this->numberOfAtoms = system.getNumParticles();
+    this->atomCoordinates = &atomCoordinates[0];
+    this->velocities = &velocities[0];
+    this->inverseMasses = &inverseMasses[0];
+    this->xPrime = &xPrime[0];
+    
+    // Signal the threads to start running and wait for them to finish.
+    
+    Update3Task task(*this);
+    threads.execute(task);
+    threads.waitForThreads();
+    
+    // Compute the positions of virtual sites.
+    
+    virtualSites.computePositions(system, atomCoordinates);
+}
+
 void CpuLangevinDynamics::threadUpdate1(int threadIndex) {
     const RealOpenMM tau = getTau();
     const RealOpenMM vscale = EXP(-getDeltaT()/tau);
     const RealOpenMM fscale = (1-vscale)*tau;
     const RealOpenMM kT = BOLTZ*getTemperature();
     const RealOpenMM noisescale = SQRT(2*kT/tau)*SQRT(0.5*(1-vscale*vscale)*tau);
+    
+    // Each random number stream is always used for the same atoms, so the results do not depend on
+    // the number of threads.
+    
+    int numStreams = random.getNumStreams();
+    int firstStream = threadIndex*numStreams/threads.getNumThreads();
+    int lastStream = (threadIndex+1)*numStreams/threads.getNumThreads();
+    float* noise = &threadNoise[threadIndex][0];
+    for (int stream = firstStream; stream < lastStream; stream++) {
+        int start, end;
+        random.getStreamRange(stream, numberOfAtoms, start, end);
+        random.fillGaussianRandom(stream, noise, 3*(end-start));
+        for (int i = start; i < end; i++) {
+            if (inverseMasses[i] != 0.0) {
+                RealOpenMM sqrtInvMass = SQRT(inverseMasses[i]);
+                float* atomNoise = &noise[3*(i-start)];
+                RealVec noiseVec(atomNoise[0], atomNoise[1], atomNoise[2]);
+                velocities[i]  = velocities[i]*vscale + forces[i]*(fscale*inverseMasses[i]) + noiseVec*(noisescale*sqrtInvMass);
+            }
+        }
+    }
+}
+
+void CpuLangevinDynamics::threadUpdate2(int threadIndex) {
+    const RealOpenMM dt = getDeltaT();
     int start = threadIndex*numberOfAtoms/threads.getNumThreads();
     int end = (threadIndex+1)*numberOfAtoms/threads.getNumThreads();
 
     for (int i = start; i < end; i++) {
         if (inverseMasses[i] != 0.0) {
             RealOpenMM sqrtInvMass = SQRT(inverseMasses[i]);
-            RealVec noise(random.getGaussianRandom(threadIndex), random.getGaussianRandom(threadIndex), random.getGaussianRandom(threadIndex));
-            velocities[i]  = velocities[i]*vscale + forces[i]*(fscale*inverseMasses[i]) + noise*(noisescale*sqrtInvMass);
+            xPrime[i] = atomCoordinates[i]+velocities[i]*dt;
         }
    }
 }
 
-void CpuLangevinDynamics::threadUpdate2(int threadIndex) {
-    const RealOpenMM dt = getDeltaT();
+void CpuLangevinDynamics::threadUpdate3(int threadIndex) {
+    const RealOpenMM invStepSize = 1.0/getDeltaT();
     int start = threadIndex*numberOfAtoms/threads.getNumThreads();
     int end = (threadIndex+1)*numberOfAtoms/threads.getNumThreads();
 
     for (int i = start; i < end; i++) {
         if (inverseMasses[i] != 0.0) {
-            RealOpenMM sqrtInvMass = SQRT(inverseMasses[i]);
-            xPrime[i] = atomCoordinates[i]+velocities[i]*dt;
+            velocities[i] = (xPrime[i]-atomCoordinates[i])*invStepSize;
+            atomCoordinates[i] = xPrime[i];
         }
-   }
+    }
 }
@@ -34,7 +34,6 @@
 #include "openmm/internal/vectorize.h"
 #include "hilbert.h"
 #include <algorithm>
-#include <set>
 #include <map>
 #include <cmath>
 
@@ -335,7 +334,7 @@ public:
                         
                         // Add this atom to the list of neighbors.
                         
-                        neighbors.push_back(sortedAtoms[sortedIndex]);
+                        neighbors.push_back(sortedIndex);
                         if (sortedIndex < blockSize*blockIndex)
                             exclusions.push_back(0);
                         else {
@@ -362,18 +361,22 @@ private:
 
 class CpuNeighborList::ThreadTask : public ThreadPool::Task {
 public:
-    ThreadTask(CpuNeighborList& owner) : owner(owner) {
+    ThreadTask(CpuNeighborList& owner, bool computeBins) : owner(owner), computeBins(computeBins) {
     }
     void execute(ThreadPool& threads, int threadIndex) {
-        owner.threadComputeNeighborList(threads, threadIndex);
+        if (computeBins)
+            owner.threadComputeAtomBins(threads, threadIndex);
+        else
+            owner.threadComputeNeighborList(threads, threadIndex);
     }
     CpuNeighborList& owner;
+    bool computeBins;
 };
 
 CpuNeighborList::CpuNeighborList(int blockSize) : blockSize(blockSize) {
 }
 
-void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const vector<set<int> >& exclusions,
+void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const CpuExclusions& exclusions,
             const RealVec* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads) {
     int numBlocks = (numAtoms+blockSize-1)/blockSize;
     blockNeighbors.resize(numBlocks);
@@ -410,8 +413,8 @@ void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float
     // Sort the atoms based on a Hilbert curve.
     
     atomBins.resize(numAtoms);
-    ThreadTask task(*this);
-    threads.execute(task);
+    ThreadTask binsTask(*this, true);
+    threads.execute(binsTask);
     threads.waitForThreads();
     sort(atomBins.begin(), atomBins.end());
 
@@ -435,7 +438,8 @@ void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float
 
     // Signal the threads to start running and wait for them to finish.
     
-    threads.resumeThreads();
+    ThreadTask neighborsTask(*this, false);
+    threads.execute(neighborsTask);
     threads.waitForThreads();
     
     // Add padding atoms to fill up the last block.
@@ -468,7 +472,7 @@ const std::vector<char>& CpuNeighborList::getBlockExclusions(int blockIndex) con
     
 }
 
-void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadIndex) {
+void CpuNeighborList::threadComputeAtomBins(ThreadPool& threads, int threadIndex) {
     // Compute the positions of atoms along the Hilbert curve.
 
     float binWidth = max(max(maxx-minx, maxy-miny), maxz-minz)/255.0f;
@@ -483,10 +487,12 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
         int bin = (int) hilbert_c2i(3, 8, coords);
         atomBins[i] = pair<int, int>(bin, i);
     }
-    threads.syncThreads();
+}
 
+void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadIndex) {
     // Compute this thread's subset of neighbors.
 
+    int numThreads = threads.getNumThreads();
     int numBlocks = blockNeighbors.size();
     vector<int> blockAtoms;
     vector<VoxelIndex> atomVoxelIndex;
@@ -513,11 +519,13 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
         // Record the exclusions for this block.
 
         for (int j = 0; j < atomsInBlock; j++) {
-            const set<int>& atomExclusions = (*exclusions)[sortedAtoms[firstIndex+j]];
+            int atom = sortedAtoms[firstIndex+j];
+            if (exclusions->begin(atom) == exclusions->end(atom))
+                continue;
             char mask = 1<<j;
             for (int k = 0; k < (int) blockNeighbors[i].size(); k++) {
-                int atomIndex = blockNeighbors[i][k];
-                if (atomExclusions.find(atomIndex) != atomExclusions.end())
+                int atomIndex = sortedAtoms[blockNeighbors[i][k]];
+                if (exclusions->isExcluded(atom, atomIndex))
                     blockExclusions[i][k] |= mask;
             }
         }
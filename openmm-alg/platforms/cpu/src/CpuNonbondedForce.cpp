@@ -22,8 +22,6 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#include <complex>
-
 #include "SimTKOpenMMUtilities.h"
 #include "CpuNonbondedForce.h"
 #include "ReferenceForce.h"
@@ -51,13 +49,34 @@ public:
     CpuNonbondedForce& owner;
 };
 
+class CpuNonbondedForce::ComputeReciprocalTask : public ThreadPool::Task {
+public:
+    ComputeReciprocalTask(CpuNonbondedForce& owner, int phase) : owner(owner), phase(phase) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadComputeReciprocal(threads, threadIndex, phase);
+    }
+    CpuNonbondedForce& owner;
+    int phase;
+};
+
+class CpuNonbondedForce::CopyToSortedTask : public ThreadPool::Task {
+public:
+    CopyToSortedTask(CpuNonbondedForce& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.copyToSortedOrder(threads, threadIndex);
+    }
+    CpuNonbondedForce& owner;
+};
+
 /**---------------------------------------------------------------------------------------
 
    CpuNonbondedForce constructor
 
    --------------------------------------------------------------------------------------- */
 
-CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), tableIsValid(false), cutoffDistance(0.0f), alphaEwald(0.0f) {
+CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), alchemical(false), tableIsValid(false), sortedParametersValid(false), cutoffDistance(0.0f), alphaEwald(0.0f) {
 }
 
 CpuNonbondedForce::~CpuNonbondedForce() {
@@ -83,6 +102,10 @@ void CpuNonbondedForce::setUseCutoff(float distance, const CpuNeighborList& neig
     crf = (1.0/cutoffDistance)*(3.0*solventDielectric)/(2.0*solventDielectric+1.0);
   }
 
+void CpuNonbondedForce::invalidateSortedParameters() {
+    sortedParametersValid = false;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Set the force to use a switching function on the Lennard-Jones interaction.
@@ -170,6 +193,27 @@ void CpuNonbondedForce::setUseSwitchingFunction(float distance) {
       tabulateEwaldScaleFactor();
   }
 
+  /**---------------------------------------------------------------------------------------
+
+     Set the force to scale the interactions between alchemical and non-alchemical atoms.
+
+     @param isAlchemical          1 for each alchemical atom and 0 for every other atom
+     @param alpha                 the soft-core alpha parameter
+     @param lambdaElectrostatics  the scale factor for Coulomb interactions
+     @param lambdaSterics         the coupling parameter for soft-core Lennard-Jones interactions
+
+     --------------------------------------------------------------------------------------- */
+
+  void CpuNonbondedForce::setUseAlchemical(const vector<float>& isAlchemical, float alpha, float lambdaElectrostatics, float lambdaSterics) {
+      if (!alchemical || this->isAlchemical != &isAlchemical[0])
+          sortedParametersValid = false;
+      this->isAlchemical = &isAlchemical[0];
+      softcoreAlpha = alpha;
+      this->lambdaElectrostatics = lambdaElectrostatics;
+      this->lambdaSterics = lambdaSterics;
+      alchemical = true;
+  }
+
   
 void CpuNonbondedForce::tabulateEwaldScaleFactor() {
     if (tableIsValid)
@@ -186,15 +230,11 @@ void CpuNonbondedForce::tabulateEwaldScaleFactor() {
 }
   
 void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, const vector<RealVec>& atomCoordinates,
-                                             const vector<pair<float, float> >& atomParameters, const vector<set<int> >& exclusions,
-                                             vector<RealVec>& forces, double* totalEnergy) const {
-    typedef std::complex<float> d_complex;
-
+                                             const vector<pair<float, float> >& atomParameters, const CpuExclusions& exclusions,
+                                             vector<RealVec>& forces, double* totalEnergy, ThreadPool& threads, bool includeForces) {
     static const float epsilon     =  1.0;
 
     int kmax                       = (ewald ? max(numRx, max(numRy,numRz)) : 0);
-    float factorEwald              = -1 / (4*alphaEwald*alphaEwald);
-    float TWO_PI                   = 2.0 * PI_M;
     float recipCoeff               = (float)(ONE_4PI_EPS0*4*PI_M/(periodicBoxVectors[0][0] * periodicBoxVectors[1][1] * periodicBoxVectors[2][2]) /epsilon);
 
     if (pme) {
@@ -213,108 +253,229 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
     // Ewald method
 
     else if (ewald) {
-
-        // setup reciprocal box
-
-        float recipBoxSize[3] = {(float) (TWO_PI/periodicBoxVectors[0][0]), (float) (TWO_PI/periodicBoxVectors[1][1]), (float) (TWO_PI/periodicBoxVectors[2][2])};
-
-
-        // setup K-vectors
-
-        #define EIR(x, y, z) eir[(x)*numberOfAtoms*3+(y)*3+z]
-        vector<d_complex> eir(kmax*numberOfAtoms*3);
-        vector<d_complex> tab_xy(numberOfAtoms);
-        vector<d_complex> tab_qxyz(numberOfAtoms);
-
-        for (int i = 0; (i < numberOfAtoms); i++) {
-            float* pos = posq+4*i;
-            for (int m = 0; (m < 3); m++)
-              EIR(0, i, m) = d_complex(1,0);
-
-            for (int m=0; (m<3); m++)
-              EIR(1, i, m) = d_complex(cos(pos[m]*recipBoxSize[m]),
-                                       sin(pos[m]*recipBoxSize[m]));
-
-            for (int j=2; (j<kmax); j++)
-              for (int m=0; (m<3); m++)
-                EIR(j, i, m) = EIR(j-1, i, m) * EIR(1, i, m);
+        // Record the parameters for the threads.
+
+        this->numberOfAtoms = numberOfAtoms;
+        this->posq = posq;
+        this->includeForces = includeForces;
+        reciprocalForces = &forces[0];
+        paddedNumAtoms = 4*((numberOfAtoms+3)/4);
+        ewaldCharges.resize(paddedNumAtoms);
+        eirReal.resize(3*kmax*paddedNumAtoms);
+        eirImag.resize(3*kmax*paddedNumAtoms);
+        int numKVectors = numRx*(2*numRy-1)*(2*numRz-1);
+        ewaldCs.resize(numKVectors);
+        ewaldSs.resize(numKVectors);
+        ewaldAk.resize(numKVectors);
+        threadTabXY.resize(threads.getNumThreads());
+        for (int i = 0; i < (int) threadTabXY.size(); i++)
+            threadTabXY[i].resize(2*paddedNumAtoms);
+        gmx_atomic_t counter;
+        gmx_atomic_set(&counter, 0);
+        this->atomicCounter = &counter;
+
+        // Build the tables of exp(i*k*r), then compute the structure factors.
+
+        ComputeReciprocalTask tablesTask(*this, 0);
+        threads.execute(tablesTask);
+        threads.waitForThreads();
+        ComputeReciprocalTask structureFactorsTask(*this, 1);
+        threads.execute(structureFactorsTask);
+        threads.waitForThreads();
+
+        // Sum the energy over k vectors in a fixed order so the result does not depend on the number of threads.
+
+        if (totalEnergy) {
+            double recipEnergy = 0;
+            int numKy = 2*numRy-1;
+            int numKz = 2*numRz-1;
+            for (int rx = 0; rx < numRx; rx++)
+                for (int ry = (rx == 0 ? 0 : 1-numRy); ry < numRy; ry++) {
+                    int lowrz = (rx == 0 && ry == 0 ? 1 : 1-numRz);
+                    for (int rz = lowrz; rz < numRz; rz++) {
+                        int k = (rx*numKy+ry+numRy-1)*numKz+rz+numRz-1;
+                        recipEnergy += recipCoeff * ewaldAk[k] * (ewaldCs[k] * ewaldCs[k] + ewaldSs[k] * ewaldSs[k]);
+                    }
+                }
+            *totalEnergy += recipEnergy;
         }
+        if (includeForces) {
+            ComputeReciprocalTask forcesTask(*this, 2);
+            threads.execute(forcesTask);
+            threads.waitForThreads();
+        }
+    }
+}
 
-        // calculate reciprocal space energy and forces
-
-        int lowry = 0;
-        int lowrz = 1;
-
-        for (int rx = 0; rx < numRx; rx++) {
-            float kx = rx * recipBoxSize[0];
-            for (int ry = lowry; ry < numRy; ry++) {
-                float ky = ry * recipBoxSize[1];
-                if (ry >= 0) {
-                    for (int n = 0; n < numberOfAtoms; n++)
-                      tab_xy[n] = EIR(rx, n, 0) * EIR(ry, n, 1);
+void CpuNonbondedForce::threadComputeReciprocal(ThreadPool& threads, int threadIndex, int phase) {
+    int numThreads = threads.getNumThreads();
+    int kmax = max(numRx, max(numRy, numRz));
+    int numKy = 2*numRy-1;
+    int numKz = 2*numRz-1;
+    int numPairs = numRx*numKy;
+    float TWO_PI = 2.0 * PI_M;
+    float kUnit[3] = {(float) (TWO_PI/periodicBoxVectors[0][0]), (float) (TWO_PI/periodicBoxVectors[1][1]), (float) (TWO_PI/periodicBoxVectors[2][2])};
+    float factorEwald = -1 / (4*alphaEwald*alphaEwald);
+    float recipCoeff = (float)(ONE_4PI_EPS0*4*PI_M/(periodicBoxVectors[0][0] * periodicBoxVectors[1][1] * periodicBoxVectors[2][2]));
+    #define EIR_INDEX(k, m) (((k)*3+(m))*paddedNumAtoms)
+    int start = 4*(threadIndex*(paddedNumAtoms/4)/numThreads);
+    int end = 4*((threadIndex+1)*(paddedNumAtoms/4)/numThreads);
+
+    if (phase == 0) {
+        // Build the tables of exp(i*k*r) for this thread's atoms.  Padding atoms get zero charge.
+
+        for (int n = start; n < end; n++) {
+            bool isRealAtom = (n < numberOfAtoms);
+            ewaldCharges[n] = (isRealAtom ? posq[4*n+3] : 0.0f);
+            for (int m = 0; m < 3; m++) {
+                float theta = (isRealAtom ? posq[4*n+m]*kUnit[m] : 0.0f);
+                float cosTheta = cos(theta);
+                float sinTheta = sin(theta);
+                float re = 1.0f, im = 0.0f;
+                eirReal[EIR_INDEX(0, m)+n] = re;
+                eirImag[EIR_INDEX(0, m)+n] = im;
+                for (int k = 1; k < kmax; k++) {
+                    float newRe = re*cosTheta - im*sinTheta;
+                    im = re*sinTheta + im*cosTheta;
+                    re = newRe;
+                    eirReal[EIR_INDEX(k, m)+n] = re;
+                    eirImag[EIR_INDEX(k, m)+n] = im;
                 }
-                else {
-                    for (int n = 0; n < numberOfAtoms; n++)
-                      tab_xy[n]= EIR(rx, n, 0) * conj (EIR(-ry, n, 1));
+            }
+        }
+    }
+    else if (phase == 1) {
+        // Compute the structure factors.  Each work item is one (kx, ky) pair, for which the products of the x and y
+        // tables are computed once and then reused for every kz.  Negative wave vectors use the complex conjugate.
+
+        float* tabReal = &threadTabXY[threadIndex][0];
+        float* tabImag = tabReal+paddedNumAtoms;
+        while (true) {
+            int pair = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (pair >= numPairs)
+                break;
+            int rx = pair/numKy;
+            int ry = pair%numKy-(numRy-1);
+            if (rx == 0 && ry < 0)
+                continue;
+            const float* xReal = &eirReal[EIR_INDEX(rx, 0)];
+            const float* xImag = &eirImag[EIR_INDEX(rx, 0)];
+            const float* yReal = &eirReal[EIR_INDEX(abs(ry), 1)];
+            const float* yImag = &eirImag[EIR_INDEX(abs(ry), 1)];
+            fvec4 ySign(ry < 0 ? -1.0f : 1.0f);
+            for (int n = 0; n < paddedNumAtoms; n += 4) {
+                fvec4 q(&ewaldCharges[n]);
+                fvec4 xr(xReal+n), xi(xImag+n), yr(yReal+n);
+                fvec4 yi = fvec4(yImag+n)*ySign;
+                (q*(xr*yr-xi*yi)).store(tabReal+n);
+                (q*(xr*yi+xi*yr)).store(tabImag+n);
+            }
+            float kx = rx*kUnit[0];
+            float ky = ry*kUnit[1];
+            int lowrz = (rx == 0 && ry == 0 ? 1 : 1-numRz);
+            for (int rz = lowrz; rz < numRz; rz++) {
+                const float* zReal = &eirReal[EIR_INDEX(abs(rz), 2)];
+                const float* zImag = &eirImag[EIR_INDEX(abs(rz), 2)];
+                fvec4 zSign(rz < 0 ? -1.0f : 1.0f);
+                fvec4 cs(0.0f), ss(0.0f);
+                for (int n = 0; n < paddedNumAtoms; n += 4) {
+                    fvec4 xyr(tabReal+n), xyi(tabImag+n), zr(zReal+n);
+                    fvec4 zi = fvec4(zImag+n)*zSign;
+                    cs += xyr*zr-xyi*zi;
+                    ss += xyr*zi+xyi*zr;
                 }
+                float kz = rz*kUnit[2];
+                float k2 = kx*kx + ky*ky + kz*kz;
+                int k = pair*numKz+rz+numRz-1;
+                ewaldCs[k] = dot4(cs, fvec4(1.0f));
+                ewaldSs[k] = dot4(ss, fvec4(1.0f));
+                ewaldAk[k] = exp(k2*factorEwald) / k2;
+            }
+        }
+    }
+    else {
+        // Compute the forces on this thread's atoms, four at a time.
+
+        for (int n = start; n < end; n += 4) {
+            fvec4 q(&ewaldCharges[n]);
+            fvec4 fx(0.0f), fy(0.0f), fz(0.0f);
+            for (int pair = 0; pair < numPairs; pair++) {
+                int rx = pair/numKy;
+                int ry = pair%numKy-(numRy-1);
+                if (rx == 0 && ry < 0)
+                    continue;
+                fvec4 xr(&eirReal[EIR_INDEX(rx, 0)+n]), xi(&eirImag[EIR_INDEX(rx, 0)+n]);
+                fvec4 yr(&eirReal[EIR_INDEX(abs(ry), 1)+n]);
+                fvec4 yi = fvec4(&eirImag[EIR_INDEX(abs(ry), 1)+n])*fvec4(ry < 0 ? -1.0f : 1.0f);
+                fvec4 xyr = q*(xr*yr-xi*yi);
+                fvec4 xyi = q*(xr*yi+xi*yr);
+                fvec4 pairForce(0.0f);
+                int lowrz = (rx == 0 && ry == 0 ? 1 : 1-numRz);
                 for (int rz = lowrz; rz < numRz; rz++) {
-                    if (rz >= 0) {
-                        for (int n = 0; n < numberOfAtoms; n++)
-                            tab_qxyz[n] = posq[4*n+3] * (tab_xy[n] * EIR(rz, n, 2));
-                    }
-                    else {
-                        for (int n = 0; n < numberOfAtoms; n++)
-                            tab_qxyz[n] = posq[4*n+3] * (tab_xy[n] * conj(EIR(-rz, n, 2)));
-                    }
-                    float cs = 0.0f;
-                    float ss = 0.0f;
-
-                    for (int n = 0; n < numberOfAtoms; n++) {
-                        cs += tab_qxyz[n].real();
-                        ss += tab_qxyz[n].imag();
-                    }
-
-                    float kz = rz * recipBoxSize[2];
-                    float k2 = kx * kx + ky * ky + kz * kz;
-                    float ak = exp(k2*factorEwald) / k2;
-
-                    for (int n = 0; n < numberOfAtoms; n++) {
-                        float force = ak * (cs * tab_qxyz[n].imag() - ss * tab_qxyz[n].real());
-                        forces[n][0] += 2 * recipCoeff * force * kx;
-                        forces[n][1] += 2 * recipCoeff * force * ky;
-                        forces[n][2] += 2 * recipCoeff * force * kz;
-                    }
-
-                    if (totalEnergy)
-                        *totalEnergy += recipCoeff * ak * (cs * cs + ss * ss);
-
-                    lowrz = 1 - numRz;
+                    fvec4 zr(&eirReal[EIR_INDEX(abs(rz), 2)+n]);
+                    fvec4 zi = fvec4(&eirImag[EIR_INDEX(abs(rz), 2)+n])*fvec4(rz < 0 ? -1.0f : 1.0f);
+                    fvec4 re = xyr*zr-xyi*zi;
+                    fvec4 im = xyr*zi+xyi*zr;
+                    int k = pair*numKz+rz+numRz-1;
+                    fvec4 force = ewaldAk[k]*(ewaldCs[k]*im - ewaldSs[k]*re);
+                    pairForce += force;
+                    fz += force*(rz*kUnit[2]);
                 }
-                lowry = 1 - numRy;
+                fx += pairForce*(rx*kUnit[0]);
+                fy += pairForce*(ry*kUnit[1]);
+            }
+            for (int i = 0; i < 4 && n+i < numberOfAtoms; i++) {
+                reciprocalForces[n+i][0] += 2 * recipCoeff * fx[i];
+                reciprocalForces[n+i][1] += 2 * recipCoeff * fy[i];
+                reciprocalForces[n+i][2] += 2 * recipCoeff * fz[i];
             }
         }
     }
+    #undef EIR_INDEX
 }
 
 
 void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const vector<RealVec>& atomCoordinates, const vector<pair<float, float> >& atomParameters,
-                const vector<set<int> >& exclusions, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
+                const CpuExclusions& exclusions, vector<AlignedArray<float> >& threadForce, double* totalEnergy, double* lambdaDerivatives, ThreadPool& threads, bool includeForces) {
     // Record the parameters for the threads.
     
     this->numberOfAtoms = numberOfAtoms;
     this->posq = posq;
     this->atomCoordinates = &atomCoordinates[0];
     this->atomParameters = &atomParameters[0];
-    this->exclusions = &exclusions[0];
+    this->exclusions = &exclusions;
     this->threadForce = &threadForce;
+    this->includeForces = includeForces;
     includeEnergy = (totalEnergy != NULL);
+    includeLambdaDerivatives = (alchemical && includeEnergy && lambdaDerivatives != NULL);
     threadEnergy.resize(threads.getNumThreads());
+    threadLambdaDerivatives.resize(2*threads.getNumThreads());
     gmx_atomic_t counter;
     gmx_atomic_set(&counter, 0);
     this->atomicCounter = &counter;
     
     // Signal the threads to start running and wait for them to finish.
     
+    bool useNeighborList = (cutoff || ewald || pme);
+    if (useNeighborList) {
+        int numSorted = neighborList->getSortedAtoms().size();
+        sortedPosq.resize(4*numSorted);
+        copySortedParameters = !sortedParametersValid;
+        if (copySortedParameters) {
+            sortedAtomParameters.resize(numSorted);
+            if (alchemical)
+                sortedIsAlchemical.resize(numSorted);
+        }
+        threadSortedForce.resize(threads.getNumThreads());
+    }
+    if (useNeighborList) {
+        // Copy the atom data into sorted order before computing interactions.
+
+        CopyToSortedTask copyTask(*this);
+        threads.execute(copyTask);
+        threads.waitForThreads();
+        sortedParametersValid = true;
+    }
     ComputeDirectTask task(*this);
     threads.execute(task);
     threads.waitForThreads();
@@ -328,6 +489,13 @@ void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const
             directEnergy += threadEnergy[i];
         *totalEnergy += directEnergy;
     }
+    if (includeLambdaDerivatives) {
+        int numThreads = threads.getNumThreads();
+        for (int i = 0; i < numThreads; i++) {
+            lambdaDerivatives[0] += threadLambdaDerivatives[2*i];
+            lambdaDerivatives[1] += threadLambdaDerivatives[2*i+1];
+        }
+    }
 }
 
 void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex) {
@@ -336,24 +504,29 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
     int numThreads = threads.getNumThreads();
     threadEnergy[threadIndex] = 0;
     double* energyPtr = (includeEnergy ? &threadEnergy[threadIndex] : NULL);
+    threadLambdaDerivatives[2*threadIndex] = 0;
+    threadLambdaDerivatives[2*threadIndex+1] = 0;
+    double* lambdaDerivativesPtr = (includeLambdaDerivatives ? &threadLambdaDerivatives[2*threadIndex] : NULL);
     float* forces = &(*threadForce)[threadIndex][0];
     fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
     fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
     if (ewald || pme) {
         // Compute the interactions from the neighbor list.
 
+        float* sortedForces = &threadSortedForce[threadIndex][0];
         while (true) {
             int nextBlock = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (nextBlock >= neighborList->getNumBlocks())
                 break;
-            calculateBlockEwaldIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+            calculateBlockEwaldIxn(nextBlock, sortedForces, energyPtr, lambdaDerivativesPtr, boxSize, invBoxSize);
         }
+        addSortedForces(threadIndex, forces);
 
         // Now subtract off the exclusions, since they were implicitly included in the reciprocal space sum.
 
         for (int i = threadIndex; i < numberOfAtoms; i += numThreads) {
             fvec4 posI((float) atomCoordinates[i][0], (float) atomCoordinates[i][1], (float) atomCoordinates[i][2], 0.0f);
-            for (set<int>::const_iterator iter = exclusions[i].begin(); iter != exclusions[i].end(); ++iter) {
+            for (const int* iter = exclusions->begin(i); iter != exclusions->end(i); ++iter) {
                 if (*iter > i) {
                     int j = *iter;
                     fvec4 deltaR;
@@ -366,11 +539,18 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
                     float alphaR = alphaEwald*r;
                     float erfcAlphaR = erfcApprox(alphaR);
                     if (1-erfcAlphaR > 1e-6f) {
-                        float dEdR = (float) (chargeProd * inverseR * inverseR * inverseR);
-                        dEdR = (float) (dEdR * (1.0f-erfcAlphaR-TWO_OVER_SQRT_PI*alphaR*exp(-alphaR*alphaR)));
-                        fvec4 result = deltaR*dEdR;
-                        (fvec4(forces+4*i)-result).store(forces+4*i);
-                        (fvec4(forces+4*j)+result).store(forces+4*j);
+                        if (alchemical && isAlchemical[i] != isAlchemical[j]) {
+                            if (includeLambdaDerivatives)
+                                lambdaDerivativesPtr[0] -= chargeProd*inverseR*(1.0f-erfcAlphaR);
+                            chargeProd *= lambdaElectrostatics;
+                        }
+                        if (includeForces) {
+                            float dEdR = (float) (chargeProd * inverseR * inverseR * inverseR);
+                            dEdR = (float) (dEdR * (1.0f-erfcAlphaR-TWO_OVER_SQRT_PI*alphaR*exp(-alphaR*alphaR)));
+                            fvec4 result = deltaR*dEdR;
+                            (fvec4(forces+4*i)-result).store(forces+4*i);
+                            (fvec4(forces+4*j)+result).store(forces+4*j);
+                        }
                         if (includeEnergy)
                             threadEnergy[threadIndex] -= chargeProd*inverseR*(1.0f-erfcAlphaR);
                     }
@@ -381,12 +561,14 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
     else if (cutoff) {
         // Compute the interactions from the neighbor list.
 
+        float* sortedForces = &threadSortedForce[threadIndex][0];
         while (true) {
             int nextBlock = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (nextBlock >= neighborList->getNumBlocks())
                 break;
-            calculateBlockIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+            calculateBlockIxn(nextBlock, sortedForces, energyPtr, lambdaDerivativesPtr, boxSize, invBoxSize);
         }
+        addSortedForces(threadIndex, forces);
     }
     else {
         // Loop over all atom pairs
@@ -395,14 +577,62 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
             int i = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (i >= numberOfAtoms)
                 break;
-            for (int j = i+1; j < numberOfAtoms; j++)
-                if (exclusions[j].find(i) == exclusions[j].end())
-                    calculateOneIxn(i, j, forces, energyPtr, boxSize, invBoxSize);
+            // The exclusions are sorted, so we can step through them in parallel with j.
+
+            const int* nextExclusion = exclusions->begin(i);
+            const int* lastExclusion = exclusions->end(i);
+            for (int j = i+1; j < numberOfAtoms; j++) {
+                while (nextExclusion != lastExclusion && *nextExclusion < j)
+                    nextExclusion++;
+                if (nextExclusion == lastExclusion || *nextExclusion != j)
+                    calculateOneIxn(i, j, forces, energyPtr, lambdaDerivativesPtr, boxSize, invBoxSize);
+            }
         }
     }
 }
 
-void CpuNonbondedForce::calculateOneIxn(int ii, int jj, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
+void CpuNonbondedForce::copyToSortedOrder(ThreadPool& threads, int threadIndex) {
+    // Copy this thread's share of the positions into the order of the neighbor list.  The parameters only
+    // need to be copied when the neighbor list has been rebuilt or they have changed.
+
+    const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+    int numSorted = sortedAtoms.size();
+    int numThreads = threads.getNumThreads();
+    int start = (threadIndex*numSorted)/numThreads;
+    int end = ((threadIndex+1)*numSorted)/numThreads;
+    for (int i = start; i < end; i++)
+        fvec4(posq+4*sortedAtoms[i]).store(&sortedPosq[4*i]);
+    if (copySortedParameters) {
+        for (int i = start; i < end; i++)
+            sortedAtomParameters[i] = atomParameters[sortedAtoms[i]];
+        if (alchemical)
+            for (int i = start; i < end; i++)
+                sortedIsAlchemical[i] = isAlchemical[sortedAtoms[i]];
+    }
+
+    // Clear this thread's sorted force buffer.
+
+    if (includeForces) {
+        AlignedArray<float>& sortedForces = threadSortedForce[threadIndex];
+        sortedForces.resize(4*numSorted);
+        fvec4 zero(0.0f);
+        for (int i = 0; i < numSorted; i++)
+            zero.store(&sortedForces[4*i]);
+    }
+}
+
+void CpuNonbondedForce::addSortedForces(int threadIndex, float* forces) {
+    if (!includeForces)
+        return;
+    const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+    const AlignedArray<float>& sortedForces = threadSortedForce[threadIndex];
+    for (int i = 0; i < numberOfAtoms; i++) {
+        float* atomForce = forces+4*sortedAtoms[i];
+        (fvec4(atomForce)+fvec4(&sortedForces[4*i])).store(atomForce);
+    }
+}
+
+void CpuNonbondedForce::calculateOneIxn(int ii, int jj, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) {
     // get deltaR, R2, and R between 2 atoms
 
     fvec4 deltaR;
@@ -426,14 +656,27 @@ void CpuNonbondedForce::calculateOneIxn(int ii, int jj, float* forces, double* t
     float sig6      = sig2*sig2*sig2;
 
     float eps       = atomParameters[ii].second*atomParameters[jj].second;
-    float dEdR      = switchValue*eps*(12.0f*sig6 - 6.0f)*sig6;
     float chargeProd = ONE_4PI_EPS0*posq[4*ii+3]*posq[4*jj+3];
+    bool alchemicalPair = (alchemical && isAlchemical[ii] != isAlchemical[jj]);
+    float energy, dEdR, dEdLambdaSterics;
+    if (alchemicalPair) {
+        calculateSoftcoreIxn(sig6, eps, energy, dEdR, dEdLambdaSterics);
+        if (lambdaDerivatives) {
+            lambdaDerivatives[0] += (cutoff ? chargeProd*(inverseR+krf*r2-crf) : chargeProd*inverseR);
+            lambdaDerivatives[1] += switchValue*dEdLambdaSterics;
+        }
+        chargeProd *= lambdaElectrostatics;
+    }
+    else {
+        dEdR = eps*(12.0f*sig6 - 6.0f)*sig6;
+        energy = eps*(sig6-1.0f)*sig6;
+    }
+    dEdR *= switchValue;
     if (cutoff)
         dEdR += (float) (chargeProd*(inverseR-2.0f*krf*r2));
     else
         dEdR += (float) (chargeProd*inverseR);
     dEdR *= inverseR*inverseR;
-    float energy = eps*(sig6-1.0f)*sig6;
     if (useSwitch) {
         dEdR -= energy*switchDeriv*inverseR;
         energy *= switchValue;
@@ -451,11 +694,24 @@ void CpuNonbondedForce::calculateOneIxn(int ii, int jj, float* forces, double* t
 
     // accumulate forces
 
-    fvec4 result = deltaR*dEdR;
-    (fvec4(forces+4*ii)+result).store(forces+4*ii);
-    (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    if (includeForces) {
+        fvec4 result = deltaR*dEdR;
+        (fvec4(forces+4*ii)+result).store(forces+4*ii);
+        (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    }
   }
 
+void CpuNonbondedForce::calculateSoftcoreIxn(float sig6, float eps, float& energy, float& dEdR, float& dEdLambda) const {
+    // E = lambda*eps*(u^2-u), where u = 1/(alpha*(1-lambda) + (r/sigma)^6).  Everything is written in terms of
+    // (sigma/r)^6 so that atoms with sigma=0 do not produce infinities.
+
+    float d = 1/(softcoreAlpha*(1-lambdaSterics)*sig6+1);
+    float u = sig6*d;
+    energy = lambdaSterics*eps*(u-1)*u;
+    dEdR = lambdaSterics*eps*6*(2*u-1)*u*d;
+    dEdLambda = eps*((u-1)*u + lambdaSterics*softcoreAlpha*(2*u-1)*u*u);
+}
+
 void CpuNonbondedForce::getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
     deltaR = posJ-posI;
     if (periodic) {
@@ -44,28 +44,39 @@ CpuNonbondedForce* createCpuNonbondedForceVec4() {
 CpuNonbondedForceVec4::CpuNonbondedForceVec4() {
 }
 
-void CpuNonbondedForceVec4::calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    if (triclinic)
-        calculateBlockIxnImpl<true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
-    else
-        calculateBlockIxnImpl<false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+void CpuNonbondedForceVec4::calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) {
+    if (triclinic) {
+        if (includeForces)
+            calculateBlockIxnImpl<true, true>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+        else
+            calculateBlockIxnImpl<true, false>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+    }
+    else {
+        if (includeForces)
+            calculateBlockIxnImpl<false, true>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+        else
+            calculateBlockIxnImpl<false, false>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+    }
 }
 
-template <bool TRICLINIC>
-void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    // Load the positions and parameters of the atoms in the block.
+template <bool TRICLINIC, bool COMPUTE_FORCES>
+void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) {
+    // Load the positions and parameters of the atoms in the block.  They are stored in sorted order, so
+    // the block's atoms are contiguous.
     
-    const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+    const int blockStart = 4*blockIndex;
     fvec4 blockAtomPosq[4];
     fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
     for (int i = 0; i < 4; i++)
-        blockAtomPosq[i] = fvec4(posq+4*blockAtom[i]);
+        blockAtomPosq[i] = fvec4(&sortedPosq[4*(blockStart+i)]);
     fvec4 blockAtomX = fvec4(blockAtomPosq[0][0], blockAtomPosq[1][0], blockAtomPosq[2][0], blockAtomPosq[3][0]);
     fvec4 blockAtomY = fvec4(blockAtomPosq[0][1], blockAtomPosq[1][1], blockAtomPosq[2][1], blockAtomPosq[3][1]);
     fvec4 blockAtomZ = fvec4(blockAtomPosq[0][2], blockAtomPosq[1][2], blockAtomPosq[2][2], blockAtomPosq[3][2]);
     fvec4 blockAtomCharge = fvec4(ONE_4PI_EPS0)*fvec4(blockAtomPosq[0][3], blockAtomPosq[1][3], blockAtomPosq[2][3], blockAtomPosq[3][3]);
-    fvec4 blockAtomSigma(atomParameters[blockAtom[0]].first, atomParameters[blockAtom[1]].first, atomParameters[blockAtom[2]].first, atomParameters[blockAtom[3]].first);
-    fvec4 blockAtomEpsilon(atomParameters[blockAtom[0]].second, atomParameters[blockAtom[1]].second, atomParameters[blockAtom[2]].second, atomParameters[blockAtom[3]].second);
+    fvec4 blockAtomSigma(sortedAtomParameters[blockStart].first, sortedAtomParameters[blockStart+1].first, sortedAtomParameters[blockStart+2].first, sortedAtomParameters[blockStart+3].first);
+    fvec4 blockAtomEpsilon(sortedAtomParameters[blockStart].second, sortedAtomParameters[blockStart+1].second, sortedAtomParameters[blockStart+2].second, sortedAtomParameters[blockStart+3].second);
+    fvec4 blockAtomIsAlchemical = (alchemical ? fvec4(&sortedIsAlchemical[blockStart]) : fvec4(0.0f));
+    fvec4 dEdLambdaElectrostatics(0.0f), dEdLambdaSterics(0.0f);
     bool needPeriodic = (periodic && (any(blockAtomX < cutoffDistance) || any(blockAtomY < cutoffDistance) || any(blockAtomZ < cutoffDistance) ||
             any(blockAtomX > boxSize[0]-cutoffDistance) || any(blockAtomY > boxSize[1]-cutoffDistance) || any(blockAtomZ > boxSize[2]-cutoffDistance)));
     const float invSwitchingInterval = 1/(cutoffDistance-switchingDistance);
@@ -82,7 +93,7 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
         // Compute the distances to the block atoms.
         
         fvec4 dx, dy, dz, r2;
-        getDeltaR<TRICLINIC>(posq+4*atom, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
+        getDeltaR<TRICLINIC>(&sortedPosq[4*atom], blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec4 include;
         char excl = exclusions[i];
         if (excl == 0)
@@ -97,34 +108,54 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
         
         fvec4 r = sqrt(r2);
         fvec4 inverseR = fvec4(1.0f)/r;
-        fvec4 energy, dEdR;
-        float atomEpsilon = atomParameters[atom].second;
+        ivec4 alchemicalPair = 0;
+        bool anyAlchemicalPair = false;
+        if (alchemical) {
+            alchemicalPair = include & (blockAtomIsAlchemical != sortedIsAlchemical[atom]);
+            anyAlchemicalPair = any(alchemicalPair);
+        }
+        fvec4 energy, dEdR, ljDEdLambda(0.0f);
+        float atomEpsilon = sortedAtomParameters[atom].second;
         if (atomEpsilon != 0.0f) {
-            fvec4 sig = blockAtomSigma+atomParameters[atom].first;
+            fvec4 sig = blockAtomSigma+sortedAtomParameters[atom].first;
             fvec4 sig2 = inverseR*sig;
             sig2 *= sig2;
             fvec4 sig6 = sig2*sig2*sig2;
             fvec4 epsSig6 = blockAtomEpsilon*atomEpsilon*sig6;
             dEdR = epsSig6*(12.0f*sig6 - 6.0f);
             energy = epsSig6*(sig6-1.0f);
+            if (anyAlchemicalPair) {
+                fvec4 softcoreEnergy, softcoreDEdR, softcoreDEdLambda;
+                calculateSoftcoreIxn(sig6, blockAtomEpsilon*atomEpsilon, softcoreEnergy, softcoreDEdR, softcoreDEdLambda);
+                energy = blend(energy, softcoreEnergy, alchemicalPair);
+                dEdR = blend(dEdR, softcoreDEdR, alchemicalPair);
+                ljDEdLambda = blend(0.0f, softcoreDEdLambda, alchemicalPair);
+            }
             if (useSwitch) {
                 fvec4 t = blend(0.0f, (r-switchingDistance)*invSwitchingInterval, r>switchingDistance);
                 fvec4 switchValue = 1+t*t*t*(-10.0f+t*(15.0f-t*6.0f));
                 fvec4 switchDeriv = t*t*(-30.0f+t*(60.0f-t*30.0f))*invSwitchingInterval;
                 dEdR = switchValue*dEdR - energy*switchDeriv*r;
                 energy *= switchValue;
+                if (anyAlchemicalPair)
+                    ljDEdLambda *= switchValue;
             }
         }
         else {
             energy = 0.0f;
             dEdR = 0.0f;
         }
-        fvec4 chargeProd = blockAtomCharge*posq[4*atom+3];
-        if (cutoff)
-            dEdR += chargeProd*(inverseR-2.0f*krf*r2);
-        else
-            dEdR += chargeProd*inverseR;
-        dEdR *= inverseR*inverseR;
+        fvec4 chargeProd = blockAtomCharge*sortedPosq[4*atom+3];
+        fvec4 unscaledChargeProd = chargeProd;
+        if (anyAlchemicalPair)
+            chargeProd = blend(chargeProd, chargeProd*lambdaElectrostatics, alchemicalPair);
+        if (COMPUTE_FORCES) {
+            if (cutoff)
+                dEdR += chargeProd*(inverseR-2.0f*krf*r2);
+            else
+                dEdR += chargeProd*inverseR;
+            dEdR *= inverseR*inverseR;
+        }
 
         // Accumulate energies.
 
@@ -138,51 +169,81 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
             *totalEnergy += dot4(energy, one);
         }
 
+        // Accumulate derivatives with respect to the lambdas.
+
+        if (lambdaDerivatives && anyAlchemicalPair) {
+            if (cutoff)
+                dEdLambdaElectrostatics += blend(0.0f, unscaledChargeProd*(inverseR+krf*r2-crf), alchemicalPair);
+            else
+                dEdLambdaElectrostatics += blend(0.0f, unscaledChargeProd*inverseR, alchemicalPair);
+            dEdLambdaSterics += ljDEdLambda;
+        }
+
         // Accumulate forces.
 
-        dEdR = blend(0.0f, dEdR, include);
-        fvec4 fx = dx*dEdR;
-        fvec4 fy = dy*dEdR;
-        fvec4 fz = dz*dEdR;
-        blockAtomForceX += fx;
-        blockAtomForceY += fy;
-        blockAtomForceZ += fz;
-        float* atomForce = forces+4*atom;
-        atomForce[0] -= dot4(fx, one);
-        atomForce[1] -= dot4(fy, one);
-        atomForce[2] -= dot4(fz, one);
+        if (COMPUTE_FORCES) {
+            dEdR = blend(0.0f, dEdR, include);
+            fvec4 fx = dx*dEdR;
+            fvec4 fy = dy*dEdR;
+            fvec4 fz = dz*dEdR;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atom;
+            atomForce[0] -= dot4(fx, one);
+            atomForce[1] -= dot4(fy, one);
+            atomForce[2] -= dot4(fz, one);
+        }
     }
     
-    // Record the forces on the block atoms.
+    // Record the derivatives and the forces on the block atoms.
+
+    if (lambdaDerivatives) {
+        lambdaDerivatives[0] += dot4(dEdLambdaElectrostatics, fvec4(1.0f));
+        lambdaDerivatives[1] += dot4(dEdLambdaSterics, fvec4(1.0f));
+    }
 
-    fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
-    transpose(f[0], f[1], f[2], f[3]);
-    for (int j = 0; j < 4; j++)
-        (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    if (COMPUTE_FORCES) {
+        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+        transpose(f[0], f[1], f[2], f[3]);
+        for (int j = 0; j < 4; j++)
+            (fvec4(forces+4*(blockStart+j))+f[j]).store(forces+4*(blockStart+j));
+    }
   }
 
-void CpuNonbondedForceVec4::calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    if (triclinic)
-        calculateBlockEwaldIxnImpl<true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
-    else
-        calculateBlockEwaldIxnImpl<false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+void CpuNonbondedForceVec4::calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) {
+    if (triclinic) {
+        if (includeForces)
+            calculateBlockEwaldIxnImpl<true, true>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+        else
+            calculateBlockEwaldIxnImpl<true, false>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+    }
+    else {
+        if (includeForces)
+            calculateBlockEwaldIxnImpl<false, true>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+        else
+            calculateBlockEwaldIxnImpl<false, false>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+    }
 }
 
-template <bool TRICLINIC>
-void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    // Load the positions and parameters of the atoms in the block.
+template <bool TRICLINIC, bool COMPUTE_FORCES>
+void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) {
+    // Load the positions and parameters of the atoms in the block.  They are stored in sorted order, so
+    // the block's atoms are contiguous.
     
-    const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+    const int blockStart = 4*blockIndex;
     fvec4 blockAtomPosq[4];
     fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
     for (int i = 0; i < 4; i++)
-        blockAtomPosq[i] = fvec4(posq+4*blockAtom[i]);
+        blockAtomPosq[i] = fvec4(&sortedPosq[4*(blockStart+i)]);
     fvec4 blockAtomX = fvec4(blockAtomPosq[0][0], blockAtomPosq[1][0], blockAtomPosq[2][0], blockAtomPosq[3][0]);
     fvec4 blockAtomY = fvec4(blockAtomPosq[0][1], blockAtomPosq[1][1], blockAtomPosq[2][1], blockAtomPosq[3][1]);
     fvec4 blockAtomZ = fvec4(blockAtomPosq[0][2], blockAtomPosq[1][2], blockAtomPosq[2][2], blockAtomPosq[3][2]);
     fvec4 blockAtomCharge = fvec4(ONE_4PI_EPS0)*fvec4(blockAtomPosq[0][3], blockAtomPosq[1][3], blockAtomPosq[2][3], blockAtomPosq[3][3]);
-    fvec4 blockAtomSigma(atomParameters[blockAtom[0]].first, atomParameters[blockAtom[1]].first, atomParameters[blockAtom[2]].first, atomParameters[blockAtom[3]].first);
-    fvec4 blockAtomEpsilon(atomParameters[blockAtom[0]].second, atomParameters[blockAtom[1]].second, atomParameters[blockAtom[2]].second, atomParameters[blockAtom[3]].second);
+    fvec4 blockAtomSigma(sortedAtomParameters[blockStart].first, sortedAtomParameters[blockStart+1].first, sortedAtomParameters[blockStart+2].first, sortedAtomParameters[blockStart+3].first);
+    fvec4 blockAtomEpsilon(sortedAtomParameters[blockStart].second, sortedAtomParameters[blockStart+1].second, sortedAtomParameters[blockStart+2].second, sortedAtomParameters[blockStart+3].second);
+    fvec4 blockAtomIsAlchemical = (alchemical ? fvec4(&sortedIsAlchemical[blockStart]) : fvec4(0.0f));
+    fvec4 dEdLambdaElectrostatics(0.0f), dEdLambdaSterics(0.0f);
     bool needPeriodic = (periodic && (any(blockAtomX < cutoffDistance) || any(blockAtomY < cutoffDistance) || any(blockAtomZ < cutoffDistance) ||
             any(blockAtomX > boxSize[0]-cutoffDistance) || any(blockAtomY > boxSize[1]-cutoffDistance) || any(blockAtomZ > boxSize[2]-cutoffDistance)));
     const float invSwitchingInterval = 1/(cutoffDistance-switchingDistance);
@@ -199,7 +260,7 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
         // Compute the distances to the block atoms.
         
         fvec4 dx, dy, dz, r2;
-        getDeltaR<TRICLINIC>(posq+4*atom, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
+        getDeltaR<TRICLINIC>(&sortedPosq[4*atom], blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec4 include;
         char excl = exclusions[i];
         if (excl == 0)
@@ -214,31 +275,51 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
         
         fvec4 r = sqrt(r2);
         fvec4 inverseR = fvec4(1.0f)/r;
-        fvec4 energy, dEdR;
-        float atomEpsilon = atomParameters[atom].second;
+        ivec4 alchemicalPair = 0;
+        bool anyAlchemicalPair = false;
+        if (alchemical) {
+            alchemicalPair = include & (blockAtomIsAlchemical != sortedIsAlchemical[atom]);
+            anyAlchemicalPair = any(alchemicalPair);
+        }
+        fvec4 energy, dEdR, ljDEdLambda(0.0f);
+        float atomEpsilon = sortedAtomParameters[atom].second;
         if (atomEpsilon != 0.0f) {
-            fvec4 sig = blockAtomSigma+atomParameters[atom].first;
+            fvec4 sig = blockAtomSigma+sortedAtomParameters[atom].first;
             fvec4 sig2 = inverseR*sig;
             sig2 *= sig2;
             fvec4 sig6 = sig2*sig2*sig2;
             fvec4 epsSig6 = blockAtomEpsilon*atomEpsilon*sig6;
             dEdR = epsSig6*(12.0f*sig6 - 6.0f);
             energy = epsSig6*(sig6-1.0f);
+            if (anyAlchemicalPair) {
+                fvec4 softcoreEnergy, softcoreDEdR, softcoreDEdLambda;
+                calculateSoftcoreIxn(sig6, blockAtomEpsilon*atomEpsilon, softcoreEnergy, softcoreDEdR, softcoreDEdLambda);
+                energy = blend(energy, softcoreEnergy, alchemicalPair);
+                dEdR = blend(dEdR, softcoreDEdR, alchemicalPair);
+                ljDEdLambda = blend(0.0f, softcoreDEdLambda, alchemicalPair);
+            }
             if (useSwitch) {
                 fvec4 t = blend(0.0f, (r-switchingDistance)*invSwitchingInterval, r>switchingDistance);
                 fvec4 switchValue = 1+t*t*t*(-10.0f+t*(15.0f-t*6.0f));
                 fvec4 switchDeriv = t*t*(-30.0f+t*(60.0f-t*30.0f))*invSwitchingInterval;
                 dEdR = switchValue*dEdR - energy*switchDeriv*r;
                 energy *= switchValue;
+                if (anyAlchemicalPair)
+                    ljDEdLambda *= switchValue;
             }
         }
         else {
             energy = 0.0f;
             dEdR = 0.0f;
         }
-        fvec4 chargeProd = blockAtomCharge*posq[4*atom+3];
-        dEdR += chargeProd*inverseR*ewaldScaleFunction(r);
-        dEdR *= inverseR*inverseR;        
+        fvec4 chargeProd = blockAtomCharge*sortedPosq[4*atom+3];
+        fvec4 unscaledChargeProd = chargeProd;
+        if (anyAlchemicalPair)
+            chargeProd = blend(chargeProd, chargeProd*lambdaElectrostatics, alchemicalPair);
+        if (COMPUTE_FORCES) {
+            dEdR += chargeProd*inverseR*ewaldScaleFunction(r);
+            dEdR *= inverseR*inverseR;
+        }
 
         // Accumulate energies.
 
@@ -249,27 +330,43 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             *totalEnergy += dot4(energy, one);
         }
 
+        // Accumulate derivatives with respect to the lambdas.
+
+        if (lambdaDerivatives && anyAlchemicalPair) {
+            dEdLambdaElectrostatics += blend(0.0f, unscaledChargeProd*inverseR*erfcApprox(alphaEwald*r), alchemicalPair);
+            dEdLambdaSterics += ljDEdLambda;
+        }
+
         // Accumulate forces.
 
-        dEdR = blend(0.0f, dEdR, include);
-        fvec4 fx = dx*dEdR;
-        fvec4 fy = dy*dEdR;
-        fvec4 fz = dz*dEdR;
-        blockAtomForceX += fx;
-        blockAtomForceY += fy;
-        blockAtomForceZ += fz;
-        float* atomForce = forces+4*atom;
-        atomForce[0] -= dot4(fx, one);
-        atomForce[1] -= dot4(fy, one);
-        atomForce[2] -= dot4(fz, one);
+        if (COMPUTE_FORCES) {
+            dEdR = blend(0.0f, dEdR, include);
+            fvec4 fx = dx*dEdR;
+            fvec4 fy = dy*dEdR;
+            fvec4 fz = dz*dEdR;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atom;
+            atomForce[0] -= dot4(fx, one);
+            atomForce[1] -= dot4(fy, one);
+            atomForce[2] -= dot4(fz, one);
+        }
     }
     
-    // Record the forces on the block atoms.
+    // Record the derivatives and the forces on the block atoms.
+
+    if (lambdaDerivatives) {
+        lambdaDerivatives[0] += dot4(dEdLambdaElectrostatics, fvec4(1.0f));
+        lambdaDerivatives[1] += dot4(dEdLambdaSterics, fvec4(1.0f));
+    }
     
-    fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
-    transpose(f[0], f[1], f[2], f[3]);
-    for (int j = 0; j < 4; j++)
-        (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    if (COMPUTE_FORCES) {
+        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+        transpose(f[0], f[1], f[2], f[3]);
+        for (int j = 0; j < 4; j++)
+            (fvec4(forces+4*(blockStart+j))+f[j]).store(forces+4*(blockStart+j));
+    }
 }
 
 template <bool TRICLINIC>
@@ -298,6 +395,16 @@ void CpuNonbondedForceVec4::getDeltaR(const float* posI, const fvec4& x, const f
     r2 = dx*dx + dy*dy + dz*dz;
 }
 
+void CpuNonbondedForceVec4::calculateSoftcoreIxn(const fvec4& sig6, const fvec4& eps, fvec4& energy, fvec4& dEdR, fvec4& dEdLambda) const {
+    // This is the same as CpuNonbondedForce::calculateSoftcoreIxn(), computed for 4 pairs at once.
+
+    fvec4 d = 1.0f/((softcoreAlpha*(1-lambdaSterics))*sig6+1.0f);
+    fvec4 u = sig6*d;
+    energy = lambdaSterics*eps*(u-1.0f)*u;
+    dEdR = (6*lambdaSterics)*eps*(2.0f*u-1.0f)*u*d;
+    dEdLambda = eps*((u-1.0f)*u + (lambdaSterics*softcoreAlpha)*(2.0f*u-1.0f)*u*u);
+}
+
 fvec4 CpuNonbondedForceVec4::erfcApprox(const fvec4& x) {
     // This approximation for erfc is from Abramowitz and Stegun (1964) p. 299.  They cite the following as
     // the original source: C. Hastings, Jr., Approximations for Digital Computers (1955).  It has a maximum
@@ -76,27 +76,38 @@ CpuNonbondedForce* createCpuNonbondedForceVec8() {
 CpuNonbondedForceVec8::CpuNonbondedForceVec8() {
 }
 
-void CpuNonbondedForceVec8::calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    if (triclinic)
-        calculateBlockIxnImpl<true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
-    else
-        calculateBlockIxnImpl<false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+void CpuNonbondedForceVec8::calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) {
+    if (triclinic) {
+        if (includeForces)
+            calculateBlockIxnImpl<true, true>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+        else
+            calculateBlockIxnImpl<true, false>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+    }
+    else {
+        if (includeForces)
+            calculateBlockIxnImpl<false, true>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+        else
+            calculateBlockIxnImpl<false, false>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+    }
 }
 
-template <bool TRICLINIC>
-void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    // Load the positions and parameters of the atoms in the block.
+template <bool TRICLINIC, bool COMPUTE_FORCES>
+void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) {
+    // Load the positions and parameters of the atoms in the block.  They are stored in sorted order, so
+    // the block's atoms are contiguous.
     
-    const int* blockAtom = &neighborList->getSortedAtoms()[8*blockIndex];
+    const int blockStart = 8*blockIndex;
     fvec4 blockAtomPosq[8];
     fvec8 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
     fvec8 blockAtomX, blockAtomY, blockAtomZ, blockAtomCharge;
     for (int i = 0; i < 8; i++)
-        blockAtomPosq[i] = fvec4(posq+4*blockAtom[i]);
+        blockAtomPosq[i] = fvec4(&sortedPosq[4*(blockStart+i)]);
     transpose(blockAtomPosq[0], blockAtomPosq[1], blockAtomPosq[2], blockAtomPosq[3], blockAtomPosq[4], blockAtomPosq[5], blockAtomPosq[6], blockAtomPosq[7], blockAtomX, blockAtomY, blockAtomZ, blockAtomCharge);
     blockAtomCharge *= ONE_4PI_EPS0;
-    fvec8 blockAtomSigma(atomParameters[blockAtom[0]].first, atomParameters[blockAtom[1]].first, atomParameters[blockAtom[2]].first, atomParameters[blockAtom[3]].first, atomParameters[blockAtom[4]].first, atomParameters[blockAtom[5]].first, atomParameters[blockAtom[6]].first, atomParameters[blockAtom[7]].first);
-    fvec8 blockAtomEpsilon(atomParameters[blockAtom[0]].second, atomParameters[blockAtom[1]].second, atomParameters[blockAtom[2]].second, atomParameters[blockAtom[3]].second, atomParameters[blockAtom[4]].second, atomParameters[blockAtom[5]].second, atomParameters[blockAtom[6]].second, atomParameters[blockAtom[7]].second);
+    fvec8 blockAtomSigma(sortedAtomParameters[blockStart].first, sortedAtomParameters[blockStart+1].first, sortedAtomParameters[blockStart+2].first, sortedAtomParameters[blockStart+3].first, sortedAtomParameters[blockStart+4].first, sortedAtomParameters[blockStart+5].first, sortedAtomParameters[blockStart+6].first, sortedAtomParameters[blockStart+7].first);
+    fvec8 blockAtomEpsilon(sortedAtomParameters[blockStart].second, sortedAtomParameters[blockStart+1].second, sortedAtomParameters[blockStart+2].second, sortedAtomParameters[blockStart+3].second, sortedAtomParameters[blockStart+4].second, sortedAtomParameters[blockStart+5].second, sortedAtomParameters[blockStart+6].second, sortedAtomParameters[blockStart+7].second);
+    fvec8 blockAtomIsAlchemical = (alchemical ? fvec8(&sortedIsAlchemical[blockStart]) : fvec8(0.0f));
+    fvec8 dEdLambdaElectrostatics(0.0f), dEdLambdaSterics(0.0f);
     bool needPeriodic = (periodic && (any(blockAtomX < cutoffDistance) || any(blockAtomY < cutoffDistance) || any(blockAtomZ < cutoffDistance) ||
             any(blockAtomX > boxSize[0]-cutoffDistance) || any(blockAtomY > boxSize[1]-cutoffDistance) || any(blockAtomZ > boxSize[2]-cutoffDistance)));
     const float invSwitchingInterval = 1/(cutoffDistance-switchingDistance);
@@ -113,7 +124,7 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
         // Compute the distances to the block atoms.
         
         fvec8 dx, dy, dz, r2;
-        getDeltaR<TRICLINIC>(&posq[4*atom], blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
+        getDeltaR<TRICLINIC>(&sortedPosq[4*atom], blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec8 include;
         char excl = exclusions[i];
         if (excl == 0)
@@ -128,34 +139,54 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
         
         fvec8 r = sqrt(r2);
         fvec8 inverseR = fvec8(1.0f)/r;
-        fvec8 energy, dEdR;
-        float atomEpsilon = atomParameters[atom].second;
+        ivec8 alchemicalPair = 0;
+        bool anyAlchemicalPair = false;
+        if (alchemical) {
+            alchemicalPair = include & (blockAtomIsAlchemical != sortedIsAlchemical[atom]);
+            anyAlchemicalPair = any(alchemicalPair);
+        }
+        fvec8 energy, dEdR, ljDEdLambda(0.0f);
+        float atomEpsilon = sortedAtomParameters[atom].second;
         if (atomEpsilon != 0.0f) {
-            fvec8 sig = blockAtomSigma+atomParameters[atom].first;
+            fvec8 sig = blockAtomSigma+sortedAtomParameters[atom].first;
             fvec8 sig2 = inverseR*sig;
             sig2 *= sig2;
             fvec8 sig6 = sig2*sig2*sig2;
             fvec8 epsSig6 = blockAtomEpsilon*atomEpsilon*sig6;
             dEdR = epsSig6*(12.0f*sig6 - 6.0f);
             energy = epsSig6*(sig6-1.0f);
+            if (anyAlchemicalPair) {
+                fvec8 softcoreEnergy, softcoreDEdR, softcoreDEdLambda;
+                calculateSoftcoreIxn(sig6, blockAtomEpsilon*atomEpsilon, softcoreEnergy, softcoreDEdR, softcoreDEdLambda);
+                energy = blend(energy, softcoreEnergy, alchemicalPair);
+                dEdR = blend(dEdR, softcoreDEdR, alchemicalPair);
+                ljDEdLambda = blend(0.0f, softcoreDEdLambda, alchemicalPair);
+            }
             if (useSwitch) {
                 fvec8 t = (r>switchingDistance) & ((r-switchingDistance)*invSwitchingInterval);
                 fvec8 switchValue = 1+t*t*t*(-10.0f+t*(15.0f-t*6.0f));
                 fvec8 switchDeriv = t*t*(-30.0f+t*(60.0f-t*30.0f))*invSwitchingInterval;
                 dEdR = switchValue*dEdR - energy*switchDeriv*r;
                 energy *= switchValue;
+                if (anyAlchemicalPair)
+                    ljDEdLambda *= switchValue;
             }
         }
         else {
             energy = 0.0f;
             dEdR = 0.0f;
         }
-        fvec8 chargeProd = blockAtomCharge*posq[4*atom+3];
-        if (cutoff)
-            dEdR += chargeProd*(inverseR-2.0f*krf*r2);
-        else
-            dEdR += chargeProd*inverseR;
-        dEdR *= inverseR*inverseR;
+        fvec8 chargeProd = blockAtomCharge*sortedPosq[4*atom+3];
+        fvec8 unscaledChargeProd = chargeProd;
+        if (anyAlchemicalPair)
+            chargeProd = blend(chargeProd, chargeProd*lambdaElectrostatics, alchemicalPair);
+        if (COMPUTE_FORCES) {
+            if (cutoff)
+                dEdR += chargeProd*(inverseR-2.0f*krf*r2);
+            else
+                dEdR += chargeProd*inverseR;
+            dEdR *= inverseR*inverseR;
+        }
 
         // Accumulate energies.
 
@@ -169,50 +200,80 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
             *totalEnergy += dot8(energy, one);
         }
 
+        // Accumulate derivatives with respect to the lambdas.
+
+        if (lambdaDerivatives && anyAlchemicalPair) {
+            if (cutoff)
+                dEdLambdaElectrostatics += blend(0.0f, unscaledChargeProd*(inverseR+krf*r2-crf), alchemicalPair);
+            else
+                dEdLambdaElectrostatics += blend(0.0f, unscaledChargeProd*inverseR, alchemicalPair);
+            dEdLambdaSterics += ljDEdLambda;
+        }
+
         // Accumulate forces.
 
-        dEdR = blend(0.0f, dEdR, include);
-        fvec8 fx = dx*dEdR;
-        fvec8 fy = dy*dEdR;
-        fvec8 fz = dz*dEdR;
-        blockAtomForceX += fx;
-        blockAtomForceY += fy;
-        blockAtomForceZ += fz;
-        float* atomForce = forces+4*atom;
-        atomForce[0] -= dot8(fx, one);
-        atomForce[1] -= dot8(fy, one);
-        atomForce[2] -= dot8(fz, one);
+        if (COMPUTE_FORCES) {
+            dEdR = blend(0.0f, dEdR, include);
+            fvec8 fx = dx*dEdR;
+            fvec8 fy = dy*dEdR;
+            fvec8 fz = dz*dEdR;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atom;
+            atomForce[0] -= dot8(fx, one);
+            atomForce[1] -= dot8(fy, one);
+            atomForce[2] -= dot8(fz, one);
+        }
     }
     
-    // Record the forces on the block atoms.
+    // Record the derivatives and the forces on the block atoms.
+
+    if (lambdaDerivatives) {
+        lambdaDerivatives[0] += dot8(dEdLambdaElectrostatics, fvec8(1.0f));
+        lambdaDerivatives[1] += dot8(dEdLambdaSterics, fvec8(1.0f));
+    }
 
-    fvec4 f[8];
-    transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
-    for (int j = 0; j < 8; j++)
-        (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    if (COMPUTE_FORCES) {
+        fvec4 f[8];
+        transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
+        for (int j = 0; j < 8; j++)
+            (fvec4(forces+4*(blockStart+j))+f[j]).store(forces+4*(blockStart+j));
+    }
   }
 
-void CpuNonbondedForceVec8::calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    if (triclinic)
-        calculateBlockEwaldIxnImpl<true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
-    else
-        calculateBlockEwaldIxnImpl<false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+void CpuNonbondedForceVec8::calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) {
+    if (triclinic) {
+        if (includeForces)
+            calculateBlockEwaldIxnImpl<true, true>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+        else
+            calculateBlockEwaldIxnImpl<true, false>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+    }
+    else {
+        if (includeForces)
+            calculateBlockEwaldIxnImpl<false, true>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+        else
+            calculateBlockEwaldIxnImpl<false, false>(blockIndex, forces, totalEnergy, lambdaDerivatives, boxSize, invBoxSize);
+    }
 }
 
-template <bool TRICLINIC>
-void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    // Load the positions and parameters of the atoms in the block.
+template <bool TRICLINIC, bool COMPUTE_FORCES>
+void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, double* lambdaDerivatives, const fvec4& boxSize, const fvec4& invBoxSize) {
+    // Load the positions and parameters of the atoms in the block.  They are stored in sorted order, so
+    // the block's atoms are contiguous.
     
-    const int* blockAtom = &neighborList->getSortedAtoms()[8*blockIndex];
+    const int blockStart = 8*blockIndex;
     fvec4 blockAtomPosq[8];
     fvec8 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
     fvec8 blockAtomX, blockAtomY, blockAtomZ, blockAtomCharge;
     for (int i = 0; i < 8; i++)
-        blockAtomPosq[i] = fvec4(posq+4*blockAtom[i]);
+        blockAtomPosq[i] = fvec4(&sortedPosq[4*(blockStart+i)]);
     transpose(blockAtomPosq[0], blockAtomPosq[1], blockAtomPosq[2], blockAtomPosq[3], blockAtomPosq[4], blockAtomPosq[5], blockAtomPosq[6], blockAtomPosq[7], blockAtomX, blockAtomY, blockAtomZ, blockAtomCharge);
     blockAtomCharge *= ONE_4PI_EPS0;
-    fvec8 blockAtomSigma(atomParameters[blockAtom[0]].first, atomParameters[blockAtom[1]].first, atomParameters[blockAtom[2]].first, atomParameters[blockAtom[3]].first, atomParameters[blockAtom[4]].first, atomParameters[blockAtom[5]].first, atomParameters[blockAtom[6]].first, atomParameters[blockAtom[7]].first);
-    fvec8 blockAtomEpsilon(atomParameters[blockAtom[0]].second, atomParameters[blockAtom[1]].second, atomParameters[blockAtom[2]].second, atomParameters[blockAtom[3]].second, atomParameters[blockAtom[4]].second, atomParameters[blockAtom[5]].second, atomParameters[blockAtom[6]].second, atomParameters[blockAtom[7]].second);
+    fvec8 blockAtomSigma(sortedAtomParameters[blockStart].first, sortedAtomParameters[blockStart+1].first, sortedAtomParameters[blockStart+2].first, sortedAtomParameters[blockStart+3].first, sortedAtomParameters[blockStart+4].first, sortedAtomParameters[blockStart+5].first, sortedAtomParameters[blockStart+6].first, sortedAtomParameters[blockStart+7].first);
+    fvec8 blockAtomEpsilon(sortedAtomParameters[blockStart].second, sortedAtomParameters[blockStart+1].second, sortedAtomParameters[blockStart+2].second, sortedAtomParameters[blockStart+3].second, sortedAtomParameters[blockStart+4].second, sortedAtomParameters[blockStart+5].second, sortedAtomParameters[blockStart+6].second, sortedAtomParameters[blockStart+7].second);
+    fvec8 blockAtomIsAlchemical = (alchemical ? fvec8(&sortedIsAlchemical[blockStart]) : fvec8(0.0f));
+    fvec8 dEdLambdaElectrostatics(0.0f), dEdLambdaSterics(0.0f);
     bool needPeriodic = (periodic && (any(blockAtomX < cutoffDistance) || any(blockAtomY < cutoffDistance) || any(blockAtomZ < cutoffDistance) ||
             any(blockAtomX > boxSize[0]-cutoffDistance) || any(blockAtomY > boxSize[1]-cutoffDistance) || any(blockAtomZ > boxSize[2]-cutoffDistance)));
     const float invSwitchingInterval = 1/(cutoffDistance-switchingDistance);
@@ -229,7 +290,7 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
         // Compute the distances to the block atoms.
         
         fvec8 dx, dy, dz, r2;
-        getDeltaR<TRICLINIC>(&posq[4*atom], blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
+        getDeltaR<TRICLINIC>(&sortedPosq[4*atom], blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec8 include;
         char excl = exclusions[i];
         if (excl == 0)
@@ -244,31 +305,51 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
         
         fvec8 r = sqrt(r2);
         fvec8 inverseR = fvec8(1.0f)/r;
-        fvec8 energy, dEdR;
-        float atomEpsilon = atomParameters[atom].second;
+        ivec8 alchemicalPair = 0;
+        bool anyAlchemicalPair = false;
+        if (alchemical) {
+            alchemicalPair = include & (blockAtomIsAlchemical != sortedIsAlchemical[atom]);
+            anyAlchemicalPair = any(alchemicalPair);
+        }
+        fvec8 energy, dEdR, ljDEdLambda(0.0f);
+        float atomEpsilon = sortedAtomParameters[atom].second;
         if (atomEpsilon != 0.0f) {
-            fvec8 sig = blockAtomSigma+atomParameters[atom].first;
+            fvec8 sig = blockAtomSigma+sortedAtomParameters[atom].first;
             fvec8 sig2 = inverseR*sig;
             sig2 *= sig2;
             fvec8 sig6 = sig2*sig2*sig2;
             fvec8 epsSig6 = blockAtomEpsilon*atomEpsilon*sig6;
             dEdR = epsSig6*(12.0f*sig6 - 6.0f);
             energy = epsSig6*(sig6-1.0f);
+            if (anyAlchemicalPair) {
+                fvec8 softcoreEnergy, softcoreDEdR, softcoreDEdLambda;
+                calculateSoftcoreIxn(sig6, blockAtomEpsilon*atomEpsilon, softcoreEnergy, softcoreDEdR, softcoreDEdLambda);
+                energy = blend(energy, softcoreEnergy, alchemicalPair);
+                dEdR = blend(dEdR, softcoreDEdR, alchemicalPair);
+                ljDEdLambda = blend(0.0f, softcoreDEdLambda, alchemicalPair);
+            }
             if (useSwitch) {
                 fvec8 t = (r>switchingDistance) & ((r-switchingDistance)*invSwitchingInterval);
                 fvec8 switchValue = 1+t*t*t*(-10.0f+t*(15.0f-t*6.0f));
                 fvec8 switchDeriv = t*t*(-30.0f+t*(60.0f-t*30.0f))*invSwitchingInterval;
                 dEdR = switchValue*dEdR - energy*switchDeriv*r;
                 energy *= switchValue;
+                if (anyAlchemicalPair)
+                    ljDEdLambda *= switchValue;
             }
         }
         else {
             energy = 0.0f;
             dEdR = 0.0f;
         }
-        fvec8 chargeProd = blockAtomCharge*posq[4*atom+3];
-        dEdR += chargeProd*inverseR*ewaldScaleFunction(r);
-        dEdR *= inverseR*inverseR;        
+        fvec8 chargeProd = blockAtomCharge*sortedPosq[4*atom+3];
+        fvec8 unscaledChargeProd = chargeProd;
+        if (anyAlchemicalPair)
+            chargeProd = blend(chargeProd, chargeProd*lambdaElectrostatics, alchemicalPair);
+        if (COMPUTE_FORCES) {
+            dEdR += chargeProd*inverseR*ewaldScaleFunction(r);
+            dEdR *= inverseR*inverseR;
+        }
 
         // Accumulate energies.
 
@@ -279,27 +360,43 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             *totalEnergy += dot8(energy, one);
         }
 
+        // Accumulate derivatives with respect to the lambdas.
+
+        if (lambdaDerivatives && anyAlchemicalPair) {
+            dEdLambdaElectrostatics += blend(0.0f, unscaledChargeProd*inverseR*erfcApprox(alphaEwald*r), alchemicalPair);
+            dEdLambdaSterics += ljDEdLambda;
+        }
+
         // Accumulate forces.
 
-        dEdR = blend(0.0f, dEdR, include);
-        fvec8 fx = dx*dEdR;
-        fvec8 fy = dy*dEdR;
-        fvec8 fz = dz*dEdR;
-        blockAtomForceX += fx;
-        blockAtomForceY += fy;
-        blockAtomForceZ += fz;
-        float* atomForce = forces+4*atom;
-        atomForce[0] -= dot8(fx, one);
-        atomForce[1] -= dot8(fy, one);
-        atomForce[2] -= dot8(fz, one);
+        if (COMPUTE_FORCES) {
+            dEdR = blend(0.0f, dEdR, include);
+            fvec8 fx = dx*dEdR;
+            fvec8 fy = dy*dEdR;
+            fvec8 fz = dz*dEdR;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atom;
+            atomForce[0] -= dot8(fx, one);
+            atomForce[1] -= dot8(fy, one);
+            atomForce[2] -= dot8(fz, one);
+        }
     }
     
-    // Record the forces on the block atoms.
+    // Record the derivatives and the forces on the block atoms.
+
+    if (lambdaDerivatives) {
+        lambdaDerivatives[0] += dot8(dEdLambdaElectrostatics, fvec8(1.0f));
+        lambdaDerivatives[1] += dot8(dEdLambdaSterics, fvec8(1.0f));
+    }
     
-    fvec4 f[8];
-    transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
-    for (int j = 0; j < 8; j++)
-        (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    if (COMPUTE_FORCES) {
+        fvec4 f[8];
+        transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
+        for (int j = 0; j < 8; j++)
+            (fvec4(forces+4*(blockStart+j))+f[j]).store(forces+4*(blockStart+j));
+    }
 }
 
 template <bool TRICLINIC>
@@ -328,6 +425,16 @@ void CpuNonbondedForceVec8::getDeltaR(const float* posI, const fvec8& x, const f
     r2 = dx*dx + dy*dy + dz*dz;
 }
 
+void CpuNonbondedForceVec8::calculateSoftcoreIxn(const fvec8& sig6, const fvec8& eps, fvec8& energy, fvec8& dEdR, fvec8& dEdLambda) const {
+    // This is the same as CpuNonbondedForce::calculateSoftcoreIxn(), computed for 8 pairs at once.
+
+    fvec8 d = 1.0f/((softcoreAlpha*(1-lambdaSterics))*sig6+1.0f);
+    fvec8 u = sig6*d;
+    energy = lambdaSterics*eps*(u-1.0f)*u;
+    dEdR = (6*lambdaSterics)*eps*(2.0f*u-1.0f)*u*d;
+    dEdLambda = eps*((u-1.0f)*u + (lambdaSterics*softcoreAlpha)*(2.0f*u-1.0f)*u*u);
+}
+
 fvec8 CpuNonbondedForceVec8::erfcApprox(const fvec8& x) {
     // This approximation for erfc is from Abramowitz and Stegun (1964) p. 299.  They cite the following as
     // the original source: C. Hastings, Jr., Approximations for Digital Computers (1955).  It has a maximum
@@ -34,10 +34,17 @@
 #include "CpuKernels.h"
 #include "CpuSETTLE.h"
 #include "ReferenceConstraints.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/internal/hardware.h"
 #include "openmm/internal/vectorize.h"
+#include <algorithm>
+#include <cstdio>
 #include <sstream>
 #include <stdlib.h>
+#ifdef __linux__
+    #include <pthread.h>
+    #include <sched.h>
+#endif
 
 using namespace OpenMM;
 using namespace std;
@@ -67,8 +74,13 @@ CpuPlatform::CpuPlatform() {
     registerKernelFactory(CalcCustomNonbondedForceKernel::Name(), factory);
     registerKernelFactory(CalcCustomManyParticleForceKernel::Name(), factory);
     registerKernelFactory(CalcGBSAOBCForceKernel::Name(), factory);
+    registerKernelFactory(CalcGBVIForceKernel::Name(), factory);
     registerKernelFactory(CalcCustomGBForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomExternalForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomCompoundBondForceKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateVariableLangevinStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateVariableVerletStepKernel::Name(), factory);
     platformProperties.push_back(CpuThreads());
     int threads = getNumProcessors();
     char* threadsEnv = getenv("OPENMM_CPU_THREADS");
@@ -77,22 +89,57 @@ CpuPlatform::CpuPlatform() {
     stringstream defaultThreads;
     defaultThreads << threads;
     setPropertyDefaultValue(CpuThreads(), defaultThreads.str());
+    platformProperties.push_back(CpuPrecision());
+    setPropertyDefaultValue(CpuPrecision(), "mixed");
+    platformProperties.push_back(CpuCollectStatistics());
+    setPropertyDefaultValue(CpuCollectStatistics(), "false");
+    platformProperties.push_back(CpuThreadPlacement());
+    setPropertyDefaultValue(CpuThreadPlacement(), "none");
+    platformProperties.push_back(CpuPmeTuning());
+    setPropertyDefaultValue(CpuPmeTuning(), "false");
 }
 
 const string& CpuPlatform::getPropertyValue(const Context& context, const string& property) const {
     const ContextImpl& impl = getContextImpl(context);
     const PlatformData& data = getPlatformData(impl);
+    if (property == CpuStatisticsReport()) {
+        // Generate the report now so it reflects the current values.
+
+        PlatformData& mutableData = *contextData[&impl];
+        mutableData.propertyValues[property] = data.statistics.createReport(data.threads.getThreadWaitTimes());
+    }
     map<string, string>::const_iterator value = data.propertyValues.find(property);
     if (value != data.propertyValues.end())
         return value->second;
     return ReferencePlatform::getPropertyValue(context, property);
 }
 
+const CpuStatistics& CpuPlatform::getStatistics(const Context& context) const {
+    return getPlatformData(getContextImpl(context)).statistics;
+}
+
+void CpuPlatform::resetStatistics(Context& context) const {
+    PlatformData& data = getPlatformData(getContextImpl(context));
+    data.statistics.reset();
+    data.threads.resetThreadWaitTimes();
+}
+
+void CpuPlatform::getLambdaDerivatives(const Context& context, double& dEdLambdaElectrostatics, double& dEdLambdaSterics) const {
+    const PlatformData& data = getPlatformData(getContextImpl(context));
+    if (data.useDoublePrecision)
+        throw OpenMMException("getLambdaDerivatives() is not supported when CpuPrecision is \"double\"");
+    dEdLambdaElectrostatics = data.lambdaDerivatives[0];
+    dEdLambdaSterics = data.lambdaDerivatives[1];
+}
+
 double CpuPlatform::getSpeed() const {
     return 10;
 }
 
 bool CpuPlatform::supportsDoublePrecision() const {
+    // This describes the default mode, in which forces are computed in single precision.  CpuPrecision=double
+    // does not change it, since it works by using the Reference kernels rather than the CPU ones.
+
     return false;
 }
 
@@ -106,8 +153,39 @@ void CpuPlatform::contextCreated(ContextImpl& context, const map<string, string>
             getPropertyDefaultValue(CpuThreads()) : properties.find(CpuThreads())->second);
     int numThreads;
     stringstream(threadsPropValue) >> numThreads;
-    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads);
+    string precisionPropValue = (properties.find(CpuPrecision()) == properties.end() ?
+            getPropertyDefaultValue(CpuPrecision()) : properties.find(CpuPrecision())->second);
+    transform(precisionPropValue.begin(), precisionPropValue.end(), precisionPropValue.begin(), ::tolower);
+    if (precisionPropValue == "single")
+        throw OpenMMException("CpuPrecision=single is not supported: the CPU platform always accumulates energies and integrates in double precision.  Use \"mixed\" instead.");
+    if (precisionPropValue != "mixed" && precisionPropValue != "double")
+        throw OpenMMException("Illegal value for CpuPrecision: "+precisionPropValue);
+    const string& statisticsPropValue = (properties.find(CpuCollectStatistics()) == properties.end() ?
+            getPropertyDefaultValue(CpuCollectStatistics()) : properties.find(CpuCollectStatistics())->second);
+    if (statisticsPropValue != "true" && statisticsPropValue != "false")
+        throw OpenMMException("Illegal value for CpuCollectStatistics: "+statisticsPropValue);
+    string placementPropValue = (properties.find(CpuThreadPlacement()) == properties.end() ?
+            getPropertyDefaultValue(CpuThreadPlacement()) : properties.find(CpuThreadPlacement())->second);
+    transform(placementPropValue.begin(), placementPropValue.end(), placementPropValue.begin(), ::tolower);
+    if (placementPropValue != "none" && placementPropValue != "compact" && placementPropValue != "spread")
+        throw OpenMMException("Illegal value for CpuThreadPlacement: "+placementPropValue);
+    const string& tuningPropValue = (properties.find(CpuPmeTuning()) == properties.end() ?
+            getPropertyDefaultValue(CpuPmeTuning()) : properties.find(CpuPmeTuning())->second);
+    if (tuningPropValue != "true" && tuningPropValue != "false")
+        throw OpenMMException("Illegal value for CpuPmeTuning: "+tuningPropValue);
+    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads, placementPropValue);
     contextData[&context] = data;
+    data->virtualSites = new CpuVirtualSites(context.getSystem(), data->threads);
+    if (statisticsPropValue == "true") {
+        data->statistics.setEnabled(true);
+        data->threads.setRecordWaitTimes(true);
+    }
+    data->useDoublePrecision = (precisionPropValue == "double");
+    data->propertyValues[CpuPrecision()] = precisionPropValue;
+    data->propertyValues[CpuCollectStatistics()] = statisticsPropValue;
+    data->tunePme = (tuningPropValue == "true");
+    data->propertyValues[CpuPmeTuning()] = tuningPropValue;
+    data->propertyValues[CpuPmeTuningReport()] = "";
     ReferenceConstraints& constraints = *(ReferenceConstraints*) reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData())->constraints;
     if (constraints.settle != NULL) {
         CpuSETTLE* parallelSettle = new CpuSETTLE(context.getSystem(), *(ReferenceSETTLEAlgorithm*) constraints.settle, data->threads);
@@ -130,13 +208,184 @@ const CpuPlatform::PlatformData& CpuPlatform::getPlatformData(const ContextImpl&
     return *contextData[&context];
 }
 
-CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads) : posq(4*numParticles), threads(numThreads) {
+/**
+ * Get the NUMA node containing each logical processor.  If this information is not available, every
+ * processor is assigned to node 0.
+ */
+static vector<int> getProcessorNodes(int numProcessors) {
+    vector<int> nodes(numProcessors, 0);
+#ifdef __linux__
+    for (int node = 0; ; node++) {
+        // Each node lists its processors as a set of ranges, such as "0-7,16-23".
+
+        char filename[100];
+        sprintf(filename, "/sys/devices/system/node/node%d/cpulist", node);
+        FILE* file = fopen(filename, "r");
+        if (file == NULL)
+            break;
+        int first, last;
+        while (fscanf(file, "%d", &first) == 1) {
+            last = first;
+            char separator = (char) fgetc(file);
+            if (separator == '-') {
+                if (fscanf(file, "%d", &last) != 1)
+                    break;
+                separator = (char) fgetc(file);
+            }
+            for (int i = first; i <= last && i < numProcessors; i++)
+                nodes[i] = node;
+            if (separator != ',')
+                break;
+        }
+        fclose(file);
+    }
+#endif
+    return nodes;
+}
+
+/**
+ * Get the logical processors the calling thread is allowed to run on.  Worker threads inherit this set, so
+ * they should only be pinned to processors in it.
+ */
+static vector<int> getAvailableProcessors() {
+    vector<int> processors;
+#ifdef __linux__
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+        for (int i = 0; i < CPU_SETSIZE; i++)
+            if (CPU_ISSET(i, &cpus))
+                processors.push_back(i);
+#endif
+    if (processors.size() == 0)
+        for (int i = 0; i < getNumProcessors(); i++)
+            processors.push_back(i);
+    return processors;
+}
+
+/**
+ * Select the processor each thread should run on for a placement policy.
+ */
+static vector<int> selectThreadProcessors(int numThreads, const string& placement) {
+    vector<int> available = getAvailableProcessors();
+    int numAvailable = available.size();
+    vector<int> nodes = getProcessorNodes(available[numAvailable-1]+1);
+    int numNodes = 0;
+    for (int i = 0; i < numAvailable; i++)
+        numNodes = max(numNodes, nodes[available[i]]+1);
+    vector<vector<int> > nodeProcessors(numNodes);
+    for (int i = 0; i < numAvailable; i++)
+        nodeProcessors[nodes[available[i]]].push_back(available[i]);
+    vector<int> order;
+    if (placement == "compact") {
+        for (int i = 0; i < numNodes; i++)
+            order.insert(order.end(), nodeProcessors[i].begin(), nodeProcessors[i].end());
+    }
+    else {
+        for (int i = 0; (int) order.size() < numAvailable; i++)
+            for (int j = 0; j < numNodes; j++)
+                if (i < (int) nodeProcessors[j].size())
+                    order.push_back(nodeProcessors[j][i]);
+    }
+    vector<int> processors(numThreads);
+    for (int i = 0; i < numThreads; i++)
+        processors[i] = order[i%numAvailable];
+    return processors;
+}
+
+/**
+ * This task pins each worker thread to a processor, then has it allocate and initialize its own force buffer.
+ * If a thread cannot be pinned, that is recorded in pinningFailed.
+ */
+class CpuPlatform::PlatformData::InitializeThreadsTask : public ThreadPool::Task {
+public:
+    InitializeThreadsTask(PlatformData& data, int numParticles, const vector<int>& processors) :
+            data(data), numParticles(numParticles), processors(processors), pinningFailed(data.threads.getNumThreads(), 0) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+#ifdef __linux__
+        if (processors.size() > 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(processors[threadIndex], &cpus);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+                pinningFailed[threadIndex] = 1;
+        }
+#endif
+        AlignedArray<float>& forces = data.threadForce[threadIndex];
+        forces.resize(4*numParticles);
+        for (int i = 0; i < 4*numParticles; i++)
+            forces[i] = 0.0f;
+    }
+    PlatformData& data;
+    int numParticles;
+    const vector<int>& processors;
+    vector<char> pinningFailed;
+};
+
+#ifdef __linux__
+/**
+ * This task sets the affinity of every worker thread to the same set of processors.  It is used to undo
+ * the placement if some threads could not be pinned.
+ */
+class SetAffinityTask : public ThreadPool::Task {
+public:
+    SetAffinityTask(const cpu_set_t& cpus) : cpus(cpus) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    const cpu_set_t& cpus;
+};
+#endif
+
+CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads, const string& threadPlacement) : posq(4*numParticles), threads(numThreads) {
     numThreads = threads.getNumThreads();
+    vector<int> processors;
+    if (threadPlacement != "none" && numThreads > 1)
+        processors = selectThreadProcessors(numThreads, threadPlacement);
     threadForce.resize(numThreads);
-    for (int i = 0; i < numThreads; i++)
-        threadForce[i].resize(4*numParticles);
+    InitializeThreadsTask task(*this, numParticles, processors);
+    threads.execute(task);
+    threads.waitForThreads();
+    string placement = threadPlacement;
+    if (find(task.pinningFailed.begin(), task.pinningFailed.end(), 1) != task.pinningFailed.end()) {
+        // Some threads could not be pinned, so let the operating system schedule all of them, and report
+        // that no placement is in effect.
+
+#ifdef __linux__
+        cpu_set_t cpus;
+        if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+            SetAffinityTask resetTask(cpus);
+            threads.execute(resetTask);
+            threads.waitForThreads();
+        }
+#endif
+        placement = "none";
+    }
     isPeriodic = false;
+    useDoublePrecision = false;
+    tunePme = false;
+    virtualSites = NULL;
+    lambdaDerivatives[0] = lambdaDerivatives[1] = 0.0;
     stringstream threadsProperty;
     threadsProperty << numThreads;
     propertyValues[CpuThreads()] = threadsProperty.str();
+    propertyValues[CpuThreadPlacement()] = placement;
+}
+
+CpuPlatform::PlatformData::~PlatformData() {
+    if (virtualSites != NULL)
+        delete virtualSites;
+    for (int i = 0; i < (int) exclusions.size(); i++)
+        delete exclusions[i];
+}
+
+const CpuExclusions& CpuPlatform::PlatformData::shareExclusions(CpuExclusions* exclusions) {
+    for (int i = 0; i < (int) this->exclusions.size(); i++)
+        if (*this->exclusions[i] == *exclusions) {
+            delete exclusions;
+            return *this->exclusions[i];
+        }
+    this->exclusions.push_back(exclusions);
+    return *exclusions;
 }
@@ -25,6 +25,7 @@
 #include "CpuRandom.h"
 #include "openmm/internal/OSRngSeed.h"
 #include "openmm/OpenMMException.h"
+#include "openmm/internal/vectorize.h"
 #include <cmath>
 
 using namespace std;
@@ -36,6 +37,8 @@ CpuRandom::CpuRandom() : hasInitialized(false) {
 CpuRandom::~CpuRandom() {
     for (int i = 0; i < (int) threadRandom.size(); i++)
         delete threadRandom[i];
+    for (int i = 0; i < (int) streamRandom.size(); i++)
+        delete streamRandom[i];
 }
 
 void CpuRandom::initialize(int seed, int numThreads) {
@@ -57,6 +60,15 @@ void CpuRandom::initialize(int seed, int numThreads) {
     unsigned int r = (unsigned int) seed;
     if (r == 0)
         r = (unsigned int) osrngseed();
+    
+    // Initialize the streams first, so their seeds do not depend on the number of threads.
+    
+    streamRandom.resize(NumStreams);
+    for (int i = 0; i < NumStreams; i++) {
+        r = (1664525*r + 1013904223) & 0xFFFFFFFF;
+        streamRandom[i] = new OpenMM_SFMT::SFMT();
+        init_gen_rand(r, *streamRandom[i]);
+    }
     for (int i = 0; i < numThreads; i++) {
         r = (1664525*r + 1013904223) & 0xFFFFFFFF;
         threadRandom[i] = new OpenMM_SFMT::SFMT();
@@ -87,3 +99,38 @@ float CpuRandom::getGaussianRandom(int threadIndex) {
 float CpuRandom::getUniformRandom(int threadIndex) {
     return genrand_real2(*threadRandom[threadIndex]);
 }
+
+void CpuRandom::fillGaussianRandom(int stream, float* values, int count) {
+    // Use the polar form of the Box-Muller transformation, processing four pairs of values at once.
+    // Any pair that is rejected is simply skipped.
+    
+    OpenMM_SFMT::SFMT& sfmt = *streamRandom[stream];
+    int index = 0;
+    float uniform[8], r2[4], logr2[4], x[4], y[4];
+    while (index < count) {
+        for (int i = 0; i < 8; i++)
+            uniform[i] = (float) genrand_real2(sfmt);
+        fvec4 xvec = fvec4(uniform)*2.0f-1.0f;
+        fvec4 yvec = fvec4(uniform+4)*2.0f-1.0f;
+        fvec4 r2vec = xvec*xvec + yvec*yvec;
+        r2vec.store(r2);
+        for (int i = 0; i < 4; i++) {
+            if (r2[i] >= 1.0f || r2[i] == 0.0f) {
+                r2[i] = 1.0f;
+                logr2[i] = 1.0f; // Flags this pair as rejected
+            }
+            else
+                logr2[i] = logf(r2[i]);
+        }
+        fvec4 multiplier = sqrt((fvec4(logr2)*-2.0f)/fvec4(r2));
+        (xvec*multiplier).store(x);
+        (yvec*multiplier).store(y);
+        for (int i = 0; i < 4 && index < count; i++) {
+            if (logr2[i] > 0.0f)
+                continue;
+            values[index++] = x[i];
+            if (index < count)
+                values[index++] = y[i];
+        }
+    }
+}
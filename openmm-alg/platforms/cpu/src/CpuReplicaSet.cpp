@@ -0,0 +1,138 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuReplicaSet.h"
+#include "openmm/OpenMMException.h"
+#include "gmx_atomic.h"
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuReplicaSet::ReplicaTask : public ThreadPool::Task {
+public:
+    ReplicaTask(CpuReplicaSet& owner) : owner(owner), errors(owner.getNumReplicas()) {
+        gmx_atomic_set(&counter, 0);
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        // Process replicas until they have all been claimed.  Exceptions cannot propagate out of a worker
+        // thread, so record them to be rethrown by the parent thread.
+
+        while (true) {
+            int replica = gmx_atomic_fetch_add(&counter, 1);
+            if (replica >= owner.getNumReplicas())
+                break;
+            try {
+                executeReplica(replica, owner.getContext(replica));
+            }
+            catch (const exception& ex) {
+                errors[replica] = ex.what();
+            }
+        }
+    }
+    virtual void executeReplica(int replica, Context& context) = 0;
+    CpuReplicaSet& owner;
+    gmx_atomic_t counter;
+    vector<string> errors;
+};
+
+class CpuReplicaSet::StepTask : public CpuReplicaSet::ReplicaTask {
+public:
+    StepTask(CpuReplicaSet& owner, int steps) : ReplicaTask(owner), steps(steps) {
+    }
+    void executeReplica(int replica, Context& context) {
+        context.getIntegrator().step(steps);
+    }
+    int steps;
+};
+
+class CpuReplicaSet::EnergyTask : public CpuReplicaSet::ReplicaTask {
+public:
+    EnergyTask(CpuReplicaSet& owner, int groups) : ReplicaTask(owner), groups(groups), energies(owner.getNumReplicas()) {
+    }
+    void executeReplica(int replica, Context& context) {
+        energies[replica] = context.getState(State::Energy, false, groups).getPotentialEnergy();
+    }
+    int groups;
+    vector<double> energies;
+};
+
+CpuReplicaSet::CpuReplicaSet(const System& system, const vector<Integrator*>& integrators, CpuPlatform& platform,
+        const map<string, string>& properties, int numThreads) : threads(numThreads), hasInitializedKernels(false) {
+    // Each Context gets a single threaded pool, which executes its tasks inline on the calling thread.
+    // Its calculations therefore run directly on the worker that claims the replica.
+
+    map<string, string> replicaProperties = properties;
+    replicaProperties[CpuPlatform::CpuThreads()] = "1";
+    try {
+        for (int i = 0; i < (int) integrators.size(); i++)
+            contexts.push_back(new Context(system, *integrators[i], platform, replicaProperties));
+    }
+    catch (...) {
+        for (int i = 0; i < (int) contexts.size(); i++)
+            delete contexts[i];
+        throw;
+    }
+}
+
+CpuReplicaSet::~CpuReplicaSet() {
+    for (int i = 0; i < (int) contexts.size(); i++)
+        delete contexts[i];
+}
+
+void CpuReplicaSet::step(int steps) {
+    StepTask task(*this, steps);
+    execute(task);
+}
+
+vector<double> CpuReplicaSet::getPotentialEnergies(int groups) {
+    EnergyTask task(*this, groups);
+    execute(task);
+    return task.energies;
+}
+
+void CpuReplicaSet::execute(ReplicaTask& task) {
+    if (!hasInitializedKernels) {
+        // Some kernels finish setting themselves up the first time they are executed, and that is not
+        // always safe to do for several Contexts at once.  For example, the optimized PME implementation
+        // creates FFTW plans.  Evaluate each replica once on this thread, so the workers only ever run
+        // kernels that are fully initialized.  This is done here rather than in the constructor so that
+        // the replicas already have their real positions.
+
+        for (int i = 0; i < (int) contexts.size(); i++)
+            contexts[i]->getState(State::Energy);
+        hasInitializedKernels = true;
+    }
+    threads.execute(task);
+    threads.waitForThreads();
+    for (int i = 0; i < (int) task.errors.size(); i++)
+        if (task.errors[i].size() > 0)
+            throw OpenMMException(task.errors[i]);
+}
@@ -0,0 +1,105 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuStatistics.h"
+#include <sstream>
+#ifdef WIN32
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <sys/time.h>
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+CpuStatistics::CpuStatistics() : enabled(false), counts(NumCounters, 0), times(NumTimers, 0.0) {
+}
+
+void CpuStatistics::setEnabled(bool enabled) {
+    this->enabled = enabled;
+}
+
+void CpuStatistics::reset() {
+    for (int i = 0; i < NumCounters; i++)
+        counts[i] = 0;
+    for (int i = 0; i < NumTimers; i++)
+        times[i] = 0.0;
+}
+
+long long CpuStatistics::getCount(Counter counter) const {
+    return counts[counter];
+}
+
+double CpuStatistics::getTime(Timer timer) const {
+    return times[timer];
+}
+
+const string& CpuStatistics::getCounterName(Counter counter) {
+    static const string names[] = {"ForceEvaluations", "NeighborListBuilds", "PairsEvaluated", "ConstraintIterations"};
+    return names[counter];
+}
+
+const string& CpuStatistics::getTimerName(Timer timer) {
+    static const string names[] = {"ForceComputation", "InitForces", "SumForces", "NeighborList", "NonbondedDirect", "NonbondedExceptions",
+            "NonbondedReciprocal", "PmeWait", "BondedForces", "CustomForces", "ImplicitSolvent", "Integration"};
+    return names[timer];
+}
+
+#ifdef WIN32
+double CpuStatistics::getCurrentTime() {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart/(double) frequency.QuadPart;
+}
+#else
+double CpuStatistics::getCurrentTime() {
+    struct timeval tod;
+    gettimeofday(&tod, 0);
+    return tod.tv_sec+1e-6*tod.tv_usec;
+}
+#endif
+
+string CpuStatistics::createReport(const vector<double>& threadWaitTimes) const {
+    // Each line has the form "name: value".  Times are reported in milliseconds.
+
+    stringstream report;
+    for (int i = 0; i < NumCounters; i++)
+        report << getCounterName((Counter) i) << ": " << counts[i] << "\n";
+    for (int i = 0; i < NumTimers; i++)
+        report << getTimerName((Timer) i) << ": " << 1000*times[i] << "\n";
+    report << "ThreadWaitTime:";
+    for (int i = 0; i < (int) threadWaitTimes.size(); i++)
+        report << " " << 1000*threadWaitTimes[i];
+    report << "\n";
+    return report.str();
+}
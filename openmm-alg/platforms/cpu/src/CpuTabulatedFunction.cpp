@@ -0,0 +1,397 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuTabulatedFunction.h"
+#include "ReferenceTabulatedFunction.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/SplineFitter.h"
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+using Lepton::CustomFunction;
+
+CustomFunction* OpenMM::createCpuTabulatedFunction(const TabulatedFunction& function) {
+    if (dynamic_cast<const Continuous1DFunction*>(&function) != NULL)
+        return new CpuContinuous1DFunction(dynamic_cast<const Continuous1DFunction&>(function));
+    if (dynamic_cast<const Continuous2DFunction*>(&function) != NULL)
+        return new CpuContinuous2DFunction(dynamic_cast<const Continuous2DFunction&>(function));
+    if (dynamic_cast<const Continuous3DFunction*>(&function) != NULL)
+        return new CpuContinuous3DFunction(dynamic_cast<const Continuous3DFunction&>(function));
+    return createReferenceTabulatedFunction(function);
+}
+
+/**
+ * Find the grid interval containing a point, and the fractional position of the point within it.
+ * The caller must already have checked that the point lies inside the grid.
+ */
+static inline int findInterval(double t, double min, double invDelta, int numIntervals, double& fraction) {
+    double scaled = (t-min)*invDelta;
+    int index = (int) scaled;
+    if (index >= numIntervals)
+        index = numIntervals-1;
+    fraction = scaled-index;
+    return index;
+}
+
+/**
+ * Copy the contents of one AlignedArray into another.
+ */
+template <class T>
+static void copyArray(const AlignedArray<T>& source, AlignedArray<T>& dest) {
+    dest.resize(source.size());
+    for (int i = 0; i < source.size(); i++)
+        dest[i] = source[i];
+}
+
+CpuContinuous1DFunction::CpuContinuous1DFunction(const Continuous1DFunction& function) {
+    vector<double> values, derivs;
+    function.getFunctionParameters(values, min, max);
+    int numValues = values.size();
+    vector<double> x(numValues);
+    for (int i = 0; i < numValues; i++)
+        x[i] = min+i*(max-min)/(numValues-1);
+    SplineFitter::createNaturalSpline(x, values, derivs);
+
+    // Convert the spline on each interval to a cubic polynomial in the fractional position s:
+    // f = c0 + s*(c1 + s*(c2 + s*c3)).
+
+    numIntervals = numValues-1;
+    double delta = (max-min)/numIntervals;
+    invDelta = 1.0/delta;
+    double scale = delta*delta/6.0;
+    coeff.resize(4*numIntervals);
+    for (int i = 0; i < numIntervals; i++) {
+        coeff[4*i] = values[i];
+        coeff[4*i+1] = values[i+1]-values[i]-scale*(2.0*derivs[i]+derivs[i+1]);
+        coeff[4*i+2] = 3.0*scale*derivs[i];
+        coeff[4*i+3] = scale*(derivs[i+1]-derivs[i]);
+    }
+}
+
+CpuContinuous1DFunction::CpuContinuous1DFunction(const CpuContinuous1DFunction& function) : numIntervals(function.numIntervals),
+        min(function.min), max(function.max), invDelta(function.invDelta) {
+    copyArray(function.coeff, coeff);
+}
+
+int CpuContinuous1DFunction::getNumArguments() const {
+    return 1;
+}
+
+double CpuContinuous1DFunction::evaluate(const double* arguments) const {
+    double t = arguments[0];
+    if (t < min || t > max)
+        return 0.0;
+    double s;
+    const double* c = &coeff[4*findInterval(t, min, invDelta, numIntervals, s)];
+    return c[0] + s*(c[1] + s*(c[2] + s*c[3]));
+}
+
+double CpuContinuous1DFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
+    double t = arguments[0];
+    if (t < min || t > max)
+        return 0.0;
+    double s;
+    const double* c = &coeff[4*findInterval(t, min, invDelta, numIntervals, s)];
+    return (c[1] + s*(2.0*c[2] + s*3.0*c[3]))*invDelta;
+}
+
+CustomFunction* CpuContinuous1DFunction::clone() const {
+    return new CpuContinuous1DFunction(*this);
+}
+
+void CpuContinuous1DFunction::getCoefficients(double& min, double& max, vector<double>& coefficients) const {
+    min = this->min;
+    max = this->max;
+    coefficients.resize(coeff.size());
+    for (int i = 0; i < coeff.size(); i++)
+        coefficients[i] = coeff[i];
+}
+
+CpuContinuous2DFunction::CpuContinuous2DFunction(const Continuous2DFunction& function) {
+    vector<double> values;
+    function.getFunctionParameters(xsize, ysize, values, xmin, xmax, ymin, ymax);
+    vector<double> x(xsize), y(ysize);
+    for (int i = 0; i < xsize; i++)
+        x[i] = xmin+i*(xmax-xmin)/(xsize-1);
+    for (int i = 0; i < ysize; i++)
+        y[i] = ymin+i*(ymax-ymin)/(ysize-1);
+    vector<vector<double> > c;
+    SplineFitter::create2DNaturalSpline(x, y, values, c);
+    invDeltaX = (xsize-1)/(xmax-xmin);
+    invDeltaY = (ysize-1)/(ymax-ymin);
+    coeff.resize(16*c.size());
+    for (int i = 0; i < (int) c.size(); i++)
+        for (int j = 0; j < 16; j++)
+            coeff[16*i+j] = c[i][j];
+}
+
+CpuContinuous2DFunction::CpuContinuous2DFunction(const CpuContinuous2DFunction& function) : xsize(function.xsize), ysize(function.ysize),
+        xmin(function.xmin), xmax(function.xmax), ymin(function.ymin), ymax(function.ymax), invDeltaX(function.invDeltaX), invDeltaY(function.invDeltaY) {
+    copyArray(function.coeff, coeff);
+}
+
+int CpuContinuous2DFunction::getNumArguments() const {
+    return 2;
+}
+
+double CpuContinuous2DFunction::evaluate(const double* arguments) const {
+    double u = arguments[0];
+    if (u < xmin || u > xmax)
+        return 0.0;
+    double v = arguments[1];
+    if (v < ymin || v > ymax)
+        return 0.0;
+    double da, db;
+    int lowerx = findInterval(u, xmin, invDeltaX, xsize-1, da);
+    int lowery = findInterval(v, ymin, invDeltaY, ysize-1, db);
+    const double* c = &coeff[16*(lowerx+(xsize-1)*lowery)];
+    double value = 0;
+    for (int i = 3; i >= 0; i--)
+        value = da*value + ((c[i*4+3]*db + c[i*4+2])*db + c[i*4+1])*db + c[i*4+0];
+    return value;
+}
+
+double CpuContinuous2DFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
+    double u = arguments[0];
+    if (u < xmin || u > xmax)
+        return 0.0;
+    double v = arguments[1];
+    if (v < ymin || v > ymax)
+        return 0.0;
+    double da, db;
+    int lowerx = findInterval(u, xmin, invDeltaX, xsize-1, da);
+    int lowery = findInterval(v, ymin, invDeltaY, ysize-1, db);
+    const double* c = &coeff[16*(lowerx+(xsize-1)*lowery)];
+    if (derivOrder[0] == 1 && derivOrder[1] == 0) {
+        double dx = 0;
+        for (int i = 3; i >= 0; i--)
+            dx = db*dx + (3.0*c[i+3*4]*da + 2.0*c[i+2*4])*da + c[i+1*4];
+        return dx*invDeltaX;
+    }
+    if (derivOrder[0] == 0 && derivOrder[1] == 1) {
+        double dy = 0;
+        for (int i = 3; i >= 0; i--)
+            dy = da*dy + (3.0*c[i*4+3]*db + 2.0*c[i*4+2])*db + c[i*4+1];
+        return dy*invDeltaY;
+    }
+    throw OpenMMException("CpuContinuous2DFunction: Unsupported derivative order");
+}
+
+CustomFunction* CpuContinuous2DFunction::clone() const {
+    return new CpuContinuous2DFunction(*this);
+}
+
+CpuContinuous3DFunction::CpuContinuous3DFunction(const Continuous3DFunction& function) {
+    vector<double> values;
+    function.getFunctionParameters(xsize, ysize, zsize, values, xmin, xmax, ymin, ymax, zmin, zmax);
+    vector<double> x(xsize), y(ysize), z(zsize);
+    for (int i = 0; i < xsize; i++)
+        x[i] = xmin+i*(xmax-xmin)/(xsize-1);
+    for (int i = 0; i < ysize; i++)
+        y[i] = ymin+i*(ymax-ymin)/(ysize-1);
+    for (int i = 0; i < zsize; i++)
+        z[i] = zmin+i*(zmax-zmin)/(zsize-1);
+    vector<vector<double> > c;
+    SplineFitter::create3DNaturalSpline(x, y, z, values, c);
+    invDeltaX = (xsize-1)/(xmax-xmin);
+    invDeltaY = (ysize-1)/(ymax-ymin);
+    invDeltaZ = (zsize-1)/(zmax-zmin);
+    coeff.resize(64*c.size());
+    floatCoeff.resize(64*c.size());
+    for (int i = 0; i < (int) c.size(); i++)
+        for (int j = 0; j < 64; j++) {
+            coeff[64*i+j] = c[i][j];
+            floatCoeff[64*i+j] = (float) c[i][j];
+        }
+}
+
+CpuContinuous3DFunction::CpuContinuous3DFunction(const CpuContinuous3DFunction& function) : xsize(function.xsize), ysize(function.ysize), zsize(function.zsize),
+        xmin(function.xmin), xmax(function.xmax), ymin(function.ymin), ymax(function.ymax), zmin(function.zmin), zmax(function.zmax),
+        invDeltaX(function.invDeltaX), invDeltaY(function.invDeltaY), invDeltaZ(function.invDeltaZ) {
+    copyArray(function.coeff, coeff);
+    copyArray(function.floatCoeff, floatCoeff);
+}
+
+int CpuContinuous3DFunction::getNumArguments() const {
+    return 3;
+}
+
+double CpuContinuous3DFunction::evaluate(const double* arguments) const {
+    double u = arguments[0];
+    if (u < xmin || u > xmax)
+        return 0.0;
+    double v = arguments[1];
+    if (v < ymin || v > ymax)
+        return 0.0;
+    double w = arguments[2];
+    if (w < zmin || w > zmax)
+        return 0.0;
+    double da, db, dc;
+    int lowerx = findInterval(u, xmin, invDeltaX, xsize-1, da);
+    int lowery = findInterval(v, ymin, invDeltaY, ysize-1, db);
+    int lowerz = findInterval(w, zmin, invDeltaZ, zsize-1, dc);
+    const double* c = &coeff[64*(lowerx+(xsize-1)*lowery+(xsize-1)*(ysize-1)*lowerz)];
+    double value[] = {0, 0, 0, 0};
+    for (int i = 3; i >= 0; i--) {
+        for (int j = 0; j < 4; j++) {
+            int base = 4*i + 16*j;
+            value[j] = db*value[j] + ((c[base+3]*da + c[base+2])*da + c[base+1])*da + c[base];
+        }
+    }
+    return value[0] + dc*(value[1] + dc*(value[2] + dc*value[3]));
+}
+
+double CpuContinuous3DFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
+    double u = arguments[0];
+    if (u < xmin || u > xmax)
+        return 0.0;
+    double v = arguments[1];
+    if (v < ymin || v > ymax)
+        return 0.0;
+    double w = arguments[2];
+    if (w < zmin || w > zmax)
+        return 0.0;
+    double da, db, dc;
+    int lowerx = findInterval(u, xmin, invDeltaX, xsize-1, da);
+    int lowery = findInterval(v, ymin, invDeltaY, ysize-1, db);
+    int lowerz = findInterval(w, zmin, invDeltaZ, zsize-1, dc);
+    const double* c = &coeff[64*(lowerx+(xsize-1)*lowery+(xsize-1)*(ysize-1)*lowerz)];
+    if (derivOrder[0] == 1 && derivOrder[1] == 0 && derivOrder[2] == 0) {
+        double derivx[] = {0, 0, 0, 0};
+        for (int i = 3; i >= 0; i--) {
+            for (int j = 0; j < 4; j++) {
+                int base = 4*i + 16*j;
+                derivx[j] = db*derivx[j] + (3.0*c[base+3]*da + 2.0*c[base+2])*da + c[base+1];
+            }
+        }
+        return (derivx[0] + dc*(derivx[1] + dc*(derivx[2] + dc*derivx[3])))*invDeltaX;
+    }
+    if (derivOrder[0] == 0 && derivOrder[1] == 1 && derivOrder[2] == 0) {
+        double derivy[] = {0, 0, 0, 0};
+        for (int i = 3; i >= 0; i--) {
+            for (int j = 0; j < 4; j++) {
+                int base = i + 16*j;
+                derivy[j] = da*derivy[j] + (3.0*c[base+12]*db + 2.0*c[base+8])*db + c[base+4];
+            }
+        }
+        return (derivy[0] + dc*(derivy[1] + dc*(derivy[2] + dc*derivy[3])))*invDeltaY;
+    }
+    if (derivOrder[0] == 0 && derivOrder[1] == 0 && derivOrder[2] == 1) {
+        double derivz[] = {0, 0, 0, 0};
+        for (int i = 3; i >= 0; i--) {
+            for (int j = 0; j < 4; j++) {
+                int base = 4*i + 16*j;
+                derivz[j] = db*derivz[j] + ((c[base+3]*da + c[base+2])*da + c[base+1])*da + c[base];
+            }
+        }
+        return (derivz[1] + dc*(2.0*derivz[2] + 3.0*dc*derivz[3]))*invDeltaZ;
+    }
+    throw OpenMMException("CpuContinuous3DFunction: Unsupported derivative order");
+}
+
+void CpuContinuous3DFunction::evaluateWithGradient(const double* arguments, double& value, double* gradient) const {
+    double u = arguments[0];
+    double v = arguments[1];
+    double w = arguments[2];
+    if (u < xmin || u > xmax || v < ymin || v > ymax || w < zmin || w > zmax) {
+        value = gradient[0] = gradient[1] = gradient[2] = 0.0;
+        return;
+    }
+    double da, db, dc;
+    int lowerx = findInterval(u, xmin, invDeltaX, xsize-1, da);
+    int lowery = findInterval(v, ymin, invDeltaY, ysize-1, db);
+    int lowerz = findInterval(w, zmin, invDeltaZ, zsize-1, dc);
+    const double* c = &coeff[64*(lowerx+(xsize-1)*lowery+(xsize-1)*(ysize-1)*lowerz)];
+    double values[] = {0, 0, 0, 0};
+    double derivx[] = {0, 0, 0, 0};
+    double derivy[] = {0, 0, 0, 0};
+    for (int i = 3; i >= 0; i--) {
+        for (int j = 0; j < 4; j++) {
+            int base = 4*i + 16*j;
+            values[j] = db*values[j] + ((c[base+3]*da + c[base+2])*da + c[base+1])*da + c[base];
+            derivx[j] = db*derivx[j] + (3.0*c[base+3]*da + 2.0*c[base+2])*da + c[base+1];
+            base = i + 16*j;
+            derivy[j] = da*derivy[j] + (3.0*c[base+12]*db + 2.0*c[base+8])*db + c[base+4];
+        }
+    }
+    value = values[0] + dc*(values[1] + dc*(values[2] + dc*values[3]));
+    gradient[0] = (derivx[0] + dc*(derivx[1] + dc*(derivx[2] + dc*derivx[3])))*invDeltaX;
+    gradient[1] = (derivy[0] + dc*(derivy[1] + dc*(derivy[2] + dc*derivy[3])))*invDeltaY;
+    gradient[2] = (values[1] + dc*(2.0*values[2] + 3.0*dc*values[3]))*invDeltaZ;
+}
+
+void CpuContinuous3DFunction::evaluateWithGradient(const fvec4& x, const fvec4& y, const fvec4& z, fvec4& value, fvec4* gradient) const {
+    // Points outside the grid are evaluated in the first cell, and their results are masked out at the end.
+
+    fvec4 inside = (x >= (float) xmin) & (x <= (float) xmax) & (y >= (float) ymin) & (y <= (float) ymax) & (z >= (float) zmin) & (z <= (float) zmax);
+    fvec4 scaledx = ((x-(float) xmin)*(float) invDeltaX) & inside;
+    fvec4 scaledy = ((y-(float) ymin)*(float) invDeltaY) & inside;
+    fvec4 scaledz = ((z-(float) zmin)*(float) invDeltaZ) & inside;
+    ivec4 lowerx = min(ivec4(scaledx), ivec4(xsize-2));
+    ivec4 lowery = min(ivec4(scaledy), ivec4(ysize-2));
+    ivec4 lowerz = min(ivec4(scaledz), ivec4(zsize-2));
+    fvec4 da = scaledx-fvec4(lowerx);
+    fvec4 db = scaledy-fvec4(lowery);
+    fvec4 dc = scaledz-fvec4(lowerz);
+    ivec4 cell = ivec4(64)*(lowerx+ivec4(xsize-1)*lowery+ivec4((xsize-1)*(ysize-1))*lowerz);
+
+    // Gather the coefficients so that c[k] holds coefficient k of each point's cell.
+
+    fvec4 c[64];
+    for (int k = 0; k < 64; k += 4) {
+        c[k] = fvec4(&floatCoeff[cell[0]+k]);
+        c[k+1] = fvec4(&floatCoeff[cell[1]+k]);
+        c[k+2] = fvec4(&floatCoeff[cell[2]+k]);
+        c[k+3] = fvec4(&floatCoeff[cell[3]+k]);
+        transpose(c[k], c[k+1], c[k+2], c[k+3]);
+    }
+    fvec4 values[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    fvec4 derivx[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    fvec4 derivy[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 3; i >= 0; i--) {
+        for (int j = 0; j < 4; j++) {
+            int base = 4*i + 16*j;
+            values[j] = db*values[j] + ((c[base+3]*da + c[base+2])*da + c[base+1])*da + c[base];
+            derivx[j] = db*derivx[j] + (3.0f*c[base+3]*da + 2.0f*c[base+2])*da + c[base+1];
+            base = i + 16*j;
+            derivy[j] = da*derivy[j] + (3.0f*c[base+12]*db + 2.0f*c[base+8])*db + c[base+4];
+        }
+    }
+    value = (values[0] + dc*(values[1] + dc*(values[2] + dc*values[3]))) & inside;
+    gradient[0] = ((derivx[0] + dc*(derivx[1] + dc*(derivx[2] + dc*derivx[3])))*(float) invDeltaX) & inside;
+    gradient[1] = ((derivy[0] + dc*(derivy[1] + dc*(derivy[2] + dc*derivy[3])))*(float) invDeltaY) & inside;
+    gradient[2] = ((values[1] + dc*(2.0f*values[2] + 3.0f*dc*values[3]))*(float) invDeltaZ) & inside;
+}
+
+CustomFunction* CpuContinuous3DFunction::clone() const {
+    return new CpuContinuous3DFunction(*this);
+}
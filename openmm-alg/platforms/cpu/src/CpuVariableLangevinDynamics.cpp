@@ -0,0 +1,174 @@
+
+/* Portions copyright (c) 2015 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "SimTKOpenMMUtilities.h"
+#include "CpuVariableLangevinDynamics.h"
+#include <algorithm>
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuVariableLangevinDynamics::ComputeErrorTask : public ThreadPool::Task {
+public:
+    ComputeErrorTask(CpuVariableLangevinDynamics& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadComputeError(threadIndex);
+    }
+    CpuVariableLangevinDynamics& owner;
+};
+
+class CpuVariableLangevinDynamics::Update1Task : public ThreadPool::Task {
+public:
+    Update1Task(CpuVariableLangevinDynamics& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadUpdate1(threadIndex);
+    }
+    CpuVariableLangevinDynamics& owner;
+};
+
+class CpuVariableLangevinDynamics::Update2Task : public ThreadPool::Task {
+public:
+    Update2Task(CpuVariableLangevinDynamics& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadUpdate2(threadIndex);
+    }
+    CpuVariableLangevinDynamics& owner;
+};
+
+CpuVariableLangevinDynamics::CpuVariableLangevinDynamics(int numberOfAtoms, RealOpenMM tau, RealOpenMM temperature, RealOpenMM accuracy, ThreadPool& threads,
+            CpuRandom& random, CpuVirtualSites& virtualSites) : ReferenceVariableStochasticDynamics(numberOfAtoms, tau, temperature, accuracy),
+            threads(threads), random(random), virtualSites(virtualSites) {
+    int maxAtomsPerStream = numberOfAtoms/random.getNumStreams()+1;
+    threadError.resize(threads.getNumThreads());
+    threadNoise.resize(threads.getNumThreads());
+    for (int i = 0; i < (int) threadNoise.size(); i++)
+        threadNoise[i].resize(3*maxAtomsPerStream);
+}
+
+CpuVariableLangevinDynamics::~CpuVariableLangevinDynamics() {
+}
+
+void CpuVariableLangevinDynamics::update(const OpenMM::System& system, vector<RealVec>& atomCoordinates, vector<RealVec>& velocities,
+                                         vector<RealVec>& forces, vector<RealOpenMM>& masses, RealOpenMM maxStepSize, RealOpenMM tolerance) {
+    // Record the parameters for the threads.
+
+    numberOfAtoms = system.getNumParticles();
+    this->atomCoordinates = &atomCoordinates[0];
+    this->velocities = &velocities[0];
+    this->forces = &forces[0];
+    if (getTimeStep() == 0) {
+        for (int i = 0; i < numberOfAtoms; i++)
+            inverseMasses[i] = (masses[i] == 0 ? 0 : 1/masses[i]);
+    }
+
+    // Estimate the error, summing the contributions from the threads in a fixed order.
+
+    ComputeErrorTask errorTask(*this);
+    threads.execute(errorTask);
+    threads.waitForThreads();
+    RealOpenMM error = 0;
+    for (int i = 0; i < (int) threadError.size(); i++)
+        error += threadError[i];
+
+    // Select the step size to use.
+
+    error = SQRT(error/(numberOfAtoms*3));
+    RealOpenMM newStepSize = SQRT(getAccuracy()/error);
+    if (getDeltaT() > 0.0f)
+        newStepSize = min(newStepSize, getDeltaT()*2.0f); // For safety, limit how quickly dt can increase.
+    if (newStepSize > getDeltaT() && newStepSize < 1.2f*getDeltaT())
+        newStepSize = getDeltaT(); // Keeping dt constant between steps improves the behavior of the integrator.
+    if (newStepSize > maxStepSize)
+        newStepSize = maxStepSize;
+    setDeltaT(newStepSize);
+
+    // Update the velocities and compute the new positions, then apply constraints.
+
+    Update1Task task1(*this);
+    threads.execute(task1);
+    threads.waitForThreads();
+    ReferenceConstraintAlgorithm* referenceConstraintAlgorithm = getReferenceConstraintAlgorithm();
+    if (referenceConstraintAlgorithm)
+        referenceConstraintAlgorithm->apply(atomCoordinates, xPrime, inverseMasses, tolerance);
+    Update2Task task2(*this);
+    threads.execute(task2);
+    threads.waitForThreads();
+    virtualSites.computePositions(system, atomCoordinates);
+    incrementTimeStep();
+}
+
+void CpuVariableLangevinDynamics::threadComputeError(int threadIndex) {
+    int start = threadIndex*numberOfAtoms/threads.getNumThreads();
+    int end = (threadIndex+1)*numberOfAtoms/threads.getNumThreads();
+    double error = 0;
+    for (int i = start; i < end; i++) {
+        RealVec xerror = forces[i]*inverseMasses[i];
+        error += xerror.dot(xerror);
+    }
+    threadError[threadIndex] = error;
+}
+
+void CpuVariableLangevinDynamics::threadUpdate1(int threadIndex) {
+    const RealOpenMM dt = getDeltaT();
+    const RealOpenMM tau = getTau();
+    const RealOpenMM vscale = EXP(-dt/tau);
+    const RealOpenMM fscale = (1-vscale)*tau;
+    const RealOpenMM kT = BOLTZ*getTemperature();
+    const RealOpenMM noisescale = SQRT(2*kT/tau)*SQRT(0.5*(1-vscale*vscale)*tau);
+
+    // Each random number stream is always used for the same atoms, so the results do not depend on
+    // the number of threads.
+
+    int numStreams = random.getNumStreams();
+    int firstStream = threadIndex*numStreams/threads.getNumThreads();
+    int lastStream = (threadIndex+1)*numStreams/threads.getNumThreads();
+    float* noise = &threadNoise[threadIndex][0];
+    for (int stream = firstStream; stream < lastStream; stream++) {
+        int start, end;
+        random.getStreamRange(stream, numberOfAtoms, start, end);
+        random.fillGaussianRandom(stream, noise, 3*(end-start));
+        for (int i = start; i < end; i++) {
+            if (inverseMasses[i] != 0.0) {
+                RealOpenMM sqrtInvMass = SQRT(inverseMasses[i]);
+                float* atomNoise = &noise[3*(i-start)];
+                RealVec noiseVec(atomNoise[0], atomNoise[1], atomNoise[2]);
+                velocities[i] = velocities[i]*vscale + forces[i]*(fscale*inverseMasses[i]) + noiseVec*(noisescale*sqrtInvMass);
+                xPrime[i] = atomCoordinates[i]+velocities[i]*dt;
+            }
+        }
+    }
+}
+
+void CpuVariableLangevinDynamics::threadUpdate2(int threadIndex) {
+    int start = threadIndex*numberOfAtoms/threads.getNumThreads();
+    int end = (threadIndex+1)*numberOfAtoms/threads.getNumThreads();
+    for (int i = start; i < end; i++) {
+        if (inverseMasses[i] != 0.0)
+            atomCoordinates[i] = xPrime[i];
+    }
+}
@@ -0,0 +1,152 @@
+
+/* Portions copyright (c) 2015 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "SimTKOpenMMUtilities.h"
+#include "CpuVariableVerletDynamics.h"
+#include <algorithm>
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuVariableVerletDynamics::ComputeErrorTask : public ThreadPool::Task {
+public:
+    ComputeErrorTask(CpuVariableVerletDynamics& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadComputeError(threadIndex);
+    }
+    CpuVariableVerletDynamics& owner;
+};
+
+class CpuVariableVerletDynamics::Update1Task : public ThreadPool::Task {
+public:
+    Update1Task(CpuVariableVerletDynamics& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadUpdate1(threadIndex);
+    }
+    CpuVariableVerletDynamics& owner;
+};
+
+class CpuVariableVerletDynamics::Update2Task : public ThreadPool::Task {
+public:
+    Update2Task(CpuVariableVerletDynamics& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.threadUpdate2(threadIndex);
+    }
+    CpuVariableVerletDynamics& owner;
+};
+
+CpuVariableVerletDynamics::CpuVariableVerletDynamics(int numberOfAtoms, RealOpenMM accuracy, ThreadPool& threads, CpuVirtualSites& virtualSites) :
+        ReferenceVariableVerletDynamics(numberOfAtoms, accuracy), threads(threads), virtualSites(virtualSites) {
+    threadError.resize(threads.getNumThreads());
+}
+
+CpuVariableVerletDynamics::~CpuVariableVerletDynamics() {
+}
+
+void CpuVariableVerletDynamics::update(const OpenMM::System& system, vector<RealVec>& atomCoordinates, vector<RealVec>& velocities,
+                                       vector<RealVec>& forces, vector<RealOpenMM>& masses, RealOpenMM maxStepSize, RealOpenMM tolerance) {
+    // Record the parameters for the threads.
+
+    numberOfAtoms = system.getNumParticles();
+    this->atomCoordinates = &atomCoordinates[0];
+    this->velocities = &velocities[0];
+    this->forces = &forces[0];
+    if (getTimeStep() == 0) {
+        for (int i = 0; i < numberOfAtoms; i++)
+            inverseMasses[i] = (masses[i] == 0 ? 0 : 1/masses[i]);
+    }
+
+    // Estimate the error, summing the contributions from the threads in a fixed order.
+
+    ComputeErrorTask errorTask(*this);
+    threads.execute(errorTask);
+    threads.waitForThreads();
+    RealOpenMM error = 0;
+    for (int i = 0; i < (int) threadError.size(); i++)
+        error += threadError[i];
+
+    // Select the step size to use.
+
+    error = SQRT(error/(numberOfAtoms*3));
+    RealOpenMM newStepSize = SQRT(getAccuracy()/error);
+    if (getDeltaT() > 0.0f)
+        newStepSize = min(newStepSize, getDeltaT()*2.0f); // For safety, limit how quickly dt can increase.
+    if (newStepSize > getDeltaT() && newStepSize < 1.2f*getDeltaT())
+        newStepSize = getDeltaT(); // Keeping dt constant between steps improves the behavior of the integrator.
+    if (newStepSize > maxStepSize)
+        newStepSize = maxStepSize;
+    velocityStep = 0.5f*(newStepSize+getDeltaT()); // The time interval by which to advance the velocities
+    setDeltaT(newStepSize);
+
+    // Compute the new positions, apply constraints, and update the velocities.
+
+    Update1Task task1(*this);
+    threads.execute(task1);
+    threads.waitForThreads();
+    ReferenceConstraintAlgorithm* referenceConstraintAlgorithm = getReferenceConstraintAlgorithm();
+    if (referenceConstraintAlgorithm)
+        referenceConstraintAlgorithm->apply(atomCoordinates, xPrime, inverseMasses, tolerance);
+    Update2Task task2(*this);
+    threads.execute(task2);
+    threads.waitForThreads();
+    virtualSites.computePositions(system, atomCoordinates);
+    incrementTimeStep();
+}
+
+void CpuVariableVerletDynamics::threadComputeError(int threadIndex) {
+    int start = threadIndex*numberOfAtoms/threads.getNumThreads();
+    int end = (threadIndex+1)*numberOfAtoms/threads.getNumThreads();
+    double error = 0;
+    for (int i = start; i < end; i++) {
+        RealVec xerror = forces[i]*inverseMasses[i];
+        error += xerror.dot(xerror);
+    }
+    threadError[threadIndex] = error;
+}
+
+void CpuVariableVerletDynamics::threadUpdate1(int threadIndex) {
+    const RealOpenMM dt = getDeltaT();
+    int start = threadIndex*numberOfAtoms/threads.getNumThreads();
+    int end = (threadIndex+1)*numberOfAtoms/threads.getNumThreads();
+    for (int i = start; i < end; i++) {
+        if (inverseMasses[i] != 0.0)
+            xPrime[i] = atomCoordinates[i]+(velocities[i]+forces[i]*(inverseMasses[i]*velocityStep))*dt;
+    }
+}
+
+void CpuVariableVerletDynamics::threadUpdate2(int threadIndex) {
+    const RealOpenMM invStepSize = 1.0/getDeltaT();
+    int start = threadIndex*numberOfAtoms/threads.getNumThreads();
+    int end = (threadIndex+1)*numberOfAtoms/threads.getNumThreads();
+    for (int i = start; i < end; i++) {
+        if (inverseMasses[i] != 0.0) {
+            velocities[i] = (xPrime[i]-atomCoordinates[i])*invStepSize;
+            atomCoordinates[i] = xPrime[i];
+        }
+    }
+}
@@ -0,0 +1,134 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "CpuVirtualSites.h"
+#include "ReferenceVirtualSites.h"
+#include "openmm/VirtualSite.h"
+#include <map>
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuVirtualSites::ComputePositionsTask : public ThreadPool::Task {
+public:
+    ComputePositionsTask(const System& system, vector<RealVec>& atomCoordinates, const vector<int>& sites) :
+            system(system), atomCoordinates(atomCoordinates), sites(sites) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        // A virtual site may not depend on other virtual sites, so every site can be computed independently.
+        
+        int numSites = sites.size();
+        int start = threadIndex*numSites/threads.getNumThreads();
+        int end = (threadIndex+1)*numSites/threads.getNumThreads();
+        for (int i = start; i < end; i++)
+            ReferenceVirtualSites::computePosition(system, sites[i], atomCoordinates);
+    }
+    const System& system;
+    vector<RealVec>& atomCoordinates;
+    const vector<int>& sites;
+};
+
+class CpuVirtualSites::DistributeForcesTask : public ThreadPool::Task {
+public:
+    DistributeForcesTask(const System& system, const vector<RealVec>& atomCoordinates, vector<RealVec>& forces, const vector<vector<int> >& siteGroups) :
+            system(system), atomCoordinates(atomCoordinates), forces(forces), siteGroups(siteGroups) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        int numGroups = siteGroups.size();
+        int start = threadIndex*numGroups/threads.getNumThreads();
+        int end = (threadIndex+1)*numGroups/threads.getNumThreads();
+        for (int i = start; i < end; i++)
+            for (int j = 0; j < (int) siteGroups[i].size(); j++)
+                ReferenceVirtualSites::distributeForce(system, siteGroups[i][j], atomCoordinates, forces);
+    }
+    const System& system;
+    const vector<RealVec>& atomCoordinates;
+    vector<RealVec>& forces;
+    const vector<vector<int> >& siteGroups;
+};
+
+static int findRoot(vector<int>& parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+CpuVirtualSites::CpuVirtualSites(const System& system, ThreadPool& threads) : threads(threads) {
+    // Find the virtual sites, and use a union-find structure to identify which ones share particles.
+    
+    int numParticles = system.getNumParticles();
+    vector<int> parent(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        parent[i] = i;
+    for (int i = 0; i < numParticles; i++)
+        if (system.isVirtualSite(i)) {
+            sites.push_back(i);
+            const VirtualSite& site = system.getVirtualSite(i);
+            for (int j = 0; j < site.getNumParticles(); j++) {
+                int root1 = findRoot(parent, i);
+                int root2 = findRoot(parent, site.getParticle(j));
+                if (root1 != root2)
+                    parent[root2] = root1;
+            }
+        }
+    
+    // Build the groups.  Within each group, sites are processed in the same order as ReferenceVirtualSites
+    // processes them, so the results are identical.
+    
+    map<int, int> groupIndex;
+    for (int i = 0; i < (int) sites.size(); i++) {
+        int root = findRoot(parent, sites[i]);
+        if (groupIndex.find(root) == groupIndex.end()) {
+            groupIndex[root] = siteGroups.size();
+            siteGroups.push_back(vector<int>());
+        }
+        siteGroups[groupIndex[root]].push_back(sites[i]);
+    }
+}
+
+void CpuVirtualSites::computePositions(const System& system, vector<RealVec>& atomCoordinates) {
+    if (sites.empty())
+        return;
+    ComputePositionsTask task(system, atomCoordinates, sites);
+    threads.execute(task);
+    threads.waitForThreads();
+}
+
+void CpuVirtualSites::distributeForces(const System& system, const vector<RealVec>& atomCoordinates, vector<RealVec>& forces) {
+    if (sites.empty())
+        return;
+    DistributeForcesTask task(system, atomCoordinates, forces, siteGroups);
+    threads.execute(task);
+    threads.waitForThreads();
+}
@@ -0,0 +1,240 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the CPU implementation of CustomCompoundBondForce.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "CpuPlatform.h"
+#include "ReferencePlatform.h"
+#include "openmm/Context.h"
+#include "openmm/CustomCompoundBondForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * Compare the forces and energy computed by the CPU and Reference platforms.
+ */
+void compareToReference(const System& system, const vector<Vec3>& positions) {
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    CpuPlatform cpu;
+    ReferencePlatform reference;
+
+    // Use several threads even on a single core machine, so the division of work is tested.
+
+    map<string, string> properties;
+    properties["CpuThreads"] = "3";
+    Context cpuContext(system, integrator1, cpu, properties);
+    Context referenceContext(system, integrator2, reference);
+    cpuContext.setPositions(positions);
+    referenceContext.setPositions(positions);
+    State state1 = cpuContext.getState(State::Forces | State::Energy);
+    State state2 = referenceContext.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 1e-5);
+}
+
+/**
+ * Create a System containing randomly placed particles.
+ */
+void createParticles(System& system, vector<Vec3>& positions, int numParticles, double size) {
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        positions.push_back(Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*size);
+    }
+}
+
+/**
+ * Create a Continuous3DFunction describing a smooth grid potential.
+ */
+Continuous3DFunction* createGrid() {
+    const int xsize = 10, ysize = 11, zsize = 12;
+    vector<double> values(xsize*ysize*zsize);
+    for (int i = 0; i < xsize; i++)
+        for (int j = 0; j < ysize; j++)
+            for (int k = 0; k < zsize; k++)
+                values[i+xsize*j+xsize*ysize*k] = sin(0.5*i)*cos(0.4*j)+0.1*k*k;
+    return new Continuous3DFunction(xsize, ysize, zsize, values, 0.0, 3.0, 0.0, 3.5, 0.0, 4.0);
+}
+
+void testGridPotential() {
+    // Some particles are placed outside the grid, where the potential is zero.
+
+    System system;
+    vector<Vec3> positions;
+    createParticles(system, positions, 100, 4.5);
+    CustomCompoundBondForce* force = new CustomCompoundBondForce(1, "-2*weight*grid(x1,y1,z1)");
+    force->addPerBondParameter("weight");
+    force->addTabulatedFunction("grid", createGrid());
+    vector<int> particles(1);
+    vector<double> params(1);
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        particles[0] = i;
+        params[0] = 0.5+0.01*i;
+        force->addBond(particles, params);
+    }
+    system.addForce(force);
+    compareToReference(system, positions);
+}
+
+void testGlobalScale() {
+    System system;
+    vector<Vec3> positions;
+    createParticles(system, positions, 50, 3.0);
+    CustomCompoundBondForce* force = new CustomCompoundBondForce(1, "scale*grid(x1,y1,z1)");
+    force->addGlobalParameter("scale", 1.7);
+    force->addTabulatedFunction("grid", createGrid());
+    vector<int> particles(1);
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        particles[0] = i;
+        force->addBond(particles, vector<double>());
+    }
+    system.addForce(force);
+    compareToReference(system, positions);
+}
+
+void testRepeatedParticles() {
+    // Each particle appears in several bonds, so the work must be divided without two threads
+    // writing the same particle.
+
+    System system;
+    vector<Vec3> positions;
+    createParticles(system, positions, 40, 3.0);
+    CustomCompoundBondForce* force = new CustomCompoundBondForce(1, "weight*grid(x1,y1,z1)");
+    force->addPerBondParameter("weight");
+    force->addTabulatedFunction("grid", createGrid());
+    vector<int> particles(1);
+    vector<double> params(1);
+    for (int i = 0; i < 3*system.getNumParticles(); i++) {
+        particles[0] = (7*i)%system.getNumParticles();
+        params[0] = 0.2+0.01*i;
+        force->addBond(particles, params);
+    }
+    system.addForce(force);
+    compareToReference(system, positions);
+}
+
+void testUnknownScaleVariable() {
+    System system;
+    vector<Vec3> positions;
+    createParticles(system, positions, 10, 3.0);
+    CustomCompoundBondForce* force = new CustomCompoundBondForce(1, "scale*grid(x1,y1,z1)");
+    force->addTabulatedFunction("grid", createGrid());
+    vector<int> particles(1);
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        particles[0] = i;
+        force->addBond(particles, vector<double>());
+    }
+    system.addForce(force);
+    VerletIntegrator integrator(0.001);
+    CpuPlatform cpu;
+    Context context(system, integrator, cpu);
+    context.setPositions(positions);
+    bool threwException = false;
+    try {
+        context.getState(State::Energy);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testGeneralExpression() {
+    System system;
+    vector<Vec3> positions;
+    createParticles(system, positions, 50, 3.0);
+    CustomCompoundBondForce* force = new CustomCompoundBondForce(1, "k*grid(x1,y1,z1)^2+x1*y1");
+    force->addPerBondParameter("k");
+    force->addTabulatedFunction("grid", createGrid());
+    vector<int> particles(1);
+    vector<double> params(1);
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        particles[0] = i;
+        params[0] = 1.0+0.1*i;
+        force->addBond(particles, params);
+    }
+    system.addForce(force);
+    compareToReference(system, positions);
+}
+
+void testMultipleParticles() {
+    System system;
+    vector<Vec3> positions;
+    createParticles(system, positions, 30, 3.0);
+    CustomCompoundBondForce* force = new CustomCompoundBondForce(2, "k*(distance(p1,p2)-1)^2");
+    force->addPerBondParameter("k");
+    vector<int> particles(2);
+    vector<double> params(1, 2.0);
+    for (int i = 0; i < system.getNumParticles()-1; i++) {
+        particles[0] = i;
+        particles[1] = i+1;
+        force->addBond(particles, params);
+    }
+    system.addForce(force);
+    compareToReference(system, positions);
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testGridPotential();
+        testGlobalScale();
+        testRepeatedParticles();
+        testUnknownScaleVariable();
+        testGeneralExpression();
+        testMultipleParticles();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
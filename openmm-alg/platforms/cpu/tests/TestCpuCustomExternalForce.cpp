@@ -0,0 +1,119 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the CPU implementation of CustomExternalForce.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "CpuPlatform.h"
+#include "ReferencePlatform.h"
+#include "openmm/Context.h"
+#include "openmm/CustomExternalForce.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void testForce() {
+    const int numParticles = 200;
+    System system;
+    CustomExternalForce* force = new CustomExternalForce("scale*(k*((x-x0)^2+(y-y0)^2+(z-z0)^2)+sin(x*y)*z)");
+    force->addPerParticleParameter("k");
+    force->addPerParticleParameter("x0");
+    force->addPerParticleParameter("y0");
+    force->addPerParticleParameter("z0");
+    force->addGlobalParameter("scale", 0.5);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    vector<double> params(4);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        positions[i] = Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*5;
+        if (i%3 == 0)
+            continue;
+        params[0] = 1.0+genrand_real2(sfmt);
+        params[1] = genrand_real2(sfmt);
+        params[2] = genrand_real2(sfmt);
+        params[3] = genrand_real2(sfmt);
+        force->addParticle(i, params);
+    }
+    system.addForce(force);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    CpuPlatform cpu;
+    ReferencePlatform reference;
+    Context cpuContext(system, integrator1, cpu);
+    Context referenceContext(system, integrator2, reference);
+    for (int iteration = 0; iteration < 2; iteration++) {
+        cpuContext.setPositions(positions);
+        referenceContext.setPositions(positions);
+        cpuContext.setParameter("scale", 1.5*(iteration+1));
+        referenceContext.setParameter("scale", 1.5*(iteration+1));
+        State state1 = cpuContext.getState(State::Forces | State::Energy);
+        State state2 = referenceContext.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-5);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 1e-5);
+
+        // Modify the parameters and make sure they get updated.
+
+        for (int i = 0; i < force->getNumParticles(); i++) {
+            int particle;
+            force->getParticleParameters(i, particle, params);
+            params[0] *= 2.0;
+            force->setParticleParameters(i, particle, params);
+        }
+        force->updateParametersInContext(cpuContext);
+        force->updateParametersInContext(referenceContext);
+    }
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testForce();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -38,6 +38,7 @@
   #define _USE_MATH_DEFINES // Needed to get M_PI
 #endif
 #include "CpuPlatform.h"
+#include "ReferencePlatform.h"
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/Context.h"
 #include "openmm/CustomNonbondedForce.h"
@@ -321,6 +322,71 @@ void testContinuous1DFunction() {
     }
 }
 
+void testTabulatedPotential() {
+    // When the energy is a tabulated function of r, it is evaluated inline in the vectorized loop.
+    // Compare it to the Reference platform, and to the general expression path (which the extra
+    // global parameter forces it to use) in both rectangular and triclinic boxes.
+
+    const int numParticles = 300;
+    const double boxSize = 4.0;
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++)
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    vector<double> table;
+    for (int i = 0; i < 40; i++) {
+        double x = 0.1+0.03*i;
+        table.push_back(exp(-4*x)-0.5*exp(-2*x));
+    }
+    System system, generalSystem;
+    for (int general = 0; general < 2; general++) {
+        System& s = (general ? generalSystem : system);
+        CustomNonbondedForce* forceField = new CustomNonbondedForce(general ? "2.5*fn(r)*scale" : "2.5*fn(r)");
+        if (general)
+            forceField->addGlobalParameter("scale", 1.0);
+        forceField->addTabulatedFunction("fn", new Continuous1DFunction(table, 0.1, 1.27));
+        forceField->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+        forceField->setCutoffDistance(1.2);
+        forceField->setUseSwitchingFunction(true);
+        forceField->setSwitchingDistance(1.0);
+        for (int i = 0; i < numParticles; i++) {
+            s.addParticle(1.0);
+            forceField->addParticle(vector<double>());
+        }
+        for (int i = 0; i < numParticles; i += 2)
+            forceField->addExclusion(i, i+1);
+        s.addForce(forceField);
+    }
+    for (int triclinic = 0; triclinic < 2; triclinic++) {
+        Vec3 a(boxSize, 0, 0), b(triclinic ? 0.8 : 0.0, boxSize, 0), c(triclinic ? -0.5 : 0.0, triclinic ? 0.7 : 0.0, boxSize);
+        system.setDefaultPeriodicBoxVectors(a, b, c);
+        generalSystem.setDefaultPeriodicBoxVectors(a, b, c);
+        VerletIntegrator integrator1(0.01);
+        VerletIntegrator integrator2(0.01);
+        Context context(system, integrator1, platform);
+        Context generalContext(generalSystem, integrator2, platform);
+        context.setPositions(positions);
+        generalContext.setPositions(positions);
+        State state = context.getState(State::Forces | State::Energy);
+        State generalState = generalContext.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(generalState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-5);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(generalState.getForces()[i], state.getForces()[i], 1e-4);
+        ASSERT_EQUAL_TOL(generalState.getPotentialEnergy(), context.getState(State::Energy).getPotentialEnergy(), 1e-5);
+        if (!triclinic) {
+            VerletIntegrator integrator3(0.01);
+            ReferencePlatform reference;
+            Context referenceContext(system, integrator3, reference);
+            referenceContext.setPositions(positions);
+            State referenceState = referenceContext.getState(State::Forces | State::Energy);
+            ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+            for (int i = 0; i < numParticles; i++)
+                ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 1e-4);
+        }
+    }
+}
+
 void testContinuous2DFunction() {
     const int xsize = 20;
     const int ysize = 21;
@@ -913,6 +979,7 @@ int main() {
         testPeriodic();
         testTriclinic();
         testContinuous1DFunction();
+        testTabulatedPotential();
         testContinuous2DFunction();
         testContinuous3DFunction();
         testDiscrete1DFunction();
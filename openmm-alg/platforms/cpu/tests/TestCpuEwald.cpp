@@ -45,6 +45,7 @@
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
 #include <iostream>
+#include <map>
 #include <vector>
 
 using namespace OpenMM;
@@ -303,6 +304,43 @@ void testErrorTolerance(NonbondedForce::NonbondedMethod method) {
     }
 }
 
+void testEwaldThreadCountIndependence() {
+    // The reciprocal space sum is split between threads, but the result should not depend on the number of threads.
+
+    const int numParticles = 51;
+    const double boxWidth = 3.0;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 1.0 : -1.0, 0.2, 0.2);
+        positions[i] = Vec3(boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt));
+    }
+    nonbonded->setNonbondedMethod(NonbondedForce::Ewald);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setEwaldErrorTolerance(TOL);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    system.addForce(nonbonded);
+    vector<State> states;
+    const char* threadCounts[] = {"1", "2", "3", "5"};
+    for (int i = 0; i < 4; i++) {
+        VerletIntegrator integrator(0.01);
+        map<string, string> properties;
+        properties[CpuPlatform::CpuThreads()] = threadCounts[i];
+        Context context(system, integrator, platform, properties);
+        context.setPositions(positions);
+        states.push_back(context.getState(State::Forces | State::Energy));
+    }
+    for (int i = 1; i < (int) states.size(); i++) {
+        ASSERT_EQUAL_TOL(states[0].getPotentialEnergy(), states[i].getPotentialEnergy(), 1e-6);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(states[0].getForces()[j], states[i].getForces()[j], 1e-5);
+    }
+}
+
 int main(int argc, char* argv[]) {
     try {
         if (!CpuPlatform::isProcessorSupported()) {
@@ -315,6 +353,7 @@ int main(int argc, char* argv[]) {
         testTriclinic();
         testErrorTolerance(NonbondedForce::Ewald);
         testErrorTolerance(NonbondedForce::PME);
+        testEwaldThreadCountIndependence();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
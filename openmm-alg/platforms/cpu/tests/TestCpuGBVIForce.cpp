@@ -0,0 +1,173 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the CPU implementation of GBVIForce.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "CpuPlatform.h"
+#include "ReferencePlatform.h"
+#include "openmm/GBVIForce.h"
+#include "openmm/System.h"
+#include "openmm/LangevinIntegrator.h"
+#include "SimTKOpenMMRealType.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void testSingleParticle() {
+    CpuPlatform platform;
+    System system;
+    system.addParticle(2.0);
+    LangevinIntegrator integrator(0, 0.1, 0.01);
+    GBVIForce* forceField = new GBVIForce();
+    double charge = -1.0;
+    double radius = 0.15;
+    double gamma = 1.0;
+    forceField->addParticle(charge, radius, gamma);
+    system.addForce(forceField);
+    Context context(system, integrator, platform);
+    vector<Vec3> positions(1);
+    positions[0] = Vec3(0, 0, 0);
+    context.setPositions(positions);
+    State state = context.getState(State::Energy);
+    double bornRadius = radius;
+    double eps0 = EPSILON0;
+    double tau = (1.0/forceField->getSoluteDielectric()-1.0/forceField->getSolventDielectric());
+    double bornEnergy = (-charge*charge/(8*PI_M*eps0))*tau/bornRadius;
+    double nonpolarEnergy = -gamma*tau*std::pow(radius/bornRadius, 3.0);
+    ASSERT_EQUAL_TOL((bornEnergy+nonpolarEnergy), state.getPotentialEnergy(), 0.01);
+}
+
+void testForce(int numMolecules, GBVIForce::NonbondedMethod method, GBVIForce::BornRadiusScalingMethod scaling) {
+    CpuPlatform platform;
+    ReferencePlatform reference;
+    System system;
+    GBVIForce* gbvi = new GBVIForce();
+    int grid = (int) ceil(pow(numMolecules, 1.0/3.0));
+    double spacing = 0.6;
+    double boxSize = max(grid*spacing, 2.2);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+
+    // Each molecule has two bonded atoms of different sizes, so the scaled radii differ from the atomic radii.
+    // The bond lengths vary, so the smaller atom is buried to different degrees and every branch of the
+    // quintic spline is used.
+
+    vector<Vec3> positions(2*numMolecules);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    const double bondLengths[] = {0.11, 0.065, 0.04};
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        gbvi->addParticle(-0.5, 0.2, -0.3);
+        gbvi->addParticle(0.5, 0.1, 0.25);
+        double bondLength = bondLengths[i%3];
+        gbvi->addBond(2*i, 2*i+1, bondLength);
+        Vec3 site(i%grid, (i/grid)%grid, i/(grid*grid));
+        positions[2*i] = site*spacing + Vec3(0.3*genrand_real2(sfmt), 0.3*genrand_real2(sfmt), 0.3*genrand_real2(sfmt));
+        positions[2*i+1] = positions[2*i] + Vec3(bondLength, 0, 0);
+    }
+    gbvi->setNonbondedMethod(method);
+    gbvi->setCutoffDistance(1.0);
+    gbvi->setBornRadiusScalingMethod(scaling);
+    system.addForce(gbvi);
+    LangevinIntegrator integrator1(0, 0.1, 0.01);
+    LangevinIntegrator integrator2(0, 0.1, 0.01);
+    Context context(system, integrator1, platform);
+    Context refContext(system, integrator2, reference);
+    context.setPositions(positions);
+    refContext.setPositions(positions);
+    State state = context.getState(State::Forces | State::Energy);
+    State refState = refContext.getState(State::Forces | State::Energy);
+
+    // Make sure the CPU and Reference platforms agree.
+
+    double norm = 0.0;
+    double diff = 0.0;
+    for (int i = 0; i < system.getNumParticles(); ++i) {
+        Vec3 f = state.getForces()[i];
+        norm += f[0]*f[0] + f[1]*f[1] + f[2]*f[2];
+        Vec3 delta = f-refState.getForces()[i];
+        diff += delta[0]*delta[0] + delta[1]*delta[1] + delta[2]*delta[2];
+    }
+    norm = std::sqrt(norm);
+    diff = std::sqrt(diff);
+    ASSERT_EQUAL_TOL(0.0, diff, 0.001*norm);
+    ASSERT_EQUAL_TOL(refState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-3);
+
+    // Take a small step in the direction of the energy gradient and see whether the potential energy changes by the expected amount.
+    // (This doesn't work with cutoffs, since the energy changes discontinuously at the cutoff distance.)
+
+    if (method == GBVIForce::NoCutoff) {
+        const double delta = 1e-2;
+        double step = 0.5*delta/norm;
+        vector<Vec3> positions2(positions.size()), positions3(positions.size());
+        for (int i = 0; i < (int) positions.size(); ++i) {
+            Vec3 p = positions[i];
+            Vec3 f = state.getForces()[i];
+            positions2[i] = Vec3(p[0]-f[0]*step, p[1]-f[1]*step, p[2]-f[2]*step);
+            positions3[i] = Vec3(p[0]+f[0]*step, p[1]+f[1]*step, p[2]+f[2]*step);
+        }
+        context.setPositions(positions2);
+        State state2 = context.getState(State::Energy);
+        context.setPositions(positions3);
+        State state3 = context.getState(State::Energy);
+        ASSERT_EQUAL_TOL(norm, (state2.getPotentialEnergy()-state3.getPotentialEnergy())/delta, 1e-2)
+    }
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testSingleParticle();
+        for (int i = 2; i < 6; i++) {
+            testForce(i*i*i, GBVIForce::NoCutoff, GBVIForce::NoScaling);
+            testForce(i*i*i, GBVIForce::NoCutoff, GBVIForce::QuinticSpline);
+            testForce(i*i*i, GBVIForce::CutoffNonPeriodic, GBVIForce::QuinticSpline);
+            testForce(i*i*i, GBVIForce::CutoffPeriodic, GBVIForce::QuinticSpline);
+        }
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
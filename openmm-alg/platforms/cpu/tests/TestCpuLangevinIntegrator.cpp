@@ -43,6 +43,7 @@
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
 #include <iostream>
+#include <map>
 #include <vector>
 
 using namespace OpenMM;
@@ -262,6 +263,39 @@ void testRandomSeed() {
     }
 }
 
+void testThreadCountIndependence() {
+    // The trajectory for a given random seed should not depend on the number of threads.
+    
+    const int numParticles = 200;
+    System system;
+    NonbondedForce* forceField = new NonbondedForce();
+    system.addForce(forceField);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; ++i) {
+        system.addParticle(i%10 == 0 ? 0.0 : 2.0);
+        forceField->addParticle((i%2 == 0 ? 0.1 : -0.1), 0.3, 0.5);
+        positions[i] = Vec3(i%5, (i/5)%5, i/25)*0.5;
+    }
+    CpuPlatform platform;
+    vector<State> states;
+    const char* threadCounts[] = {"1", "2", "3", "5"};
+    for (int i = 0; i < 4; i++) {
+        LangevinIntegrator integrator(300.0, 5.0, 0.002);
+        integrator.setRandomNumberSeed(7);
+        map<string, string> properties;
+        properties[CpuPlatform::CpuThreads()] = threadCounts[i];
+        Context context(system, integrator, platform, properties);
+        context.setPositions(positions);
+        integrator.step(10);
+        states.push_back(context.getState(State::Positions | State::Velocities));
+    }
+    for (int i = 1; i < (int) states.size(); i++)
+        for (int j = 0; j < numParticles; j++) {
+            ASSERT_EQUAL_VEC(states[0].getPositions()[j], states[i].getPositions()[j], 1e-5);
+            ASSERT_EQUAL_VEC(states[0].getVelocities()[j], states[i].getVelocities()[j], 1e-5);
+        }
+}
+
 int main() {
     try {
         if (!CpuPlatform::isProcessorSupported()) {
@@ -273,6 +307,7 @@ int main() {
         testConstraints();
         testConstrainedMasslessParticles();
         testRandomSeed();
+        testThreadCountIndependence();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
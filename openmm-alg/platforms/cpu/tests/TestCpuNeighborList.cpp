@@ -36,6 +36,7 @@
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/internal/ThreadPool.h"
 #include "AlignedArray.h"
+#include "CpuExclusions.h"
 #include "CpuNeighborList.h"
 #include "CpuPlatform.h"
 #include "sfmt/SFMT.h"
@@ -48,6 +49,44 @@
 using namespace OpenMM;
 using namespace std;
 
+void testExclusions() {
+    const int numParticles = 20;
+    vector<pair<int, int> > excludedPairs;
+    excludedPairs.push_back(make_pair(5, 3));
+    excludedPairs.push_back(make_pair(3, 5));
+    excludedPairs.push_back(make_pair(3, 12));
+    excludedPairs.push_back(make_pair(3, 1));
+    excludedPairs.push_back(make_pair(7, 7));
+    excludedPairs.push_back(make_pair(19, 0));
+    CpuExclusions exclusions(numParticles, excludedPairs);
+    ASSERT_EQUAL(numParticles, exclusions.getNumAtoms());
+    ASSERT_EQUAL(4, exclusions.getNumExcludedPairs());
+    
+    // The exclusions for each atom should be sorted, with duplicates and self exclusions removed.
+    
+    ASSERT_EQUAL(3, exclusions.end(3)-exclusions.begin(3));
+    ASSERT_EQUAL(1, exclusions.begin(3)[0]);
+    ASSERT_EQUAL(5, exclusions.begin(3)[1]);
+    ASSERT_EQUAL(12, exclusions.begin(3)[2]);
+    ASSERT_EQUAL(0, exclusions.end(7)-exclusions.begin(7));
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < numParticles; j++) {
+            bool expected = false;
+            for (int k = 0; k < (int) excludedPairs.size(); k++)
+                if (i != j && ((excludedPairs[k].first == i && excludedPairs[k].second == j) || (excludedPairs[k].first == j && excludedPairs[k].second == i)))
+                    expected = true;
+            ASSERT_EQUAL(expected, exclusions.isExcluded(i, j));
+        }
+    
+    // Check comparisons.
+    
+    ASSERT(exclusions == CpuExclusions(numParticles, excludedPairs));
+    ThreadPool threads(3);
+    ASSERT(exclusions == CpuExclusions(numParticles, excludedPairs, threads));
+    ASSERT(!(exclusions == CpuExclusions(numParticles)));
+    ASSERT_EQUAL(0, CpuExclusions(numParticles).getNumExcludedPairs());
+}
+
 void testNeighborList(bool periodic, bool triclinic) {
     const int numParticles = 500;
     const float cutoff = 2.0f;
@@ -70,14 +109,13 @@ void testNeighborList(bool periodic, bool triclinic) {
     for (int i = 0; i < 4*numParticles; i++)
         if (i%4 < 3)
             positions[i] = boxSize[i%4]*genrand_real2(sfmt);
-    vector<set<int> > exclusions(numParticles);
+    vector<pair<int, int> > excludedPairs;
     for (int i = 0; i < numParticles; i++) {
         int num = min(i+1, 10);
-        for (int j = 0; j < num; j++) {
-            exclusions[i].insert(i-j);
-            exclusions[i-j].insert(i);
-        }
+        for (int j = 1; j < num; j++)
+            excludedPairs.push_back(make_pair(i, i-j));
     }
+    CpuExclusions exclusions(numParticles, excludedPairs);
     ThreadPool threads;
     CpuNeighborList neighborList(blockSize);
     neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoff, threads);
@@ -92,7 +130,7 @@ void testNeighborList(bool periodic, bool triclinic) {
         for (int j = 0; j < (int) neighborList.getBlockExclusions(blockIndex).size(); j++) {
             if ((neighborList.getBlockExclusions(blockIndex)[j] & mask) == 0) {
                 int atom1 = neighborList.getSortedAtoms()[i];
-                int atom2 = neighborList.getBlockNeighbors(blockIndex)[j];
+                int atom2 = neighborList.getSortedAtoms()[neighborList.getBlockNeighbors(blockIndex)[j]];
                 pair<int, int> entry = make_pair(min(atom1, atom2), max(atom1, atom2));
                 ASSERT(neighbors.find(entry) == neighbors.end() && neighbors.find(make_pair(entry.second, entry.first)) == neighbors.end()); // No duplicates
                 neighbors.insert(entry);
@@ -104,7 +142,7 @@ void testNeighborList(bool periodic, bool triclinic) {
 
     for (int i = 0; i < numParticles; i++)
         for (int j = 0; j <= i; j++) {
-            bool shouldInclude = (exclusions[i].find(j) == exclusions[i].end());
+            bool shouldInclude = (i != j && !exclusions.isExcluded(i, j));
             Vec3 diff(positions[4*i]-positions[4*j], positions[4*i+1]-positions[4*j+1], positions[4*i+2]-positions[4*j+2]);
             if (periodic) {
                 diff -= boxVectors[2]*floor(diff[2]/boxSize[2]+0.5);
@@ -125,6 +163,7 @@ int main() {
             cout << "CPU is not supported.  Exiting." << endl;
             return 0;
         }
+        testExclusions();
         testNeighborList(false, false);
         testNeighborList(true, false);
         testNeighborList(true, true);
@@ -39,6 +39,7 @@
 #include "ReferencePlatform.h"
 #include "openmm/HarmonicBondForce.h"
 #include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/LangevinIntegrator.h"
 #include "openmm/VerletIntegrator.h"
@@ -46,6 +47,8 @@
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
 #include <iostream>
+#include <map>
+#include <set>
 #include <vector>
 
 using namespace OpenMM;
@@ -188,6 +191,46 @@ void testExclusionsAnd14() {
     }
 }
 
+void testMany14WithThreads() {
+    // Create chains of particles with many 1-4 interactions, and make sure that dividing them
+    // between threads gives the same result as the Reference platform.
+    
+    const int numChains = 50;
+    const int chainLength = 20;
+    const int numParticles = numChains*chainLength;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    vector<Vec3> positions;
+    vector<pair<int, int> > bonds;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numChains; i++) {
+        for (int j = 0; j < chainLength; j++) {
+            system.addParticle(1.0);
+            nonbonded->addParticle(j%2 == 0 ? 0.5 : -0.5, 0.2, 0.5);
+            positions.push_back(Vec3(0.15*j+0.02*genrand_real2(sfmt), 2.0*i+0.05*genrand_real2(sfmt), 0.05*genrand_real2(sfmt)));
+            if (j > 0)
+                bonds.push_back(make_pair(i*chainLength+j-1, i*chainLength+j));
+        }
+    }
+    nonbonded->createExceptionsFromBonds(bonds, 0.8333, 0.5);
+    system.addForce(nonbonded);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = "4";
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    Context cpuContext(system, integrator1, platform, properties);
+    ReferencePlatform reference;
+    Context referenceContext(system, integrator2, reference);
+    cpuContext.setPositions(positions);
+    referenceContext.setPositions(positions);
+    State cpuState = cpuContext.getState(State::Forces | State::Energy);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], cpuState.getForces()[i], 1e-4);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), cpuState.getPotentialEnergy(), 1e-4);
+}
+
 void testCutoff() {
     System system;
     system.addParticle(1.0);
@@ -629,6 +672,81 @@ void testChangingParameters() {
     ASSERT_EQUAL_TOL(cpuState.getPotentialEnergy(), referenceState.getPotentialEnergy(), tol);
 }
 
+void testChangingSomeParameters() {
+    const int numMolecules = 300;
+    const int numParticles = numMolecules*3;
+    const double cutoff = 2.0;
+    const double boxSize = 15.0;
+    const double tol = 2e-3;
+    ReferencePlatform reference;
+    System system;
+    for (int i = 0; i < numParticles; i++)
+        system.addParticle(1.0);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        nonbonded->addParticle(-0.8, 0.2, 0.1);
+        nonbonded->addParticle(0.4, 0.1, 0.1);
+        nonbonded->addParticle(0.4, 0.1, 0.1);
+        positions[3*i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions[3*i+1] = Vec3(positions[3*i][0]+0.1, positions[3*i][1], positions[3*i][2]);
+        positions[3*i+2] = Vec3(positions[3*i][0], positions[3*i][1]+0.3, positions[3*i][2]);
+        nonbonded->addException(3*i, 3*i+1, 0.0, 0.15, 0.0);
+        nonbonded->addException(3*i+1, 3*i+2, 0.05, 0.15, 0.05);
+    }
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(cutoff);
+    nonbonded->setUseDispersionCorrection(true);
+    system.addForce(nonbonded);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    Context cpuContext(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    cpuContext.setPositions(positions);
+    referenceContext.setPositions(positions);
+    
+    // Modify a range of particles and exceptions, update only those in the CPU Context, and see if it agrees
+    // with a full update of the Reference Context.
+    
+    for (int step = 0; step < 3; step++) {
+        int firstParticle = 30+100*step, numChanged = 20;
+        for (int i = firstParticle; i < firstParticle+numChanged; i++) {
+            double charge, sigma, epsilon;
+            nonbonded->getParticleParameters(i, charge, sigma, epsilon);
+            nonbonded->setParticleParameters(i, 1.5*charge, 1.1*sigma, (step == 1 ? epsilon : 1.7*epsilon));
+        }
+        for (int i = firstParticle; i < firstParticle+numChanged; i++) {
+            int particle1, particle2;
+            double chargeProd, sigma, epsilon;
+            nonbonded->getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
+            if (chargeProd != 0.0 || epsilon != 0.0)
+                nonbonded->setExceptionParameters(i, particle1, particle2, 2.0*chargeProd, 1.2*sigma, 1.5*epsilon);
+        }
+        nonbonded->updateParametersInContext(cpuContext, firstParticle, numChanged, firstParticle, numChanged);
+        nonbonded->updateParametersInContext(referenceContext);
+        State cpuState = cpuContext.getState(State::Forces | State::Energy);
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[i], cpuState.getForces()[i], tol);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), cpuState.getPotentialEnergy(), tol);
+    }
+    
+    // Turning an excluded exception into a 1-4 interaction is not allowed.
+    
+    nonbonded->setExceptionParameters(0, 0, 1, 0.1, 0.15, 0.0);
+    bool threwException = false;
+    try {
+        nonbonded->updateParametersInContext(cpuContext, 0, 0, 0, 1);
+    }
+    catch (OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 void testSwitchingFunction(NonbondedForce::NonbondedMethod method) {
     System system;
     system.setDefaultPeriodicBoxVectors(Vec3(6, 0, 0), Vec3(0, 6, 0), Vec3(0, 0, 6));
@@ -684,6 +802,198 @@ void testSwitchingFunction(NonbondedForce::NonbondedMethod method) {
     }
 }
 
+void testEnergyOnly(NonbondedForce::NonbondedMethod method) {
+    // Computing only the energy should give the same result as computing forces and energy together.
+
+    const int numMolecules = 300;
+    const int numParticles = numMolecules*2;
+    const double boxSize = 5.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-1.0, 0.2, 0.1);
+        nonbonded->addParticle(1.0, 0.1, 0.1);
+        positions[2*i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions[2*i+1] = Vec3(positions[2*i][0]+0.1, positions[2*i][1], positions[2*i][2]);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 0.15, 0.0);
+    }
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    double energy = context.getState(State::Energy).getPotentialEnergy();
+    State state = context.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), energy, 1e-5);
+
+    // Make sure the forces are unaffected by a preceding energy-only evaluation.
+
+    context.getState(State::Energy);
+    State state2 = context.getState(State::Forces);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state.getForces()[i], state2.getForces()[i], 1e-5);
+}
+
+void testComputeEnergies(NonbondedForce::NonbondedMethod method) {
+    // Context::computeEnergies() uses the energy-only kernels.  Its results should match computing forces
+    // and energy together, and should leave the forces of later evaluations unaffected.
+
+    const int numMolecules = 300;
+    const int numParticles = numMolecules*2;
+    const double boxSize = 5.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    vector<vector<Vec3> > positions(2, vector<Vec3>(numParticles));
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-1.0, 0.2, 0.1);
+        nonbonded->addParticle(1.0, 0.1, 0.1);
+        for (int j = 0; j < (int) positions.size(); j++) {
+            positions[j][2*i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+            positions[j][2*i+1] = Vec3(positions[j][2*i][0]+0.1, positions[j][2*i][1], positions[j][2*i][2]);
+        }
+        nonbonded->addException(2*i, 2*i+1, 0.0, 0.15, 0.0);
+    }
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, platform);
+    context.setPositions(positions[0]);
+    vector<vector<double> > energies = context.computeEnergies(positions, vector<map<string, double> >());
+    State state = context.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), energies[0][0], 1e-5);
+    context.setPositions(positions[1]);
+    ASSERT_EQUAL_TOL(context.getState(State::Energy).getPotentialEnergy(), energies[1][0], 1e-5);
+    context.setPositions(positions[0]);
+    State state2 = context.getState(State::Forces);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state.getForces()[i], state2.getForces()[i], 1e-5);
+}
+
+void testAlchemical(NonbondedForce::NonbondedMethod method, bool useSwitch) {
+    // Compare the alchemical interactions to the Reference platform at several values of the lambdas.
+
+    const int numMolecules = 150;
+    const int numParticles = numMolecules*2;
+    const double boxSize = 3.5;
+    const double tol = 2e-3;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-1.0, 0.2, 0.1);
+        nonbonded->addParticle(1.0, 0.1, 0.2);
+        
+        // Place the molecules on a jittered lattice, so there are no severe overlaps to dominate the energy.
+        
+        Vec3 site((i%6)+0.5*genrand_real2(sfmt), ((i/6)%6)+0.5*genrand_real2(sfmt), (i/36)+0.5*genrand_real2(sfmt));
+        positions[2*i] = site*(boxSize/6);
+        positions[2*i+1] = Vec3(positions[2*i][0]+0.1, positions[2*i][1], positions[2*i][2]);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 0.15, 0.0);
+    }
+    
+    // Some molecules are entirely alchemical, and some have only one alchemical particle.
+    
+    set<int> alchemical;
+    for (int i = 0; i < numParticles; i += 7)
+        alchemical.insert(i);
+    for (int i = 0; i < 20; i++)
+        alchemical.insert(i);
+    nonbonded->setAlchemicalParticles(alchemical);
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseSwitchingFunction(useSwitch);
+    nonbonded->setSwitchingDistance(0.8);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    Context cpuContext(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    cpuContext.setPositions(positions);
+    referenceContext.setPositions(positions);
+    double lambdas[][2] = {{1.0, 1.0}, {0.6, 1.0}, {0.0, 0.7}, {0.0, 0.2}, {0.0, 0.0}};
+    for (int i = 0; i < 5; i++) {
+        cpuContext.setParameter(NonbondedForce::LambdaElectrostatics(), lambdas[i][0]);
+        cpuContext.setParameter(NonbondedForce::LambdaSterics(), lambdas[i][1]);
+        referenceContext.setParameter(NonbondedForce::LambdaElectrostatics(), lambdas[i][0]);
+        referenceContext.setParameter(NonbondedForce::LambdaSterics(), lambdas[i][1]);
+        State cpuState = cpuContext.getState(State::Forces | State::Energy);
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[j], cpuState.getForces()[j], tol);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), cpuState.getPotentialEnergy(), tol);
+        
+        // The derivatives with respect to the lambdas should match finite differences of the energy.
+        
+        double dEdLambdaElectrostatics, dEdLambdaSterics;
+        platform.getLambdaDerivatives(cpuContext, dEdLambdaElectrostatics, dEdLambdaSterics);
+        double delta = 1e-3;
+        double derivs[2];
+        for (int j = 0; j < 2; j++) {
+            const string& name = (j == 0 ? NonbondedForce::LambdaElectrostatics() : NonbondedForce::LambdaSterics());
+            referenceContext.setParameter(name, lambdas[i][j]+delta);
+            double e1 = referenceContext.getState(State::Energy).getPotentialEnergy();
+            referenceContext.setParameter(name, lambdas[i][j]-delta);
+            double e2 = referenceContext.getState(State::Energy).getPotentialEnergy();
+            referenceContext.setParameter(name, lambdas[i][j]);
+            derivs[j] = (e1-e2)/(2*delta);
+        }
+        ASSERT_EQUAL_TOL(derivs[0], dEdLambdaElectrostatics, tol);
+        ASSERT_EQUAL_TOL(derivs[1], dEdLambdaSterics, tol);
+    }
+}
+
+void testAlchemicalDoublePrecision() {
+    // In double precision mode the Reference kernel is used, which does not compute the lambda derivatives.
+
+    System system;
+    system.addParticle(1.0);
+    system.addParticle(1.0);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->addParticle(-1.0, 0.2, 0.1);
+    nonbonded->addParticle(1.0, 0.1, 0.2);
+    set<int> alchemical;
+    alchemical.insert(1);
+    nonbonded->setAlchemicalParticles(alchemical);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator(0.01);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuPrecision()] = "double";
+    Context context(system, integrator, platform, properties);
+    vector<Vec3> positions(2);
+    positions[1] = Vec3(0.5, 0, 0);
+    context.setPositions(positions);
+    context.setParameter(NonbondedForce::LambdaSterics(), 0.5);
+    context.getState(State::Energy);
+    double dEdLambdaElectrostatics, dEdLambdaSterics;
+    bool threwException = false;
+    try {
+        platform.getLambdaDerivatives(context, dEdLambdaElectrostatics, dEdLambdaSterics);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 int main(int argc, char* argv[]) {
     try {
         if (!CpuPlatform::isProcessorSupported()) {
@@ -693,6 +1003,7 @@ int main(int argc, char* argv[]) {
         testCoulomb();
         testLJ();
         testExclusionsAnd14();
+        testMany14WithThreads();
         testCutoff();
         testCutoff14();
         testPeriodic();
@@ -700,8 +1011,22 @@ int main(int argc, char* argv[]) {
         testLargeSystem();
         testDispersionCorrection();
         testChangingParameters();
+        testChangingSomeParameters();
         testSwitchingFunction(NonbondedForce::CutoffNonPeriodic);
         testSwitchingFunction(NonbondedForce::PME);
+        testEnergyOnly(NonbondedForce::NoCutoff);
+        testEnergyOnly(NonbondedForce::CutoffNonPeriodic);
+        testEnergyOnly(NonbondedForce::CutoffPeriodic);
+        testEnergyOnly(NonbondedForce::Ewald);
+        testEnergyOnly(NonbondedForce::PME);
+        testComputeEnergies(NonbondedForce::CutoffPeriodic);
+        testComputeEnergies(NonbondedForce::PME);
+        testAlchemical(NonbondedForce::NoCutoff, false);
+        testAlchemical(NonbondedForce::CutoffPeriodic, false);
+        testAlchemical(NonbondedForce::CutoffPeriodic, true);
+        testAlchemical(NonbondedForce::Ewald, false);
+        testAlchemical(NonbondedForce::PME, true);
+        testAlchemicalDoublePrecision();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -0,0 +1,198 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests automatic tuning of PME parameters on the CPU platform.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "CpuPlatform.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "openmm/internal/NonbondedForceImpl.h"
+#include "sfmt/SFMT.h"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+CpuPlatform platform;
+
+void createSystem(System& system, NonbondedForce*& nonbonded, vector<Vec3>& positions) {
+    const int numParticles = 500;
+    const double boxSize = 3.0;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setEwaldErrorTolerance(1e-4);
+    system.addForce(nonbonded);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? -1.0 : 1.0, 0.2, 0.5);
+        positions.push_back(Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt)));
+    }
+}
+
+Platform* findOptimizedPmePlatform() {
+    // The optimized PME implementation is a plugin, so it only gets registered with CPU platforms
+    // that were loaded from the plugins directory.
+
+    Platform::loadPluginsFromDirectory(Platform::getDefaultPluginsDirectory());
+    vector<string> kernelNames;
+    kernelNames.push_back("CalcPmeReciprocalForce");
+    for (int i = 0; i < Platform::getNumPlatforms(); i++) {
+        Platform& p = Platform::getPlatform(i);
+        if (p.getName() == "CPU" && p.supportsKernels(kernelNames))
+            return &p;
+    }
+    return NULL;
+}
+
+void testTuning() {
+    Platform* cpuPlatform = findOptimizedPmePlatform();
+    if (cpuPlatform == NULL) {
+        cout << "The optimized PME implementation is not available.  Skipping testTuning." << endl;
+        return;
+    }
+
+    // Tuning changes the interpolation order and grid, but the accuracy should be the same, so the
+    // results should agree to within the error tolerance.
+
+    System system;
+    NonbondedForce* nonbonded;
+    vector<Vec3> positions;
+    createSystem(system, nonbonded, positions);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    map<string, string> properties;
+    Context context1(system, integrator1, *cpuPlatform, properties);
+    ASSERT_EQUAL("false", cpuPlatform->getPropertyValue(context1, CpuPlatform::CpuPmeTuning()));
+    properties[CpuPlatform::CpuPmeTuning()] = "true";
+    Context context2(system, integrator2, *cpuPlatform, properties);
+    ASSERT_EQUAL("true", cpuPlatform->getPropertyValue(context2, CpuPlatform::CpuPmeTuning()));
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-3);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 5e-3);
+    
+    // The report should describe the selection.
+    
+    ASSERT_EQUAL("", cpuPlatform->getPropertyValue(context1, CpuPlatform::CpuPmeTuningReport()));
+    string report = cpuPlatform->getPropertyValue(context2, CpuPlatform::CpuPmeTuningReport());
+    int order, gridx, gridy, gridz;
+    ASSERT_EQUAL(4, sscanf(report.c_str(), "Selected order %d, grid %dx%dx%d", &order, &gridx, &gridy, &gridz));
+    ASSERT(order >= 4 && order <= 8);
+    ASSERT(gridx >= order && gridy >= order && gridz >= order);
+
+    // Compare to a reference calculation that uses the same Ewald parameter but a much finer grid, so
+    // the difference comes from the selected order and grid.  The relative error in the forces should
+    // be within the error tolerance.
+
+    double alpha;
+    int defaultx, defaulty, defaultz;
+    NonbondedForceImpl::calcPMEParameters(system, *nonbonded, alpha, defaultx, defaulty, defaultz);
+    nonbonded->setPMEParameters(alpha, 4*defaultx, 4*defaulty, 4*defaultz);
+    VerletIntegrator integrator3(0.001);
+    Context context3(system, integrator3, Platform::getPlatformByName("Reference"));
+    context3.setPositions(positions);
+    State state3 = context3.getState(State::Forces);
+    double diff = 0.0, norm = 0.0;
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        Vec3 delta = state3.getForces()[i]-state2.getForces()[i];
+        diff += delta.dot(delta);
+        norm += state3.getForces()[i].dot(state3.getForces()[i]);
+    }
+    ASSERT(sqrt(diff/norm) <= nonbonded->getEwaldErrorTolerance());
+}
+
+void testExplicitParameters() {
+    // If the PME parameters were set explicitly, they should not be tuned.
+
+    System system;
+    NonbondedForce* nonbonded;
+    vector<Vec3> positions;
+    createSystem(system, nonbonded, positions);
+    nonbonded->setPMEParameters(3.0, 24, 24, 24);
+    VerletIntegrator integrator(0.001);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuPmeTuning()] = "true";
+    Context context(system, integrator, platform, properties);
+    context.setPositions(positions);
+    context.getState(State::Energy);
+    ASSERT_EQUAL("", platform.getPropertyValue(context, CpuPlatform::CpuPmeTuningReport()));
+}
+
+void testIllegalValue() {
+    System system;
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.001);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuPmeTuning()] = "yes";
+    bool threwException = false;
+    try {
+        Context context(system, integrator, platform, properties);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testTuning();
+        testExplicitParameters();
+        testIllegalValue();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,166 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the CpuPrecision property of the CPU platform.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "CpuPlatform.h"
+#include "ReferencePlatform.h"
+#include "openmm/GBSAOBCForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void createSystem(System& system, vector<Vec3>& positions) {
+    const int numParticles = 200;
+    const double boxSize = 3.0;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    GBSAOBCForce* gbsa = new GBSAOBCForce();
+    gbsa->setNonbondedMethod(GBSAOBCForce::CutoffPeriodic);
+    gbsa->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    system.addForce(gbsa);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        double charge = (i%2 == 0 ? -0.5 : 0.5);
+        system.addParticle(10.0);
+        nonbonded->addParticle(charge, 0.2, 0.5);
+        gbsa->addParticle(charge, 0.15, 0.8);
+        positions.push_back(Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*boxSize);
+    }
+}
+
+void testDefaultPrecision() {
+    CpuPlatform platform;
+    System system;
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    ASSERT_EQUAL("mixed", platform.getPropertyValue(context, CpuPlatform::CpuPrecision()));
+}
+
+void testDoublePrecision() {
+    CpuPlatform platform;
+    ReferencePlatform reference;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuPrecision()] = "Double";
+    Context context(system, integrator1, platform, properties);
+    Context referenceContext(system, integrator2, reference);
+    ASSERT_EQUAL("double", platform.getPropertyValue(context, CpuPlatform::CpuPrecision()));
+    context.setPositions(positions);
+    referenceContext.setPositions(positions);
+    State state = context.getState(State::Forces | State::Energy);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    
+    // In double precision mode, results should agree with the Reference platform to nearly full precision.
+    
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 1e-10);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-10);
+}
+
+void testMixedPrecision() {
+    CpuPlatform platform;
+    ReferencePlatform reference;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuPrecision()] = "mixed";
+    Context context(system, integrator1, platform, properties);
+    Context referenceContext(system, integrator2, reference);
+    context.setPositions(positions);
+    referenceContext.setPositions(positions);
+    State state = context.getState(State::Forces | State::Energy);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 1e-4);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+}
+
+void testIllegalValue(const string& value) {
+    CpuPlatform platform;
+    System system;
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.001);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuPrecision()] = value;
+    bool threwException = false;
+    try {
+        Context context(system, integrator, platform, properties);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testDefaultPrecision();
+        testDoublePrecision();
+        testMixedPrecision();
+        testIllegalValue("quadruple");
+        testIllegalValue("single");
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,129 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+/**
+ * This tests the CPU random number generator.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "CpuPlatform.h"
+#include "CpuRandom.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void testGaussianDistribution() {
+    CpuRandom random;
+    random.initialize(5, 2);
+    const int numValues = 100001;
+    vector<float> values(numValues);
+    for (int stream = 0; stream < random.getNumStreams(); stream += 21) {
+        random.fillGaussianRandom(stream, &values[0], numValues);
+        double mean = 0.0, var = 0.0, skew = 0.0, kurtosis = 0.0;
+        for (int i = 0; i < numValues; i++) {
+            double x = values[i];
+            mean += x;
+            var += x*x;
+            skew += x*x*x;
+            kurtosis += x*x*x*x;
+        }
+        mean /= numValues;
+        var /= numValues;
+        skew /= numValues;
+        kurtosis /= numValues;
+        double c2 = var-mean*mean;
+        double c3 = skew-3*var*mean+2*mean*mean*mean;
+        double c4 = kurtosis-4*skew*mean-3*var*var+12*var*mean*mean-6*mean*mean*mean*mean;
+        ASSERT_EQUAL_TOL(0.0, mean, 0.01);
+        ASSERT_EQUAL_TOL(1.0, c2, 0.01);
+        ASSERT_EQUAL_TOL(0.0, c3, 0.02);
+        ASSERT_EQUAL_TOL(0.0, c4, 0.04);
+    }
+}
+
+void testReproducibility() {
+    // Streams should produce the same values for the same seed, regardless of the number of threads.
+    
+    CpuRandom random1, random2, random3;
+    random1.initialize(10, 1);
+    random2.initialize(10, 4);
+    random3.initialize(11, 1);
+    const int numValues = 1001;
+    vector<float> values1(numValues), values2(numValues), values3(numValues);
+    for (int stream = 0; stream < random1.getNumStreams(); stream++) {
+        random1.fillGaussianRandom(stream, &values1[0], numValues);
+        random2.fillGaussianRandom(stream, &values2[0], numValues);
+        random3.fillGaussianRandom(stream, &values3[0], numValues);
+        int numDifferent = 0;
+        for (int i = 0; i < numValues; i++) {
+            ASSERT_EQUAL(values1[i], values2[i]);
+            if (values1[i] != values3[i])
+                numDifferent++;
+        }
+        ASSERT(numDifferent > numValues/2);
+    }
+}
+
+void testStreamRanges() {
+    CpuRandom random;
+    const int numElements = 1000;
+    int expectedStart = 0;
+    for (int stream = 0; stream < random.getNumStreams(); stream++) {
+        int start, end;
+        random.getStreamRange(stream, numElements, start, end);
+        ASSERT_EQUAL(expectedStart, start);
+        ASSERT(end >= start);
+        expectedStart = end;
+    }
+    ASSERT_EQUAL(numElements, expectedStart);
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testGaussianDistribution();
+        testReproducibility();
+        testStreamRanges();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,211 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests stepping many replicas together with CpuReplicaSet.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "CpuPlatform.h"
+#include "CpuReplicaSet.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/LangevinIntegrator.h"
+#include "openmm/VerletIntegrator.h"
+#include "SimTKOpenMMRealType.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+CpuPlatform platform;
+
+void createSystem(System& system, vector<Vec3>& positions, NonbondedForce::NonbondedMethod method=NonbondedForce::CutoffPeriodic) {
+    const int numMolecules = 20;
+    const double boxSize = 2.0;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(0.9);
+    system.addForce(nonbonded);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(10.0);
+        system.addParticle(10.0);
+        nonbonded->addParticle(-0.5, 0.3, 0.5);
+        nonbonded->addParticle(0.5, 0.3, 0.5);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        bonds->addBond(2*i, 2*i+1, 0.15, 10000.0);
+        Vec3 pos(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.15, 0, 0));
+    }
+}
+
+CpuPlatform& findPmePlatform() {
+    // If the optimized PME implementation is available, it is registered with the CPU platform that was
+    // loaded from the plugins directory.  Otherwise the CPU platform uses its own PME implementation.
+
+    Platform::loadPluginsFromDirectory(Platform::getDefaultPluginsDirectory());
+    vector<string> kernelNames;
+    kernelNames.push_back("CalcPmeReciprocalForce");
+    for (int i = 0; i < Platform::getNumPlatforms(); i++) {
+        CpuPlatform* cpuPlatform = dynamic_cast<CpuPlatform*>(&Platform::getPlatform(i));
+        if (cpuPlatform != NULL && cpuPlatform->supportsKernels(kernelNames))
+            return *cpuPlatform;
+    }
+    return platform;
+}
+
+void testMatchesSeparateContexts(CpuPlatform& platform, NonbondedForce::NonbondedMethod method) {
+    const int numReplicas = 5;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions, method);
+    vector<Integrator*> integrators;
+    for (int i = 0; i < numReplicas; i++)
+        integrators.push_back(new VerletIntegrator(0.001));
+    CpuReplicaSet replicas(system, integrators, platform, map<string, string>(), 2);
+    ASSERT_EQUAL(numReplicas, replicas.getNumReplicas());
+    for (int i = 0; i < numReplicas; i++) {
+        ASSERT_EQUAL("1", platform.getPropertyValue(replicas.getContext(i), CpuPlatform::CpuThreads()));
+        replicas.getContext(i).setPositions(positions);
+        replicas.getContext(i).setVelocitiesToTemperature(300.0, i+1);
+    }
+
+    // Step each replica independently to get the expected results.
+
+    vector<State> expected;
+    for (int i = 0; i < numReplicas; i++) {
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, platform);
+        context.setState(replicas.getContext(i).getState(State::Positions | State::Velocities));
+        integrator.step(20);
+        expected.push_back(context.getState(State::Positions | State::Velocities | State::Energy));
+    }
+
+    // Step them all together and compare.
+
+    replicas.step(20);
+    vector<double> energies = replicas.getPotentialEnergies();
+    ASSERT_EQUAL(numReplicas, energies.size());
+    for (int i = 0; i < numReplicas; i++) {
+        State state = replicas.getContext(i).getState(State::Positions | State::Velocities);
+        for (int j = 0; j < system.getNumParticles(); j++) {
+            ASSERT_EQUAL_VEC(expected[i].getPositions()[j], state.getPositions()[j], 1e-5);
+            ASSERT_EQUAL_VEC(expected[i].getVelocities()[j], state.getVelocities()[j], 1e-5);
+        }
+        ASSERT_EQUAL_TOL(expected[i].getPotentialEnergy(), energies[i], 1e-5);
+    }
+    for (int i = 0; i < numReplicas; i++)
+        delete integrators[i];
+}
+
+void testLangevin() {
+    // Replicas using Langevin integrators should stay at the right temperature.
+
+    const int numReplicas = 4;
+    const double temp = 300.0;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    vector<Integrator*> integrators;
+    for (int i = 0; i < numReplicas; i++) {
+        LangevinIntegrator* integrator = new LangevinIntegrator(temp, 10.0, 0.002);
+        integrator->setRandomNumberSeed(i+1);
+        integrators.push_back(integrator);
+    }
+    CpuReplicaSet replicas(system, integrators, platform);
+    for (int i = 0; i < numReplicas; i++)
+        replicas.getContext(i).setPositions(positions);
+    replicas.step(500);
+    double ke = 0.0;
+    for (int j = 0; j < 500; j++) {
+        replicas.step(10);
+        for (int i = 0; i < numReplicas; i++)
+            ke += replicas.getContext(i).getState(State::Energy).getKineticEnergy();
+    }
+    ke /= 500*numReplicas;
+    double expected = 0.5*system.getNumParticles()*3*BOLTZ*temp;
+    ASSERT_USUALLY_EQUAL_TOL(expected, ke, 0.1);
+    for (int i = 0; i < numReplicas; i++)
+        delete integrators[i];
+}
+
+void testErrors() {
+    // An exception thrown while stepping a replica should be passed on to the caller.
+
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    vector<Integrator*> integrators;
+    integrators.push_back(new VerletIntegrator(0.001));
+    integrators.push_back(new VerletIntegrator(0.001));
+    CpuReplicaSet replicas(system, integrators, platform);
+    replicas.getContext(0).setPositions(positions);
+    bool threwException = false;
+    try {
+        replicas.step(1);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    for (int i = 0; i < (int) integrators.size(); i++)
+        delete integrators[i];
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testMatchesSeparateContexts(platform, NonbondedForce::CutoffPeriodic);
+        testMatchesSeparateContexts(findPmePlatform(), NonbondedForce::PME);
+        testLangevin();
+        testErrors();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,176 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests collection of statistics by the CPU platform.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "CpuPlatform.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/LangevinIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void createWaterBox(System& system, vector<Vec3>& positions) {
+    const int gridSize = 6;
+    const double spacing = 0.4;
+    const double boxSize = gridSize*spacing;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < gridSize; i++)
+        for (int j = 0; j < gridSize; j++)
+            for (int k = 0; k < gridSize; k++) {
+                Vec3 pos(i*spacing, j*spacing, k*spacing);
+                int first = system.getNumParticles();
+                system.addParticle(16.0);
+                system.addParticle(1.0);
+                system.addParticle(1.0);
+                nonbonded->addParticle(-0.8, 0.315, 0.64);
+                nonbonded->addParticle(0.4, 1.0, 0.0);
+                nonbonded->addParticle(0.4, 1.0, 0.0);
+                positions.push_back(pos);
+                positions.push_back(pos+Vec3(0.1, 0, 0));
+                positions.push_back(pos+Vec3(-0.03, 0.095, 0));
+                system.addConstraint(first, first+1, 0.1);
+                system.addConstraint(first, first+2, 0.1);
+                system.addConstraint(first+1, first+2, 0.1633);
+                nonbonded->addException(first, first+1, 0, 1, 0);
+                nonbonded->addException(first, first+2, 0, 1, 0);
+                nonbonded->addException(first+1, first+2, 0, 1, 0);
+            }
+}
+
+void testStatisticsDisabled() {
+    CpuPlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createWaterBox(system, positions);
+    LangevinIntegrator integrator(300.0, 1.0, 0.002);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    integrator.step(5);
+    ASSERT_EQUAL("false", platform.getPropertyValue(context, CpuPlatform::CpuCollectStatistics()));
+    const CpuStatistics& stats = platform.getStatistics(context);
+    ASSERT(!stats.isEnabled());
+    for (int i = 0; i < CpuStatistics::NumCounters; i++)
+        ASSERT_EQUAL(0, stats.getCount((CpuStatistics::Counter) i));
+    for (int i = 0; i < CpuStatistics::NumTimers; i++)
+        ASSERT_EQUAL(0.0, stats.getTime((CpuStatistics::Timer) i));
+}
+
+void testStatisticsEnabled() {
+    CpuPlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createWaterBox(system, positions);
+    LangevinIntegrator integrator(300.0, 1.0, 0.002);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuCollectStatistics()] = "true";
+    Context context(system, integrator, platform, properties);
+    context.setPositions(positions);
+    const int numSteps = 10;
+    integrator.step(numSteps);
+    ASSERT_EQUAL("true", platform.getPropertyValue(context, CpuPlatform::CpuCollectStatistics()));
+    const CpuStatistics& stats = platform.getStatistics(context);
+    ASSERT(stats.isEnabled());
+    ASSERT_EQUAL(numSteps, stats.getCount(CpuStatistics::ForceEvaluations));
+    ASSERT(stats.getCount(CpuStatistics::NeighborListBuilds) > 0);
+    ASSERT(stats.getCount(CpuStatistics::NeighborListBuilds) <= numSteps);
+    ASSERT(stats.getCount(CpuStatistics::PairsEvaluated) > 0);
+    ASSERT(stats.getTime(CpuStatistics::ForceComputation) > 0.0);
+    ASSERT(stats.getTime(CpuStatistics::ForceComputation) >= stats.getTime(CpuStatistics::NonbondedDirect));
+    
+    // The report should list every counter and timer.
+    
+    string report = platform.getPropertyValue(context, CpuPlatform::CpuStatisticsReport());
+    for (int i = 0; i < CpuStatistics::NumCounters; i++)
+        ASSERT(report.find(CpuStatistics::getCounterName((CpuStatistics::Counter) i)+":") != string::npos);
+    for (int i = 0; i < CpuStatistics::NumTimers; i++)
+        ASSERT(report.find(CpuStatistics::getTimerName((CpuStatistics::Timer) i)+":") != string::npos);
+    ASSERT(report.find("ThreadWaitTime:") != string::npos);
+    
+    // Resetting should clear everything.
+    
+    platform.resetStatistics(context);
+    for (int i = 0; i < CpuStatistics::NumCounters; i++)
+        ASSERT_EQUAL(0, stats.getCount((CpuStatistics::Counter) i));
+    integrator.step(1);
+    ASSERT_EQUAL(1, stats.getCount(CpuStatistics::ForceEvaluations));
+}
+
+void testIllegalValue() {
+    CpuPlatform platform;
+    System system;
+    system.addParticle(1.0);
+    LangevinIntegrator integrator(300.0, 1.0, 0.002);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuCollectStatistics()] = "yes";
+    bool threwException = false;
+    try {
+        Context context(system, integrator, platform, properties);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testStatisticsDisabled();
+        testStatisticsEnabled();
+        testIllegalValue();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
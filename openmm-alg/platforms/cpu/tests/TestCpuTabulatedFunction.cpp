@@ -0,0 +1,138 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the CPU implementation of tabulated functions against the Reference implementation.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "CpuPlatform.h"
+#include "CpuTabulatedFunction.h"
+#include "ReferenceTabulatedFunction.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void compareFunctions(const TabulatedFunction& function, const vector<double>& min, const vector<double>& max) {
+    Lepton::CustomFunction* cpu = createCpuTabulatedFunction(function);
+    Lepton::CustomFunction* reference = createReferenceTabulatedFunction(function);
+    Lepton::CustomFunction* copy = cpu->clone();
+    int numArgs = min.size();
+    ASSERT_EQUAL(numArgs, cpu->getNumArguments());
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<double> args(numArgs);
+    vector<int> derivOrder(numArgs);
+    for (int i = 0; i < 500; i++) {
+        // Choose a point, including some on the boundaries and some outside the grid.
+
+        for (int j = 0; j < numArgs; j++) {
+            double width = max[j]-min[j];
+            if (i < 2)
+                args[j] = (i == 0 ? min[j] : max[j]);
+            else
+                args[j] = min[j]-0.1*width+1.2*width*genrand_real2(sfmt);
+        }
+        double expected = reference->evaluate(&args[0]);
+        ASSERT_EQUAL_TOL(expected, cpu->evaluate(&args[0]), 1e-10);
+        ASSERT_EQUAL_TOL(expected, copy->evaluate(&args[0]), 1e-10);
+        for (int j = 0; j < numArgs; j++) {
+            for (int k = 0; k < numArgs; k++)
+                derivOrder[k] = (j == k ? 1 : 0);
+            ASSERT_EQUAL_TOL(reference->evaluateDerivative(&args[0], &derivOrder[0]), cpu->evaluateDerivative(&args[0], &derivOrder[0]), 1e-8);
+        }
+    }
+    delete cpu;
+    delete reference;
+    delete copy;
+}
+
+void testContinuous1D() {
+    vector<double> values;
+    for (int i = 0; i < 50; i++)
+        values.push_back(sin(0.3*i)+0.01*i*i);
+    Continuous1DFunction function(values, 0.5, 3.0);
+    compareFunctions(function, vector<double>(1, 0.5), vector<double>(1, 3.0));
+}
+
+void testContinuous2D() {
+    const int xsize = 12, ysize = 15;
+    vector<double> values(xsize*ysize);
+    for (int i = 0; i < xsize; i++)
+        for (int j = 0; j < ysize; j++)
+            values[i+xsize*j] = sin(0.4*i)*cos(0.3*j)+0.1*i;
+    Continuous2DFunction function(xsize, ysize, values, -1.0, 2.0, 0.5, 4.0);
+    vector<double> min, max;
+    min.push_back(-1.0);
+    min.push_back(0.5);
+    max.push_back(2.0);
+    max.push_back(4.0);
+    compareFunctions(function, min, max);
+}
+
+void testContinuous3D() {
+    const int xsize = 8, ysize = 9, zsize = 10;
+    vector<double> values(xsize*ysize*zsize);
+    for (int i = 0; i < xsize; i++)
+        for (int j = 0; j < ysize; j++)
+            for (int k = 0; k < zsize; k++)
+                values[i+xsize*j+xsize*ysize*k] = sin(0.4*i)*cos(0.3*j)*(1.0+0.2*k)+0.05*j*k;
+    Continuous3DFunction function(xsize, ysize, zsize, values, -1.0, 2.0, 0.5, 4.0, 0.0, 1.5);
+    vector<double> min, max;
+    min.push_back(-1.0);
+    min.push_back(0.5);
+    min.push_back(0.0);
+    max.push_back(2.0);
+    max.push_back(4.0);
+    max.push_back(1.5);
+    compareFunctions(function, min, max);
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testContinuous1D();
+        testContinuous2D();
+        testContinuous3D();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
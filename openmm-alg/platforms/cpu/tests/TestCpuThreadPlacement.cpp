@@ -0,0 +1,245 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the thread placement options of the CPU platform.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/ThreadPool.h"
+#include "openmm/Context.h"
+#include "CpuPlatform.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+#ifdef __linux__
+    #include <sched.h>
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+CpuPlatform platform;
+
+void createSystem(System& system, vector<Vec3>& positions) {
+    const int numParticles = 500;
+    const double boxSize = 3.0;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? -1.0 : 1.0, 0.2, 0.5);
+        positions.push_back(Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt)));
+    }
+}
+
+/**
+ * This gives the test access to the ContextImpl, so it can run tasks on the Context's thread pool.
+ */
+class ImplAccessor : public NonbondedForce {
+public:
+    static ContextImpl& getImpl(Context& context) {
+        ImplAccessor accessor;
+        return accessor.getContextImpl(context);
+    }
+};
+
+#ifdef __linux__
+/**
+ * Get the processors the calling thread is allowed to run on.
+ */
+set<int> getAffinity() {
+    set<int> processors;
+    cpu_set_t cpus;
+    ASSERT(sched_getaffinity(0, sizeof(cpus), &cpus) == 0);
+    for (int i = 0; i < CPU_SETSIZE; i++)
+        if (CPU_ISSET(i, &cpus))
+            processors.insert(i);
+    return processors;
+}
+
+/**
+ * Set the processors the calling thread is allowed to run on.
+ */
+void setAffinity(const set<int>& processors) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (set<int>::const_iterator iter = processors.begin(); iter != processors.end(); ++iter)
+        CPU_SET(*iter, &cpus);
+    ASSERT(sched_setaffinity(0, sizeof(cpus), &cpus) == 0);
+}
+
+/**
+ * This task records the processors each worker thread is allowed to run on.
+ */
+class GetAffinityTask : public ThreadPool::Task {
+public:
+    GetAffinityTask(int numThreads) : affinity(numThreads) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        affinity[threadIndex] = getAffinity();
+    }
+    vector<set<int> > affinity;
+};
+
+/**
+ * Check that the worker threads of a Context are placed as its CpuThreadPlacement property says.
+ */
+void checkThreadAffinity(Context& context, const set<int>& available) {
+    ThreadPool& threads = CpuPlatform::getPlatformData(ImplAccessor::getImpl(context)).threads;
+    GetAffinityTask task(threads.getNumThreads());
+    threads.execute(task);
+    threads.waitForThreads();
+    string placement = platform.getPropertyValue(context, CpuPlatform::CpuThreadPlacement());
+    set<int> used;
+    for (int i = 0; i < threads.getNumThreads(); i++) {
+        if (placement == "none") {
+            ASSERT(task.affinity[i] == available);
+        }
+        else {
+            ASSERT_EQUAL(1, task.affinity[i].size());
+            int processor = *task.affinity[i].begin();
+            ASSERT(available.find(processor) != available.end());
+            used.insert(processor);
+        }
+    }
+    if (placement != "none")
+        ASSERT_EQUAL(min((int) available.size(), threads.getNumThreads()), used.size());
+}
+#endif
+
+void testPlacement() {
+    // Every placement policy should give identical results.
+
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    State expected;
+    const char* placements[] = {"none", "compact", "spread"};
+    for (int i = 0; i < 3; i++) {
+        map<string, string> properties;
+        properties[CpuPlatform::CpuThreads()] = "3";
+        properties[CpuPlatform::CpuThreadPlacement()] = placements[i];
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, platform, properties);
+        string placement = platform.getPropertyValue(context, CpuPlatform::CpuThreadPlacement());
+        ASSERT(placement == placements[i] || placement == "none");
+#ifdef __linux__
+        checkThreadAffinity(context, getAffinity());
+#endif
+        context.setPositions(positions);
+        State state = context.getState(State::Forces | State::Energy);
+        if (i == 0)
+            expected = state;
+        else {
+            ASSERT_EQUAL_TOL(expected.getPotentialEnergy(), state.getPotentialEnergy(), 1e-5);
+            for (int j = 0; j < system.getNumParticles(); j++)
+                ASSERT_EQUAL_VEC(expected.getForces()[j], state.getForces()[j], 1e-5);
+        }
+    }
+}
+
+void testRestrictedAffinity() {
+#ifdef __linux__
+    // Restrict this thread to a single processor (the highest numbered one it can use), and make sure the
+    // worker threads are only placed on that processor.
+
+    set<int> original = getAffinity();
+    set<int> restricted;
+    restricted.insert(*original.rbegin());
+    setAffinity(restricted);
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    try {
+        const char* placements[] = {"compact", "spread"};
+        for (int i = 0; i < 2; i++) {
+            map<string, string> properties;
+            properties[CpuPlatform::CpuThreads()] = "2";
+            properties[CpuPlatform::CpuThreadPlacement()] = placements[i];
+            VerletIntegrator integrator(0.001);
+            Context context(system, integrator, platform, properties);
+            checkThreadAffinity(context, restricted);
+        }
+    }
+    catch (...) {
+        setAffinity(original);
+        throw;
+    }
+    setAffinity(original);
+#endif
+}
+
+void testIllegalValue() {
+    System system;
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.001);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreadPlacement()] = "scatter";
+    bool threwException = false;
+    try {
+        Context context(system, integrator, platform, properties);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testPlacement();
+        testRestrictedAffinity();
+        testIllegalValue();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,165 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+/**
+ * This tests the CPU implementation of virtual sites.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "CpuPlatform.h"
+#include "ReferencePlatform.h"
+#include "openmm/CustomExternalForce.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/LangevinIntegrator.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "openmm/VirtualSite.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const int numMolecules = 50;
+const int particlesPerMolecule = 6;
+
+/**
+ * Build a System where each molecule has three atoms and three virtual sites of different types
+ * that all share the same atoms.
+ */
+void createSystem(System& system, vector<Vec3>& positions) {
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    CustomExternalForce* external = new CustomExternalForce("a*x^2+b*y*z");
+    external->addPerParticleParameter("a");
+    external->addPerParticleParameter("b");
+    system.addForce(external);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<double> params(2);
+    for (int i = 0; i < numMolecules; i++) {
+        int first = system.getNumParticles();
+        for (int j = 0; j < 3; j++)
+            system.addParticle(10.0);
+        for (int j = 0; j < 3; j++)
+            system.addParticle(0.0);
+        system.setVirtualSite(first+3, new TwoParticleAverageSite(first, first+1, 0.4, 0.6));
+        system.setVirtualSite(first+4, new OutOfPlaneSite(first, first+1, first+2, 0.3, 0.4, 0.5));
+        system.setVirtualSite(first+5, new LocalCoordinatesSite(first, first+1, first+2, Vec3(0.2, 0.3, 0.5), Vec3(-1.0, 0.5, 0.5), Vec3(0.0, -1.0, 1.0), Vec3(0.1, 0.2, 0.05)));
+        bonds->addBond(first, first+1, 0.15, 1000.0);
+        bonds->addBond(first+1, first+2, 0.15, 1000.0);
+        bonds->addBond(first, first+2, 0.2, 1000.0);
+        for (int j = 0; j < particlesPerMolecule; j++) {
+            params[0] = genrand_real2(sfmt);
+            params[1] = genrand_real2(sfmt);
+            external->addParticle(first+j, params);
+        }
+        Vec3 center(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt));
+        positions.push_back(center);
+        positions.push_back(center+Vec3(0.15, 0, 0));
+        positions.push_back(center+Vec3(0, 0.15, 0));
+        for (int j = 0; j < 3; j++)
+            positions.push_back(Vec3());
+    }
+}
+
+void testForces() {
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    CpuPlatform cpu;
+    ReferencePlatform reference;
+    Context context1(system, integrator1, cpu);
+    Context context2(system, integrator2, reference);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    context1.computeVirtualSites();
+    context2.computeVirtualSites();
+    State state1 = context1.getState(State::Positions | State::Forces | State::Energy);
+    State state2 = context2.getState(State::Positions | State::Forces | State::Energy);
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        ASSERT_EQUAL_VEC(state2.getPositions()[i], state1.getPositions()[i], 1e-10);
+        ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 1e-10);
+    }
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-10);
+    
+    // Computing only the energy should not modify the forces.
+    
+    context1.getState(State::Energy);
+    State state3 = context1.getState(State::Forces);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state3.getForces()[i], 1e-10);
+}
+
+void testLangevinIntegrator() {
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    LangevinIntegrator integrator(300.0, 1.0, 0.002);
+    CpuPlatform cpu;
+    Context context(system, integrator, cpu);
+    context.setPositions(positions);
+    context.computeVirtualSites();
+    for (int step = 0; step < 20; step++) {
+        integrator.step(5);
+        State state = context.getState(State::Positions);
+        const vector<Vec3>& pos = state.getPositions();
+        for (int i = 0; i < numMolecules; i++) {
+            int first = i*particlesPerMolecule;
+            ASSERT_EQUAL_VEC(pos[first]*0.4+pos[first+1]*0.6, pos[first+3], 1e-10);
+            Vec3 v12 = pos[first+1]-pos[first];
+            Vec3 v13 = pos[first+2]-pos[first];
+            ASSERT_EQUAL_VEC(pos[first]+v12*0.3+v13*0.4+v12.cross(v13)*0.5, pos[first+4], 1e-10);
+        }
+    }
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testForces();
+        testLangevinIntegrator();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
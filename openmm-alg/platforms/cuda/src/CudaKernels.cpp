@@ -1488,6 +1488,10 @@ static int findFFTDimension(int minimum) {
 
 void CudaCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
     cu.setAsCurrent();
+    set<int> alchemicalParticles;
+    force.getAlchemicalParticles(alchemicalParticles);
+    if (alchemicalParticles.size() > 0)
+        throw OpenMMException("NonbondedForce: This platform does not support alchemical particles");
 
     // Identify which exceptions are 1-4 interactions.
 
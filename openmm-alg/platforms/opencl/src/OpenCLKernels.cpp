@@ -1461,6 +1461,10 @@ OpenCLCalcNonbondedForceKernel::~OpenCLCalcNonbondedForceKernel() {
 }
 
 void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
+    set<int> alchemicalParticles;
+    force.getAlchemicalParticles(alchemicalParticles);
+    if (alchemicalParticles.size() > 0)
+        throw OpenMMException("NonbondedForce: This platform does not support alchemical particles");
 
     // Identify which exceptions are 1-4 interactions.
 
@@ -37,6 +37,7 @@ class OPENMM_EXPORT ReferenceCCMAAlgorithm : public ReferenceConstraintAlgorithm
 protected:
 
     int _maximumNumberOfIterations;
+    int _lastNumberOfIterations;
 
     int _numberOfConstraints;
     std::vector<std::pair<int, int> > _atomIndices;
@@ -86,6 +87,11 @@ public:
      */
     void setMaximumNumberOfIterations(int maximumNumberOfIterations);
 
+    /**
+     * Get the number of iterations that were required the last time constraints were applied.
+     */
+    int getLastNumberOfIterations() const;
+
     /**
      * Apply the constraint algorithm.
      * 
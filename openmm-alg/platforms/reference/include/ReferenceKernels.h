@@ -572,10 +572,11 @@ private:
     int numParticles, num14;
     int **bonded14IndexArray;
     RealOpenMM **particleParamArray, **bonded14ParamArray;
-    RealOpenMM nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, dispersionCoefficient;
+    RealOpenMM nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, dispersionCoefficient, softcoreAlpha;
     int kmax[3], gridSize[3];
-    bool useSwitchingFunction;
+    bool useSwitchingFunction, hasAlchemical;
     std::vector<std::set<int> > exclusions;
+    std::vector<bool> isAlchemical;
     NonbondedMethod nonbondedMethod;
     NeighborList* neighborList;
 };
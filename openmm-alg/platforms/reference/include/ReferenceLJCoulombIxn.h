@@ -39,11 +39,14 @@ class ReferenceLJCoulombIxn {
       bool periodic;
       bool ewald;
       bool pme;
+      bool alchemical;
       const OpenMM::NeighborList* neighborList;
+      const std::vector<bool>* isAlchemical;
       OpenMM::RealVec periodicBoxVectors[3];
       RealOpenMM cutoffDistance, switchingDistance;
       RealOpenMM krf, crf;
       RealOpenMM alphaEwald;
+      RealOpenMM softcoreAlpha, lambdaElectrostatics, lambdaSterics;
       int numRx, numRy, numRz;
       int meshDim[3];
 
@@ -71,6 +74,21 @@ class ReferenceLJCoulombIxn {
                            RealOpenMM** atomParameters, std::vector<OpenMM::RealVec>& forces,
                            RealOpenMM* energyByAtom, RealOpenMM* totalEnergy) const;
 
+      /**---------------------------------------------------------------------------------------
+      
+         Calculate the soft-core Lennard-Jones interaction between an alchemical and a
+         non-alchemical particle
+      
+         @param r                the distance between the particles
+         @param sig              the combined sigma
+         @param eps              the combined epsilon (including the factor of 4)
+         @param energy           the energy (output)
+         @param dEdR             -r times the derivative of the energy with respect to r (output)
+            
+         --------------------------------------------------------------------------------------- */
+          
+      void calculateSoftcoreIxn(RealOpenMM r, RealOpenMM sig, RealOpenMM eps, RealOpenMM& energy, RealOpenMM& dEdR) const;
+
 
    public:
 
@@ -148,6 +166,19 @@ class ReferenceLJCoulombIxn {
          --------------------------------------------------------------------------------------- */
       
       void setUsePME(RealOpenMM alpha, int meshSize[3]);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Set the force to scale the interactions between alchemical and non-alchemical particles.
+      
+         @param isAlchemical          specifies which particles are alchemical
+         @param alpha                 the soft-core alpha parameter
+         @param lambdaElectrostatics  the scale factor for Coulomb interactions
+         @param lambdaSterics         the coupling parameter for soft-core Lennard-Jones interactions
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setUseAlchemical(const std::vector<bool>& isAlchemical, RealOpenMM alpha, RealOpenMM lambdaElectrostatics, RealOpenMM lambdaSterics);
       
       /**---------------------------------------------------------------------------------------
       
@@ -195,6 +226,26 @@ private:
                             RealOpenMM** atomParameters, std::vector<std::set<int> >& exclusions,
                             RealOpenMM* fixedParameters, std::vector<OpenMM::RealVec>& forces,
                             RealOpenMM* energyByAtom, RealOpenMM* totalEnergy, bool includeDirect, bool includeReciprocal) const;
+
+      /**---------------------------------------------------------------------------------------
+      
+         Calculate the reciprocal space part of an Ewald sum in which the interactions between
+         alchemical and non-alchemical particles are scaled by lambdaElectrostatics
+      
+         @param numberOfAtoms    number of atoms
+         @param atomCoordinates  atom coordinates
+         @param atomParameters   atom parameters (charges, c6, c12, ...)     atomParameters[atomIndex][paramterIndex]
+         @param exclusions       atom exclusion indices
+                                 exclusions[atomIndex] contains the list of exclusions for that atom
+         @param fixedParameters  non atom parameters (not currently used)
+         @param forces           force array (forces added)
+         @param totalEnergy      total energy
+            
+         --------------------------------------------------------------------------------------- */
+          
+      void calculateAlchemicalReciprocalIxn(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
+                            RealOpenMM** atomParameters, std::vector<std::set<int> >& exclusions,
+                            RealOpenMM* fixedParameters, std::vector<OpenMM::RealVec>& forces, RealOpenMM* totalEnergy) const;
 };
 
 } // namespace OpenMM
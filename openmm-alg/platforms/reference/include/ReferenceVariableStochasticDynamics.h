@@ -31,7 +31,7 @@ namespace OpenMM {
 
 class ReferenceVariableStochasticDynamics : public ReferenceDynamics {
 
-   private:
+   protected:
 
       std::vector<OpenMM::RealVec> xPrime;
       std::vector<RealOpenMM> inverseMasses;
@@ -48,6 +48,23 @@ public:
      * Distribute forces from virtual sites to the atoms they are based on.
      */
     static void distributeForces(const OpenMM::System& system, const std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& forces);
+    /**
+     * Compute the position of a single virtual site.
+     *
+     * @param system           the System containing the virtual site
+     * @param index            the index of the particle whose position should be computed.  It must be a virtual site.
+     * @param atomCoordinates  atom coordinates.  The position of the virtual site is updated.
+     */
+    static void computePosition(const OpenMM::System& system, int index, std::vector<OpenMM::RealVec>& atomCoordinates);
+    /**
+     * Distribute the force on a single virtual site to the atoms it is based on.
+     *
+     * @param system           the System containing the virtual site
+     * @param index            the index of the virtual site
+     * @param atomCoordinates  atom coordinates
+     * @param forces           forces on all particles.  The forces on the atoms the site is based on are updated.
+     */
+    static void distributeForce(const OpenMM::System& system, int index, const std::vector<OpenMM::RealVec>& atomCoordinates, std::vector<OpenMM::RealVec>& forces);
 };
 
 } // namespace OpenMM
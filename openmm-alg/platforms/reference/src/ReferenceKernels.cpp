@@ -852,6 +852,13 @@ void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const N
         dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(system, force);
     else
         dispersionCoefficient = 0.0;
+    set<int> alchemicalParticles;
+    force.getAlchemicalParticles(alchemicalParticles);
+    hasAlchemical = (alchemicalParticles.size() > 0);
+    isAlchemical.resize(numParticles, false);
+    for (set<int>::const_iterator iter = alchemicalParticles.begin(); iter != alchemicalParticles.end(); ++iter)
+        isAlchemical[*iter] = true;
+    softcoreAlpha = (RealOpenMM) force.getSoftcoreAlpha();
 }
 
 double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
@@ -879,6 +886,9 @@ double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool inc
         clj.setUsePME(ewaldAlpha, gridSize);
     if (useSwitchingFunction)
         clj.setUseSwitchingFunction(switchingDistance);
+    if (hasAlchemical)
+        clj.setUseAlchemical(isAlchemical, softcoreAlpha, (RealOpenMM) context.getParameter(NonbondedForce::LambdaElectrostatics()),
+                (RealOpenMM) context.getParameter(NonbondedForce::LambdaSterics()));
     clj.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, forceData, 0, includeEnergy ? &energy : NULL, includeDirect, includeReciprocal);
     if (includeDirect) {
         ReferenceBondForce refBondForce;
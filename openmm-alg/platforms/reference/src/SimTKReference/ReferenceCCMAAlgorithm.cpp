@@ -50,6 +50,7 @@ ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm(int numberOfAtoms,
     _distance = distance;
 
     _maximumNumberOfIterations = 150;
+    _lastNumberOfIterations = 0;
     _hasInitializedMasses = false;
 
     // work arrays
@@ -195,6 +196,10 @@ void ReferenceCCMAAlgorithm::setMaximumNumberOfIterations(int maximumNumberOfIte
     _maximumNumberOfIterations = maximumNumberOfIterations;
 }
 
+int ReferenceCCMAAlgorithm::getLastNumberOfIterations() const {
+    return _lastNumberOfIterations;
+}
+
 void ReferenceCCMAAlgorithm::apply(vector<RealVec>& atomCoordinates,
                                          vector<RealVec>& atomCoordinatesP,
                                          vector<RealOpenMM>& inverseMasses, RealOpenMM tolerance) {
@@ -289,4 +294,5 @@ void ReferenceCCMAAlgorithm::applyConstraints(vector<RealVec>& atomCoordinates,
             atomCoordinatesP[atomJ] -= dr*inverseMasses[atomJ];
         }
     }
+    _lastNumberOfIterations = iterations;
 }
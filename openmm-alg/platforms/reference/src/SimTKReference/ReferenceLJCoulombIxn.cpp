@@ -47,7 +47,7 @@ using namespace OpenMM;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceLJCoulombIxn::ReferenceLJCoulombIxn() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false) {
+ReferenceLJCoulombIxn::ReferenceLJCoulombIxn() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), alchemical(false) {
 
    // ---------------------------------------------------------------------------------------
 
@@ -163,6 +163,25 @@ void ReferenceLJCoulombIxn::setUseSwitchingFunction(RealOpenMM distance) {
       pme = true;
   }
 
+  /**---------------------------------------------------------------------------------------
+
+     Set the force to scale the interactions between alchemical and non-alchemical particles.
+
+     @param isAlchemical          specifies which particles are alchemical
+     @param alpha                 the soft-core alpha parameter
+     @param lambdaElectrostatics  the scale factor for Coulomb interactions
+     @param lambdaSterics         the coupling parameter for soft-core Lennard-Jones interactions
+
+     --------------------------------------------------------------------------------------- */
+
+  void ReferenceLJCoulombIxn::setUseAlchemical(const vector<bool>& isAlchemical, RealOpenMM alpha, RealOpenMM lambdaElectrostatics, RealOpenMM lambdaSterics) {
+      this->isAlchemical = &isAlchemical;
+      softcoreAlpha = alpha;
+      this->lambdaElectrostatics = lambdaElectrostatics;
+      this->lambdaSterics = lambdaSterics;
+      alchemical = true;
+  }
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Ewald ixn
@@ -375,18 +394,27 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
            switchDeriv = t*t*(-30+t*(60-t*30))/(cutoffDistance-switchingDistance);
        }
        RealOpenMM alphaR    = alphaEwald * r;
+       bool alchemicalPair  = (alchemical && (*isAlchemical)[ii] != (*isAlchemical)[jj]);
+       RealOpenMM chargeProd = (RealOpenMM) (ONE_4PI_EPS0 * atomParameters[ii][QIndex] * atomParameters[jj][QIndex]);
+       if (alchemicalPair)
+           chargeProd *= lambdaElectrostatics;
 
-
-       RealOpenMM dEdR      = (RealOpenMM) (ONE_4PI_EPS0 * atomParameters[ii][QIndex] * atomParameters[jj][QIndex] * inverseR * inverseR * inverseR);
+       RealOpenMM dEdR      = (RealOpenMM) (chargeProd * inverseR * inverseR * inverseR);
                   dEdR      = (RealOpenMM) (dEdR * (erfc(alphaR) + 2 * alphaR * exp (- alphaR * alphaR) / SQRT_PI));
 
        RealOpenMM sig       = atomParameters[ii][SigIndex] +  atomParameters[jj][SigIndex];
-       RealOpenMM sig2      = inverseR*sig;
-                  sig2     *= sig2;
-       RealOpenMM sig6      = sig2*sig2*sig2;
        RealOpenMM eps       = atomParameters[ii][EpsIndex]*atomParameters[jj][EpsIndex];
-                  dEdR     += switchValue*eps*(twelve*sig6 - six)*sig6*inverseR*inverseR;
-       vdwEnergy = eps*(sig6-one)*sig6;
+       RealOpenMM vdwDEdR;
+       if (alchemicalPair)
+           calculateSoftcoreIxn(r, sig, eps, vdwEnergy, vdwDEdR);
+       else {
+           RealOpenMM sig2  = inverseR*sig;
+                      sig2 *= sig2;
+           RealOpenMM sig6  = sig2*sig2*sig2;
+           vdwDEdR          = eps*(twelve*sig6 - six)*sig6;
+           vdwEnergy        = eps*(sig6-one)*sig6;
+       }
+                  dEdR     += switchValue*vdwDEdR*inverseR*inverseR;
        if (useSwitch) {
            dEdR -= vdwEnergy*switchDeriv*inverseR;
            vdwEnergy *= switchValue;
@@ -402,7 +430,7 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
 
        // accumulate energies
 
-       realSpaceEwaldEnergy        = (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR*erfc(alphaR));
+       realSpaceEwaldEnergy        = (RealOpenMM) (chargeProd*inverseR*erfc(alphaR));
 
        totalVdwEnergy             += vdwEnergy;
        totalRealSpaceEwaldEnergy  += realSpaceEwaldEnergy;
@@ -432,7 +460,10 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
                RealOpenMM inverseR  = one/(deltaR[0][ReferenceForce::RIndex]);
                RealOpenMM alphaR    = alphaEwald * r;
                if (erf(alphaR) > 1e-6) {
-                   RealOpenMM dEdR      = (RealOpenMM) (ONE_4PI_EPS0 * atomParameters[ii][QIndex] * atomParameters[jj][QIndex] * inverseR * inverseR * inverseR);
+                   RealOpenMM chargeProd = (RealOpenMM) (ONE_4PI_EPS0 * atomParameters[ii][QIndex] * atomParameters[jj][QIndex]);
+                   if (alchemical && (*isAlchemical)[ii] != (*isAlchemical)[jj])
+                       chargeProd *= lambdaElectrostatics;
+                   RealOpenMM dEdR      = (RealOpenMM) (chargeProd * inverseR * inverseR * inverseR);
                               dEdR      = (RealOpenMM) (dEdR * (erf(alphaR) - 2 * alphaR * exp (- alphaR * alphaR) / SQRT_PI));
 
                    // accumulate forces
@@ -445,7 +476,7 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
 
                    // accumulate energies
 
-                   realSpaceEwaldEnergy = (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR*erf(alphaR));
+                   realSpaceEwaldEnergy = (RealOpenMM) (chargeProd*inverseR*erf(alphaR));
 
                    totalExclusionEnergy += realSpaceEwaldEnergy;
                    if (energyByAtom) {
@@ -485,6 +516,10 @@ void ReferenceLJCoulombIxn::calculatePairIxn(int numberOfAtoms, vector<RealVec>&
                                              RealOpenMM* energyByAtom, RealOpenMM* totalEnergy, bool includeDirect, bool includeReciprocal) const {
 
    if (ewald || pme) {
+       if (includeReciprocal && alchemical && lambdaElectrostatics != 1) {
+           calculateAlchemicalReciprocalIxn(numberOfAtoms, atomCoordinates, atomParameters, exclusions, fixedParameters, forces, totalEnergy);
+           includeReciprocal = false;
+       }
        calculateEwaldIxn(numberOfAtoms, atomCoordinates, atomParameters, exclusions, fixedParameters, forces, energyByAtom,
                totalEnergy, includeDirect, includeReciprocal);
        return;
@@ -508,6 +543,38 @@ void ReferenceLJCoulombIxn::calculatePairIxn(int numberOfAtoms, vector<RealVec>&
    }
 }
 
+void ReferenceLJCoulombIxn::calculateAlchemicalReciprocalIxn(int numberOfAtoms, vector<RealVec>& atomCoordinates,
+                                             RealOpenMM** atomParameters, vector<set<int> >& exclusions,
+                                             RealOpenMM* fixedParameters, vector<RealVec>& forces, RealOpenMM* totalEnergy) const {
+    // The reciprocal space energy is a quadratic function of the charges, so the interaction between alchemical and
+    // non-alchemical particles is E(all) - E(non-alchemical only) - E(alchemical only).  Scaling it by lambda gives
+    // lambda*E(all) + (1-lambda)*(E(non-alchemical only) + E(alchemical only)), and likewise for the forces.  The
+    // self energy terms cancel in the same way.
+
+    vector<RealOpenMM> params(3*numberOfAtoms);
+    vector<RealOpenMM*> paramPointers(numberOfAtoms);
+    for (int i = 0; i < numberOfAtoms; i++)
+        paramPointers[i] = &params[3*i];
+    for (int term = 0; term < 3; term++) {
+        RealOpenMM weight = (term == 0 ? lambdaElectrostatics : 1-lambdaElectrostatics);
+        if (weight == 0)
+            continue;
+        for (int i = 0; i < numberOfAtoms; i++) {
+            bool include = (term == 0 || (term == 1 && !(*isAlchemical)[i]) || (term == 2 && (*isAlchemical)[i]));
+            params[3*i+SigIndex] = atomParameters[i][SigIndex];
+            params[3*i+EpsIndex] = atomParameters[i][EpsIndex];
+            params[3*i+QIndex] = (include ? atomParameters[i][QIndex] : 0);
+        }
+        vector<RealVec> termForces(numberOfAtoms, RealVec());
+        RealOpenMM termEnergy = 0;
+        calculateEwaldIxn(numberOfAtoms, atomCoordinates, &paramPointers[0], exclusions, fixedParameters, termForces, NULL, &termEnergy, false, true);
+        for (int i = 0; i < numberOfAtoms; i++)
+            forces[i] += termForces[i]*weight;
+        if (totalEnergy)
+            *totalEnergy += weight*termEnergy;
+    }
+}
+
   /**---------------------------------------------------------------------------------------
 
      Calculate LJ Coulomb pair ixn between two atoms
@@ -566,27 +633,36 @@ void ReferenceLJCoulombIxn::calculateOneIxn(int ii, int jj, vector<RealVec>& ato
             switchDeriv = t*t*(-30+t*(60-t*30))/(cutoffDistance-switchingDistance);
         }
     }
+    bool alchemicalPair  = (alchemical && (*isAlchemical)[ii] != (*isAlchemical)[jj]);
     RealOpenMM sig       = atomParameters[ii][SigIndex] +  atomParameters[jj][SigIndex];
-    RealOpenMM sig2      = inverseR*sig;
-               sig2     *= sig2;
-    RealOpenMM sig6      = sig2*sig2*sig2;
-
     RealOpenMM eps       = atomParameters[ii][EpsIndex]*atomParameters[jj][EpsIndex];
-    RealOpenMM dEdR      = switchValue*eps*(twelve*sig6 - six)*sig6;
+    RealOpenMM dEdR, energy;
+    if (alchemicalPair)
+        calculateSoftcoreIxn(deltaR[0][ReferenceForce::RIndex], sig, eps, energy, dEdR);
+    else {
+        RealOpenMM sig2  = inverseR*sig;
+                   sig2 *= sig2;
+        RealOpenMM sig6  = sig2*sig2*sig2;
+        dEdR             = eps*(twelve*sig6 - six)*sig6;
+        energy           = eps*(sig6-one)*sig6;
+    }
+    dEdR                *= switchValue;
+    RealOpenMM chargeProd = (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]);
+    if (alchemicalPair)
+        chargeProd *= lambdaElectrostatics;
     if (cutoff)
-        dEdR += (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*(inverseR-2.0f*krf*r2));
+        dEdR += (RealOpenMM) (chargeProd*(inverseR-2.0f*krf*r2));
     else
-        dEdR += (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR);
+        dEdR += (RealOpenMM) (chargeProd*inverseR);
     dEdR     *= inverseR*inverseR;
-    RealOpenMM energy = eps*(sig6-one)*sig6;
     if (useSwitch) {
         dEdR -= energy*switchDeriv*inverseR;
         energy *= switchValue;
     }
     if (cutoff)
-        energy += (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*(inverseR+krf*r2-crf));
+        energy += (RealOpenMM) (chargeProd*(inverseR+krf*r2-crf));
     else
-        energy += (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR);
+        energy += (RealOpenMM) (chargeProd*inverseR);
 
     // accumulate forces
 
@@ -606,3 +682,17 @@ void ReferenceLJCoulombIxn::calculateOneIxn(int ii, int jj, vector<RealVec>& ato
     }
   }
 
+void ReferenceLJCoulombIxn::calculateSoftcoreIxn(RealOpenMM r, RealOpenMM sig, RealOpenMM eps, RealOpenMM& energy, RealOpenMM& dEdR) const {
+    // E = lambda*eps*(u^2-u), where u = 1/(alpha*(1-lambda) + (r/sig)^6).
+
+    if (eps == 0 || sig == 0) {
+        energy = 0;
+        dEdR = 0;
+        return;
+    }
+    RealOpenMM rs2 = (r/sig)*(r/sig);
+    RealOpenMM rs6 = rs2*rs2*rs2;
+    RealOpenMM u = 1/(softcoreAlpha*(1-lambdaSterics)+rs6);
+    energy = lambdaSterics*eps*(u-1)*u;
+    dEdR = lambdaSterics*eps*6*(2*u-1)*u*u*rs6;
+}
@@ -219,16 +219,40 @@ void ReferenceStochasticDynamics::update(const OpenMM::System& system, vector<Re
    if (referenceConstraintAlgorithm)
       referenceConstraintAlgorithm->apply(atomCoordinates, xPrime, inverseMasses, tolerance);
 
+   // 3rd update
+
+   updatePart3(system, atomCoordinates, velocities, inverseMasses, xPrime);
+
+   incrementTimeStep();
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Third update: copy the constrained positions back, compute the velocities from them,
+   and compute the positions of virtual sites
+
+   @param system              the System being integrated
+   @param atomCoordinates     atom coordinates
+   @param velocities          velocities
+   @param inverseMasses       inverse atom masses
+   @param xPrime              xPrime
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceStochasticDynamics::updatePart3(const OpenMM::System& system, vector<RealVec>& atomCoordinates,
+                                              vector<RealVec>& velocities, vector<RealOpenMM>& inverseMasses,
+                                              vector<RealVec>& xPrime) {
+
    // copy xPrime -> atomCoordinates
 
+   int numberOfAtoms = system.getNumParticles();
    RealOpenMM invStepSize = 1.0/getDeltaT();
    for (int i = 0; i < numberOfAtoms; ++i)
-       if (masses[i] != zero)
+       if (inverseMasses[i] != 0.0)
            for (int j = 0; j < 3; ++j) {
                velocities[i][j] = invStepSize*(xPrime[i][j]-atomCoordinates[i][j]);
                atomCoordinates[i][j] = xPrime[i][j];
            }
 
    ReferenceVirtualSites::computePositions(system, atomCoordinates);
-   incrementTimeStep();
 }
@@ -36,6 +36,7 @@
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/Context.h"
 #include "ReferencePlatform.h"
+#include "openmm/CustomNonbondedForce.h"
 #include "openmm/NonbondedForce.h"
 #include "openmm/System.h"
 #include "openmm/VerletIntegrator.h"
@@ -43,6 +44,7 @@
 #include "openmm/HarmonicBondForce.h"
 #include "sfmt/SFMT.h"
 #include <iostream>
+#include <set>
 #include <vector>
 
 using namespace OpenMM;
@@ -559,6 +561,168 @@ void testSwitchingFunction(NonbondedForce::NonbondedMethod method) {
     }
 }
 
+void testAlchemical(NonbondedForce::NonbondedMethod method) {
+    // Compare the alchemical interactions to an equivalent CustomNonbondedForce.
+
+    ReferencePlatform platform;
+    const int numParticles = 12;
+    const double boxSize = 3.0;
+    const double cutoff = 1.0;
+    const double lambdaElectrostatics = 0.6;
+    const double lambdaSterics = 0.3;
+    const double softcoreAlpha = 0.4;
+    System system1, system2;
+    NonbondedForce* nonbonded1 = new NonbondedForce();
+    NonbondedForce* nonbonded2 = new NonbondedForce();
+    CustomNonbondedForce* custom = new CustomNonbondedForce("lambdaS*4*eps*(u^2-u) + lambdaE*138.935456*q1*q2*(1/r+krf*r^2-crf); "
+            "u=1/(alpha*(1-lambdaS)+(r/sig)^6); sig=0.5*(sig1+sig2); eps=sqrt(eps1*eps2)");
+    double krf = 0.0, crf = 0.0;
+    if (method != NonbondedForce::NoCutoff) {
+        double dielectric = nonbonded1->getReactionFieldDielectric();
+        krf = pow(cutoff, -3.0)*(dielectric-1.0)/(2.0*dielectric+1.0);
+        crf = (1.0/cutoff)*(3.0*dielectric)/(2.0*dielectric+1.0);
+    }
+    custom->addGlobalParameter("lambdaE", lambdaElectrostatics);
+    custom->addGlobalParameter("lambdaS", lambdaSterics);
+    custom->addGlobalParameter("alpha", softcoreAlpha);
+    custom->addGlobalParameter("krf", krf);
+    custom->addGlobalParameter("crf", crf);
+    custom->addPerParticleParameter("q");
+    custom->addPerParticleParameter("sig");
+    custom->addPerParticleParameter("eps");
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    set<int> alchemical, nonalchemical;
+    for (int i = 0; i < numParticles; i++) {
+        system1.addParticle(1.0);
+        system2.addParticle(1.0);
+        double charge = (i%2 == 0 ? 0.5 : -0.5);
+        double sigma = 0.2+0.1*genrand_real2(sfmt);
+        double epsilon = 0.5+genrand_real2(sfmt);
+        nonbonded1->addParticle(charge, sigma, epsilon);
+        nonbonded2->addParticle(charge, sigma, epsilon);
+        vector<double> params(3);
+        params[0] = charge;
+        params[1] = sigma;
+        params[2] = epsilon;
+        custom->addParticle(params);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        if (i < 4)
+            alchemical.insert(i);
+        else
+            nonalchemical.insert(i);
+    }
+    for (int i = 0; i < 4; i++)
+        for (int j = 4; j < numParticles; j++)
+            nonbonded2->addException(i, j, 0.0, 1.0, 0.0);
+    custom->addInteractionGroup(alchemical, nonalchemical);
+    nonbonded1->setAlchemicalParticles(alchemical);
+    nonbonded1->setSoftcoreAlpha(softcoreAlpha);
+    nonbonded1->setNonbondedMethod(method);
+    nonbonded2->setNonbondedMethod(method);
+    custom->setNonbondedMethod(method == NonbondedForce::NoCutoff ? CustomNonbondedForce::NoCutoff : CustomNonbondedForce::CutoffPeriodic);
+    nonbonded1->setCutoffDistance(cutoff);
+    nonbonded2->setCutoffDistance(cutoff);
+    custom->setCutoffDistance(cutoff);
+    nonbonded1->setUseDispersionCorrection(false);
+    nonbonded2->setUseDispersionCorrection(false);
+    system1.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    system2.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    system1.addForce(nonbonded1);
+    system2.addForce(nonbonded2);
+    system2.addForce(custom);
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    Context context1(system1, integrator1, platform);
+    Context context2(system2, integrator2, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    context1.setParameter(NonbondedForce::LambdaElectrostatics(), lambdaElectrostatics);
+    context1.setParameter(NonbondedForce::LambdaSterics(), lambdaSterics);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), TOL);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], TOL);
+}
+
+void testAlchemicalDecoupling() {
+    // When both lambdas are 0, the alchemical particles should be completely decoupled from the others, including
+    // in reciprocal space.  The energy should then equal the sum of the energies of the two sets of particles
+    // simulated separately.  The energy should also be linear in lambdaElectrostatics.
+
+    ReferencePlatform platform;
+    const int numParticles = 12;
+    const int numAlchemical = 4;
+    const double boxSize = 3.0;
+    System system, system1, system2;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    NonbondedForce* nonbonded1 = new NonbondedForce();
+    NonbondedForce* nonbonded2 = new NonbondedForce();
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles), positions1, positions2;
+    set<int> alchemical;
+    for (int i = 0; i < numParticles; i++) {
+        double charge = (i%2 == 0 ? 0.5 : -0.5);
+        double sigma = 0.2+0.1*genrand_real2(sfmt);
+        double epsilon = 0.5+genrand_real2(sfmt);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        system.addParticle(1.0);
+        nonbonded->addParticle(charge, sigma, epsilon);
+        if (i < numAlchemical) {
+            alchemical.insert(i);
+            system1.addParticle(1.0);
+            nonbonded1->addParticle(charge, sigma, epsilon);
+            positions1.push_back(positions[i]);
+        }
+        else {
+            system2.addParticle(1.0);
+            nonbonded2->addParticle(charge, sigma, epsilon);
+            positions2.push_back(positions[i]);
+        }
+    }
+    nonbonded->addException(0, 1, 0.0, 1.0, 0.0);
+    nonbonded1->addException(0, 1, 0.0, 1.0, 0.0);
+    nonbonded->setAlchemicalParticles(alchemical);
+    NonbondedForce* forces[] = {nonbonded, nonbonded1, nonbonded2};
+    System* systems[] = {&system, &system1, &system2};
+    for (int i = 0; i < 3; i++) {
+        forces[i]->setNonbondedMethod(NonbondedForce::PME);
+        forces[i]->setCutoffDistance(1.0);
+        forces[i]->setPMEParameters(3.0, 32, 32, 32);
+        forces[i]->setUseDispersionCorrection(false);
+        systems[i]->setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+        systems[i]->addForce(forces[i]);
+    }
+    VerletIntegrator integrator(0.01);
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    Context context(system, integrator, platform);
+    Context context1(system1, integrator1, platform);
+    Context context2(system2, integrator2, platform);
+    context.setPositions(positions);
+    context1.setPositions(positions1);
+    context2.setPositions(positions2);
+    context.setParameter(NonbondedForce::LambdaElectrostatics(), 0.0);
+    context.setParameter(NonbondedForce::LambdaSterics(), 0.0);
+    State state = context.getState(State::Forces | State::Energy);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy()+state2.getPotentialEnergy(), state.getPotentialEnergy(), TOL);
+    for (int i = 0; i < numParticles; i++) {
+        Vec3 expected = (i < numAlchemical ? state1.getForces()[i] : state2.getForces()[i-numAlchemical]);
+        ASSERT_EQUAL_VEC(expected, state.getForces()[i], TOL);
+    }
+    double energy0 = state.getPotentialEnergy();
+    context.setParameter(NonbondedForce::LambdaElectrostatics(), 1.0);
+    double energy1 = context.getState(State::Energy).getPotentialEnergy();
+    context.setParameter(NonbondedForce::LambdaElectrostatics(), 0.3);
+    double energy = context.getState(State::Energy).getPotentialEnergy();
+    ASSERT_EQUAL_TOL(0.3*energy1+0.7*energy0, energy, TOL);
+}
+
 int main() {
     try {
         testCoulomb();
@@ -571,6 +735,9 @@ int main() {
         testDispersionCorrection();
         testSwitchingFunction(NonbondedForce::CutoffNonPeriodic);
         testSwitchingFunction(NonbondedForce::PME);
+        testAlchemical(NonbondedForce::NoCutoff);
+        testAlchemical(NonbondedForce::CutoffPeriodic);
+        testAlchemicalDecoupling();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
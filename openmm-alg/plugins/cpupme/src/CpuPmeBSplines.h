@@ -0,0 +1,145 @@
+#ifndef OPENMM_CPU_PME_BSPLINES_H_
+#define OPENMM_CPU_PME_BSPLINES_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/Vec3.h"
+#include "openmm/internal/vectorize.h"
+#include <cstddef>
+
+namespace OpenMM {
+
+/**
+ * The lowest and highest interpolation orders supported by the CPU PME kernel.
+ */
+static const int MIN_PME_ORDER = 4;
+static const int MAX_PME_ORDER = 8;
+
+/**
+ * A function that spreads the charges of the particles in [start, end) onto a grid.
+ */
+typedef void (*PmeSpreadChargeFunction)(int start, int end, float* posq, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors);
+
+/**
+ * A function that interpolates the forces on the particles in [start, end) from a grid.
+ */
+typedef void (*PmeInterpolateForcesFunction)(int start, int end, float* posq, float* force, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors);
+
+/**
+ * Get whether the current CPU supports the AVX versions of the charge spreading and force
+ * interpolation functions.
+ */
+bool isPmeVec8Supported();
+
+/**
+ * Get the AVX versions of the charge spreading and force interpolation functions for an
+ * interpolation order.
+ */
+void getPmeVec8Functions(int order, PmeSpreadChargeFunction& spread, PmeInterpolateForcesFunction& interpolate);
+
+// The functions and classes below are compiled into both CpuPmeKernels.cpp and CpuPmeKernelsVec8.cpp,
+// which use different instruction sets, so they must have internal linkage.
+
+namespace {
+
+/**
+ * Compute the B-spline coefficients of a given order along all three axes.  dr holds the fractional
+ * offset of the particle from the grid point it is assigned to.  If ddata is not NULL, the derivatives
+ * of the coefficients are stored into it.
+ */
+template <int ORDER>
+static inline void computeBSplines(const fvec4& dr, fvec4* data, fvec4* ddata) {
+    const fvec4 one(1);
+    const fvec4 scale(1.0f/(ORDER-1));
+    data[ORDER-1] = 0.0f;
+    data[1] = dr;
+    data[0] = one-dr;
+    for (int j = 3; j < ORDER; j++) {
+        fvec4 div(1.0f/(j-1));
+        data[j-1] = div*dr*data[j-2];
+        for (int k = 1; k < j-1; k++)
+            data[j-k-1] = div*((dr+k)*data[j-k-2]+(fvec4(j-k)-dr)*data[j-k-1]);
+        data[0] = div*(one-dr)*data[0];
+    }
+    if (ddata != NULL) {
+        ddata[0] = -data[0];
+        for (int j = 1; j < ORDER; j++)
+            ddata[j] = data[j-1]-data[j];
+    }
+    data[ORDER-1] = scale*dr*data[ORDER-2];
+    for (int j = 1; j < (ORDER-1); j++)
+        data[ORDER-j-1] = scale*((dr+j)*data[ORDER-j-2]+(fvec4(ORDER-j)-dr)*data[ORDER-j-1]);
+    data[0] = scale*(one-dr)*data[0];
+}
+
+/**
+ * This class maps particle positions to grid points.  It is created once for each call to a charge
+ * spreading or force interpolation function, then used for every particle.
+ */
+class PmeGridMapper {
+public:
+    PmeGridMapper(const Vec3* periodicBoxVectors, const Vec3* recipBoxVectors, int gridx, int gridy, int gridz) :
+            boxSize((float) periodicBoxVectors[0][0], (float) periodicBoxVectors[1][1], (float) periodicBoxVectors[2][2], 0),
+            invBoxSize((float) recipBoxVectors[0][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[2][2], 0),
+            recipBoxVec0((float) recipBoxVectors[0][0], (float) recipBoxVectors[0][1], (float) recipBoxVectors[0][2], 0),
+            recipBoxVec1((float) recipBoxVectors[1][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[1][2], 0),
+            recipBoxVec2((float) recipBoxVectors[2][0], (float) recipBoxVectors[2][1], (float) recipBoxVectors[2][2], 0),
+            gridSize(gridx, gridy, gridz, 0), gridSizeInt(gridx, gridy, gridz, 0) {
+    }
+    /**
+     * Find the grid point a particle is assigned to and its fractional offset from it.  This returns false
+     * if the position is invalid, which happens when a simulation blows up and coordinates become NaN.
+     */
+    bool findGridPoint(const float* pos, int* gridIndex, fvec4& dr) const {
+        fvec4 p(pos);
+        float posInBox[4];
+        (p-boxSize*floor(p*invBoxSize)).store(posInBox);
+        fvec4 t = posInBox[0]*recipBoxVec0 + posInBox[1]*recipBoxVec1 + posInBox[2]*recipBoxVec2;
+        t = (t-floor(t))*gridSize;
+        ivec4 ti = t;
+        dr = t-ti;
+        ivec4 index = ti-(gridSizeInt&ti==gridSizeInt);
+        gridIndex[0] = index[0];
+        gridIndex[1] = index[1];
+        gridIndex[2] = index[2];
+        return (gridIndex[0] >= 0);
+    }
+private:
+    fvec4 boxSize, invBoxSize, recipBoxVec0, recipBoxVec1, recipBoxVec2, gridSize;
+    ivec4 gridSizeInt;
+};
+
+} // namespace
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPU_PME_BSPLINES_H_*/
@@ -29,8 +29,12 @@
 #include "internal/windowsExportPme.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/OpenMMException.h"
+#include "openmm/internal/hardware.h"
+#include <algorithm>
+#include <sstream>
 
 using namespace OpenMM;
+using namespace std;
 
 extern "C" OPENMM_EXPORT_PME void registerKernelFactories() {
     if (CpuCalcPmeReciprocalForceKernel::isProcessorSupported()) {
@@ -53,7 +57,16 @@ extern "C" OPENMM_EXPORT_PME void registerPlatforms() {
 #endif
 
 KernelImpl* CpuPmeKernelFactory::createKernelImpl(std::string name, const Platform& platform, ContextImpl& context) const {
-    if (name == CalcPmeReciprocalForceKernel::Name())
-        return new CpuCalcPmeReciprocalForceKernel(name, platform);
+    if (name == CalcPmeReciprocalForceKernel::Name()) {
+        // On the CPU platform, use the same number of threads as the Context does.  Otherwise this
+        // calculation would compete with the Context's own threads, or with other Contexts that were
+        // each given only some of the cores.  On other platforms, use all of them.
+
+        int numThreads = getNumProcessors();
+        const vector<string>& properties = platform.getPropertyNames();
+        if (find(properties.begin(), properties.end(), "CpuThreads") != properties.end())
+            stringstream(platform.getPropertyValue(context.getOwner(), "CpuThreads")) >> numThreads;
+        return new CpuCalcPmeReciprocalForceKernel(name, platform, max(numThreads, 1));
+    }
     throw OpenMMException((std::string("Tried to create kernel with illegal kernel name '")+name+"'").c_str());
 }
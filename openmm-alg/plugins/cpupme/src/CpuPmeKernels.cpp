@@ -33,7 +33,9 @@
   #define _USE_MATH_DEFINES // Needed to get M_PI
 #endif
 #include "CpuPmeKernels.h"
+#include "CpuPmeBSplines.h"
 #include "SimTKOpenMMRealType.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/internal/hardware.h"
 #include "openmm/internal/vectorize.h"
 #include <cmath>
@@ -42,104 +44,66 @@
 using namespace OpenMM;
 using namespace std;
 
-static const int PME_ORDER = 5;
-
 bool CpuCalcPmeReciprocalForceKernel::hasInitializedThreads = false;
-int CpuCalcPmeReciprocalForceKernel::numThreads = 0;
+pthread_mutex_t CpuCalcPmeReciprocalForceKernel::fftwLock = PTHREAD_MUTEX_INITIALIZER;
 
+template <int ORDER>
 static void spreadCharge(int start, int end, float* posq, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
-    float temp[4];
-    fvec4 boxSize((float) periodicBoxVectors[0][0], (float) periodicBoxVectors[1][1], (float) periodicBoxVectors[2][2], 0);
-    fvec4 invBoxSize((float) recipBoxVectors[0][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[2][2], 0);
-    fvec4 recipBoxVec0((float) recipBoxVectors[0][0], (float) recipBoxVectors[0][1], (float) recipBoxVectors[0][2], 0);
-    fvec4 recipBoxVec1((float) recipBoxVectors[1][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[1][2], 0);
-    fvec4 recipBoxVec2((float) recipBoxVectors[2][0], (float) recipBoxVectors[2][1], (float) recipBoxVectors[2][2], 0);
-    fvec4 gridSize(gridx, gridy, gridz, 0);
-    ivec4 gridSizeInt(gridx, gridy, gridz, 0);
-    fvec4 one(1);
-    fvec4 scale(1.0f/(PME_ORDER-1));
+    const int NUM_ZVEC = ORDER/4;
+    PmeGridMapper mapper(periodicBoxVectors, recipBoxVectors, gridx, gridy, gridz);
     const float epsilonFactor = sqrt(ONE_4PI_EPS0);
     memset(grid, 0, sizeof(float)*gridx*gridy*gridz);
     for (int i = start; i < end; i++) {
         // Find the position relative to the nearest grid point.
         
-        fvec4 pos(&posq[4*i]);
-        float posInBox[4];
-        (pos-boxSize*floor(pos*invBoxSize)).store(posInBox);
-        fvec4 t = posInBox[0]*recipBoxVec0 + posInBox[1]*recipBoxVec1 + posInBox[2]*recipBoxVec2;
-        t = (t-floor(t))*gridSize;
-        ivec4 ti = t;
-        fvec4 dr = t-ti;
-        ivec4 gridIndex = ti-(gridSizeInt&ti==gridSizeInt);
+        int gridIndex[3];
+        fvec4 dr;
+        if (!mapper.findGridPoint(&posq[4*i], gridIndex, dr))
+            return; // This happens when a simulation blows up and coordinates become NaN.
         
         // Compute the B-spline coefficients.
         
-        fvec4 data[PME_ORDER];
-        data[PME_ORDER-1] = 0.0f;
-        data[1] = dr;
-        data[0] = one-dr;
-        for (int j = 3; j < PME_ORDER; j++) {
-            fvec4 div(1.0f/(j-1));
-            data[j-1] = div*dr*data[j-2];
-            for (int k = 1; k < j-1; k++)
-                data[j-k-1] = div*((dr+k)*data[j-k-2]+(fvec4(j-k)-dr)*data[j-k-1]);
-            data[0] = div*(one-dr)*data[0];
-        }
-        data[PME_ORDER-1] = scale*dr*data[PME_ORDER-2];
-        for (int j = 1; j < (PME_ORDER-1); j++)
-            data[PME_ORDER-j-1] = scale*((dr+j)*data[PME_ORDER-j-2]+(fvec4(PME_ORDER-j)-dr)*data[PME_ORDER-j-1]);
-        data[0] = scale*(one-dr)*data[0];
+        fvec4 data[ORDER];
+        computeBSplines<ORDER>(dr, data, NULL);
         
-        // Spread the charges.
+        // Spread the charges.  When the points along z do not wrap around the end of the grid, the
+        // first multiple of four of them are updated with vector operations.
         
         int gridIndexX = gridIndex[0];
         int gridIndexY = gridIndex[1];
         int gridIndexZ = gridIndex[2];
-        if (gridIndexX < 0)
-            return; // This happens when a simulation blows up and coordinates become NaN.
-        int zindex[PME_ORDER];
-        for (int j = 0; j < PME_ORDER; j++) {
+        int zindex[ORDER];
+        float zdata[ORDER];
+        for (int j = 0; j < ORDER; j++) {
             zindex[j] = gridIndexZ+j;
             zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+            zdata[j] = data[j][2];
         }
+        fvec4 zvec[NUM_ZVEC];
+        for (int j = 0; j < NUM_ZVEC; j++)
+            zvec[j] = fvec4(&zdata[4*j]);
+        bool contiguous = (gridIndexZ+ORDER <= gridz);
         float charge = epsilonFactor*posq[4*i+3];
-        fvec4 zdata0to3(data[0][2], data[1][2], data[2][2], data[3][2]);
-        float zdata4 = data[4][2];
-        if (gridIndexZ+4 < gridz) {
-            for (int ix = 0; ix < PME_ORDER; ix++) {
-                int xbase = gridIndexX+ix;
-                xbase -= (xbase >= gridx ? gridx : 0);
-                xbase = xbase*gridy*gridz;
-                float xdata = charge*data[ix][0];
-                for (int iy = 0; iy < PME_ORDER; iy++) {
-                    int ybase = gridIndexY+iy;
-                    ybase -= (ybase >= gridy ? gridy : 0);
-                    ybase = xbase + ybase*gridz;
-                    float multiplier = xdata*data[iy][1];
-                    fvec4 add0to3 = zdata0to3*multiplier;
-                    (fvec4(&grid[ybase+gridIndexZ])+add0to3).store(&grid[ybase+gridIndexZ]);
-                    grid[ybase+zindex[4]] += multiplier*zdata4;
+        for (int ix = 0; ix < ORDER; ix++) {
+            int xbase = gridIndexX+ix;
+            xbase -= (xbase >= gridx ? gridx : 0);
+            xbase = xbase*gridy*gridz;
+            float xdata = charge*data[ix][0];
+            for (int iy = 0; iy < ORDER; iy++) {
+                int ybase = gridIndexY+iy;
+                ybase -= (ybase >= gridy ? gridy : 0);
+                ybase = xbase + ybase*gridz;
+                float multiplier = xdata*data[iy][1];
+                float* column = &grid[ybase];
+                if (contiguous) {
+                    for (int j = 0; j < NUM_ZVEC; j++)
+                        (fvec4(&column[gridIndexZ+4*j])+zvec[j]*multiplier).store(&column[gridIndexZ+4*j]);
+                    for (int j = 4*NUM_ZVEC; j < ORDER; j++)
+                        column[gridIndexZ+j] += multiplier*zdata[j];
                 }
-            }
-        }
-        else {
-            for (int ix = 0; ix < PME_ORDER; ix++) {
-                int xbase = gridIndexX+ix;
-                xbase -= (xbase >= gridx ? gridx : 0);
-                xbase = xbase*gridy*gridz;
-                float xdata = charge*data[ix][0];
-                for (int iy = 0; iy < PME_ORDER; iy++) {
-                    int ybase = gridIndexY+iy;
-                    ybase -= (ybase >= gridy ? gridy : 0);
-                    ybase = xbase + ybase*gridz;
-                    float multiplier = xdata*data[iy][1];
-                    fvec4 add0to3 = zdata0to3*multiplier;
-                    add0to3.store(temp);
-                    grid[ybase+zindex[0]] += temp[0];
-                    grid[ybase+zindex[1]] += temp[1];
-                    grid[ybase+zindex[2]] += temp[2];
-                    grid[ybase+zindex[3]] += temp[3];
-                    grid[ybase+zindex[4]] += multiplier*zdata4;
+                else {
+                    for (int j = 0; j < ORDER; j++)
+                        column[zindex[j]] += multiplier*zdata[j];
                 }
             }
         }
@@ -240,68 +204,39 @@ static void reciprocalConvolution(int start, int end, fftwf_complex* grid, int g
     }
 }
 
+template <int ORDER>
 static void interpolateForces(int start, int end, float* posq, float* force, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
-    fvec4 boxSize((float) periodicBoxVectors[0][0], (float) periodicBoxVectors[1][1], (float) periodicBoxVectors[2][2], 0);
-    fvec4 invBoxSize((float) recipBoxVectors[0][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[2][2], 0);
-    fvec4 recipBoxVec0((float) recipBoxVectors[0][0], (float) recipBoxVectors[0][1], (float) recipBoxVectors[0][2], 0);
-    fvec4 recipBoxVec1((float) recipBoxVectors[1][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[1][2], 0);
-    fvec4 recipBoxVec2((float) recipBoxVectors[2][0], (float) recipBoxVectors[2][1], (float) recipBoxVectors[2][2], 0);
-    fvec4 gridSize(gridx, gridy, gridz, 0);
-    ivec4 gridSizeInt(gridx, gridy, gridz, 0);
-    fvec4 one(1);
-    fvec4 scale(1.0f/(PME_ORDER-1));
+    PmeGridMapper mapper(periodicBoxVectors, recipBoxVectors, gridx, gridy, gridz);
     const float epsilonFactor = sqrt(ONE_4PI_EPS0);
     for (int i = start; i < end; i++) {
         // Find the position relative to the nearest grid point.
         
-        fvec4 pos(&posq[4*i]);
-        float posInBox[4];
-        (pos-boxSize*floor(pos*invBoxSize)).store(posInBox);
-        fvec4 t = posInBox[0]*recipBoxVec0 + posInBox[1]*recipBoxVec1 + posInBox[2]*recipBoxVec2;
-        t = (t-floor(t))*gridSize;
-        ivec4 ti = t;
-        fvec4 dr = t-ti;
-        ivec4 gridIndex = ti-(gridSizeInt&ti==gridSizeInt);
+        int gridIndex[3];
+        fvec4 dr;
+        if (!mapper.findGridPoint(&posq[4*i], gridIndex, dr))
+            return; // This happens when a simulation blows up and coordinates become NaN.
         
         // Compute the B-spline coefficients.
         
-        fvec4 data[PME_ORDER];
-        fvec4 ddata[PME_ORDER];
-        data[PME_ORDER-1] = 0.0f;
-        data[1] = dr;
-        data[0] = one-dr;
-        for (int j = 3; j < PME_ORDER; j++) {
-            fvec4 div(1.0f/(j-1));
-            data[j-1] = div*dr*data[j-2];
-            for (int k = 1; k < j-1; k++)
-                data[j-k-1] = div*((dr+k)*data[j-k-2]+(fvec4(j-k)-dr)*data[j-k-1]);
-            data[0] = div*(one-dr)*data[0];
-        }
-        ddata[0] = -data[0];
-        for (int j = 1; j < PME_ORDER; j++)
-            ddata[j] = data[j-1]-data[j];
-        data[PME_ORDER-1] = scale*dr*data[PME_ORDER-2];
-        for (int j = 1; j < (PME_ORDER-1); j++)
-            data[PME_ORDER-j-1] = scale*((dr+j)*data[PME_ORDER-j-2]+(fvec4(PME_ORDER-j)-dr)*data[PME_ORDER-j-1]);
-        data[0] = scale*(one-dr)*data[0];
+        fvec4 data[ORDER];
+        fvec4 ddata[ORDER];
+        computeBSplines<ORDER>(dr, data, ddata);
                 
         // Compute the force on this atom.
         
         int gridIndexX = gridIndex[0];
         int gridIndexY = gridIndex[1];
         int gridIndexZ = gridIndex[2];
-        if (gridIndexX < 0)
-            return; // This happens when a simulation blows up and coordinates become NaN.
-        int zindex[PME_ORDER];
-        for (int j = 0; j < PME_ORDER; j++) {
+        int zindex[ORDER];
+        for (int j = 0; j < ORDER; j++) {
             zindex[j] = gridIndexZ+j;
             zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
         }
-        fvec4 zdata[PME_ORDER];
-        for (int j = 0; j < PME_ORDER; j++)
+        fvec4 zdata[ORDER];
+        for (int j = 0; j < ORDER; j++)
             zdata[j] = fvec4(data[j][2], data[j][2], ddata[j][2], 0);
         fvec4 f = 0.0f;
-        for (int ix = 0; ix < PME_ORDER; ix++) {
+        for (int ix = 0; ix < ORDER; ix++) {
             int xbase = gridIndexX+ix;
             xbase -= (xbase >= gridx ? gridx : 0);
             xbase = xbase*gridy*gridz;
@@ -309,7 +244,7 @@ static void interpolateForces(int start, int end, float* posq, float* force, flo
             float ddx = ddata[ix][0];
             fvec4 xdata(ddx, dx, dx, 0);
 
-            for (int iy = 0; iy < PME_ORDER; iy++) {
+            for (int iy = 0; iy < ORDER; iy++) {
                 int ybase = gridIndexY+iy;
                 ybase -= (ybase >= gridy ? gridy : 0);
                 ybase = xbase + ybase*gridz;
@@ -317,7 +252,7 @@ static void interpolateForces(int start, int end, float* posq, float* force, flo
                 float ddy = ddata[iy][1];
                 fvec4 xydata = xdata*fvec4(dy, ddy, dy, 0);
 
-                for (int iz = 0; iz < PME_ORDER; iz++) {
+                for (int iz = 0; iz < ORDER; iz++) {
                     fvec4 gridValue(grid[ybase+zindex[iz]]);
                     f = f+xydata*zdata[iz]*gridValue;
                 }
@@ -332,6 +267,40 @@ static void interpolateForces(int start, int end, float* posq, float* force, flo
     }
 }
 
+/**
+ * Select the charge spreading and force interpolation functions to use for an interpolation order.
+ */
+static void selectPmeFunctions(int order, PmeSpreadChargeFunction& spread, PmeInterpolateForcesFunction& interpolate) {
+    if (isPmeVec8Supported()) {
+        getPmeVec8Functions(order, spread, interpolate);
+        return;
+    }
+    switch (order) {
+        case 4:
+            spread = spreadCharge<4>;
+            interpolate = interpolateForces<4>;
+            break;
+        case 5:
+            spread = spreadCharge<5>;
+            interpolate = interpolateForces<5>;
+            break;
+        case 6:
+            spread = spreadCharge<6>;
+            interpolate = interpolateForces<6>;
+            break;
+        case 7:
+            spread = spreadCharge<7>;
+            interpolate = interpolateForces<7>;
+            break;
+        case 8:
+            spread = spreadCharge<8>;
+            interpolate = interpolateForces<8>;
+            break;
+        default:
+            throw OpenMMException("CpuCalcPmeReciprocalForceKernel: Unsupported PME interpolation order");
+    }
+}
+
 class CpuCalcPmeReciprocalForceKernel::ThreadData {
 public:
     CpuCalcPmeReciprocalForceKernel& owner;
@@ -351,14 +320,17 @@ static void* threadBody(void* args) {
 }
 
 void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha) {
-    if (!hasInitializedThreads) {
-        numThreads = getNumProcessors();
-        fftwf_init_threads();
-        hasInitializedThreads = true;
-    }
-    gridx = findFFTDimension(xsize, false);
-    gridy = findFFTDimension(ysize, false);
-    gridz = findFFTDimension(zsize, true);
+    initialize(xsize, ysize, zsize, numParticles, alpha, 5);
+}
+
+void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, int order) {
+    if (order < MIN_PME_ORDER || order > MAX_PME_ORDER)
+        throw OpenMMException("CpuCalcPmeReciprocalForceKernel: Unsupported PME interpolation order");
+    pmeOrder = order;
+    selectPmeFunctions(pmeOrder, spreadChargeFunction, interpolateForcesFunction);
+    gridx = findFFTDimension(max(xsize, pmeOrder), false);
+    gridy = findFFTDimension(max(ysize, pmeOrder), false);
+    gridz = findFFTDimension(max(zsize, pmeOrder), true);
     this->numParticles = numParticles;
     this->alpha = alpha;
     force.resize(4*numParticles);
@@ -380,25 +352,32 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
     }
     pthread_create(&mainThread, NULL, threadBody, new ThreadData(*this, -1));
     
-    // Initialize FFTW.
+    // Initialize FFTW.  The planner is not thread safe, and the number of threads to plan with is global,
+    // so kernels for different Contexts must not do this at the same time.
     
     realGrid = threadData[0]->tempGrid;
     complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
+    pthread_mutex_lock(&fftwLock);
+    if (!hasInitializedThreads) {
+        fftwf_init_threads();
+        hasInitializedThreads = true;
+    }
     fftwf_plan_with_nthreads(numThreads);
     forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
     backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
     hasCreatedPlan = true;
+    pthread_mutex_unlock(&fftwLock);
     
     // Initialize the b-spline moduli.
 
     int maxSize = max(max(gridx, gridy), gridz);
-    vector<double> data(PME_ORDER);
-    vector<double> ddata(PME_ORDER);
+    vector<double> data(pmeOrder);
+    vector<double> ddata(pmeOrder);
     vector<double> bsplinesData(maxSize);
-    data[PME_ORDER-1] = 0.0;
+    data[pmeOrder-1] = 0.0;
     data[1] = 0.0;
     data[0] = 1.0;
-    for (int i = 3; i < PME_ORDER; i++) {
+    for (int i = 3; i < pmeOrder; i++) {
         double div = 1.0/(i-1.0);
         data[i-1] = 0.0;
         for (int j = 1; j < (i-1); j++)
@@ -409,16 +388,16 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
     // Differentiate.
 
     ddata[0] = -data[0];
-    for (int i = 1; i < PME_ORDER; i++)
+    for (int i = 1; i < pmeOrder; i++)
         ddata[i] = data[i-1]-data[i];
-    double div = 1.0/(PME_ORDER-1);
-    data[PME_ORDER-1] = 0.0;
-    for (int i = 1; i < (PME_ORDER-1); i++)
-        data[PME_ORDER-i-1] = div*(i*data[PME_ORDER-i-2]+(PME_ORDER-i)*data[PME_ORDER-i-1]);
+    double div = 1.0/(pmeOrder-1);
+    data[pmeOrder-1] = 0.0;
+    for (int i = 1; i < (pmeOrder-1); i++)
+        data[pmeOrder-i-1] = div*(i*data[pmeOrder-i-2]+(pmeOrder-i)*data[pmeOrder-i-1]);
     data[0] = div*data[0];
     for (int i = 0; i < maxSize; i++)
         bsplinesData[i] = 0.0;
-    for (int i = 1; i <= PME_ORDER; i++)
+    for (int i = 1; i <= pmeOrder; i++)
         bsplinesData[i] = data[i-1];
 
     // Evaluate the actual bspline moduli for X/Y/Z.
@@ -462,8 +441,10 @@ CpuCalcPmeReciprocalForceKernel::~CpuCalcPmeReciprocalForceKernel() {
     if (complexGrid != NULL)
         fftwf_free(complexGrid);
     if (hasCreatedPlan) {
+        pthread_mutex_lock(&fftwLock);
         fftwf_destroy_plan(forwardFFT);
         fftwf_destroy_plan(backwardFFT);
+        pthread_mutex_unlock(&fftwLock);
     }
 }
 
@@ -511,7 +492,7 @@ void CpuCalcPmeReciprocalForceKernel::runThread(int index) {
             threadWait();
             if (isDeleted)
                 break;
-            spreadCharge(particleStart, particleEnd, posq, threadData[index]->tempGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors);
+            spreadChargeFunction(particleStart, particleEnd, posq, threadData[index]->tempGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors);
             threadWait();
             int numGrids = threadData.size();
             for (int i = gridStart; i < gridEnd; i += 4) {
@@ -534,7 +515,7 @@ void CpuCalcPmeReciprocalForceKernel::runThread(int index) {
             }
             reciprocalConvolution(gridxStart, gridxEnd, complexGrid, gridx, gridy, gridz, recipEterm);
             threadWait();
-            interpolateForces(particleStart, particleEnd, posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors);
+            interpolateForcesFunction(particleStart, particleEnd, posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors);
         }
     }
 }
@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "internal/windowsExportPme.h"
+#include "CpuPmeBSplines.h"
 #include "openmm/kernels.h"
 #include "openmm/Vec3.h"
 #include <fftw3.h>
@@ -44,24 +45,45 @@ namespace OpenMM {
 /**
  * This is an optimized CPU implementation of CalcPmeReciprocalForceKernel.  It is both
  * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs.
+ * Interpolation orders from 4 to 8 are supported.  When the CPU supports AVX, 8 wide vectors
+ * are used for charge spreading and force interpolation at every order.
  */
 
 class OPENMM_EXPORT_PME CpuCalcPmeReciprocalForceKernel : public CalcPmeReciprocalForceKernel {
 public:
     class ThreadData;
-    CpuCalcPmeReciprocalForceKernel(std::string name, const Platform& platform) : CalcPmeReciprocalForceKernel(name, platform),
-            hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL) {
+    /**
+     * Create a CpuCalcPmeReciprocalForceKernel.
+     * 
+     * @param name         the name of the kernel
+     * @param platform     the Platform the kernel belongs to
+     * @param numThreads   the number of threads to use for the calculation, including the FFTs
+     */
+    CpuCalcPmeReciprocalForceKernel(std::string name, const Platform& platform, int numThreads) : CalcPmeReciprocalForceKernel(name, platform),
+            numThreads(numThreads), pmeOrder(5), hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL) {
     }
     /**
      * Initialize the kernel.
      * 
-     * @param gridx        the x size of the PME grid
-     * @param gridy        the y size of the PME grid
-     * @param gridz        the z size of the PME grid
+     * @param xsize        the x size of the PME grid
+     * @param ysize        the y size of the PME grid
+     * @param zsize        the z size of the PME grid
      * @param numParticles the number of particles in the system
      * @param alpha        the Ewald blending parameter
      */
     void initialize(int xsize, int ysize, int zsize, int numParticles, double alpha);
+    /**
+     * Initialize the kernel, specifying the order of the B-splines used to interpolate charges
+     * onto the grid.  Higher orders are more accurate, which allows a coarser grid to be used.
+     * 
+     * @param xsize        the x size of the PME grid
+     * @param ysize        the y size of the PME grid
+     * @param zsize        the z size of the PME grid
+     * @param numParticles the number of particles in the system
+     * @param alpha        the Ewald blending parameter
+     * @param order        the B-spline interpolation order.  This must be between 4 and 8.
+     */
+    void initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, int order);
     ~CpuCalcPmeReciprocalForceKernel();
     /**
      * Begin computing the force and energy.
@@ -100,9 +122,11 @@ private:
      */
     int findFFTDimension(int minimum, bool isZ);
     static bool hasInitializedThreads;
-    static int numThreads;
-    int gridx, gridy, gridz, numParticles;
+    static pthread_mutex_t fftwLock;
+    int numThreads, pmeOrder, gridx, gridy, gridz, numParticles;
     double alpha;
+    PmeSpreadChargeFunction spreadChargeFunction;
+    PmeInterpolateForcesFunction interpolateForcesFunction;
     bool hasCreatedPlan, isFinished, isDeleted;
     std::vector<float> force;
     std::vector<float> bsplineModuli[3];
@@ -0,0 +1,234 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuPmeBSplines.h"
+#include "SimTKOpenMMRealType.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/hardware.h"
+#include <cmath>
+#include <cstring>
+
+using namespace OpenMM;
+
+#ifdef _MSC_VER
+    // Workaround for a compiler bug in Visual Studio 10. Hopefully we can remove this
+    // once we move to a later version.
+    #undef __AVX__
+#endif
+
+#ifndef __AVX__
+bool OpenMM::isPmeVec8Supported() {
+    return false;
+}
+
+void OpenMM::getPmeVec8Functions(int order, PmeSpreadChargeFunction& spread, PmeInterpolateForcesFunction& interpolate) {
+    throw OpenMMException("Internal error: OpenMM was compiled without AVX support");
+}
+#else
+#include "openmm/internal/vectorize8.h"
+
+/**
+ * Check whether 8 component vectors are supported with the current CPU.
+ */
+bool OpenMM::isPmeVec8Supported() {
+    // Make sure the CPU supports AVX.
+    
+    int cpuInfo[4];
+    cpuid(cpuInfo, 0);
+    if (cpuInfo[0] >= 1) {
+        cpuid(cpuInfo, 1);
+        return ((cpuInfo[2] & ((int) 1 << 28)) != 0);
+    }
+    return false;
+}
+
+/**
+ * Spread the charges onto the grid.  Every order from 4 to 8 fits in a single fvec8 along the z axis,
+ * so each column of grid points is updated with a single vector operation.  Unused elements hold zeros.
+ */
+template <int ORDER>
+static void spreadChargeVec8(int start, int end, float* posq, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
+    PmeGridMapper mapper(periodicBoxVectors, recipBoxVectors, gridx, gridy, gridz);
+    const float epsilonFactor = sqrt(ONE_4PI_EPS0);
+    memset(grid, 0, sizeof(float)*gridx*gridy*gridz);
+    for (int i = start; i < end; i++) {
+        // Find the position relative to the nearest grid point.
+        
+        int gridIndex[3];
+        fvec4 dr;
+        if (!mapper.findGridPoint(&posq[4*i], gridIndex, dr))
+            return; // This happens when a simulation blows up and coordinates become NaN.
+        
+        // Compute the B-spline coefficients.
+        
+        fvec4 data[ORDER];
+        computeBSplines<ORDER>(dr, data, NULL);
+        
+        // Spread the charges.
+        
+        int gridIndexX = gridIndex[0];
+        int gridIndexY = gridIndex[1];
+        int gridIndexZ = gridIndex[2];
+        int zindex[ORDER];
+        float zdata[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (int j = 0; j < ORDER; j++) {
+            zindex[j] = gridIndexZ+j;
+            zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+            zdata[j] = data[j][2];
+        }
+        fvec8 zvec(zdata);
+        bool contiguous = (gridIndexZ+8 <= gridz);
+        float charge = epsilonFactor*posq[4*i+3];
+        for (int ix = 0; ix < ORDER; ix++) {
+            int xbase = gridIndexX+ix;
+            xbase -= (xbase >= gridx ? gridx : 0);
+            xbase = xbase*gridy*gridz;
+            float xdata = charge*data[ix][0];
+            for (int iy = 0; iy < ORDER; iy++) {
+                int ybase = gridIndexY+iy;
+                ybase -= (ybase >= gridy ? gridy : 0);
+                ybase = xbase + ybase*gridz;
+                float multiplier = xdata*data[iy][1];
+                float* column = &grid[ybase];
+                if (contiguous)
+                    (fvec8(&column[gridIndexZ])+zvec*multiplier).store(&column[gridIndexZ]);
+                else {
+                    for (int j = 0; j < ORDER; j++)
+                        column[zindex[j]] += multiplier*zdata[j];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Interpolate the forces from the grid.  For each column of grid points along z, the values are
+ * accumulated into three vectors weighted by the x and y coefficients, which are then combined with
+ * the z coefficients at the end.
+ */
+template <int ORDER>
+static void interpolateForcesVec8(int start, int end, float* posq, float* force, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
+    PmeGridMapper mapper(periodicBoxVectors, recipBoxVectors, gridx, gridy, gridz);
+    const float epsilonFactor = sqrt(ONE_4PI_EPS0);
+    for (int i = start; i < end; i++) {
+        // Find the position relative to the nearest grid point.
+        
+        int gridIndex[3];
+        fvec4 dr;
+        if (!mapper.findGridPoint(&posq[4*i], gridIndex, dr))
+            return; // This happens when a simulation blows up and coordinates become NaN.
+        
+        // Compute the B-spline coefficients.
+        
+        fvec4 data[ORDER];
+        fvec4 ddata[ORDER];
+        computeBSplines<ORDER>(dr, data, ddata);
+                
+        // Compute the force on this atom.
+        
+        int gridIndexX = gridIndex[0];
+        int gridIndexY = gridIndex[1];
+        int gridIndexZ = gridIndex[2];
+        int zindex[ORDER];
+        float zdata[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        float dzdata[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (int j = 0; j < ORDER; j++) {
+            zindex[j] = gridIndexZ+j;
+            zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+            zdata[j] = data[j][2];
+            dzdata[j] = ddata[j][2];
+        }
+        bool contiguous = (gridIndexZ+8 <= gridz);
+        float columnValues[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        fvec8 sumX(0.0f), sumY(0.0f), sumZ(0.0f);
+        for (int ix = 0; ix < ORDER; ix++) {
+            int xbase = gridIndexX+ix;
+            xbase -= (xbase >= gridx ? gridx : 0);
+            xbase = xbase*gridy*gridz;
+            float dx = data[ix][0];
+            float ddx = ddata[ix][0];
+            for (int iy = 0; iy < ORDER; iy++) {
+                int ybase = gridIndexY+iy;
+                ybase -= (ybase >= gridy ? gridy : 0);
+                ybase = xbase + ybase*gridz;
+                float dy = data[iy][1];
+                float ddy = ddata[iy][1];
+                fvec8 column;
+                if (contiguous)
+                    column = fvec8(&grid[ybase+gridIndexZ]);
+                else {
+                    for (int j = 0; j < ORDER; j++)
+                        columnValues[j] = grid[ybase+zindex[j]];
+                    column = fvec8(columnValues);
+                }
+                sumX += column*(ddx*dy);
+                sumY += column*(dx*ddy);
+                sumZ += column*(dx*dy);
+            }
+        }
+        float scale = -epsilonFactor*posq[4*i+3];
+        fvec8 zvec(zdata), dzvec(dzdata);
+        float fx = scale*dot8(sumX, zvec);
+        float fy = scale*dot8(sumY, zvec);
+        float fz = scale*dot8(sumZ, dzvec);
+        force[4*i+0] = fx*gridx*(float)recipBoxVectors[0][0];
+        force[4*i+1] = fx*gridx*(float)recipBoxVectors[1][0]+fy*gridy*(float)recipBoxVectors[1][1];
+        force[4*i+2] = fx*gridx*(float)recipBoxVectors[2][0]+fy*gridy*(float)recipBoxVectors[2][1]+fz*gridz*(float)recipBoxVectors[2][2];
+    }
+}
+
+void OpenMM::getPmeVec8Functions(int order, PmeSpreadChargeFunction& spread, PmeInterpolateForcesFunction& interpolate) {
+    switch (order) {
+        case 4:
+            spread = spreadChargeVec8<4>;
+            interpolate = interpolateForcesVec8<4>;
+            break;
+        case 5:
+            spread = spreadChargeVec8<5>;
+            interpolate = interpolateForcesVec8<5>;
+            break;
+        case 6:
+            spread = spreadChargeVec8<6>;
+            interpolate = interpolateForcesVec8<6>;
+            break;
+        case 7:
+            spread = spreadChargeVec8<7>;
+            interpolate = interpolateForcesVec8<7>;
+            break;
+        case 8:
+            spread = spreadChargeVec8<8>;
+            interpolate = interpolateForcesVec8<8>;
+            break;
+        default:
+            throw OpenMMException("CpuCalcPmeReciprocalForceKernel: Unsupported PME interpolation order");
+    }
+}
+#endif
@@ -33,6 +33,7 @@
 #include "openmm/serialization/SerializationNode.h"
 #include "openmm/Force.h"
 #include "openmm/NonbondedForce.h"
+#include <set>
 #include <sstream>
 
 using namespace OpenMM;
@@ -60,6 +61,7 @@ void NonbondedForceProxy::serialize(const void* object, SerializationNode& node)
     node.setIntProperty("ny", ny);
     node.setIntProperty("nz", nz);
     node.setIntProperty("recipForceGroup", force.getReciprocalSpaceForceGroup());
+    node.setDoubleProperty("softcoreAlpha", force.getSoftcoreAlpha());
     SerializationNode& particles = node.createChildNode("Particles");
     for (int i = 0; i < force.getNumParticles(); i++) {
         double charge, sigma, epsilon;
@@ -73,6 +75,11 @@ void NonbondedForceProxy::serialize(const void* object, SerializationNode& node)
         force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
         exceptions.createChildNode("Exception").setIntProperty("p1", particle1).setIntProperty("p2", particle2).setDoubleProperty("q", chargeProd).setDoubleProperty("sig", sigma).setDoubleProperty("eps", epsilon);
     }
+    SerializationNode& alchemicalParticles = node.createChildNode("AlchemicalParticles");
+    set<int> alchemical;
+    force.getAlchemicalParticles(alchemical);
+    for (set<int>::const_iterator iter = alchemical.begin(); iter != alchemical.end(); ++iter)
+        alchemicalParticles.createChildNode("Particle").setIntProperty("index", *iter);
 }
 
 void* NonbondedForceProxy::deserialize(const SerializationNode& node) const {
@@ -94,6 +101,7 @@ void* NonbondedForceProxy::deserialize(const SerializationNode& node) const {
         int nz = node.getIntProperty("nz", 0);
         force->setPMEParameters(alpha, nx, ny, nz);
         force->setReciprocalSpaceForceGroup(node.getIntProperty("recipForceGroup", -1));
+        force->setSoftcoreAlpha(node.getDoubleProperty("softcoreAlpha", 0.5));
         const SerializationNode& particles = node.getChildNode("Particles");
         for (int i = 0; i < (int) particles.getChildren().size(); i++) {
             const SerializationNode& particle = particles.getChildren()[i];
@@ -104,6 +112,17 @@ void* NonbondedForceProxy::deserialize(const SerializationNode& node) const {
             const SerializationNode& exception = exceptions.getChildren()[i];
             force->addException(exception.getIntProperty("p1"), exception.getIntProperty("p2"), exception.getDoubleProperty("q"), exception.getDoubleProperty("sig"), exception.getDoubleProperty("eps"));
         }
+        for (int i = 0; i < (int) node.getChildren().size(); i++) {
+            // Older files will be missing this block.
+
+            if (node.getChildren()[i].getName() == "AlchemicalParticles") {
+                const SerializationNode& alchemicalParticles = node.getChildren()[i];
+                set<int> alchemical;
+                for (int j = 0; j < (int) alchemicalParticles.getChildren().size(); j++)
+                    alchemical.insert(alchemicalParticles.getChildren()[j].getIntProperty("index"));
+                force->setAlchemicalParticles(alchemical);
+            }
+        }
     }
     catch (...) {
         delete force;
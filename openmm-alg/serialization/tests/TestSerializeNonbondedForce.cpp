@@ -58,6 +58,11 @@ void testSerialization() {
     force.addParticle(-0.5, 0.3, 0.03);
     force.addException(0, 1, 2, 0.5, 0.1);
     force.addException(1, 2, 0.2, 0.4, 0.2);
+    set<int> alchemical;
+    alchemical.insert(0);
+    alchemical.insert(2);
+    force.setAlchemicalParticles(alchemical);
+    force.setSoftcoreAlpha(0.3);
 
     // Serialize and then deserialize it.
 
@@ -84,6 +89,10 @@ void testSerialization() {
     ASSERT_EQUAL(nx, nx2);
     ASSERT_EQUAL(ny, ny2);
     ASSERT_EQUAL(nz, nz2);    
+    ASSERT_EQUAL(force.getSoftcoreAlpha(), force2.getSoftcoreAlpha());
+    set<int> alchemical2;
+    force2.getAlchemicalParticles(alchemical2);
+    ASSERT(alchemical == alchemical2);
     for (int i = 0; i < force.getNumParticles(); i++) {
         double charge1, sigma1, epsilon1;
         double charge2, sigma2, epsilon2;
@@ -0,0 +1,219 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests Context::computeEnergies().
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/ForceImpl.h"
+#include "openmm/CustomNonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/Platform.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * A Force that adds no energy, but whose evaluation throws an exception when the global parameter
+ * "fail" is nonzero.
+ */
+class FailingForce : public Force {
+protected:
+    ForceImpl* createImpl() const;
+};
+
+class FailingForceImpl : public ForceImpl {
+public:
+    FailingForceImpl(const FailingForce& owner) : owner(owner) {
+    }
+    void initialize(ContextImpl& context) {
+    }
+    const Force& getOwner() const {
+        return owner;
+    }
+    void updateContextState(ContextImpl& context) {
+    }
+    double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
+        if (context.getParameter("fail") != 0.0)
+            throw OpenMMException("FailingForce: evaluation failed");
+        return 0.0;
+    }
+    map<string, double> getDefaultParameters() {
+        map<string, double> parameters;
+        parameters["fail"] = 0.0;
+        return parameters;
+    }
+    vector<string> getKernelNames() {
+        return vector<string>();
+    }
+private:
+    const FailingForce& owner;
+};
+
+ForceImpl* FailingForce::createImpl() const {
+    return new FailingForceImpl(*this);
+}
+
+void testComputeEnergies() {
+    // Evaluate a batch of configurations and parameter sets, and compare to evaluating them one at a time.
+
+    const int numParticles = 100;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomNonbondedForce* nonbonded = new CustomNonbondedForce("scale*(a/r)^6");
+    nonbonded->addGlobalParameter("scale", 1.0);
+    nonbonded->addGlobalParameter("a", 0.3);
+    nonbonded->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(vector<double>());
+    }
+    system.addForce(nonbonded);
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<vector<Vec3> > positions(3, vector<Vec3>(numParticles));
+    for (int i = 0; i < (int) positions.size(); i++)
+        for (int j = 0; j < numParticles; j++)
+            positions[i][j] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    vector<map<string, double> > parameters(4);
+    parameters[1]["scale"] = 2.0;
+    parameters[2]["a"] = 0.25;
+    parameters[3]["scale"] = 0.5;
+    parameters[3]["a"] = 0.35;
+    context.setPositions(positions[0]);
+    vector<vector<double> > energies = context.computeEnergies(positions, parameters);
+    ASSERT_EQUAL(positions.size(), energies.size());
+
+    // The Context should be unchanged.
+
+    State state = context.getState(State::Positions | State::Parameters);
+    ASSERT_EQUAL_VEC(positions[0][5], state.getPositions()[5], 0.0);
+    ASSERT_EQUAL(1.0, context.getParameter("scale"));
+    ASSERT_EQUAL(0.3, context.getParameter("a"));
+
+    // Check each energy against a separate evaluation.
+
+    for (int i = 0; i < (int) positions.size(); i++) {
+        ASSERT_EQUAL(parameters.size(), energies[i].size());
+        context.setPositions(positions[i]);
+        for (int j = 0; j < (int) parameters.size(); j++) {
+            context.setParameter("scale", parameters[j].find("scale") == parameters[j].end() ? 1.0 : parameters[j]["scale"]);
+            context.setParameter("a", parameters[j].find("a") == parameters[j].end() ? 0.3 : parameters[j]["a"]);
+            ASSERT_EQUAL_TOL(context.getState(State::Energy).getPotentialEnergy(), energies[i][j], 1e-5);
+        }
+    }
+
+    // Passing no configurations or parameter sets should use the current values.
+
+    energies = context.computeEnergies(vector<vector<Vec3> >(), vector<map<string, double> >());
+    ASSERT_EQUAL(1, energies.size());
+    ASSERT_EQUAL_TOL(context.getState(State::Energy).getPotentialEnergy(), energies[0][0], 1e-5);
+
+    // An invalid parameter name should throw an exception.
+
+    parameters[0]["b"] = 1.0;
+    bool threwException = false;
+    try {
+        context.computeEnergies(vector<vector<Vec3> >(), parameters);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testRestoreAfterException() {
+    // The second parameter set makes an evaluation fail.  The positions and parameters should still be restored.
+
+    System system;
+    system.addParticle(1.0);
+    system.addParticle(1.0);
+    CustomNonbondedForce* nonbonded = new CustomNonbondedForce("scale*r");
+    nonbonded->addGlobalParameter("scale", 1.0);
+    nonbonded->addParticle(vector<double>());
+    nonbonded->addParticle(vector<double>());
+    system.addForce(nonbonded);
+    system.addForce(new FailingForce());
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    vector<Vec3> originalPositions(2);
+    originalPositions[0] = Vec3(1, 0, 0);
+    originalPositions[1] = Vec3(0, 2, 0);
+    context.setPositions(originalPositions);
+    vector<vector<Vec3> > positions(2, vector<Vec3>(2));
+    positions[0][0] = Vec3(3, 0, 0);
+    positions[1][0] = Vec3(4, 0, 0);
+    vector<map<string, double> > parameters(2);
+    parameters[0]["scale"] = 2.0;
+    parameters[1]["fail"] = 1.0;
+    bool threwException = false;
+    try {
+        context.computeEnergies(positions, parameters);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    State state = context.getState(State::Positions | State::Energy);
+    ASSERT_EQUAL_VEC(originalPositions[0], state.getPositions()[0], 0.0);
+    ASSERT_EQUAL_VEC(originalPositions[1], state.getPositions()[1], 0.0);
+    ASSERT_EQUAL(1.0, context.getParameter("scale"));
+    ASSERT_EQUAL(0.0, context.getParameter("fail"));
+    ASSERT_EQUAL_TOL(sqrt(5.0), state.getPotentialEnergy(), 1e-10);
+}
+
+int main() {
+    try {
+        testComputeEnergies();
+        testRestoreAfterException();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,126 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/HydrogenMassRepartitioner.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VirtualSite.h"
+#include <iostream>
+
+using namespace OpenMM;
+using namespace std;
+
+void testRepartition() {
+    // Build a methanol molecule with a virtual site, using both constraints and bonds.
+    
+    System system;
+    system.addParticle(12.0); // C
+    system.addParticle(1.008); // H
+    system.addParticle(1.008); // H
+    system.addParticle(1.008); // H
+    system.addParticle(16.0); // O
+    system.addParticle(1.008); // H
+    system.addParticle(0.0); // Virtual site
+    system.setVirtualSite(6, new TwoParticleAverageSite(4, 5, 0.5, 0.5));
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    for (int i = 1; i < 4; i++) {
+        system.addConstraint(0, i, 0.109);
+        bonds->addBond(0, i, 0.109, 1000.0);
+    }
+    bonds->addBond(0, 4, 0.143, 1000.0);
+    bonds->addBond(5, 4, 0.096, 1000.0);
+    bonds->addBond(4, 6, 0.05, 1000.0);
+    double totalMass = 0.0;
+    for (int i = 0; i < system.getNumParticles(); i++)
+        totalMass += system.getParticleMass(i);
+    HydrogenMassRepartitioner::repartition(system, 4.0);
+    double transfer = 4.0-1.008;
+    ASSERT_EQUAL_TOL(12.0-3*transfer, system.getParticleMass(0), 1e-10);
+    for (int i = 1; i < 4; i++)
+        ASSERT_EQUAL_TOL(4.0, system.getParticleMass(i), 1e-10);
+    ASSERT_EQUAL_TOL(16.0-transfer, system.getParticleMass(4), 1e-10);
+    ASSERT_EQUAL_TOL(4.0, system.getParticleMass(5), 1e-10);
+    ASSERT_EQUAL(0.0, system.getParticleMass(6));
+    double newTotalMass = 0.0;
+    for (int i = 0; i < system.getNumParticles(); i++)
+        newTotalMass += system.getParticleMass(i);
+    ASSERT_EQUAL_TOL(totalMass, newTotalMass, 1e-10);
+}
+
+void testHydrogenMolecule() {
+    // Mass should never be transferred between two hydrogens.
+    
+    System system;
+    system.addParticle(1.008);
+    system.addParticle(1.008);
+    system.addConstraint(0, 1, 0.074);
+    HydrogenMassRepartitioner::repartition(system, 3.0);
+    ASSERT_EQUAL(1.008, system.getParticleMass(0));
+    ASSERT_EQUAL(1.008, system.getParticleMass(1));
+}
+
+void testNegativeMass() {
+    // Repartitioning that would leave a heavy atom with negative mass should fail.
+    
+    System system;
+    system.addParticle(4.0);
+    for (int i = 0; i < 4; i++) {
+        system.addParticle(1.008);
+        system.addConstraint(0, i+1, 0.1);
+    }
+    bool threwException = false;
+    try {
+        HydrogenMassRepartitioner::repartition(system, 3.0);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    ASSERT_EQUAL(4.0, system.getParticleMass(0));
+}
+
+int main() {
+    try {
+        testRepartition();
+        testHydrogenMolecule();
+        testNegativeMass();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -208,6 +208,39 @@ void testCustomFunction(const string& expression, const string& equivalent) {
     verifySameValue(deriv3, deriv4, 2.0, -3.0);
 }
 
+/**
+ * Test compiling several expressions into a single multi-output program.
+ */
+
+void testMultipleOutputs(const string& expression) {
+    ParsedExpression energy = Parser::parse(expression).optimize();
+    vector<ParsedExpression> expressions;
+    expressions.push_back(energy);
+    expressions.push_back(energy.differentiate("x").optimize());
+    expressions.push_back(energy.differentiate("y").optimize());
+    expressions.push_back(Parser::parse("x"));
+    CompiledExpression multi(expressions);
+    if (multi.getNumOutputs() != 4)
+        throw exception();
+    CompiledExpression copy = multi;
+    CompiledExpression* compiled[] = {&multi, &copy};
+    double values[][2] = {{1.0, 2.0}, {2.0, 3.0}, {-2.0, 0.5}};
+    for (int i = 0; i < 3; i++) {
+        map<string, double> variables;
+        variables["x"] = values[i][0];
+        variables["y"] = values[i][1];
+        for (int j = 0; j < 2; j++) {
+            if (compiled[j]->getVariables().find("x") != compiled[j]->getVariables().end())
+                compiled[j]->getVariableReference("x") = values[i][0];
+            if (compiled[j]->getVariables().find("y") != compiled[j]->getVariables().end())
+                compiled[j]->getVariableReference("y") = values[i][1];
+            assertNumbersEqual(expressions[0].evaluate(variables), compiled[j]->evaluate());
+            for (int k = 0; k < (int) expressions.size(); k++)
+                assertNumbersEqual(expressions[k].evaluate(variables), compiled[j]->getOutput(k));
+        }
+    }
+}
+
 int main() {
     try {
         verifyEvaluation("5", 5.0);
@@ -284,6 +317,8 @@ int main() {
         verifyDerivative("floor(x)+0.5*x*ceil(x)", "0.5*ceil(x)");
         testCustomFunction("custom(x, y)/2", "x*y");
         testCustomFunction("custom(x^2, 1)+custom(2, y-1)", "2*x^2+4*(y-1)");
+        testMultipleOutputs("exp(-2*x*y)/x+sin(x)*y^2");
+        testMultipleOutputs("step(1-x)*(1-x)^2+cos(x)");
         cout << Parser::parse("x*x").optimize() << endl;
         cout << Parser::parse("x*(x*x)").optimize() << endl;
         cout << Parser::parse("(x*x)*x").optimize() << endl;
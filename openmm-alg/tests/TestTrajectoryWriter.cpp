@@ -0,0 +1,551 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/Platform.h"
+#include "openmm/System.h"
+#include "openmm/TrajectoryWriter.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const char* FILENAME = "TestTrajectoryWriter.traj";
+
+vector<char> readFile(const char* filename) {
+    ifstream file(filename, ios::binary);
+    return vector<char>((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+}
+
+template <class T>
+T readValue(const vector<char>& data, int& offset, bool bigEndian) {
+    char bytes[sizeof(T)];
+    memcpy(bytes, &data[offset], sizeof(T));
+    int one = 1;
+    bool littleEndian = (*reinterpret_cast<char*>(&one) == 1);
+    if (bigEndian == littleEndian)
+        for (int i = 0; i < (int) sizeof(T)/2; i++)
+            swap(bytes[i], bytes[sizeof(T)-1-i]);
+    offset += sizeof(T);
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+/**
+ * This is an independent implementation of the XTC decompression algorithm, used to check the output.
+ */
+class XtcReader {
+public:
+    XtcReader(const vector<char>& data) : data(data), offset(0) {
+    }
+    bool atEnd() {
+        return (offset >= (int) data.size());
+    }
+    void readFrame(vector<Vec3>& positions, Vec3* box, int& step, float& time) {
+        ASSERT_EQUAL(1995, readValue<int>(data, offset, true));
+        int numParticles = readValue<int>(data, offset, true);
+        step = readValue<int>(data, offset, true);
+        time = readValue<float>(data, offset, true);
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                box[i][j] = readValue<float>(data, offset, true);
+        ASSERT_EQUAL(numParticles, readValue<int>(data, offset, true));
+        positions.resize(numParticles);
+        if (numParticles <= 9) {
+            for (int i = 0; i < numParticles; i++)
+                for (int j = 0; j < 3; j++)
+                    positions[i][j] = readValue<float>(data, offset, true);
+            return;
+        }
+        float precision = readValue<float>(data, offset, true);
+        int minInt[3], maxInt[3];
+        for (int i = 0; i < 3; i++)
+            minInt[i] = readValue<int>(data, offset, true);
+        for (int i = 0; i < 3; i++)
+            maxInt[i] = readValue<int>(data, offset, true);
+        unsigned int sizeInt[3];
+        int bitSizeInt[3];
+        bool large = false;
+        for (int i = 0; i < 3; i++) {
+            sizeInt[i] = maxInt[i]-minInt[i]+1;
+            bitSizeInt[i] = sizeOfInt(sizeInt[i]);
+            if (sizeInt[i] > 0xffffff)
+                large = true;
+        }
+        int bitSize = (large ? 0 : sizeOfInts(sizeInt));
+        int smallIndex = readValue<int>(data, offset, true);
+        int smaller = magicInts(max(9, smallIndex-1))/2;
+        int smallNum = magicInts(smallIndex)/2;
+        int numBytes = readValue<int>(data, offset, true);
+        bit = 8*offset;
+        int run = 0;
+        int i = 0;
+        while (i < numParticles) {
+            int thisCoord[3], prevCoord[3];
+            if (large)
+                for (int j = 0; j < 3; j++)
+                    thisCoord[j] = receiveBits(bitSizeInt[j]);
+            else
+                receiveInts(bitSize, sizeInt, thisCoord);
+            for (int j = 0; j < 3; j++) {
+                thisCoord[j] += minInt[j];
+                prevCoord[j] = thisCoord[j];
+            }
+            int isSmaller = 0;
+            if (receiveBits(1) == 1) {
+                run = receiveBits(5);
+                isSmaller = run%3;
+                run -= isSmaller;
+                isSmaller--;
+            }
+            if (run == 0)
+                positions[i++] = Vec3(thisCoord[0], thisCoord[1], thisCoord[2])/precision;
+            for (int k = 0; k < run; k += 3) {
+                unsigned int sizeSmall[] = {magicInts(smallIndex), magicInts(smallIndex), magicInts(smallIndex)};
+                receiveInts(smallIndex, sizeSmall, thisCoord);
+                for (int j = 0; j < 3; j++)
+                    thisCoord[j] += prevCoord[j]-smallNum;
+                if (k == 0) {
+                    // The first two particles were swapped.
+
+                    for (int j = 0; j < 3; j++)
+                        swap(thisCoord[j], prevCoord[j]);
+                    positions[i++] = Vec3(prevCoord[0], prevCoord[1], prevCoord[2])/precision;
+                }
+                else
+                    for (int j = 0; j < 3; j++)
+                        prevCoord[j] = thisCoord[j];
+                positions[i++] = Vec3(thisCoord[0], thisCoord[1], thisCoord[2])/precision;
+            }
+            smallIndex += isSmaller;
+            if (isSmaller < 0) {
+                smallNum = smaller;
+                smaller = (smallIndex > 9 ? magicInts(smallIndex-1)/2 : 0);
+            }
+            else if (isSmaller > 0) {
+                smaller = smallNum;
+                smallNum = magicInts(smallIndex)/2;
+            }
+        }
+        ASSERT(bit <= 8*(offset+numBytes));
+        offset += 4*((numBytes+3)/4);
+    }
+private:
+    static unsigned int magicInts(int index) {
+        // For index >= 9, these are approximately 2^(index/3).
+
+        static const int values[] = {8, 10, 12, 16, 20, 25, 32, 40, 50, 64,
+            80, 101, 128, 161, 203, 256, 322, 406, 512, 645, 812, 1024, 1290,
+            1625, 2048, 2580, 3250, 4096, 5060, 6501, 8192, 10321, 13003, 16384,
+            20642, 26007, 32768, 41285, 52015, 65536, 82570, 104031, 131072,
+            165140, 208063, 262144, 330280, 416127, 524287, 660561, 832255,
+            1048576, 1321122, 1664510, 2097152, 2642245, 3329021, 4194304,
+            5284491, 6658042, 8388607, 10568983, 13316085, 16777216};
+        ASSERT(index >= 9 && index < 73);
+        return values[index-9];
+    }
+    static int sizeOfInt(unsigned int size) {
+        int bits = 0;
+        while (bits < 32 && size >= (1ULL<<bits))
+            bits++;
+        return bits;
+    }
+    static int sizeOfInts(const unsigned int sizes[3]) {
+        // Multiply the sizes together, storing the product as a sequence of bytes.
+
+        unsigned int bytes[32] = {1};
+        int numBytes = 1;
+        for (int i = 0; i < 3; i++) {
+            unsigned long long carry = 0;
+            for (int j = 0; j < numBytes; j++) {
+                carry += bytes[j]*(unsigned long long) sizes[i];
+                bytes[j] = carry&0xff;
+                carry >>= 8;
+            }
+            for (; carry != 0; carry >>= 8)
+                bytes[numBytes++] = carry&0xff;
+        }
+        return 8*(numBytes-1)+sizeOfInt(bytes[numBytes-1]);
+    }
+    unsigned int receiveBits(int numBits) {
+        unsigned int value = 0;
+        for (int i = 0; i < numBits; i++, bit++)
+            value = (value<<1) | ((data[bit/8]>>(7-bit%8))&1);
+        return value;
+    }
+    void receiveInts(int numBits, const unsigned int sizes[3], int nums[3]) {
+        unsigned int bytes[32];
+        int numBytes = 0;
+        while (numBits > 8) {
+            bytes[numBytes++] = receiveBits(8);
+            numBits -= 8;
+        }
+        if (numBits > 0)
+            bytes[numBytes++] = receiveBits(numBits);
+        for (int i = 2; i >= 0; i--) {
+            unsigned long long remainder = 0;
+            for (int j = numBytes-1; j >= 0; j--) {
+                remainder = (remainder<<8) | bytes[j];
+                bytes[j] = remainder/sizes[i];
+                remainder -= bytes[j]*(unsigned long long) sizes[i];
+            }
+            nums[i] = remainder;
+        }
+    }
+    const vector<char>& data;
+    int offset;
+    long long bit;
+};
+
+/**
+ * Create a set of positions that resembles a solvated system: clusters of three atoms, at random
+ * locations, plus a few isolated atoms.
+ */
+vector<Vec3> createPositions(int numClusters, OpenMM_SFMT::SFMT& sfmt) {
+    vector<Vec3> positions;
+    for (int i = 0; i < numClusters; i++) {
+        Vec3 center(4*genrand_real2(sfmt), 4*genrand_real2(sfmt), 4*genrand_real2(sfmt)-2);
+        positions.push_back(center);
+        positions.push_back(center+Vec3(0.09, 0.03, 0));
+        positions.push_back(center+Vec3(-0.03, 0.09, 0.01));
+        if (i%10 == 0)
+            positions.push_back(Vec3(4*genrand_real2(sfmt), 4*genrand_real2(sfmt), 4*genrand_real2(sfmt)));
+    }
+    return positions;
+}
+
+void testDCD(bool periodic) {
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    const int numFrames = 7;
+    Vec3 a(4, 0, 0), b(0.5, 4.5, 0), c(-1, 0.2, 5);
+    vector<vector<Vec3> > frames;
+    {
+        TrajectoryWriter writer(FILENAME, TrajectoryWriter::DCD, 0.002, 100, 50);
+        writer.setBufferSize(3);
+        for (int i = 0; i < numFrames; i++) {
+            frames.push_back(createPositions(20, sfmt));
+            if (periodic)
+                writer.writeFrame(frames[i], a, b, c, 0.1*i);
+            else
+                writer.writeFrame(frames[i], 0.1*i);
+        }
+        ASSERT_EQUAL(numFrames, writer.getNumFrames());
+    }
+    vector<char> data = readFile(FILENAME);
+    remove(FILENAME);
+    int numParticles = frames[0].size();
+
+    // Check the header.
+
+    int offset = 0;
+    ASSERT_EQUAL(84, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(string("CORD"), string(&data[4], 4));
+    offset = 8;
+    ASSERT_EQUAL(numFrames, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(100, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(50, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(100+numFrames*50, readValue<int>(data, offset, false));
+    offset = 44;
+    ASSERT_EQUAL_TOL(0.002/0.04888821, readValue<float>(data, offset, false), 1e-6);
+    ASSERT_EQUAL(periodic ? 1 : 0, readValue<int>(data, offset, false));
+    offset = 84;
+    ASSERT_EQUAL(24, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(84, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(164, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(2, readValue<int>(data, offset, false));
+    offset += 160;
+    ASSERT_EQUAL(164, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(4, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(numParticles, readValue<int>(data, offset, false));
+    ASSERT_EQUAL(4, readValue<int>(data, offset, false));
+
+    // Check the frames.
+
+    for (int frame = 0; frame < numFrames; frame++) {
+        if (periodic) {
+            ASSERT_EQUAL(48, readValue<int>(data, offset, false));
+            ASSERT_EQUAL_TOL(40.0, readValue<double>(data, offset, false), 1e-6);
+            ASSERT_EQUAL_TOL(a.dot(b)/(4*sqrt(b.dot(b))), readValue<double>(data, offset, false), 1e-6);
+            ASSERT_EQUAL_TOL(10*sqrt(b.dot(b)), readValue<double>(data, offset, false), 1e-6);
+            ASSERT_EQUAL_TOL(a.dot(c)/(4*sqrt(c.dot(c))), readValue<double>(data, offset, false), 1e-6);
+            ASSERT_EQUAL_TOL(b.dot(c)/sqrt(b.dot(b)*c.dot(c)), readValue<double>(data, offset, false), 1e-6);
+            ASSERT_EQUAL_TOL(10*sqrt(c.dot(c)), readValue<double>(data, offset, false), 1e-6);
+            ASSERT_EQUAL(48, readValue<int>(data, offset, false));
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            ASSERT_EQUAL(4*numParticles, readValue<int>(data, offset, false));
+            for (int i = 0; i < numParticles; i++)
+                ASSERT_EQUAL_TOL(10*frames[frame][i][axis], readValue<float>(data, offset, false), 1e-6);
+            ASSERT_EQUAL(4*numParticles, readValue<int>(data, offset, false));
+        }
+    }
+    ASSERT_EQUAL((int) data.size(), offset);
+}
+
+void testXTC(int numClusters, double precision, bool useThread) {
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    const int numFrames = 5;
+    Vec3 box[] = {Vec3(4, 0, 0), Vec3(0.5, 4.5, 0), Vec3(-1, 0.2, 5)};
+    vector<vector<Vec3> > frames;
+    {
+        TrajectoryWriter writer(FILENAME, TrajectoryWriter::XTC, 0.002, 10, 20);
+        writer.setXtcPrecision(precision);
+        writer.setUseBackgroundThread(useThread);
+        writer.setBufferSize(2);
+        for (int i = 0; i < numFrames; i++) {
+            frames.push_back(createPositions(numClusters, sfmt));
+            writer.writeFrame(frames[i], box[0], box[1], box[2], 0.5*i);
+        }
+        writer.close();
+    }
+    vector<char> data = readFile(FILENAME);
+    remove(FILENAME);
+    XtcReader reader(data);
+    for (int frame = 0; frame < numFrames; frame++) {
+        vector<Vec3> positions;
+        Vec3 readBox[3];
+        int step;
+        float time;
+        reader.readFrame(positions, readBox, step, time);
+        ASSERT_EQUAL(10+20*frame, step);
+        ASSERT_EQUAL_TOL(0.5*frame, time, 1e-6);
+        for (int i = 0; i < 3; i++)
+            ASSERT_EQUAL_VEC(box[i], readBox[i], 1e-6);
+        ASSERT_EQUAL(frames[frame].size(), positions.size());
+        double tol = (positions.size() <= 9 ? 1e-6 : 0.5/precision+1e-6);
+        for (int i = 0; i < (int) positions.size(); i++)
+            for (int j = 0; j < 3; j++)
+                ASSERT(fabs(frames[frame][i][j]-positions[i][j]) <= tol);
+    }
+    ASSERT(reader.atEnd());
+}
+
+void testXTCFixture() {
+    // Compare the encoding of a small frame to a known file.  The expected bytes were checked by decoding
+    // them with the XTC reader in VMD's molfile plugin, which is derived from the GROMACS xdrfile library.
+
+    static const unsigned char expected[] = {
+    0x00, 0x00, 0x07, 0xcb, 0x00, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x00, 0x64,
+    0x3e, 0x4c, 0xcc, 0xcd, 0x40, 0x46, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x46, 0x66, 0x66,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x40, 0x46, 0x66, 0x66, 0x00, 0x00, 0x00, 0x0e, 0x44, 0x7a, 0x00, 0x00,
+    0x00, 0x00, 0x01, 0xb4, 0x00, 0x00, 0x00, 0x76, 0x00, 0x00, 0x00, 0xfa,
+    0x00, 0x00, 0x0b, 0x15, 0x00, 0x00, 0x0a, 0x93, 0x00, 0x00, 0x0b, 0x53,
+    0x00, 0x00, 0x00, 0x16, 0x00, 0x00, 0x00, 0x32, 0x6c, 0x70, 0x62, 0x3e,
+    0x27, 0x89, 0xa2, 0x06, 0xff, 0xb0, 0x12, 0x28, 0x6a, 0x77, 0x79, 0x13,
+    0x44, 0x0d, 0xff, 0x60, 0x33, 0x4a, 0x32, 0x9a, 0xda, 0x26, 0x88, 0x1b,
+    0xfe, 0xc0, 0x61, 0xdc, 0x63, 0x39, 0xc4, 0x4d, 0x10, 0x37, 0xfd, 0x80,
+    0x80, 0xe3, 0x0f, 0xa6, 0xb0, 0x9a, 0x21, 0x88, 0x0c, 0xe0, 0x00, 0x00
+    };
+    vector<Vec3> positions;
+    Vec3 oxygens[] = {Vec3(0.512, 1.337, 0.250), Vec3(1.904, 0.118, 2.046), Vec3(2.761, 2.203, 1.480), Vec3(0.925, 2.648, 2.899)};
+    for (int i = 0; i < 4; i++) {
+        positions.push_back(oxygens[i]);
+        positions.push_back(oxygens[i]+Vec3(0.076, 0.059, 0.0));
+        positions.push_back(oxygens[i]+Vec3(-0.076, 0.059, 0.0));
+    }
+    positions.push_back(Vec3(1.250, 0.875, 0.433));
+    positions.push_back(Vec3(2.374, 1.602, 2.718));
+    {
+        TrajectoryWriter writer(FILENAME, TrajectoryWriter::XTC, 0.002, 100, 50);
+        writer.writeFrame(positions, Vec3(3.1, 0, 0), Vec3(0, 3.1, 0), Vec3(0, 0, 3.1), 0.2);
+    }
+    vector<char> data = readFile(FILENAME);
+    remove(FILENAME);
+    ASSERT_EQUAL(sizeof(expected), data.size());
+    for (int i = 0; i < (int) data.size(); i++)
+        ASSERT_EQUAL((int) expected[i], (int) (unsigned char) data[i]);
+}
+
+void testContext(TrajectoryWriter::Format format) {
+    // Simulate a periodic system, and compare the recorded frames to ones written from States.
+
+    const int numParticles = 50;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    system.setDefaultPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0, 3, 0), Vec3(0, 0, 3));
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(10.0);
+        nonbonded->addParticle(0.0, 0.3, 0.5);
+        positions[i] = Vec3(i%4, (i/4)%4, i/16)*0.75+Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*0.1;
+    }
+    VerletIntegrator integrator(0.002);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    const char* expectedFile = "TestTrajectoryWriterExpected.traj";
+    {
+        TrajectoryWriter writer(FILENAME, format, 0.002, 0, 5);
+        TrajectoryWriter expected(expectedFile, format, 0.002, 0, 5);
+        writer.setUseBackgroundThread(true);
+        writer.setBufferSize(4);
+        for (int i = 0; i < 10; i++) {
+            integrator.step(5);
+            writer.writeFrame(context);
+            State state = context.getState(State::Positions);
+            Vec3 a, b, c;
+            state.getPeriodicBoxVectors(a, b, c);
+            expected.writeFrame(state.getPositions(), a, b, c, state.getTime());
+            if (i == 5)
+                writer.flush();
+        }
+    }
+    vector<char> data = readFile(FILENAME);
+    vector<char> expectedData = readFile(expectedFile);
+    remove(FILENAME);
+    remove(expectedFile);
+
+    // The DCD header contains the time the file was created, so skip it.
+
+    int start = (format == TrajectoryWriter::DCD ? 276 : 0);
+    ASSERT_EQUAL(expectedData.size(), data.size());
+    ASSERT(equal(data.begin()+start, data.end(), expectedData.begin()+start));
+}
+
+void testErrors() {
+    vector<Vec3> positions(20);
+    TrajectoryWriter writer(FILENAME, TrajectoryWriter::XTC, 0.002);
+    writer.writeFrame(positions, 0.0);
+    bool threwException = false;
+    try {
+        writer.writeFrame(vector<Vec3>(21), 1.0);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    threwException = false;
+    try {
+        writer.setXtcPrecision(100.0);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    threwException = false;
+    positions[3][1] = sqrt(-1.0);
+    try {
+        writer.writeFrame(positions, 1.0);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    ASSERT_EQUAL(1, writer.getNumFrames());
+    writer.close();
+    remove(FILENAME);
+}
+
+void testEncodingError(bool useThread) {
+    // A coordinate that is too large for an XTC file cannot be encoded.  The error should be reported
+    // by a later call, even if the frame was encoded on the background thread.
+
+    vector<Vec3> positions(20);
+    for (int i = 0; i < 20; i++)
+        positions[i] = Vec3(0.1*i, 0, 0);
+    positions[5][2] = 1e7;
+    TrajectoryWriter writer(FILENAME, TrajectoryWriter::XTC, 0.002);
+    writer.setUseBackgroundThread(useThread);
+    writer.setBufferSize(1);
+    bool threwException = false;
+    try {
+        writer.writeFrame(positions, 0.0);
+        writer.flush();
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+
+    // Once an error has occurred, writing more frames should fail too.
+
+    positions[5][2] = 0.0;
+    threwException = false;
+    try {
+        writer.writeFrame(positions, 1.0);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    threwException = false;
+    try {
+        writer.close();
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    remove(FILENAME);
+}
+
+int main() {
+    try {
+        testDCD(false);
+        testDCD(true);
+        testXTC(2, 1000.0, false);
+        testXTC(200, 1000.0, false);
+        testXTC(200, 100.0, true);
+        testXTC(200, 1e5, false);
+        testXTCFixture();
+        testContext(TrajectoryWriter::DCD);
+        testContext(TrajectoryWriter::XTC);
+        testErrors();
+        testEncodingError(false);
+        testEncodingError(true);
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}